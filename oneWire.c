@@ -97,53 +97,394 @@
  */
 
 #include "oneWire.h"
+#ifndef ONEWIRE_PORT_LINUX
 #include "stm32f3xx_hal_gpio.h"
 #include "task.h"
+#endif
 
 
-GPIO_PinState sampled_bus_bit = GPIO_PIN_SET;
+// write slot chain selected by value of bit that is send next, indexed by bit value (0 or 1)
+static const OneWireState write_slot_init_state[2] = {
+	ONEWIRE_STATE_WRITE_LOW_INIT,
+	ONEWIRE_STATE_WRITE_HIGH_INIT
+};
 
+static const OneWireTiming standard_timing = {
+	STANDARD_WRITE_1_LOW_DELAY,
+	STANDARD_WRITE_1_RELEASE_BUS_DELAY,
+	STANDARD_WRITE_0_LOW_DELAY,
+	STANDARD_WRITE_0_RELEASE_BUS_DELAY,
+	STANDARD_READ_RELEASE_BUS_DELAY,
+	STANDARD_READ_SAMPLE_DELAY,
+	STANDARD_RESET_INIT_DELAY,
+	STANDARD_RESET_DRIVE_BUS_LOW_DELAY,
+	STANDARD_RESET_RELEASE_BUS_DELAY,
+	STANDARD_RESET_SAMPLE_BUS_DELAY
+};
+
+static const OneWireTiming overdrive_timing = {
+	OVERDRIVE_WRITE_1_LOW_DELAY,
+	OVERDRIVE_WRITE_1_RELEASE_BUS_DELAY,
+	OVERDRIVE_WRITE_0_LOW_DELAY,
+	OVERDRIVE_WRITE_0_RELEASE_BUS_DELAY,
+	OVERDRIVE_READ_RELEASE_BUS_DELAY,
+	OVERDRIVE_READ_SAMPLE_DELAY,
+	OVERDRIVE_RESET_INIT_DELAY,
+	OVERDRIVE_RESET_DRIVE_BUS_LOW_DELAY,
+	OVERDRIVE_RESET_RELEASE_BUS_DELAY,
+	OVERDRIVE_RESET_SAMPLE_BUS_DELAY
+};
+
+// Dallas/Maxim CRC8 (x^8 + x^5 + x^4 + 1) lookup table, reflected polynomial 0x8C
+static const uint8_t crc8_table[256] = {
+	0x00, 0x5e, 0xbc, 0xe2, 0x61, 0x3f, 0xdd, 0x83, 0xc2, 0x9c, 0x7e, 0x20, 0xa3, 0xfd, 0x1f, 0x41,
+	0x9d, 0xc3, 0x21, 0x7f, 0xfc, 0xa2, 0x40, 0x1e, 0x5f, 0x01, 0xe3, 0xbd, 0x3e, 0x60, 0x82, 0xdc,
+	0x23, 0x7d, 0x9f, 0xc1, 0x42, 0x1c, 0xfe, 0xa0, 0xe1, 0xbf, 0x5d, 0x03, 0x80, 0xde, 0x3c, 0x62,
+	0xbe, 0xe0, 0x02, 0x5c, 0xdf, 0x81, 0x63, 0x3d, 0x7c, 0x22, 0xc0, 0x9e, 0x1d, 0x43, 0xa1, 0xff,
+	0x46, 0x18, 0xfa, 0xa4, 0x27, 0x79, 0x9b, 0xc5, 0x84, 0xda, 0x38, 0x66, 0xe5, 0xbb, 0x59, 0x07,
+	0xdb, 0x85, 0x67, 0x39, 0xba, 0xe4, 0x06, 0x58, 0x19, 0x47, 0xa5, 0xfb, 0x78, 0x26, 0xc4, 0x9a,
+	0x65, 0x3b, 0xd9, 0x87, 0x04, 0x5a, 0xb8, 0xe6, 0xa7, 0xf9, 0x1b, 0x45, 0xc6, 0x98, 0x7a, 0x24,
+	0xf8, 0xa6, 0x44, 0x1a, 0x99, 0xc7, 0x25, 0x7b, 0x3a, 0x64, 0x86, 0xd8, 0x5b, 0x05, 0xe7, 0xb9,
+	0x8c, 0xd2, 0x30, 0x6e, 0xed, 0xb3, 0x51, 0x0f, 0x4e, 0x10, 0xf2, 0xac, 0x2f, 0x71, 0x93, 0xcd,
+	0x11, 0x4f, 0xad, 0xf3, 0x70, 0x2e, 0xcc, 0x92, 0xd3, 0x8d, 0x6f, 0x31, 0xb2, 0xec, 0x0e, 0x50,
+	0xaf, 0xf1, 0x13, 0x4d, 0xce, 0x90, 0x72, 0x2c, 0x6d, 0x33, 0xd1, 0x8f, 0x0c, 0x52, 0xb0, 0xee,
+	0x32, 0x6c, 0x8e, 0xd0, 0x53, 0x0d, 0xef, 0xb1, 0xf0, 0xae, 0x4c, 0x12, 0x91, 0xcf, 0x2d, 0x73,
+	0xca, 0x94, 0x76, 0x28, 0xab, 0xf5, 0x17, 0x49, 0x08, 0x56, 0xb4, 0xea, 0x69, 0x37, 0xd5, 0x8b,
+	0x57, 0x09, 0xeb, 0xb5, 0x36, 0x68, 0x8a, 0xd4, 0x95, 0xcb, 0x29, 0x77, 0xf4, 0xaa, 0x48, 0x16,
+	0xe9, 0xb7, 0x55, 0x0b, 0x88, 0xd6, 0x34, 0x6a, 0x2b, 0x75, 0x97, 0xc9, 0x4a, 0x14, 0xf6, 0xa8,
+	0x74, 0x2a, 0xc8, 0x96, 0x15, 0x4b, 0xa9, 0xf7, 0xb6, 0xe8, 0x0a, 0x54, 0xd7, 0x89, 0x6b, 0x35
+};
+
+// odd parity of nibble, used for Dallas/Maxim CRC16 (x^16 + x^15 + x^2 + 1)
+static const uint8_t crc16_odd_parity[16] = { 0, 1, 1, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0, 1, 1, 0 };
+
+// slave write slot chain selected by bit that is send next, 0 holds bus low, 1 only waits for slot end
+static const OneWireState slave_write_slot_state[2] = {
+	ONEWIRE_STATE_SLAVE_WRITE_DRIVE_BUS_LOW,
+	ONEWIRE_STATE_SLAVE_WRITE_RELEASE_BUS
+};
+
+// slave low pulse classification, thresholds lie between nominal widths of neighbouring pulse types
+#define SLAVE_WRITE_0_MIN_WIDTH(timing)     (((timing)->write_1_low_delay + (timing)->write_0_low_delay) / 2)
+#define SLAVE_RESET_MIN_WIDTH(timing)       ((timing)->reset_drive_bus_low_delay / 2)
+#define SLAVE_STANDARD_RESET_MIN_WIDTH      (STANDARD_RESET_DRIVE_BUS_LOW_DELAY / 2)
+// presence pulse of slave starts half of master sample delay after rising edge (allowed 15-60us and 2-6us)
+// and lasts 140us standard and 16us overdrive (allowed 60-240us and 8-24us), so it spans master sample point
+#define SLAVE_PRESENCE_WAIT_DELAY(timing)   ((timing)->reset_release_bus_delay / 2)
+#define SLAVE_PRESENCE_DELAY(timing)        ((timing)->reset_release_bus_delay * 2)
+
+// delays of timed states, value is selected from OneWireTiming of current speed
+typedef enum {
+	STATE_DELAY_NONE,                   // state is left on next call or waits for bus edge
+	STATE_DELAY_RESET_INIT,
+	STATE_DELAY_RESET_LOW,
+	STATE_DELAY_RESET_RELEASE,
+	STATE_DELAY_RESET_SAMPLE,
+	STATE_DELAY_WRITE_1_LOW,
+	STATE_DELAY_WRITE_1_RELEASE,
+	STATE_DELAY_WRITE_0_LOW,
+	STATE_DELAY_WRITE_0_RELEASE,
+	STATE_DELAY_READ_RELEASE,
+	STATE_DELAY_READ_SAMPLE,
+	STATE_DELAY_SLAVE_PRESENCE_WAIT,
+	STATE_DELAY_SLAVE_PRESENCE,
+	STATE_DELAY_SLAVE_WRITE_0
+} StateDelay;
+
+// what driver waits for in state, used by onewire_process() and onewire_get_next_event_delay()
+typedef enum {
+	STATE_WAKE_NOW,                     // state is left on next call
+	STATE_WAKE_DELAY,                   // nothing happens until delay expires
+	STATE_WAKE_POLL,                    // bus is sampled on every call until delay expires
+	STATE_WAKE_EDGE                     // bus edge, DMA callback or application request
+} StateWake;
+
+typedef struct {
+	uint8_t delay;                      // StateDelay
+	uint8_t wake;                       // StateWake
+} StateTiming;
+
+static const StateTiming state_timing[] = {
+	[ONEWIRE_STATE_IDLE]                         = { STATE_DELAY_NONE,                STATE_WAKE_EDGE },
+	[ONEWIRE_STATE_ERROR]                        = { STATE_DELAY_NONE,                STATE_WAKE_EDGE },
+	[ONEWIRE_STATE_RESET_INIT]                   = { STATE_DELAY_RESET_INIT,          STATE_WAKE_DELAY },
+	[ONEWIRE_STATE_RESET_DRIVE_BUS_LOW]          = { STATE_DELAY_RESET_LOW,           STATE_WAKE_DELAY },
+	[ONEWIRE_STATE_RESET_RELEASE_BUS]            = { STATE_DELAY_RESET_RELEASE,       STATE_WAKE_DELAY },
+	[ONEWIRE_STATE_RESET_SAMPLE_BUS]             = { STATE_DELAY_RESET_SAMPLE,        STATE_WAKE_POLL },
+	[ONEWIRE_STATE_RESET_DONE]                   = { STATE_DELAY_NONE,                STATE_WAKE_NOW },
+	[ONEWIRE_STATE_WRITE_HIGH_INIT]              = { STATE_DELAY_NONE,                STATE_WAKE_NOW },
+	[ONEWIRE_STATE_WRITE_HIGH_DRIVE_BUS_LOW]     = { STATE_DELAY_WRITE_1_LOW,         STATE_WAKE_DELAY },
+	[ONEWIRE_STATE_WRITE_HIGH_RELEASE_BUS]       = { STATE_DELAY_WRITE_1_RELEASE,     STATE_WAKE_DELAY },
+	[ONEWIRE_STATE_WRITE_HIGH_DONE]              = { STATE_DELAY_NONE,                STATE_WAKE_NOW },
+	[ONEWIRE_STATE_WRITE_LOW_INIT]               = { STATE_DELAY_NONE,                STATE_WAKE_NOW },
+	[ONEWIRE_STATE_WRITE_LOW_DRIVE_BUS_LOW]      = { STATE_DELAY_WRITE_0_LOW,         STATE_WAKE_DELAY },
+	[ONEWIRE_STATE_WRITE_LOW_RELEASE_BUS]        = { STATE_DELAY_WRITE_0_RELEASE,     STATE_WAKE_DELAY },
+	[ONEWIRE_STATE_WRITE_LOW_DONE]               = { STATE_DELAY_NONE,                STATE_WAKE_NOW },
+	[ONEWIRE_STATE_MASTER_READ_INIT]             = { STATE_DELAY_NONE,                STATE_WAKE_NOW },
+	[ONEWIRE_STATE_MASTER_READ_DRIVE_BUS_LOW]    = { STATE_DELAY_WRITE_1_LOW,         STATE_WAKE_DELAY },
+	[ONEWIRE_STATE_MASTER_READ_RELEASE_BUS]      = { STATE_DELAY_READ_RELEASE,        STATE_WAKE_POLL },  // sample window starts in same call
+	[ONEWIRE_STATE_MASTER_READ_SAMPLE_BUS]       = { STATE_DELAY_READ_SAMPLE,         STATE_WAKE_POLL },
+	[ONEWIRE_STATE_MASTER_READ_DONE]             = { STATE_DELAY_NONE,                STATE_WAKE_NOW },
+	[ONEWIRE_STATE_SLAVE_READ_INIT]              = { STATE_DELAY_NONE,                STATE_WAKE_EDGE },
+	[ONEWIRE_STATE_SLAVE_READ_MONITOR_BUS]       = { STATE_DELAY_NONE,                STATE_WAKE_EDGE },
+	[ONEWIRE_STATE_SLAVE_RESET_RELEASE_BUS]      = { STATE_DELAY_SLAVE_PRESENCE_WAIT, STATE_WAKE_DELAY },
+	[ONEWIRE_STATE_SLAVE_PRESENCE_DRIVE_BUS_LOW] = { STATE_DELAY_SLAVE_PRESENCE,      STATE_WAKE_DELAY },
+	[ONEWIRE_STATE_SLAVE_READ_DONE]              = { STATE_DELAY_NONE,                STATE_WAKE_NOW },
+	[ONEWIRE_STATE_SLAVE_WRITE_INIT]             = { STATE_DELAY_NONE,                STATE_WAKE_EDGE },
+	[ONEWIRE_STATE_SLAVE_WRITE_DRIVE_BUS_LOW]    = { STATE_DELAY_SLAVE_WRITE_0,       STATE_WAKE_DELAY },
+	[ONEWIRE_STATE_SLAVE_WRITE_RELEASE_BUS]      = { STATE_DELAY_NONE,                STATE_WAKE_EDGE },
+	[ONEWIRE_STATE_SLAVE_WRITE_DONE]             = { STATE_DELAY_NONE,                STATE_WAKE_NOW },
+	[ONEWIRE_STATE_SPI_TRANSFER]                 = { STATE_DELAY_NONE,                STATE_WAKE_NOW },   // SPI peripheral state is polled
+	[ONEWIRE_STATE_SPI_STREAM]                   = { STATE_DELAY_NONE,                STATE_WAKE_EDGE }
+};
 
 /* Private function prototypes -----------------------------------------------*/
 static void pull_low(OneWireDriver* onewire);
 static void pull_high(OneWireDriver* onewire);
 static GPIO_PinState read_pin(OneWireDriver* onewire);
 static int is_time_expired(OneWireDriver* onewire, TickType_t expatration_time);
+static TickType_t get_remaining_ticks(OneWireDriver* onewire, TickType_t expatration_time);
+static TickType_t get_state_delay(OneWireDriver* onewire);
 static void set_state(OneWireDriver* onewire, OneWireState newState);
 static void pin_output_mode(OneWireDriver* onewire);
 static void set_flag(OneWireDriver* onewire, OneWireFlags flagBit);
 static void reset_flag(OneWireDriver* onewire, OneWireFlags flagBit);
 static uint8_t get_flag(OneWireDriver* onewire, OneWireFlags flagBit);
 static void store_read_bit(OneWireDriver* onewire, uint8_t value);
+static void update_crc8(OneWireDriver* onewire, uint8_t data);
 static void set_write_init_state(OneWireDriver* onewire,uint8_t bit);
 static void handle_write_bit_done_state(OneWireDriver* onewire);
 static void pin_input_mode(OneWireDriver* onewire);
+static void dual_pin_mode(OneWireDriver* onewire);
+static void init_driver(OneWireDriver* onewire, OneWireOperatingMode mode);
+static void trace_event(OneWireDriver* onewire, OneWireTraceType type, GPIO_PinState level);
+static void process_state(OneWireDriver* onewire);
+#if ONEWIRE_BUS_STATS
+static uint8_t is_bus_occupied_state(OneWireState state);
+static void stats_state_changed(OneWireDriver* onewire, OneWireState old_state, TickType_t now);
+static void stats_account_cycles(OneWireDriver* onewire, uint32_t start_cycles);
+#endif
+#if ONEWIRE_LATENCY_STATS
+static void txn_mark_start(OneWireDriver* onewire);
+static uint8_t latency_bucket(TickType_t ticks);
+#endif
+#if ONEWIRE_OP_RECORD
+static void record_op(OneWireDriver* onewire, OneWireRecordedOp op, uint8_t data);
+#endif
+static void slave_write_slot_start(OneWireDriver* onewire);
+static void slave_handle_rising_edge(OneWireDriver* onewire, TickType_t now);
+static void slave_finish_bit(OneWireDriver* onewire);
+static void slave_start_transmit(OneWireDriver* onewire, const uint8_t* data, uint16_t length, uint8_t crc_bytes, OneWireSlavePhase phase_after);
+static uint8_t slave_load_tx_byte(OneWireDriver* onewire);
+static void slave_handle_byte_received(OneWireDriver* onewire);
+static void slave_handle_byte_sent(OneWireDriver* onewire);
+static uint8_t slave_get_rom_bit(OneWireDriver* onewire);
+static void slave_start_search(OneWireDriver* onewire);
+static void slave_handle_search_slot(OneWireDriver* onewire);
+static void slave_handle_rom_command(OneWireDriver* onewire, uint8_t command);
+static void slave_handle_function_command(OneWireDriver* onewire, uint8_t command);
+#if ONEWIRE_SPI_BACKEND
+static void spi_start(OneWireDriver* onewire, OneWireSpiOperation operation, uint16_t length);
+static void spi_handle_transfer_done(OneWireDriver* onewire);
+static uint8_t spi_decode_byte(OneWireDriver* onewire, const uint8_t* frames);
+static void spi_stream_deliver(OneWireDriver* onewire, const uint8_t* frames);
+#endif
 
 
 
 static void pull_low(OneWireDriver* onewire) {
+	onewire->driven_level = GPIO_PIN_RESET;
+	trace_event(onewire, ONEWIRE_TRACE_DRIVE, GPIO_PIN_RESET);
+	if (onewire->bus_interface == ONEWIRE_INTERFACE_CUSTOM) {
+		onewire->bus_ops->drive_low(onewire->bus_context);
+		return;
+	}
+	if (onewire->bus_interface == ONEWIRE_INTERFACE_DUAL_PIN) {
+		HAL_GPIO_WritePin(onewire->Port, onewire->Pin, GPIO_PIN_SET); // turn on transistor, bus is pulled low
+		return;
+	}
 	pin_output_mode(onewire);
 	HAL_GPIO_WritePin(onewire->Port, onewire->Pin, GPIO_PIN_RESET);
 }
 
 static void pull_high(OneWireDriver* onewire) {
+	onewire->driven_level = GPIO_PIN_SET;
+	trace_event(onewire, ONEWIRE_TRACE_DRIVE, GPIO_PIN_SET);
+	if (onewire->bus_interface == ONEWIRE_INTERFACE_CUSTOM) {
+		onewire->bus_ops->release(onewire->bus_context);
+		return;
+	}
+	if (onewire->bus_interface == ONEWIRE_INTERFACE_DUAL_PIN) {
+		HAL_GPIO_WritePin(onewire->Port, onewire->Pin, GPIO_PIN_RESET); // turn off transistor, bus is released
+		return;
+	}
 	pin_output_mode(onewire);
 	HAL_GPIO_WritePin(onewire->Port, onewire->Pin, GPIO_PIN_SET);
 }
 
 static GPIO_PinState read_pin(OneWireDriver* onewire) {
+	if (onewire->bus_interface == ONEWIRE_INTERFACE_CUSTOM) {
+		return onewire->bus_ops->read(onewire->bus_context);
+	}
+	if (onewire->bus_interface == ONEWIRE_INTERFACE_DUAL_PIN) {
+		return HAL_GPIO_ReadPin(onewire->RxPort, onewire->RxPin); // sense pin is always input, no mode switching
+	}
 	pin_input_mode(onewire);
 	return HAL_GPIO_ReadPin(onewire->Port, onewire->Pin);
 }
 
+// elapsed time is compared, so expiry stays correct when tick counter wraps around
 static int is_time_expired(OneWireDriver *onewire, TickType_t expatration_time) {
-	return onewire->timestamp + pdMS_TO_TICKS(expatration_time) <= xTaskGetTickCount();
+	TickType_t delay = pdMS_TO_TICKS(expatration_time);
+	TickType_t elapsed = (TickType_t)(ONEWIRE_GET_TICK() - onewire->timestamp);
+	TickType_t lateness;
+
+	if (elapsed < delay) {
+		return 0;
+	}
+	// how late deadline is noticed, caused by scheduling of onewire_process()
+	lateness = (TickType_t)(elapsed - delay);
+	onewire->jitter.deadline_count++;
+	onewire->jitter.total_lateness += lateness;
+	if (lateness > onewire->jitter.max_lateness) {
+		onewire->jitter.max_lateness = lateness;
+	}
+	return 1;
+}
+
+// ticks left until delay of current state expires, 0 when it already expired
+static TickType_t get_remaining_ticks(OneWireDriver* onewire, TickType_t expatration_time) {
+	TickType_t delay = pdMS_TO_TICKS(expatration_time);
+	TickType_t elapsed = (TickType_t)(ONEWIRE_GET_TICK() - onewire->timestamp);
+
+	return (elapsed < delay) ? (TickType_t)(delay - elapsed) : 0;
+}
+
+// delay of current state from state_timing, 0 for states without delay
+static TickType_t get_state_delay(OneWireDriver* onewire) {
+	const OneWireTiming* timing = onewire->timing;
+
+	switch (state_timing[onewire->state].delay) {
+	case STATE_DELAY_RESET_INIT:
+		return pdMS_TO_TICKS(timing->reset_init_delay);
+	case STATE_DELAY_RESET_LOW:
+		return pdMS_TO_TICKS(timing->reset_drive_bus_low_delay);
+	case STATE_DELAY_RESET_RELEASE:
+		return pdMS_TO_TICKS(timing->reset_release_bus_delay);
+	case STATE_DELAY_RESET_SAMPLE:
+		return pdMS_TO_TICKS(timing->reset_sample_bus_delay);
+	case STATE_DELAY_WRITE_1_LOW:
+		return pdMS_TO_TICKS(timing->write_1_low_delay);
+	case STATE_DELAY_WRITE_1_RELEASE:
+		return pdMS_TO_TICKS(timing->write_1_release_bus_delay);
+	case STATE_DELAY_WRITE_0_LOW:
+		return pdMS_TO_TICKS(timing->write_0_low_delay);
+	case STATE_DELAY_WRITE_0_RELEASE:
+		return pdMS_TO_TICKS(timing->write_0_release_bus_delay);
+	case STATE_DELAY_READ_RELEASE:
+		return pdMS_TO_TICKS(timing->read_release_bus_delay);
+	case STATE_DELAY_READ_SAMPLE:
+		return pdMS_TO_TICKS(timing->read_sample_delay - timing->write_0_release_bus_delay);
+	case STATE_DELAY_SLAVE_PRESENCE_WAIT:
+		return pdMS_TO_TICKS(SLAVE_PRESENCE_WAIT_DELAY(timing));
+	case STATE_DELAY_SLAVE_PRESENCE:
+		return pdMS_TO_TICKS(SLAVE_PRESENCE_DELAY(timing));
+	case STATE_DELAY_SLAVE_WRITE_0:
+		return pdMS_TO_TICKS(timing->write_0_low_delay / 2);
+	default:
+		return 0;
+	}
 }
 
 static void set_state(OneWireDriver *onewire, OneWireState new_state) {
+	OneWireState old_state = onewire->state;
+
+	if (new_state == ONEWIRE_STATE_ERROR && old_state != ONEWIRE_STATE_ERROR) {
+		onewire->errors.errors++;
+	}
 	onewire->state = new_state;
-	onewire->timestamp = xTaskGetTickCount();
+	onewire->timestamp = ONEWIRE_GET_TICK();
+#if ONEWIRE_BUS_STATS
+	stats_state_changed(onewire, old_state, onewire->timestamp);
+#endif
+	trace_event(onewire, ONEWIRE_TRACE_STATE, onewire->driven_level);
+}
+
+#if ONEWIRE_BUS_STATS
+// states in which driver waits for work or for other device, everything else holds bus in slot or reset
+static uint8_t is_bus_occupied_state(OneWireState state) {
+	switch (state) {
+	case ONEWIRE_STATE_IDLE:
+	case ONEWIRE_STATE_ERROR:
+	case ONEWIRE_STATE_RESET_DONE:
+	case ONEWIRE_STATE_SLAVE_READ_INIT:
+	case ONEWIRE_STATE_SLAVE_WRITE_INIT:
+		return 0;
+	default:
+		return 1;
+	}
+}
+
+static void stats_state_changed(OneWireDriver* onewire, OneWireState old_state, TickType_t now) {
+	uint8_t was_occupied = is_bus_occupied_state(old_state);
+	uint8_t is_occupied = is_bus_occupied_state(onewire->state);
+
+	if (!was_occupied && is_occupied) {
+		onewire->busy_start = now;
+	}
+	else if (was_occupied && !is_occupied) {
+		onewire->window_busy_ticks += now - onewire->busy_start;
+	}
+}
+
+static void stats_account_cycles(OneWireDriver* onewire, uint32_t start_cycles) {
+	onewire->window_cycles += ONEWIRE_GET_CYCLES() - start_cycles;
+}
+#endif
+
+#if ONEWIRE_LATENCY_STATS
+// first bus operation after submit ends queueing delay
+static void txn_mark_start(OneWireDriver* onewire) {
+	OneWireTxnStats* txn = onewire->txn_active;
+
+	if (txn != NULL && txn->phase == 1) {
+		txn->start_tick = ONEWIRE_GET_TICK();
+		txn->phase = 2;
+	}
+}
+
+static uint8_t latency_bucket(TickType_t ticks) {
+	uint8_t bucket = 0;
+
+	while (ticks > 1 && bucket < ONEWIRE_LATENCY_BUCKETS - 1) {
+		ticks >>= 1;
+		bucket++;
+	}
+	return bucket;
+}
+#endif
+
+#if ONEWIRE_OP_RECORD
+static void record_op(OneWireDriver* onewire, OneWireRecordedOp op, uint8_t data) {
+	OneWireOpRecorder* recorder = onewire->op_recorder;
+	OneWireOpRecord* record;
+
+	if (recorder == NULL) {
+		return;
+	}
+	record = &recorder->records[recorder->head];
+	record->tick = ONEWIRE_GET_TICK();
+	record->op = op;
+	record->data = data;
+	recorder->head = (recorder->head + 1) % recorder->capacity;
+	if (recorder->count < recorder->capacity) {
+		recorder->count++;
+	}
+	else {
+		recorder->overwritten++;
+	}
 }
+#endif
 
 static void pin_output_mode(OneWireDriver* onewire) {
 	GPIO_InitTypeDef GPIO_InitStruct = {0};
@@ -167,6 +508,22 @@ static void pin_input_mode(OneWireDriver* onewire) {
 	HAL_GPIO_Init(onewire->Port, &GPIO_InitStruct);
 }
 
+static void dual_pin_mode(OneWireDriver* onewire) {
+	GPIO_InitTypeDef GPIO_InitStruct = {0};
+
+	// release bus before tx pin become output
+	HAL_GPIO_WritePin(onewire->Port, onewire->Pin, GPIO_PIN_RESET);
+	GPIO_InitStruct.Pin = onewire->Pin;
+	GPIO_InitStruct.Mode = GPIO_MODE_OUTPUT_PP;
+	GPIO_InitStruct.Pull = GPIO_NOPULL;
+	GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
+	HAL_GPIO_Init(onewire->Port, &GPIO_InitStruct);
+
+	GPIO_InitStruct.Pin = onewire->RxPin;
+	GPIO_InitStruct.Mode = MODE_INPUT;
+	HAL_GPIO_Init(onewire->RxPort, &GPIO_InitStruct);
+}
+
 static void set_flag(OneWireDriver* onewire, OneWireFlags flag_bit) {
 	if(flag_bit < 8) {
 		onewire->flag_reg |= (1 << flag_bit);
@@ -186,24 +543,389 @@ static uint8_t get_flag(OneWireDriver* onewire, OneWireFlags flag_bit) {
 	return 0;
 }
 
-static void store_read_bit(OneWireDriver* onewire, uint8_t value) {
-    if (value) {
-        onewire->rx_byte |= (1 << onewire->bit_index);   // Set bit
-    } else {
-        onewire->rx_byte &= ~(1 << onewire->bit_index);  // Clear bit
-    }
+#if ONEWIRE_SPI_BACKEND
+static void spi_start(OneWireDriver* onewire, OneWireSpiOperation operation, uint16_t length) {
+	onewire->spi_operation = operation;
+	set_state(onewire, ONEWIRE_STATE_SPI_TRANSFER);
+	if (HAL_SPI_TransmitReceive_DMA(onewire->hspi, onewire->spi_tx, onewire->spi_rx, length) != HAL_OK) {
+		set_flag(onewire, FLAG_ERROR);
+		set_state(onewire, ONEWIRE_STATE_ERROR);
+	}
 }
 
-static void set_write_init_state(OneWireDriver* onewire,uint8_t bit) {
-	onewire->timestamp = xTaskGetTickCount();
-	if(bit) {
-		onewire->state = ONEWIRE_STATE_WRITE_HIGH_INIT;
+static void spi_handle_transfer_done(OneWireDriver* onewire) {
+	switch (onewire->spi_operation) {
+	case ONEWIRE_SPI_OPERATION_RESET:
+		reset_flag(onewire, FLAG_PRESENCE_DETECTED);
+		for (uint8_t i = ONEWIRE_SPI_RESET_LOW_FRAMES + ONEWIRE_SPI_PRESENCE_FIRST_FRAME; i < ONEWIRE_SPI_BUFFER_SIZE; i++) {
+			if (onewire->spi_rx[i] != 0xFF) {
+				set_flag(onewire, FLAG_PRESENCE_DETECTED); // slave pulled line low after reset
+			}
+		}
+		trace_event(onewire, ONEWIRE_TRACE_SAMPLE, get_flag(onewire, FLAG_PRESENCE_DETECTED) ? GPIO_PIN_RESET : GPIO_PIN_SET);
+		if (!get_flag(onewire, FLAG_PRESENCE_DETECTED)) {
+			onewire->errors.missing_presence++;
+			set_flag(onewire, FLAG_ERROR);
+#if ONEWIRE_BLACKBOX_SIZE > 0
+			onewire_blackbox_trigger(onewire);
+#endif
+		}
+		break;
+	case ONEWIRE_SPI_OPERATION_WRITE:
+		set_flag(onewire, FLAG_BYTE_SEND);
+		break;
+	case ONEWIRE_SPI_OPERATION_READ:
+		spi_decode_byte(onewire, onewire->spi_rx);
+		set_flag(onewire, FLAG_BYTE_RECEIVED);
+		break;
+	case ONEWIRE_SPI_OPERATION_READ_BIT:
+		store_read_bit(onewire, (onewire->spi_rx[0] & ONEWIRE_SPI_READ_SAMPLE_MASK) != 0);
+		set_flag(onewire, FLAG_BYTE_RECEIVED);
+		break;
+	}
+	set_state(onewire, ONEWIRE_STATE_IDLE);
+}
+
+static uint8_t spi_decode_byte(OneWireDriver* onewire, const uint8_t* frames) {
+	for (uint8_t i = 0; i < 8; i++) {
+		store_read_bit(onewire, (frames[i] & ONEWIRE_SPI_READ_SAMPLE_MASK) != 0);
+	}
+	update_crc8(onewire, onewire->rx_byte);
+	return onewire->rx_byte;
+}
+
+static void spi_stream_deliver(OneWireDriver* onewire, const uint8_t* frames) {
+#if ONEWIRE_BUS_STATS
+	uint32_t start_cycles = ONEWIRE_GET_CYCLES();
+#endif
+
+	if (onewire->state != ONEWIRE_STATE_SPI_STREAM) {
+		return; // late DMA interrupt after stream is stopped
+	}
+	for (uint8_t i = 0; i < ONEWIRE_SPI_STREAM_BYTES; i++) {
+		onewire->stream_data[i] = spi_decode_byte(onewire, &frames[8 * i]);
+	}
+	if (onewire->stream_callback != NULL) {
+		onewire->stream_callback(onewire, onewire->stream_data, ONEWIRE_SPI_STREAM_BYTES, onewire->stream_context);
+	}
+#if ONEWIRE_BUS_STATS
+	stats_account_cycles(onewire, start_cycles); // application callback is counted as well
+#endif
+}
+#endif
+
+static void trace_event(OneWireDriver* onewire, OneWireTraceType type, GPIO_PinState level) {
+#if ONEWIRE_TRACE
+	OneWireTraceEvent event;
+
+#if ONEWIRE_BLACKBOX_SIZE > 0
+	if (onewire->trace_hook == NULL && onewire->blackbox_frozen) {
+		return;
+	}
+#else
+	if (onewire->trace_hook == NULL) {
+		return;
+	}
+#endif
+	event.timestamp = ONEWIRE_GET_TICK();
+	event.type = type;
+	event.state = onewire->state;
+	event.level = level;
+#if ONEWIRE_BLACKBOX_SIZE > 0
+	if (!onewire->blackbox_frozen) {
+		onewire->blackbox[onewire->blackbox_head] = event;
+		onewire->blackbox_head = (onewire->blackbox_head + 1) % ONEWIRE_BLACKBOX_SIZE;
+		if (onewire->blackbox_count < ONEWIRE_BLACKBOX_SIZE) {
+			onewire->blackbox_count++;
+		}
+		if (onewire->state == ONEWIRE_STATE_ERROR) {
+			onewire->blackbox_frozen = 1; // keep events that lead to failure
+		}
+	}
+	if (onewire->trace_hook == NULL) {
+		return;
+	}
+#endif
+	onewire->trace_hook(onewire, &event, onewire->trace_context);
+#else
+	(void)onewire;
+	(void)type;
+	(void)level;
+#endif
+}
+
+static void slave_write_slot_start(OneWireDriver* onewire) {
+	set_state(onewire, slave_write_slot_state[onewire->tx_byte & 0x01]);
+	onewire->edge_timestamp = onewire->timestamp;
+	if (!(onewire->tx_byte & 0x01)) {
+		pull_low(onewire); // hold bus low over master sample point to send 0
+	}
+}
+
+// classifies low pulse that ended at now by its width, reset is recognised at any bit of byte
+static void slave_handle_rising_edge(OneWireDriver* onewire, TickType_t now) {
+	const OneWireTiming* timing = onewire->timing;
+	TickType_t width = now - onewire->edge_timestamp;
+
+	if (width >= pdMS_TO_TICKS(SLAVE_RESET_MIN_WIDTH(timing))) {
+		// overdrive reset keeps overdrive, standard reset always returns slave to standard speed
+		if (width >= pdMS_TO_TICKS(SLAVE_STANDARD_RESET_MIN_WIDTH)) {
+			onewire_set_speed(onewire, ONEWIRE_STANDARD_SPEED);
+		}
+		onewire->bit_index = 0;
+		onewire->slave_phase = ONEWIRE_SLAVE_PHASE_ROM_COMMAND;
+		set_state(onewire, ONEWIRE_STATE_SLAVE_RESET_RELEASE_BUS);
+		onewire->timestamp = now; // presence is timed from rising edge
+	}
+	else if (onewire->state == ONEWIRE_STATE_SLAVE_WRITE_RELEASE_BUS) {
+		set_state(onewire, ONEWIRE_STATE_SLAVE_WRITE_DONE);
 	}
 	else {
-		onewire->state = ONEWIRE_STATE_WRITE_LOW_INIT;
+		store_read_bit(onewire, width < pdMS_TO_TICKS(SLAVE_WRITE_0_MIN_WIDTH(timing)));
+		set_state(onewire, ONEWIRE_STATE_SLAVE_READ_DONE);
 	}
 }
 
+// bookkeeping of completed slave slot, called from onewire_process() or from edge interrupt
+static void slave_finish_bit(OneWireDriver* onewire) {
+	if (onewire->slave_phase == ONEWIRE_SLAVE_PHASE_SEARCH) {
+		slave_handle_search_slot(onewire); // search sends and reads single bits
+		return;
+	}
+	onewire->bit_index++; // move index 
+	if (onewire->state == ONEWIRE_STATE_SLAVE_WRITE_DONE) {
+		if (onewire->bit_index >= 8) {
+			onewire->bit_index = 0;
+			slave_handle_byte_sent(onewire);
+		}
+		else {
+			onewire->tx_byte >>= 1;
+			set_state(onewire, ONEWIRE_STATE_SLAVE_WRITE_INIT);
+		}
+	}
+	else if (onewire->bit_index >= 8){
+		update_crc8(onewire, onewire->rx_byte);
+		set_flag(onewire, FLAG_BYTE_RECEIVED); // we received whole byte of data
+		// prepair for new byte
+		onewire->bit_index = 0;
+		slave_handle_byte_received(onewire);
+	}
+	else {
+		set_state(onewire, ONEWIRE_STATE_SLAVE_READ_INIT); // continue reading until all 8 bits are read
+	}
+}
+
+// crc_bytes is number of inverted CRC16 bytes send after data (0 or 2)
+static void slave_start_transmit(OneWireDriver* onewire, const uint8_t* data, uint16_t length, uint8_t crc_bytes, OneWireSlavePhase phase_after) {
+	onewire->slave_phase = ONEWIRE_SLAVE_PHASE_TRANSMIT;
+	onewire->slave_phase_after_tx = phase_after;
+	onewire->slave_tx_data = data;
+	onewire->slave_tx_length = length;
+	onewire->slave_tx_crc_bytes = crc_bytes;
+	onewire->slave_offset = 0;
+	slave_load_tx_byte(onewire);
+}
+
+// loads next byte to tx_byte and starts write slots, returns 0 when there is nothing more to send
+static uint8_t slave_load_tx_byte(OneWireDriver* onewire) {
+	if (onewire->slave_offset < onewire->slave_tx_length) {
+		onewire->tx_byte = onewire->slave_tx_data[onewire->slave_offset++];
+		onewire->crc16 = onewire_crc16_update(onewire->crc16, onewire->tx_byte);
+	}
+	else if (onewire->slave_tx_crc_bytes > 0) {
+		// inverted CRC16 is send LSB first
+		onewire->tx_byte = (onewire->slave_tx_crc_bytes == 2) ? ~onewire->crc16 & 0xFF : (~onewire->crc16 >> 8) & 0xFF;
+		onewire->slave_tx_crc_bytes--;
+	}
+	else {
+		onewire->slave_phase = onewire->slave_phase_after_tx;
+		return 0;
+	}
+	onewire->bit_index = 0;
+	set_state(onewire, ONEWIRE_STATE_SLAVE_WRITE_INIT);
+	return 1;
+}
+
+static void slave_handle_rom_command(OneWireDriver* onewire, uint8_t command) {
+	OneWireSlaveMemory* memory = onewire->slave_memory;
+
+	switch (command) {
+	case OVERDRIVE_SKIP_ROM:
+		onewire_set_speed(onewire, ONEWIRE_OVERDRIVE_SPEED); // master continues in overdrive after this byte
+		onewire->slave_phase = (memory != NULL) ? ONEWIRE_SLAVE_PHASE_FUNCTION_COMMAND : ONEWIRE_SLAVE_PHASE_RAW;
+		break;
+	case SKIP_ROM:
+		onewire->slave_phase = (memory != NULL) ? ONEWIRE_SLAVE_PHASE_FUNCTION_COMMAND : ONEWIRE_SLAVE_PHASE_RAW;
+		break;
+	default:
+		if (memory == NULL) {
+			onewire->slave_phase = ONEWIRE_SLAVE_PHASE_RAW; // application handles ROM layer
+		}
+		else if (command == MATCH_ROM || command == OVERDRIVE_MATCH_ROM) {
+			if (command == OVERDRIVE_MATCH_ROM) {
+				onewire_set_speed(onewire, ONEWIRE_OVERDRIVE_SPEED);
+			}
+			onewire->slave_offset = 0;
+			onewire->slave_phase = ONEWIRE_SLAVE_PHASE_MATCH_ROM;
+		}
+		else if (command == READ_ROM) {
+			slave_start_transmit(onewire, memory->rom, sizeof(memory->rom), 0, ONEWIRE_SLAVE_PHASE_FUNCTION_COMMAND);
+		}
+		else if (command == SEARCH_ROM || (command == ALARM_SEARCH && memory->alarm)) {
+			slave_start_search(onewire); // alarm flag is sampled once, when command byte completes
+		}
+		else {
+			onewire->slave_phase = ONEWIRE_SLAVE_PHASE_IGNORE;
+		}
+		break;
+	}
+}
+
+static void slave_handle_function_command(OneWireDriver* onewire, uint8_t command) {
+	OneWireSlaveMemory* memory = onewire->slave_memory;
+
+	onewire->crc16 = onewire_crc16_update(0, command);
+	onewire->slave_offset = 0;
+	onewire->slave_address = 0;
+	switch (command) {
+	case READ_SCRATCHPAD:
+		// swap only between frames, buffer stays stable until master resets
+		if (memory->publish_pending) {
+			memory->front ^= 1;
+			memory->publish_pending = 0;
+		}
+		slave_start_transmit(onewire, memory->scratchpad[memory->front], memory->scratchpad_size, 2, ONEWIRE_SLAVE_PHASE_IGNORE);
+		break;
+	case WRITE_SCRATCHPAD:
+		onewire->slave_phase = ONEWIRE_SLAVE_PHASE_WRITE_SCRATCHPAD;
+		break;
+	case READ_MEMORY:
+		onewire->slave_phase = ONEWIRE_SLAVE_PHASE_READ_MEMORY_ADDRESS;
+		break;
+	default:
+		onewire->slave_phase = ONEWIRE_SLAVE_PHASE_IGNORE;
+		break;
+	}
+}
+
+static void slave_handle_byte_received(OneWireDriver* onewire) {
+	OneWireSlaveMemory* memory = onewire->slave_memory;
+	uint8_t data = onewire->rx_byte;
+
+	switch (onewire->slave_phase) {
+	case ONEWIRE_SLAVE_PHASE_ROM_COMMAND:
+		slave_handle_rom_command(onewire, data);
+		break;
+	case ONEWIRE_SLAVE_PHASE_MATCH_ROM:
+		if (data != memory->rom[onewire->slave_offset++]) {
+			onewire->slave_phase = ONEWIRE_SLAVE_PHASE_IGNORE; // other device is addressed
+		}
+		else if (onewire->slave_offset >= sizeof(memory->rom)) {
+			onewire->slave_phase = ONEWIRE_SLAVE_PHASE_FUNCTION_COMMAND;
+		}
+		break;
+	case ONEWIRE_SLAVE_PHASE_FUNCTION_COMMAND:
+		slave_handle_function_command(onewire, data);
+		break;
+	case ONEWIRE_SLAVE_PHASE_READ_MEMORY_ADDRESS:
+		onewire->crc16 = onewire_crc16_update(onewire->crc16, data);
+		onewire->slave_address |= (uint16_t)data << (8 * onewire->slave_offset++); // TA1 then TA2
+		if (onewire->slave_offset >= 2) {
+			if (onewire->slave_address < memory->memory_size) {
+				slave_start_transmit(onewire, &memory->memory[onewire->slave_address], memory->memory_size - onewire->slave_address, 2, ONEWIRE_SLAVE_PHASE_IGNORE);
+			}
+			else {
+				onewire->slave_phase = ONEWIRE_SLAVE_PHASE_IGNORE;
+			}
+		}
+		break;
+	case ONEWIRE_SLAVE_PHASE_WRITE_SCRATCHPAD:
+		onewire->crc16 = onewire_crc16_update(onewire->crc16, data);
+		if (onewire->slave_offset < memory->write_buffer_size) {
+			memory->write_buffer[onewire->slave_offset++] = data;
+		}
+		if (onewire->slave_offset >= memory->write_buffer_size) {
+			if (memory->write_callback != NULL) {
+				memory->write_callback(onewire, memory->write_buffer_size, memory->context);
+			}
+			slave_start_transmit(onewire, NULL, 0, 2, ONEWIRE_SLAVE_PHASE_IGNORE);
+		}
+		break;
+	default:
+		break; // raw and ignored bytes are only flagged for application
+	}
+
+	if (onewire->slave_phase != ONEWIRE_SLAVE_PHASE_TRANSMIT && onewire->slave_phase != ONEWIRE_SLAVE_PHASE_SEARCH) {
+		set_state(onewire, ONEWIRE_STATE_IDLE); // listen for next byte
+	}
+}
+
+static void slave_handle_byte_sent(OneWireDriver* onewire) {
+	if (!slave_load_tx_byte(onewire)) {
+		set_state(onewire, ONEWIRE_STATE_IDLE); // transmit finished, listen for next byte or reset
+	}
+}
+
+static uint8_t slave_get_rom_bit(OneWireDriver* onewire) {
+	return (onewire->slave_memory->rom[onewire->slave_offset >> 3] >> (onewire->slave_offset & 0x07)) & 0x01;
+}
+
+static void slave_start_search(OneWireDriver* onewire) {
+	onewire->slave_phase = ONEWIRE_SLAVE_PHASE_SEARCH;
+	onewire->slave_offset = 0;
+	onewire->slave_search_slot = 0;
+	onewire->tx_byte = slave_get_rom_bit(onewire);
+	set_state(onewire, ONEWIRE_STATE_SLAVE_WRITE_INIT);
+}
+
+// every ROM bit takes three slots, slave sends bit and its complement and reads direction chosen by master.
+// slave_offset is index of current ROM bit, slave drops out of search when direction differs from its bit
+static void slave_handle_search_slot(OneWireDriver* onewire) {
+	uint8_t bit = slave_get_rom_bit(onewire);
+
+	onewire->bit_index = 0;
+	switch (onewire->slave_search_slot) {
+	case 0:
+		onewire->slave_search_slot = 1;
+		onewire->tx_byte = bit ^ 0x01;
+		set_state(onewire, ONEWIRE_STATE_SLAVE_WRITE_INIT);
+		break;
+	case 1:
+		onewire->slave_search_slot = 2;
+		set_state(onewire, ONEWIRE_STATE_SLAVE_READ_INIT);
+		break;
+	default:
+		if ((onewire->rx_byte >> 7) != bit) {
+			onewire->slave_phase = ONEWIRE_SLAVE_PHASE_IGNORE; // master continues with other branch
+			set_state(onewire, ONEWIRE_STATE_IDLE);
+		}
+		else if (++onewire->slave_offset >= 8 * sizeof(onewire->slave_memory->rom)) {
+			onewire->slave_phase = ONEWIRE_SLAVE_PHASE_FUNCTION_COMMAND; // device is selected
+			set_state(onewire, ONEWIRE_STATE_IDLE);
+		}
+		else {
+			onewire->slave_search_slot = 0;
+			onewire->tx_byte = slave_get_rom_bit(onewire);
+			set_state(onewire, ONEWIRE_STATE_SLAVE_WRITE_INIT);
+		}
+		break;
+	}
+}
+
+static void store_read_bit(OneWireDriver* onewire, uint8_t value) {
+	trace_event(onewire, ONEWIRE_TRACE_SAMPLE, value ? GPIO_PIN_SET : GPIO_PIN_RESET);
+	// bits arrive LSB first, after 8 shifts first received bit is on position 0
+	onewire->rx_byte = (onewire->rx_byte >> 1) | ((value & 0x01) << 7);
+}
+
+static void update_crc8(OneWireDriver* onewire, uint8_t data) {
+	onewire->crc8 = crc8_table[onewire->crc8 ^ data];
+}
+
+static void set_write_init_state(OneWireDriver* onewire,uint8_t bit) {
+	set_state(onewire, write_slot_init_state[bit & 0x01]);
+}
+
 static void handle_write_bit_done_state(OneWireDriver* onewire){
 	onewire->bit_index++;
 	// set int state
@@ -213,23 +935,54 @@ static void handle_write_bit_done_state(OneWireDriver* onewire){
 		onewire->rx_byte = 0;
 		set_flag(onewire, FLAG_BYTE_SEND);
 	}
-	// set state to write 1 or 0 depending of bit that is on bit_index place in tx_byte
+	// tx_byte is used as shift register, next bit to send is always on position 0
 	else {
-		set_write_init_state(onewire, (onewire->tx_byte >> onewire->bit_index)& 0x01);
+		onewire->tx_byte >>= 1;
+		set_write_init_state(onewire, onewire->tx_byte);
 	}
 }
 
-void onewire_init(OneWireDriver* onewire, GPIO_TypeDef* port, uint32_t pin, OneWireOperatingMode mode) {
-
-	onewire->Pin = pin;
-	onewire->Port = port;
-	pin_output_mode(onewire);
+static void init_driver(OneWireDriver* onewire, OneWireOperatingMode mode) {
 	onewire->state = ONEWIRE_STATE_IDLE;
 	onewire->rx_byte = 0x00;
 	onewire->tx_byte = 0x00;
 	onewire->bit_index = 0;
 	onewire->timestamp = 0;
+	onewire->edge_timestamp = 0;
+	onewire->slave_memory = NULL;
+	onewire->slave_phase = ONEWIRE_SLAVE_PHASE_RAW;
 	onewire->flag_reg = 0; //reset all flags
+	onewire->crc8 = 0;
+	onewire->sampled_bus_bit = GPIO_PIN_SET;
+	onewire->driven_level = GPIO_PIN_SET;
+	onewire_reset_jitter_stats(onewire);
+	onewire_reset_error_counters(onewire);
+#if ONEWIRE_LATENCY_STATS
+	onewire_reset_latency_stats(onewire);
+#endif
+#if ONEWIRE_BUS_STATS
+	onewire_reset_bus_stats(onewire);
+#ifndef ONEWIRE_PORT_LINUX
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk; // start DWT cycle counter
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
+#endif
+#if ONEWIRE_TRACE
+	onewire->trace_hook = NULL;
+	onewire->trace_context = NULL;
+#endif
+#if ONEWIRE_BLACKBOX_SIZE > 0
+	onewire_blackbox_rearm(onewire);
+#endif
+#if ONEWIRE_OP_RECORD
+	onewire->op_recorder = NULL;
+#endif
+#if ONEWIRE_HOTPLUG
+	onewire->idle_edge_timestamp = 0;
+	onewire->idle_edge_armed = 0;
+	onewire->hotplug_dirty = 0;
+	onewire->hotplug_pulses = 0;
+#endif
 	
 	if (mode == OPERATING_MODE_SLAVE){
 		set_flag(onewire, FLAG_IS_SLAVE);
@@ -237,10 +990,134 @@ void onewire_init(OneWireDriver* onewire, GPIO_TypeDef* port, uint32_t pin, OneW
 	else{
 		reset_flag(onewire, FLAG_IS_SLAVE);
 	}
+	onewire_set_speed(onewire, ONEWIRE_SPEED_MODE);
+}
+
+void onewire_init(OneWireDriver* onewire, GPIO_TypeDef* port, uint32_t pin, OneWireOperatingMode mode) {
+
+	onewire->Pin = pin;
+	onewire->Port = port;
+	onewire->RxPin = pin;
+	onewire->RxPort = port;
+	onewire->bus_interface = ONEWIRE_INTERFACE_SINGLE_PIN;
+	pin_output_mode(onewire);
+	init_driver(onewire, mode);
+}
+
+void onewire_init_dual_pin(OneWireDriver* onewire, GPIO_TypeDef* tx_port, uint32_t tx_pin, GPIO_TypeDef* rx_port, uint32_t rx_pin, OneWireOperatingMode mode) {
+
+	onewire->Pin = tx_pin;
+	onewire->Port = tx_port;
+	onewire->RxPin = rx_pin;
+	onewire->RxPort = rx_port;
+	onewire->bus_interface = ONEWIRE_INTERFACE_DUAL_PIN;
+	dual_pin_mode(onewire);
+	init_driver(onewire, mode);
+}
+
+void onewire_init_custom(OneWireDriver* onewire, const OneWireBusOps* ops, void* context, OneWireOperatingMode mode) {
+
+	onewire->Pin = 0;
+	onewire->Port = NULL;
+	onewire->RxPin = 0;
+	onewire->RxPort = NULL;
+	onewire->bus_ops = ops;
+	onewire->bus_context = context;
+	onewire->bus_interface = ONEWIRE_INTERFACE_CUSTOM;
+	ops->release(context);
+	init_driver(onewire, mode);
+}
+
+#if ONEWIRE_SPI_BACKEND
+void onewire_init_spi(OneWireDriver* onewire, SPI_HandleTypeDef* hspi) {
+
+	onewire->Pin = 0;
+	onewire->Port = NULL;
+	onewire->RxPin = 0;
+	onewire->RxPort = NULL;
+	onewire->hspi = hspi;
+	onewire->bus_interface = ONEWIRE_INTERFACE_SPI;
+	onewire->stream_callback = NULL;
+	onewire->stream_context = NULL;
+	init_driver(onewire, OPERATING_MODE_MASTER); // SPI can only generate slots, slave mode is not supported
+}
+
+void onewire_spi_stream_start(OneWireDriver* onewire, OneWireStreamCallback callback, void* context) {
+	onewire->stream_callback = callback;
+	onewire->stream_context = context;
+	for (uint16_t i = 0; i < ONEWIRE_SPI_STREAM_FRAMES; i++) {
+		onewire->stream_tx[i] = ONEWIRE_SPI_READ_FRAME;
+	}
+	set_state(onewire, ONEWIRE_STATE_SPI_STREAM);
+	// with circular DMA transfer never completes, each half is handed over from DMA callbacks
+	if (HAL_SPI_TransmitReceive_DMA(onewire->hspi, onewire->stream_tx, onewire->stream_rx, ONEWIRE_SPI_STREAM_FRAMES) != HAL_OK) {
+		set_flag(onewire, FLAG_ERROR);
+		set_state(onewire, ONEWIRE_STATE_ERROR);
+	}
+}
+
+void onewire_spi_stream_stop(OneWireDriver* onewire) {
+	if (onewire->state == ONEWIRE_STATE_SPI_STREAM) {
+		set_state(onewire, ONEWIRE_STATE_IDLE);
+		HAL_SPI_DMAStop(onewire->hspi);
+	}
+}
+
+// call from HAL_SPI_TxRxHalfCpltCallback, first half of stream_rx is filled
+void onewire_spi_stream_half_complete(OneWireDriver* onewire) {
+	spi_stream_deliver(onewire, onewire->stream_rx);
 }
 
+// call from HAL_SPI_TxRxCpltCallback, second half of stream_rx is filled
+void onewire_spi_stream_complete(OneWireDriver* onewire) {
+	spi_stream_deliver(onewire, &onewire->stream_rx[ONEWIRE_SPI_STREAM_FRAMES / 2]);
+}
+#endif
+
 void onewire_process(OneWireDriver *onewire){
-	
+#if ONEWIRE_BUS_STATS
+	uint32_t start_cycles = ONEWIRE_GET_CYCLES();
+	TickType_t now = ONEWIRE_GET_TICK();
+	TickType_t window = now - onewire->stats_window_start;
+
+	process_state(onewire);
+	if (window >= ONEWIRE_STATS_WINDOW_TICKS) {
+		OneWireBusStats* stats = &onewire->bus_stats;
+
+		if (is_bus_occupied_state(onewire->state)) {
+			onewire->window_busy_ticks += now - onewire->busy_start; // split slot that spans window boundary
+			onewire->busy_start = now;
+		}
+		stats->last_utilization = (uint16_t)(((uint64_t)onewire->window_busy_ticks * ONEWIRE_STATS_FULL_SCALE) / window);
+		if (stats->last_utilization > ONEWIRE_STATS_FULL_SCALE) {
+			stats->last_utilization = ONEWIRE_STATS_FULL_SCALE;
+		}
+		stats_account_cycles(onewire, start_cycles);
+		stats->last_cpu_cycles = onewire->window_cycles;
+		// averages are kept scaled by 2^ONEWIRE_STATS_EWMA_SHIFT, so they settle exactly on steady load
+		if (stats->window_count == 0) {
+			onewire->utilization_sum = (uint32_t)stats->last_utilization << ONEWIRE_STATS_EWMA_SHIFT; // first window seeds averages
+			onewire->cpu_cycles_sum = (uint64_t)stats->last_cpu_cycles << ONEWIRE_STATS_EWMA_SHIFT;
+		}
+		else {
+			onewire->utilization_sum += stats->last_utilization - (onewire->utilization_sum >> ONEWIRE_STATS_EWMA_SHIFT);
+			onewire->cpu_cycles_sum += stats->last_cpu_cycles - (onewire->cpu_cycles_sum >> ONEWIRE_STATS_EWMA_SHIFT);
+		}
+		stats->utilization = (uint16_t)(onewire->utilization_sum >> ONEWIRE_STATS_EWMA_SHIFT);
+		stats->cpu_cycles = (uint32_t)(onewire->cpu_cycles_sum >> ONEWIRE_STATS_EWMA_SHIFT);
+		stats->window_count++;
+		onewire->stats_window_start = now;
+		onewire->window_busy_ticks = 0;
+		onewire->window_cycles = 0;
+		return;
+	}
+	stats_account_cycles(onewire, start_cycles);
+#else
+	process_state(onewire);
+#endif
+}
+
+static void process_state(OneWireDriver *onewire){
 	switch (onewire->state) {
 	case ONEWIRE_STATE_IDLE:
 		if (get_flag(onewire, FLAG_IS_SLAVE)){
@@ -248,49 +1125,57 @@ void onewire_process(OneWireDriver *onewire){
 		}
 		break;
 	case ONEWIRE_STATE_RESET_INIT:
-		if (is_time_expired(onewire, pdMS_TO_TICKS(RESET_INIT_DELAY))){
+		if (is_time_expired(onewire, get_state_delay(onewire))){
 			set_state(onewire, ONEWIRE_STATE_RESET_DRIVE_BUS_LOW);
 			pull_low(onewire);
 		}
 		break;
 	case ONEWIRE_STATE_RESET_DRIVE_BUS_LOW:
-		if (is_time_expired(onewire, pdMS_TO_TICKS(RESET_DRIVE_BUS_LOW_DELAY))){
+		if (is_time_expired(onewire, get_state_delay(onewire))){
 			set_state(onewire, ONEWIRE_STATE_RESET_RELEASE_BUS);
 			pull_high(onewire);
 		}
 		break;
 	case ONEWIRE_STATE_RESET_RELEASE_BUS:
-		if (is_time_expired(onewire, pdMS_TO_TICKS(RESET_RELEASE_BUS_DELAY))){
+		if (is_time_expired(onewire, get_state_delay(onewire))){
 			set_state(onewire, ONEWIRE_STATE_RESET_SAMPLE_BUS);
 			reset_flag(onewire, FLAG_PRESENCE_DETECTED);
 		}
 		break;
 	case ONEWIRE_STATE_RESET_SAMPLE_BUS:
-		if (!is_time_expired(onewire, pdMS_TO_TICKS(RESET_SAMPLE_BUS_DELAY))){
+		if (!is_time_expired(onewire, get_state_delay(onewire))){
 			if (read_pin(onewire) == GPIO_PIN_RESET){
 				set_flag(onewire, FLAG_PRESENCE_DETECTED);
 			}
 		}
 		else {
 			set_state(onewire, ONEWIRE_STATE_RESET_DONE);
-			if (get_flag(onewire, FLAG_PRESENCE_DETECTED) !=0){
-				set_flag(onewire, FLAG_ERROR);
+			trace_event(onewire, ONEWIRE_TRACE_SAMPLE, get_flag(onewire, FLAG_PRESENCE_DETECTED) ? GPIO_PIN_RESET : GPIO_PIN_SET);
+			if (!get_flag(onewire, FLAG_PRESENCE_DETECTED)) {
+				onewire->errors.missing_presence++;
+				set_flag(onewire, FLAG_ERROR); // no slave answered reset
+#if ONEWIRE_BLACKBOX_SIZE > 0
+				onewire_blackbox_trigger(onewire); // keep reset that nobody answered
+#endif
 			}
 		}
 		break;
+	case ONEWIRE_STATE_RESET_DONE:
+		set_state(onewire, ONEWIRE_STATE_IDLE); // presence result stays in FLAG_PRESENCE_DETECTED
+		break;
 	// write high
 	case ONEWIRE_STATE_WRITE_HIGH_INIT:
 		set_state(onewire,ONEWIRE_STATE_WRITE_HIGH_DRIVE_BUS_LOW);
 		pull_low(onewire);
 		break;
 	case ONEWIRE_STATE_WRITE_HIGH_DRIVE_BUS_LOW:
-		if (is_time_expired(onewire, pdMS_TO_TICKS(WRITE_1_LOW_DELAY))){
+		if (is_time_expired(onewire, get_state_delay(onewire))){
 			set_state(onewire, ONEWIRE_STATE_WRITE_HIGH_RELEASE_BUS);
 			pull_high(onewire);
 		}
 		break;
 	case ONEWIRE_STATE_WRITE_HIGH_RELEASE_BUS:
-		if (is_time_expired(onewire, pdMS_TO_TICKS(WRITE_1_RELEASE_BUS_DELAY))){
+		if (is_time_expired(onewire, get_state_delay(onewire))){
 			set_state(onewire, ONEWIRE_STATE_WRITE_HIGH_DONE);
 		}
 		break;
@@ -300,13 +1185,13 @@ void onewire_process(OneWireDriver *onewire){
 		pull_low(onewire);
 		break;
 	case ONEWIRE_STATE_WRITE_LOW_DRIVE_BUS_LOW:
-		if (is_time_expired(onewire, pdMS_TO_TICKS(WRITE_0_LOW_DELAY))){
+		if (is_time_expired(onewire, get_state_delay(onewire))){
 			set_state(onewire, ONEWIRE_STATE_WRITE_LOW_RELEASE_BUS);
 			pull_high(onewire);
 		}
 		break;
 	case ONEWIRE_STATE_WRITE_LOW_RELEASE_BUS:
-		if (is_time_expired(onewire, pdMS_TO_TICKS(WRITE_0_RELEASE_BUS_DELAY))){
+		if (is_time_expired(onewire, get_state_delay(onewire))){
 			set_state(onewire, ONEWIRE_STATE_WRITE_LOW_DONE);
 		}
 		break;
@@ -320,30 +1205,33 @@ void onewire_process(OneWireDriver *onewire){
 		pull_low(onewire);
 		break;
 	case ONEWIRE_STATE_MASTER_READ_DRIVE_BUS_LOW:
-		if (is_time_expired(onewire, pdMS_TO_TICKS(WRITE_1_LOW_DELAY))){
+		if (is_time_expired(onewire, get_state_delay(onewire))){
 			set_state(onewire, ONEWIRE_STATE_MASTER_READ_RELEASE_BUS);
 			pull_high(onewire);
 		}
 		break;
 	case ONEWIRE_STATE_MASTER_READ_RELEASE_BUS:
-		if (is_time_expired(onewire, pdMS_TO_TICKS(READ_RELEASE_BUS_DELAY))){
+		if (is_time_expired(onewire, get_state_delay(onewire))){
 			set_state(onewire, ONEWIRE_STATE_MASTER_READ_SAMPLE_BUS);
 		}
 	case ONEWIRE_STATE_MASTER_READ_SAMPLE_BUS:
-		if (!is_time_expired(onewire, pdMS_TO_TICKS(READ_SAMPLE_DELAY - WRITE_0_RELEASE_BUS_DELAY))){
-			if (read_pin(onewire) == GPIO_PIN_RESET && sampled_bus_bit != GPIO_PIN_RESET){
-				sampled_bus_bit = GPIO_PIN_RESET; //set temp bit to 0
+		if (!is_time_expired(onewire, get_state_delay(onewire))){
+			if (read_pin(onewire) == GPIO_PIN_RESET && onewire->sampled_bus_bit != GPIO_PIN_RESET){
+				onewire->sampled_bus_bit = GPIO_PIN_RESET; //set temp bit to 0
 			}
 		}
 		else {
-			store_read_bit(onewire, sampled_bus_bit); // shift value from bus to left by index
+			store_read_bit(onewire, onewire->sampled_bus_bit); // shift sampled value into rx_byte
 			set_state(onewire, ONEWIRE_STATE_MASTER_READ_DONE);
 		}
 		break;
 	case ONEWIRE_STATE_MASTER_READ_DONE:
 		onewire->bit_index++; // move index 
-		sampled_bus_bit = GPIO_PIN_SET;// set bit to start value	
+		onewire->sampled_bus_bit = GPIO_PIN_SET;// set bit to start value	
 		if (onewire->bit_index >= 8){
+			if (!get_flag(onewire, FLAG_BIT_OPERATION)) {
+				update_crc8(onewire, onewire->rx_byte); // single bit is not part of CRC protected data
+			}
 			set_flag(onewire, FLAG_BYTE_RECEIVED); // we received whole byte of data
 			// prepair for new byte
 			onewire->bit_index = 0;
@@ -357,93 +1245,412 @@ void onewire_process(OneWireDriver *onewire){
 	case ONEWIRE_STATE_SLAVE_READ_INIT:
 		if (read_pin(onewire) == GPIO_PIN_RESET) {
 			set_state(onewire,ONEWIRE_STATE_SLAVE_READ_MONITOR_BUS);
+			onewire->edge_timestamp = onewire->timestamp;
 		}
 		break;
 	case ONEWIRE_STATE_SLAVE_READ_MONITOR_BUS:
-		if (is_time_expired(onewire, pdMS_TO_TICKS(WRITE_1_LOW_DELAY))){
-			set_state(onewire,ONEWIRE_STATE_SLAVE_READ_RELEASE_BUS);
+		if (read_pin(onewire) == GPIO_PIN_SET) {
+			slave_handle_rising_edge(onewire, ONEWIRE_GET_TICK());
 		}
 		break;
-	case ONEWIRE_STATE_SLAVE_READ_RELEASE_BUS:
-		if (is_time_expired(onewire,pdMS_TO_TICKS(READ_RELEASE_BUS_DELAY))){
-			set_state(onewire,ONEWIRE_STATE_SLAVE_READ_SAMPLE_BUS);
+	case ONEWIRE_STATE_SLAVE_RESET_RELEASE_BUS:
+		if (is_time_expired(onewire, get_state_delay(onewire))) {
+			set_state(onewire, ONEWIRE_STATE_SLAVE_PRESENCE_DRIVE_BUS_LOW);
+			pull_low(onewire); // send signal to master that you are present
+			set_flag(onewire, FLAG_PRESENCE_DETECTED);
 		}
 		break;
-	case ONEWIRE_STATE_SLAVE_READ_SAMPLE_BUS:
-		if (is_time_expired(onewire,pdMS_TO_TICKS(READ_SAMPLE_DELAY - WRITE_0_RELEASE_BUS_DELAY))){
-			set_state(onewire, ONEWIRE_STATE_SLAVE_READ_DELAY_BUS);
-		}
-		else {
-			// check if low until time for sampling expired
-			if (sampled_bus_bit != GPIO_PIN_RESET){
-				if ((read_pin(onewire) == GPIO_PIN_RESET)){
-					sampled_bus_bit = GPIO_PIN_RESET; //set temp bit to 0
-				}
-			}
+	case ONEWIRE_STATE_SLAVE_PRESENCE_DRIVE_BUS_LOW:
+		if (is_time_expired(onewire, get_state_delay(onewire))) {
+			pull_high(onewire); // release bus 
+			set_state(onewire, ONEWIRE_STATE_SLAVE_READ_INIT);
 		}
 		break;
-	case ONEWIRE_STATE_SLAVE_READ_DELAY_BUS:
-		if (is_time_expired(onewire, pdMS_TO_TICKS(WRITE_0_RELEASE_BUS_DELAY))) {
-			if(read_pin(onewire) == GPIO_PIN_SET) {
-				store_read_bit(onewire, sampled_bus_bit); // shift value from bus to left by index
-				set_state(onewire, ONEWIRE_STATE_SLAVE_READ_DONE);
-			}
-			else {
-				set_state(onewire, ONEWIRE_STATE_SLAVE_RESET_MONITOR_BUS);
-			}
-		}
-		;
+	case ONEWIRE_STATE_SLAVE_READ_DONE:
+	case ONEWIRE_STATE_SLAVE_WRITE_DONE:
+		slave_finish_bit(onewire);
 		break;
-	case ONEWIRE_STATE_SLAVE_RESET_MONITOR_BUS:
-		if (is_time_expired(onewire, pdMS_TO_TICKS(RESET_DRIVE_BUS_LOW_DELAY-WRITE_1_LOW_DELAY-READ_RELEASE_BUS_DELAY-READ_SAMPLE_DELAY))){
-			if (read_pin(onewire) == GPIO_PIN_RESET){
-				set_state(onewire, ONEWIRE_STATE_SLAVE_RESET_RELEASE_BUS);
-			}
-			else {
-				set_flag(onewire, FLAG_ERROR);
-				set_state(onewire, ONEWIRE_STATE_ERROR);
-			}
+	// slave write
+	case ONEWIRE_STATE_SLAVE_WRITE_INIT:
+		if (read_pin(onewire) == GPIO_PIN_RESET) {
+			slave_write_slot_start(onewire); // master started read slot
 		}
 		break;
-	case ONEWIRE_STATE_SLAVE_RESET_RELEASE_BUS:
-		if (is_time_expired(onewire, RESET_RELEASE_BUS_DELAY)) {
-			set_state(onewire, ONEWIRE_STATE_SLAVE_RESET_SAMPLE_BUS);
+	case ONEWIRE_STATE_SLAVE_WRITE_DRIVE_BUS_LOW:
+		if (is_time_expired(onewire, get_state_delay(onewire))) {
+			set_state(onewire, ONEWIRE_STATE_SLAVE_WRITE_RELEASE_BUS); // before release, edge interrupt may end slot
+			pull_high(onewire); // master sample point is passed
 		}
 		break;
-	case ONEWIRE_STATE_SLAVE_RESET_SAMPLE_BUS:
-		if (is_time_expired(onewire, RESET_SAMPLE_BUS_DELAY)){
-			pull_high(onewire); // release bus 
-			set_state(onewire, ONEWIRE_STATE_SLAVE_READ_INIT);
-		}
-		else {
-			pull_low(onewire); // send signal to master that you are present
-			set_flag(onewire, FLAG_PRESENCE_DETECTED);
+	case ONEWIRE_STATE_SLAVE_WRITE_RELEASE_BUS:
+		if (read_pin(onewire) == GPIO_PIN_SET) {
+			slave_handle_rising_edge(onewire, ONEWIRE_GET_TICK()); // end of slot or reset during transmit
 		}
 		break;
-	case ONEWIRE_STATE_SLAVE_READ_DONE:
-		onewire->bit_index++; // move index 
-		sampled_bus_bit = GPIO_PIN_SET;// set bit to start value	
-		if (onewire->bit_index >= 8){
-			set_flag(onewire, FLAG_BYTE_RECEIVED); // we received whole byte of data
-			// prepair for new byte
-			onewire->bit_index = 0;
-			set_state(onewire, ONEWIRE_STATE_IDLE);
-		}		
-		else {
-			set_state(onewire, ONEWIRE_STATE_SLAVE_READ_INIT); // continue reading until all 8 bits are read
+#if ONEWIRE_SPI_BACKEND
+	// SPI backend
+	case ONEWIRE_STATE_SPI_TRANSFER:
+		if (HAL_SPI_GetState(onewire->hspi) == HAL_SPI_STATE_READY) {
+			spi_handle_transfer_done(onewire);
 		}
 		break;
-	
+	case ONEWIRE_STATE_SPI_STREAM:
+		break; // bytes are delivered from DMA callbacks until onewire_spi_stream_stop()
+#endif
 
+	case ONEWIRE_STATE_ERROR:
+		break; // driver stays in error until application starts new operation
 	default:
 		set_state(onewire, ONEWIRE_STATE_ERROR); // state not defined
 		set_flag(onewire, FLAG_ERROR);
-		
-		
+		break;
+	}
+}
+
+// Ticks until onewire_process() has something to do next, so caller (RTOS task or discrete-event
+// host simulation) can sleep or move clock forward instead of stepping every tick.
+// 0 is returned while bus is polled (sample windows, immediate transitions) and portMAX_DELAY
+// while driver only waits for bus edge or application request. Delay is relative to current
+// tick, so it stays valid when tick counter wraps around.
+// Delays come from state_timing, same table onewire_process() uses.
+TickType_t onewire_get_next_event_delay(OneWireDriver* onewire) {
+	switch (state_timing[onewire->state].wake) {
+	case STATE_WAKE_DELAY:
+		return get_remaining_ticks(onewire, get_state_delay(onewire));
+	case STATE_WAKE_EDGE:
+		if (onewire->state == ONEWIRE_STATE_IDLE && get_flag(onewire, FLAG_IS_SLAVE)) {
+			return 0; // slave goes to listening state on next call
+		}
+		return portMAX_DELAY; // waiting for bus edge or DMA callbacks
+	default:
+		return 0; // polling bus or immediate transition
+	}
+}
+
+void onewire_set_speed(OneWireDriver* onewire, uint8_t speed_mode) {
+#if ONEWIRE_OP_RECORD
+	if (!get_flag(onewire, FLAG_IS_SLAVE)) {
+		record_op(onewire, ONEWIRE_OP_SET_SPEED, speed_mode); // slave switches speed on its own
+	}
+#endif
+	if (speed_mode == ONEWIRE_OVERDRIVE_SPEED) {
+		onewire->timing = &overdrive_timing;
+		set_flag(onewire, FLAG_OVERDRIVE);
+	}
+	else {
+		onewire->timing = &standard_timing;
+		reset_flag(onewire, FLAG_OVERDRIVE);
+	}
+}
+
+uint8_t onewire_is_overdrive(OneWireDriver* onewire) {
+	return get_flag(onewire, FLAG_OVERDRIVE);
+}
+
+// call from EXTI interrupt on falling edge of bus in slave mode, pulse width and slave write slot
+// are then timed from edge itself instead of from first onewire_process() call that notices low bus
+void onewire_slave_falling_edge_irq(OneWireDriver* onewire) {
+#if ONEWIRE_BUS_STATS
+	uint32_t start_cycles = ONEWIRE_GET_CYCLES();
+#endif
+
+	if (onewire->state == ONEWIRE_STATE_SLAVE_READ_DONE || onewire->state == ONEWIRE_STATE_SLAVE_WRITE_DONE) {
+		slave_finish_bit(onewire); // end of previous slot was seen by onewire_process() that did not run since
+	}
+	if (onewire->state == ONEWIRE_STATE_IDLE && get_flag(onewire, FLAG_IS_SLAVE)) {
+		set_state(onewire, ONEWIRE_STATE_SLAVE_READ_INIT); // slot starts before listening state is entered
+	}
+	if (onewire->state == ONEWIRE_STATE_SLAVE_READ_INIT) {
+		set_state(onewire, ONEWIRE_STATE_SLAVE_READ_MONITOR_BUS);
+		onewire->edge_timestamp = onewire->timestamp;
+	}
+	else if (onewire->state == ONEWIRE_STATE_SLAVE_WRITE_INIT) {
+		slave_write_slot_start(onewire);
+	}
+#if ONEWIRE_BUS_STATS
+	stats_account_cycles(onewire, start_cycles);
+#endif
+}
+
+// call from EXTI interrupt on rising edge of bus in slave mode
+void onewire_slave_rising_edge_irq(OneWireDriver* onewire) {
+#if ONEWIRE_BUS_STATS
+	uint32_t start_cycles = ONEWIRE_GET_CYCLES();
+#endif
+
+	if (onewire->state == ONEWIRE_STATE_SLAVE_READ_MONITOR_BUS || onewire->state == ONEWIRE_STATE_SLAVE_WRITE_RELEASE_BUS) {
+		slave_handle_rising_edge(onewire, ONEWIRE_GET_TICK());
+		// bit is finished here, next slot can start before onewire_process() runs again
+		if (onewire->state == ONEWIRE_STATE_SLAVE_READ_DONE || onewire->state == ONEWIRE_STATE_SLAVE_WRITE_DONE) {
+			slave_finish_bit(onewire);
+		}
+		if (onewire->state == ONEWIRE_STATE_IDLE) {
+			set_state(onewire, ONEWIRE_STATE_SLAVE_READ_INIT);
+		}
+	}
+#if ONEWIRE_BUS_STATS
+	stats_account_cycles(onewire, start_cycles);
+#endif
+}
+
+#if ONEWIRE_TRACE
+void onewire_set_trace_hook(OneWireDriver* onewire, OneWireTraceHook hook, void* context) {
+	onewire->trace_context = context;
+	onewire->trace_hook = hook;
+}
+#endif
+
+#if ONEWIRE_HOTPLUG
+// call from EXTI interrupt on falling edge of bus in master mode, edges of own slots are ignored
+void onewire_idle_falling_edge_irq(OneWireDriver* onewire) {
+	onewire->idle_edge_timestamp = ONEWIRE_GET_TICK();
+	onewire->idle_edge_armed = (onewire->state == ONEWIRE_STATE_IDLE && onewire->driven_level == GPIO_PIN_SET);
+}
+
+// call from EXTI interrupt on rising edge of bus in master mode
+void onewire_idle_rising_edge_irq(OneWireDriver* onewire) {
+	TickType_t width = ONEWIRE_GET_TICK() - onewire->idle_edge_timestamp;
+
+	if (!onewire->idle_edge_armed || onewire->state != ONEWIRE_STATE_IDLE) {
+		onewire->idle_edge_armed = 0;
+		return; // every master slot starts with falling edge, so pulse did not overlap own operation only when still armed
+	}
+	onewire->idle_edge_armed = 0;
+	if (width >= pdMS_TO_TICKS(ONEWIRE_HOTPLUG_MIN_PULSE) && width <= pdMS_TO_TICKS(ONEWIRE_HOTPLUG_MAX_PULSE)) {
+		onewire->hotplug_pulses++;
+		onewire->hotplug_dirty = 1;
 	}
 }
 
+// returns 1 once after spontaneous presence pulse, caller searches bus for new devices
+uint8_t onewire_hotplug_take(OneWireDriver* onewire) {
+	uint8_t dirty = onewire->hotplug_dirty;
+
+	onewire->hotplug_dirty = 0;
+	return dirty;
+}
+#endif
+
+#if ONEWIRE_BLACKBOX_SIZE > 0
+// freezes recorder on failure detected outside of driver (CRC mismatch, missing device, ...)
+void onewire_blackbox_trigger(OneWireDriver* onewire) {
+	onewire->blackbox_frozen = 1;
+}
+
+uint8_t onewire_blackbox_is_frozen(OneWireDriver* onewire) {
+	return onewire->blackbox_frozen;
+}
+
+// writes recorder content as blob described in oneWire.h, returns its length or 0 when buffer is too small.
+// Recorder should be frozen, otherwise events may be added while it is exported.
+uint16_t onewire_blackbox_export(OneWireDriver* onewire, uint8_t* buffer, uint16_t size) {
+	uint16_t count = onewire->blackbox_count;
+	uint16_t index = (onewire->blackbox_head + ONEWIRE_BLACKBOX_SIZE - count) % ONEWIRE_BLACKBOX_SIZE;
+	uint16_t length = ONEWIRE_BLACKBOX_HEADER_SIZE + ONEWIRE_BLACKBOX_EVENT_SIZE * count;
+	TickType_t previous = (count > 0) ? onewire->blackbox[index].timestamp : 0;
+	uint8_t* out = buffer;
+
+	if (size < length) {
+		return 0;
+	}
+	*out++ = 'O';
+	*out++ = 'W';
+	*out++ = 'B';
+	*out++ = ONEWIRE_BLACKBOX_VERSION;
+	*out++ = count & 0xFF;
+	*out++ = count >> 8;
+	*out++ = onewire->blackbox_frozen;
+	*out++ = 0;
+	for (uint8_t i = 0; i < 4; i++) {
+		*out++ = ((uint32_t)previous >> (8 * i)) & 0xFF;
+	}
+	for (uint16_t i = 0; i < count; i++) {
+		const OneWireTraceEvent* event = &onewire->blackbox[index];
+		TickType_t delta = event->timestamp - previous;
+
+		if (delta > 0xFFFF) {
+			delta = 0xFFFF;
+		}
+		*out++ = delta & 0xFF;
+		*out++ = (delta >> 8) & 0xFF;
+		*out++ = event->state;
+		*out++ = (event->type << 1) | (event->level & 0x01);
+		previous = event->timestamp;
+		index = (index + 1) % ONEWIRE_BLACKBOX_SIZE;
+	}
+	return length;
+}
+
+// clears recorder and starts recording again
+void onewire_blackbox_rearm(OneWireDriver* onewire) {
+	onewire->blackbox_head = 0;
+	onewire->blackbox_count = 0;
+	onewire->blackbox_frozen = 0;
+}
+#endif
+
+void onewire_get_jitter_stats(OneWireDriver* onewire, OneWireJitterStats* stats) {
+	*stats = onewire->jitter;
+}
+
+void onewire_reset_jitter_stats(OneWireDriver* onewire) {
+	onewire->jitter.deadline_count = 0;
+	onewire->jitter.total_lateness = 0;
+	onewire->jitter.max_lateness = 0;
+}
+
+void onewire_get_error_counters(OneWireDriver* onewire, OneWireErrorCounters* counters) {
+	*counters = onewire->errors;
+}
+
+void onewire_reset_error_counters(OneWireDriver* onewire) {
+	onewire->errors.errors = 0;
+	onewire->errors.missing_presence = 0;
+}
+
+#if ONEWIRE_BUS_STATS
+void onewire_get_bus_stats(OneWireDriver* onewire, OneWireBusStats* stats) {
+	*stats = onewire->bus_stats;
+}
+
+void onewire_reset_bus_stats(OneWireDriver* onewire) {
+	onewire->bus_stats.utilization = 0;
+	onewire->bus_stats.last_utilization = 0;
+	onewire->bus_stats.cpu_cycles = 0;
+	onewire->bus_stats.last_cpu_cycles = 0;
+	onewire->bus_stats.window_count = 0;
+	onewire->utilization_sum = 0;
+	onewire->cpu_cycles_sum = 0;
+	onewire->stats_window_start = ONEWIRE_GET_TICK();
+	onewire->busy_start = onewire->stats_window_start;
+	onewire->window_busy_ticks = 0;
+	onewire->window_cycles = 0;
+}
+#endif
+
+#if ONEWIRE_LATENCY_STATS
+// transaction is queued, any number of transactions can wait with their own stats
+void onewire_txn_submit(OneWireDriver* onewire, OneWireTxnStats* txn, OneWireTxnType type) {
+#if ONEWIRE_OP_RECORD
+	record_op(onewire, ONEWIRE_OP_TXN_SUBMIT, type);
+#else
+	(void)onewire;
+#endif
+	txn->type = (type < ONEWIRE_TXN_TYPE_COUNT) ? type : ONEWIRE_TXN_OTHER;
+	txn->submit_tick = ONEWIRE_GET_TICK();
+	txn->phase = 1;
+}
+
+// transaction takes bus, call right before its first operation
+void onewire_txn_start(OneWireDriver* onewire, OneWireTxnStats* txn) {
+#if ONEWIRE_OP_RECORD
+	record_op(onewire, ONEWIRE_OP_TXN_START, 0);
+#endif
+	onewire->txn_active = txn;
+}
+
+// transaction that never reached bus is counted with zero service time
+void onewire_txn_complete(OneWireDriver* onewire, OneWireTxnStats* txn, uint8_t success) {
+	OneWireLatencyHistogram* histogram;
+	TickType_t now = ONEWIRE_GET_TICK();
+
+#if ONEWIRE_OP_RECORD
+	record_op(onewire, ONEWIRE_OP_TXN_COMPLETE, success);
+#endif
+	if (onewire->txn_active == txn) {
+		onewire->txn_active = NULL;
+	}
+	if (txn->phase == 0) {
+		return;
+	}
+	if (txn->phase == 1) {
+		txn->start_tick = now;
+	}
+	histogram = &onewire->latency[txn->type];
+	histogram->queue_delay[latency_bucket((TickType_t)(txn->start_tick - txn->submit_tick))]++;
+	histogram->service_time[latency_bucket((TickType_t)(now - txn->start_tick))]++;
+	histogram->count++;
+	if (!success) {
+		histogram->failed++;
+	}
+	txn->phase = 0;
+}
+
+void onewire_get_latency_histogram(OneWireDriver* onewire, OneWireTxnType type, OneWireLatencyHistogram* histogram) {
+	if (type < ONEWIRE_TXN_TYPE_COUNT) {
+		*histogram = onewire->latency[type];
+	}
+}
+
+void onewire_reset_latency_stats(OneWireDriver* onewire) {
+	for (uint8_t type = 0; type < ONEWIRE_TXN_TYPE_COUNT; type++) {
+		OneWireLatencyHistogram* histogram = &onewire->latency[type];
+
+		for (uint8_t i = 0; i < ONEWIRE_LATENCY_BUCKETS; i++) {
+			histogram->queue_delay[i] = 0;
+			histogram->service_time[i] = 0;
+		}
+		histogram->count = 0;
+		histogram->failed = 0;
+	}
+	onewire->txn_active = NULL;
+}
+
+// returns upper bound in ticks of bucket that holds given percentile, 0 for empty histogram
+TickType_t onewire_latency_percentile(const uint32_t* buckets, uint8_t percent) {
+	uint32_t total = 0;
+	uint32_t sum = 0;
+	uint8_t i;
+
+	for (i = 0; i < ONEWIRE_LATENCY_BUCKETS; i++) {
+		total += buckets[i];
+	}
+	if (total == 0) {
+		return 0;
+	}
+	for (i = 0; i < ONEWIRE_LATENCY_BUCKETS; i++) {
+		sum += buckets[i];
+		if ((uint64_t)sum * 100 >= (uint64_t)total * percent) {
+			break;
+		}
+	}
+	if (i >= ONEWIRE_LATENCY_BUCKETS - 1) {
+		return portMAX_DELAY; // last bucket is open ended
+	}
+	return ((TickType_t)2 << i) - 1;
+}
+#endif
+
+#if ONEWIRE_OP_RECORD
+// starts recording of master operations into records, NULL recorder or capacity 0 stops recording
+void onewire_set_op_recorder(OneWireDriver* onewire, OneWireOpRecorder* recorder, OneWireOpRecord* records, uint16_t capacity) {
+	if (recorder != NULL) {
+		recorder->records = records;
+		recorder->capacity = capacity;
+		recorder->head = 0;
+		recorder->count = 0;
+		recorder->overwritten = 0;
+	}
+	onewire->op_recorder = (records != NULL && capacity > 0) ? recorder : NULL;
+}
+#endif
+
 void onewire_reset(OneWireDriver* onewire) {
+#if ONEWIRE_OP_RECORD
+	record_op(onewire, ONEWIRE_OP_RESET, 0);
+#endif
+#if ONEWIRE_LATENCY_STATS
+	txn_mark_start(onewire);
+#endif
+#if ONEWIRE_SPI_BACKEND
+	if (onewire->bus_interface == ONEWIRE_INTERFACE_SPI) {
+		for (uint8_t i = 0; i < ONEWIRE_SPI_BUFFER_SIZE; i++) {
+			onewire->spi_tx[i] = (i < ONEWIRE_SPI_RESET_LOW_FRAMES) ? 0x00 : 0xFF;
+		}
+		spi_start(onewire, ONEWIRE_SPI_OPERATION_RESET, ONEWIRE_SPI_BUFFER_SIZE);
+		return;
+	}
+#endif
 	if(!get_flag(onewire, FLAG_IS_SLAVE)){
 		set_state(onewire, ONEWIRE_STATE_RESET_INIT);
 	}
@@ -453,9 +1660,115 @@ uint8_t onewire_is_slave_present(OneWireDriver* onewire) {
 }
 
 void onewire_write_byte(OneWireDriver* onewire, uint8_t data) {
-	onewire->tx_byte = data;// set data to tx_buffer
+#if ONEWIRE_OP_RECORD
+	record_op(onewire, ONEWIRE_OP_WRITE_BYTE, data);
+#endif
+#if ONEWIRE_LATENCY_STATS
+	txn_mark_start(onewire);
+#endif
+	reset_flag(onewire, FLAG_BIT_OPERATION);
+#if ONEWIRE_SPI_BACKEND
+	if (onewire->bus_interface == ONEWIRE_INTERFACE_SPI) {
+		for (uint8_t i = 0; i < 8; i++) {
+			onewire->spi_tx[i] = ((data >> i) & 0x01) ? ONEWIRE_SPI_WRITE_1_FRAME : ONEWIRE_SPI_WRITE_0_FRAME;
+		}
+		spi_start(onewire, ONEWIRE_SPI_OPERATION_WRITE, 8);
+		return;
+	}
+#endif
+	onewire->tx_byte = data;// set data to tx_buffer, bits are shifted out LSB first
 	onewire->bit_index = 0;
-	set_write_init_state(onewire, data & 0x01);// set state to write 0 or 1 depending of first(0) bite
+	set_write_init_state(onewire, data);// set state to write 0 or 1 depending of first(0) bite
+}
+
+void onewire_read_byte(OneWireDriver* onewire) {
+#if ONEWIRE_OP_RECORD
+	record_op(onewire, ONEWIRE_OP_READ_BYTE, 0);
+#endif
+#if ONEWIRE_LATENCY_STATS
+	txn_mark_start(onewire);
+#endif
+	reset_flag(onewire, FLAG_BIT_OPERATION);
+#if ONEWIRE_SPI_BACKEND
+	if (onewire->bus_interface == ONEWIRE_INTERFACE_SPI) {
+		reset_flag(onewire, FLAG_BYTE_RECEIVED);
+		for (uint8_t i = 0; i < 8; i++) {
+			onewire->spi_tx[i] = ONEWIRE_SPI_READ_FRAME;
+		}
+		spi_start(onewire, ONEWIRE_SPI_OPERATION_READ, 8);
+		return;
+	}
+#endif
+	if(!get_flag(onewire, FLAG_IS_SLAVE)){
+		onewire->bit_index = 0;
+		reset_flag(onewire, FLAG_BYTE_RECEIVED);
+		set_state(onewire, ONEWIRE_STATE_MASTER_READ_INIT);
+	}
+}
+
+// single write slot, used by search and by devices with bit level protocols
+void onewire_write_bit(OneWireDriver* onewire, uint8_t bit) {
+#if ONEWIRE_OP_RECORD
+	record_op(onewire, ONEWIRE_OP_WRITE_BIT, bit & 0x01);
+#endif
+#if ONEWIRE_LATENCY_STATS
+	txn_mark_start(onewire);
+#endif
+	set_flag(onewire, FLAG_BIT_OPERATION);
+#if ONEWIRE_SPI_BACKEND
+	if (onewire->bus_interface == ONEWIRE_INTERFACE_SPI) {
+		onewire->spi_tx[0] = (bit & 0x01) ? ONEWIRE_SPI_WRITE_1_FRAME : ONEWIRE_SPI_WRITE_0_FRAME;
+		spi_start(onewire, ONEWIRE_SPI_OPERATION_WRITE, 1);
+		return;
+	}
+#endif
+	onewire->tx_byte = bit & 0x01;
+	onewire->bit_index = 7; // last bit of byte, operation ends after one slot
+	set_write_init_state(onewire, bit);
+}
+
+// single read slot, result is taken with onewire_get_bit() when onewire_is_data_available()
+void onewire_read_bit(OneWireDriver* onewire) {
+#if ONEWIRE_OP_RECORD
+	record_op(onewire, ONEWIRE_OP_READ_BIT, 0);
+#endif
+#if ONEWIRE_LATENCY_STATS
+	txn_mark_start(onewire);
+#endif
+	set_flag(onewire, FLAG_BIT_OPERATION);
+#if ONEWIRE_SPI_BACKEND
+	if (onewire->bus_interface == ONEWIRE_INTERFACE_SPI) {
+		reset_flag(onewire, FLAG_BYTE_RECEIVED);
+		onewire->spi_tx[0] = ONEWIRE_SPI_READ_FRAME;
+		spi_start(onewire, ONEWIRE_SPI_OPERATION_READ_BIT, 1);
+		return;
+	}
+#endif
+	if(!get_flag(onewire, FLAG_IS_SLAVE)){
+		onewire->bit_index = 7;
+		reset_flag(onewire, FLAG_BYTE_RECEIVED);
+		set_state(onewire, ONEWIRE_STATE_MASTER_READ_INIT);
+	}
+}
+
+// read bit is shifted in as MSB of rx_byte
+uint8_t onewire_get_bit(OneWireDriver* onewire) {
+	reset_flag(onewire, FLAG_BYTE_RECEIVED);
+	return (onewire->rx_byte >> 7) & 0x01;
+}
+
+GPIO_PinState onewire_get_bus_level(OneWireDriver* onewire){
+#if ONEWIRE_SPI_BACKEND
+	if (onewire->bus_interface == ONEWIRE_INTERFACE_SPI) {
+		return GPIO_PIN_SET; // bus is sampled only by SPI during slots, report idle level
+	}
+#endif
+	if (onewire->bus_interface == ONEWIRE_INTERFACE_SINGLE_PIN) {
+		// input data register follows line in open-drain output mode too, pin is not switched to input
+		// so level can be polled while slot is driven without releasing bus
+		return HAL_GPIO_ReadPin(onewire->Port, onewire->Pin);
+	}
+	return read_pin(onewire);
 }
 
 uint8_t onewire_is_data_available(OneWireDriver* onewire){
@@ -466,3 +1779,65 @@ uint8_t onewire_get_byte(OneWireDriver* onewire){
 	reset_flag(onewire, FLAG_BYTE_RECEIVED);
 	return onewire->rx_byte;
 }
+
+void onewire_crc8_reset(OneWireDriver* onewire){
+	onewire->crc8 = 0;
+}
+
+uint8_t onewire_get_crc8(OneWireDriver* onewire){
+	return onewire->crc8;
+}
+
+// Dallas CRC8 of ROM and scratchpad, crc starts at 0 and is 0 after data including its CRC byte
+uint8_t onewire_crc8_update(uint8_t crc, uint8_t data) {
+	return crc8_table[crc ^ data];
+}
+
+uint16_t onewire_crc16_update(uint16_t crc, uint8_t data) {
+	uint16_t value = (data ^ (crc & 0xFF)) & 0xFF;
+
+	crc >>= 8;
+	if (crc16_odd_parity[value & 0x0F] ^ crc16_odd_parity[value >> 4]) {
+		crc ^= 0xC001;
+	}
+	value <<= 6;
+	crc ^= value;
+	value <<= 1;
+	crc ^= value;
+	return crc;
+}
+
+// memory map is served after next reset, NULL returns slave to raw byte mode
+void onewire_slave_set_memory(OneWireDriver* onewire, OneWireSlaveMemory* memory) {
+	if (memory != NULL) {
+		memory->front = 0;
+		memory->publish_pending = 0;
+		memory->alarm = 0;
+	}
+	onewire->slave_memory = memory;
+	onewire->slave_phase = ONEWIRE_SLAVE_PHASE_IGNORE;
+}
+
+// returns scratchpad buffer application can fill, NULL while previously published buffer is not yet taken.
+// Published buffer can be swapped to front by next Read Scratchpad at any time, so it is never handed out again
+uint8_t* onewire_slave_get_scratchpad_buffer(OneWireDriver* onewire) {
+	OneWireSlaveMemory* memory = onewire->slave_memory;
+
+	if (memory == NULL || memory->publish_pending) {
+		return NULL;
+	}
+	return memory->scratchpad[memory->front ^ 1];
+}
+
+void onewire_slave_publish_scratchpad(OneWireDriver* onewire) {
+	if (onewire->slave_memory != NULL) {
+		onewire->slave_memory->publish_pending = 1;
+	}
+}
+
+// alarm condition is evaluated by application, slave only reads cached flag when Alarm Search command arrives
+void onewire_slave_set_alarm(OneWireDriver* onewire, uint8_t active) {
+	if (onewire->slave_memory != NULL) {
+		onewire->slave_memory->alarm = active ? 1 : 0;
+	}
+}
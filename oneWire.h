@@ -103,10 +103,14 @@
  extern "C" {
 #endif
 
-#include <stdint.h>
-#include <stdbool.h>
+#ifdef ONEWIRE_PORT_LINUX
+#include "oneWirePortLinux.h"   // first, it selects POSIX interfaces before any system header
+#else
 #include "FreeRTOS.h"
 #include "stm32f3xx_hal.h"
+#endif
+#include <stdint.h>
+#include <stdbool.h>
 
  // Select speed mode
  #define ONEWIRE_STANDARD_SPEED   1
@@ -116,21 +120,19 @@
  #define ONEWIRE_SPEED_MODE       ONEWIRE_STANDARD_SPEED
 //  #define ONEWIRE_SPEED_MODE       ONEWIRE_OVERDRIVE_SPEED
 
- #if (ONEWIRE_SPEED_MODE == ONEWIRE_STANDARD_SPEED)
+ // Both timings are available at runtime, ONEWIRE_SPEED_MODE selects timing used after init
 
  // Standard Speed Delays (in microseconds)
- #define WRITE_1_LOW_DELAY        	6     // A time of low puls for write 1
- #define WRITE_1_RELEASE_BUS_DELAY  64    // B time of high puls for write 1
- #define WRITE_0_LOW_DELAY        	60    // C time of low puls for write 0
- #define WRITE_0_RELEASE_BUS_DELAY  10    // D time of high puls for write 0
- #define READ_RELEASE_BUS_DELAY     9     // E time where bus state is ignores during read operation, stabilization time 
- #define READ_SAMPLE_DELAY          55    // F time when bus is read for read operation
- #define RESET_INIT_DELAY         	0     // G time where bus state is ignores before reset operation, stabilization time 
- #define RESET_DRIVE_BUS_LOW_DELAY 	480   // H time low puls of reset signal
- #define RESET_RELEASE_BUS_DELAY  	70    // I time where bus state is ignores during reset operation, stabilization time 
- #define RESET_SAMPLE_BUS_DELAY   	410   // J time where bus state is read for reset operation, expecting sleave to pull down line for acknowledge presence 
-
- #else // Overdrive Speed
+ #define STANDARD_WRITE_1_LOW_DELAY        	6     // A time of low puls for write 1
+ #define STANDARD_WRITE_1_RELEASE_BUS_DELAY  64    // B time of high puls for write 1
+ #define STANDARD_WRITE_0_LOW_DELAY        	60    // C time of low puls for write 0
+ #define STANDARD_WRITE_0_RELEASE_BUS_DELAY  10    // D time of high puls for write 0
+ #define STANDARD_READ_RELEASE_BUS_DELAY     9     // E time where bus state is ignores during read operation, stabilization time 
+ #define STANDARD_READ_SAMPLE_DELAY          55    // F time when bus is read for read operation
+ #define STANDARD_RESET_INIT_DELAY         	0     // G time where bus state is ignores before reset operation, stabilization time 
+ #define STANDARD_RESET_DRIVE_BUS_LOW_DELAY 	480   // H time low puls of reset signal
+ #define STANDARD_RESET_RELEASE_BUS_DELAY  	70    // I time where bus state is ignores during reset operation, stabilization time 
+ #define STANDARD_RESET_SAMPLE_BUS_DELAY   	410   // J time where bus state is read for reset operation, expecting sleave to pull down line for acknowledge presence 
 
 //  // Overdrive Speed Delays (in microseconds)
 //  #define WRITE_1_LOW_DELAY        	1     // A time of low puls for write 1
@@ -145,18 +147,135 @@
 //  #define RESET_SAMPLE_BUS_DELAY   	40    // J time where bus state is read for reset operation, expecting sleave to pull down line for acknowledge presence 
 
 // Overdrive Speed Delays (in microseconds)
- #define WRITE_1_LOW_DELAY        	1     // (A) time of low puls for write 1
- #define WRITE_1_RELEASE_BUS_DELAY  7   // (B) time of high puls for write 1
- #define WRITE_0_LOW_DELAY        	7   // (C) time of low puls for write 0
- #define WRITE_0_RELEASE_BUS_DELAY  2   // (D) time of high puls for write 0
- #define READ_RELEASE_BUS_DELAY     1     // (E) time where bus state is ignores during read operation, stabilization time 
- #define READ_SAMPLE_DELAY          7     // (F) time when bus is read for read operation
- #define RESET_INIT_DELAY         	2   // (G) time where bus state is ignores before reset operation, stabilization time 
- #define RESET_DRIVE_BUS_LOW_DELAY 	70    // (H) time low puls of reset signal
- #define RESET_RELEASE_BUS_DELAY  	8   // (I) time where bus state is ignores during reset operation, stabilization time 
- #define RESET_SAMPLE_BUS_DELAY   	40    // (J) time where bus state is read for reset operation, expecting sleave to pull down line for acknowledge presence 
+ #define OVERDRIVE_WRITE_1_LOW_DELAY        	1     // (A) time of low puls for write 1
+ #define OVERDRIVE_WRITE_1_RELEASE_BUS_DELAY  7   // (B) time of high puls for write 1
+ #define OVERDRIVE_WRITE_0_LOW_DELAY        	7   // (C) time of low puls for write 0
+ #define OVERDRIVE_WRITE_0_RELEASE_BUS_DELAY  2   // (D) time of high puls for write 0
+ #define OVERDRIVE_READ_RELEASE_BUS_DELAY     1     // (E) time where bus state is ignores during read operation, stabilization time 
+ #define OVERDRIVE_READ_SAMPLE_DELAY          7     // (F) time when bus is read for read operation
+ #define OVERDRIVE_RESET_INIT_DELAY         	2   // (G) time where bus state is ignores before reset operation, stabilization time 
+ #define OVERDRIVE_RESET_DRIVE_BUS_LOW_DELAY 	70    // (H) time low puls of reset signal
+ #define OVERDRIVE_RESET_RELEASE_BUS_DELAY  	8   // (I) time where bus state is ignores during reset operation, stabilization time 
+ #define OVERDRIVE_RESET_SAMPLE_BUS_DELAY   	40    // (J) time where bus state is read for reset operation, expecting sleave to pull down line for acknowledge presence 
+
+
 
+// SPI slot generator backend, SPI peripheral with DMA shifts out one 1-Wire slot per SPI frame.
+// MOSI drives open-drain buffer, MISO samples bus. SPI has to be configured as 8 bit, MSB first
+// with bit clock of ONEWIRE_SPI_BIT_TIME_US (~115.2 kHz for standard speed) so one frame lasts one slot.
+#ifndef ONEWIRE_SPI_BACKEND
+ #define ONEWIRE_SPI_BACKEND      0
+#endif
+
+#if ONEWIRE_SPI_BACKEND && defined(ONEWIRE_PORT_LINUX)
+ #error "SPI backend is available only on STM32"
+#endif
+
+#if ONEWIRE_SPI_BACKEND
+ #define ONEWIRE_SPI_BIT_TIME_US          8.68  // duration of one SPI bit, frame of 8 bits is one slot
+ #define ONEWIRE_SPI_WRITE_1_FRAME        0x7F  // 1 bit low (A), 7 bits released (B)
+ #define ONEWIRE_SPI_WRITE_0_FRAME        0x01  // 7 bits low (C), 1 bit released (D)
+ #define ONEWIRE_SPI_READ_FRAME           0x7F  // same as write 1, slave holds line low for 0
+ #define ONEWIRE_SPI_READ_SAMPLE_MASK     0x40  // MISO bit sampled after A+E
+ #define ONEWIRE_SPI_RESET_LOW_FRAMES     7     // frames of 0x00, ~486us low (H)
+ #define ONEWIRE_SPI_RESET_RELEASE_FRAMES 6     // frames of 0xFF, ~417us released (I+J)
+ #define ONEWIRE_SPI_PRESENCE_FIRST_FRAME 1     // first released frame where presence is sampled, skips I
+ #define ONEWIRE_SPI_BUFFER_SIZE          (ONEWIRE_SPI_RESET_LOW_FRAMES + ONEWIRE_SPI_RESET_RELEASE_FRAMES)
+ // streaming read, SPI DMA has to be in circular mode, each half of buffer holds this many bytes
+ #ifndef ONEWIRE_SPI_STREAM_BYTES
+  #define ONEWIRE_SPI_STREAM_BYTES        8
  #endif
+ #define ONEWIRE_SPI_STREAM_FRAMES        (2 * 8 * ONEWIRE_SPI_STREAM_BYTES)
+#endif
+
+
+// Slot trace, every state change, bus drive and sample decision is reported to trace hook,
+// recorded transcripts can be compared against golden transcripts on host build
+#ifndef ONEWIRE_TRACE
+ #define ONEWIRE_TRACE            0
+#endif
+
+// Black-box recorder, last ONEWIRE_BLACKBOX_SIZE trace events of each bus are kept in ring that is
+// frozen when driver enters error state, few hundred events cover whole failed transaction (0 disables)
+#ifndef ONEWIRE_BLACKBOX_SIZE
+ #define ONEWIRE_BLACKBOX_SIZE    0
+#endif
+#if ONEWIRE_BLACKBOX_SIZE > 0
+ #if !ONEWIRE_TRACE
+  #error "ONEWIRE_BLACKBOX_SIZE requires ONEWIRE_TRACE"
+ #endif
+ // exported blob, little endian:
+ //   header  'O' 'W' 'B' version, uint16 event count, uint8 frozen, uint8 reserved, uint32 first event tick
+ //   events  oldest first, uint16 ticks since previous event (saturated), uint8 state, uint8 type << 1 | level
+ #define ONEWIRE_BLACKBOX_VERSION       1
+ #define ONEWIRE_BLACKBOX_HEADER_SIZE   12
+ #define ONEWIRE_BLACKBOX_EVENT_SIZE    4
+ #define ONEWIRE_BLACKBOX_EXPORT_SIZE   (ONEWIRE_BLACKBOX_HEADER_SIZE + ONEWIRE_BLACKBOX_EVENT_SIZE * ONEWIRE_BLACKBOX_SIZE)
+#endif
+
+
+// Time source for all driver delays, can be replaced from build flags (hardware us timer,
+// host harness clock driven by timerfd thread, ...)
+#ifndef ONEWIRE_GET_TICK
+ #define ONEWIRE_GET_TICK()       xTaskGetTickCount()
+#endif
+#ifndef ONEWIRE_TICK_RATE_HZ
+ #define ONEWIRE_TICK_RATE_HZ     configTICK_RATE_HZ
+#endif
+
+
+// Bus utilization and CPU cost accounting, bus occupancy and cycles spent in driver are summed over
+// windows of ONEWIRE_STATS_WINDOW_MS and folded into rolling averages
+#ifndef ONEWIRE_BUS_STATS
+ #define ONEWIRE_BUS_STATS        0
+#endif
+#if ONEWIRE_BUS_STATS
+ #ifndef ONEWIRE_STATS_WINDOW_MS
+  #define ONEWIRE_STATS_WINDOW_MS       100
+ #endif
+ #define ONEWIRE_STATS_WINDOW_TICKS     ((TickType_t)((uint64_t)ONEWIRE_STATS_WINDOW_MS * ONEWIRE_TICK_RATE_HZ / 1000))
+ #define ONEWIRE_STATS_EWMA_SHIFT       3   // new window has weight 1/8 in rolling average
+ #define ONEWIRE_STATS_FULL_SCALE       10000   // utilization of 100 %
+ // free running cycle counter, DWT counter has to be enabled (done in onewire_init functions)
+ #ifndef ONEWIRE_GET_CYCLES
+  #define ONEWIRE_GET_CYCLES()          (DWT->CYCCNT)
+ #endif
+#endif
+
+
+// Transaction latency histograms, application brackets each transaction with onewire_txn_submit(),
+// onewire_txn_start() and onewire_txn_complete() on its own OneWireTxnStats, start on bus is taken from
+// first reset or byte operation after onewire_txn_start()
+#ifndef ONEWIRE_LATENCY_STATS
+ #define ONEWIRE_LATENCY_STATS    0
+#endif
+#if ONEWIRE_LATENCY_STATS
+ #ifndef ONEWIRE_LATENCY_BUCKETS
+  #define ONEWIRE_LATENCY_BUCKETS       16  // bucket n counts latencies from 2^n to 2^(n+1)-1 ticks
+ #endif
+#endif
+
+
+// Operation recorder, reset, bit, byte, speed and transaction calls of master are stored with their tick
+// into application buffer, exported stream is replayed by oneWireReplay.c on host or bench unit
+#ifndef ONEWIRE_OP_RECORD
+ #define ONEWIRE_OP_RECORD        0
+#endif
+
+
+// Hot-plug monitor, EXTI on edges of master bus calls onewire_idle_*_edge_irq(), low pulse of
+// presence width seen while master is idle is presence pulse of newly powered device and marks bus dirty
+#ifndef ONEWIRE_HOTPLUG
+ #define ONEWIRE_HOTPLUG          0
+#endif
+#if ONEWIRE_HOTPLUG
+ #ifndef ONEWIRE_HOTPLUG_MIN_PULSE
+  #define ONEWIRE_HOTPLUG_MIN_PULSE     30  // us, tPDL minimum is 60 us, margin for edge interrupt latency
+ #endif
+ #ifndef ONEWIRE_HOTPLUG_MAX_PULSE
+  #define ONEWIRE_HOTPLUG_MAX_PULSE     300 // us, tPDL maximum is 240 us, longer pulse is short or reset
+ #endif
+#endif
 
 
 #define SEARCH_ROM 0xf0
@@ -164,6 +283,13 @@
 #define MATCH_ROM 0x55
 #define SKIP_ROM 0xcc
 #define ALARM_SEARCH 0xec
+#define OVERDRIVE_SKIP_ROM 0x3c
+#define OVERDRIVE_MATCH_ROM 0x69
+
+// function commands served by slave memory map
+#define WRITE_SCRATCHPAD 0x4e
+#define READ_SCRATCHPAD 0xbe
+#define READ_MEMORY 0xf0
 
 
 
@@ -208,15 +334,19 @@ typedef enum {
     ONEWIRE_STATE_MASTER_READ_SAMPLE_BUS,
     ONEWIRE_STATE_MASTER_READ_DONE,
     // Slave Read
-    ONEWIRE_STATE_SLAVE_READ_INIT,              // 0
-    ONEWIRE_STATE_SLAVE_READ_MONITOR_BUS,       // 1
-    ONEWIRE_STATE_SLAVE_READ_RELEASE_BUS,       // 2
-    ONEWIRE_STATE_SLAVE_READ_SAMPLE_BUS,        // 3
-    ONEWIRE_STATE_SLAVE_READ_DELAY_BUS,         // 4
-    ONEWIRE_STATE_SLAVE_RESET_MONITOR_BUS,      // 5
-    ONEWIRE_STATE_SLAVE_RESET_RELEASE_BUS,      // 6
-    ONEWIRE_STATE_SLAVE_RESET_SAMPLE_BUS,       // 7
-    ONEWIRE_STATE_SLAVE_READ_DONE,              // 8
+    ONEWIRE_STATE_SLAVE_READ_INIT,              // 0 wait for falling edge
+    ONEWIRE_STATE_SLAVE_READ_MONITOR_BUS,       // 1 bus low, pulse width is classified on rising edge
+    ONEWIRE_STATE_SLAVE_RESET_RELEASE_BUS,      // 2 reset recognised, wait before presence
+    ONEWIRE_STATE_SLAVE_PRESENCE_DRIVE_BUS_LOW, // 3 presence pulse
+    ONEWIRE_STATE_SLAVE_READ_DONE,              // 4
+    // Slave Write
+    ONEWIRE_STATE_SLAVE_WRITE_INIT,
+    ONEWIRE_STATE_SLAVE_WRITE_DRIVE_BUS_LOW,
+    ONEWIRE_STATE_SLAVE_WRITE_RELEASE_BUS,
+    ONEWIRE_STATE_SLAVE_WRITE_DONE,
+    // SPI backend
+    ONEWIRE_STATE_SPI_TRANSFER,
+    ONEWIRE_STATE_SPI_STREAM,
 } OneWireState;
 
 typedef enum {
@@ -225,31 +355,324 @@ typedef enum {
     FLAG_BYTE_RECEIVED,         // set high when all 8 bit-s from rx_byte are send over bus
     FLAG_BYTE_SEND,             // set high when all 8 bit-s from tx_byte are send over bus
     FLAG_IS_SLAVE,              // is driver set to act as onewire slave
+    FLAG_OVERDRIVE,             // overdrive timing is used
+    FLAG_BIT_OPERATION,         // master reads or writes single slot, used by search
 } OneWireFlags;
 
+// slave protocol position, used when memory map is attached
+typedef enum {
+    ONEWIRE_SLAVE_PHASE_ROM_COMMAND,        // next received byte is first after reset
+    ONEWIRE_SLAVE_PHASE_MATCH_ROM,          // receiving ROM id from master
+    ONEWIRE_SLAVE_PHASE_FUNCTION_COMMAND,   // device is selected, waiting for function command
+    ONEWIRE_SLAVE_PHASE_READ_MEMORY_ADDRESS,// receiving TA1, TA2 of Read Memory
+    ONEWIRE_SLAVE_PHASE_WRITE_SCRATCHPAD,   // receiving Write Scratchpad data
+    ONEWIRE_SLAVE_PHASE_TRANSMIT,           // sending data followed by inverted CRC16
+    ONEWIRE_SLAVE_PHASE_SEARCH,             // taking part in Search ROM or Alarm Search
+    ONEWIRE_SLAVE_PHASE_RAW,                // no memory map, bytes are handed to application
+    ONEWIRE_SLAVE_PHASE_IGNORE              // not selected or transaction finished, wait for reset
+}OneWireSlavePhase;
+
 typedef enum {
     OPERATING_MODE_MASTER,
     OPERATING_MODE_SLAVE
 }OneWireOperatingMode;
 
 
+typedef enum {
+    ONEWIRE_INTERFACE_SINGLE_PIN,   // one open-drain pin, switched between output and input
+    ONEWIRE_INTERFACE_DUAL_PIN,     // Pin drives external transistor (high = bus low), RxPin senses bus
+    ONEWIRE_INTERFACE_SPI,          // slots are generated by SPI peripheral with DMA, master mode only
+    ONEWIRE_INTERFACE_CUSTOM        // bus is accessed through OneWireBusOps (Linux GPIO character device, ...)
+}OneWireInterface;
+
+// backend interface for ONEWIRE_INTERFACE_CUSTOM, context is passed back unchanged
+typedef struct {
+    void (*drive_low)(void* context);           // pull bus low
+    void (*release)(void* context);             // release bus, pull-up brings it high
+    GPIO_PinState (*read)(void* context);       // sample bus level
+} OneWireBusOps;
+
+typedef enum {
+    ONEWIRE_SPI_OPERATION_RESET,
+    ONEWIRE_SPI_OPERATION_WRITE,
+    ONEWIRE_SPI_OPERATION_READ,
+    ONEWIRE_SPI_OPERATION_READ_BIT
+}OneWireSpiOperation;
+
+
+// slot and reset timing in microseconds, letters refer to timing table above
 typedef struct {
-    uint32_t Pin;                   // GPIO pin used for OneWire communication
+    uint16_t write_1_low_delay;             // A
+    uint16_t write_1_release_bus_delay;     // B
+    uint16_t write_0_low_delay;             // C
+    uint16_t write_0_release_bus_delay;     // D
+    uint16_t read_release_bus_delay;        // E
+    uint16_t read_sample_delay;             // F
+    uint16_t reset_init_delay;              // G
+    uint16_t reset_drive_bus_low_delay;     // H
+    uint16_t reset_release_bus_delay;       // I
+    uint16_t reset_sample_bus_delay;        // J
+} OneWireTiming;
+
+typedef struct OneWireDriver OneWireDriver;
+
+// called when master wrote whole write_buffer with Write Scratchpad, CRC16 is send after it
+typedef void (*OneWireSlaveWriteCallback)(OneWireDriver* onewire, uint8_t length, void* context);
+
+// Slave memory map, all buffers are owned by application and served without copying.
+// Application fills back scratchpad buffer and publishes it, buffers are swapped only at start of
+// Read Scratchpad command so master never observes torn frame.
+typedef struct {
+    uint8_t rom[8];                             // family code, 48 bit serial, CRC8
+    uint8_t* scratchpad[2];                     // double buffer served by Read Scratchpad
+    uint8_t scratchpad_size;
+    uint8_t* write_buffer;                      // filled by Write Scratchpad
+    uint8_t write_buffer_size;
+    const uint8_t* memory;                      // pages served by Read Memory
+    uint16_t memory_size;
+    OneWireSlaveWriteCallback write_callback;   // can be NULL
+    void* context;                              // passed to write_callback
+    volatile uint8_t front;                     // index of scratchpad buffer served to master
+    volatile uint8_t publish_pending;           // back buffer is published, waits for swap
+    volatile uint8_t alarm;                     // device answers Alarm Search while set
+} OneWireSlaveMemory;
+
+typedef enum {
+    ONEWIRE_TRACE_STATE,            // state changed, level is bus level driven by master
+    ONEWIRE_TRACE_DRIVE,            // bus pulled low or released
+    ONEWIRE_TRACE_SAMPLE            // bit or presence decision, level is decided bus level
+}OneWireTraceType;
+
+typedef struct {
+    TickType_t timestamp;           // tick when event happened
+    uint8_t type;                   // OneWireTraceType
+    uint8_t state;                  // OneWireState after event
+    uint8_t level;                  // GPIO_PinState, meaning depends on type
+} OneWireTraceEvent;
+
+typedef struct {
+    uint32_t deadline_count;        // number of expired delays
+    uint32_t total_lateness;        // sum of ticks between delay expiration and onewire_process() noticing it
+    TickType_t max_lateness;        // worst observed lateness
+} OneWireJitterStats;
+
+typedef struct {
+    uint32_t errors;                // entries to error state
+    uint32_t missing_presence;      // master resets without presence pulse
+} OneWireErrorCounters;
+
+typedef struct {
+    uint16_t utilization;           // rolling average of time bus is occupied by slots or resets, 1/10000 of wall time
+    uint16_t last_utilization;      // utilization of last completed window
+    uint32_t cpu_cycles;            // rolling average of cycles spent in onewire_process() and interrupt calls per window
+    uint32_t last_cpu_cycles;       // cycles of last completed window
+    uint32_t window_count;          // number of completed windows
+} OneWireBusStats;
+
+typedef enum {
+    ONEWIRE_TXN_READ_ROM,
+    ONEWIRE_TXN_SEARCH,
+    ONEWIRE_TXN_READ_SCRATCHPAD,
+    ONEWIRE_TXN_WRITE_EEPROM,
+    ONEWIRE_TXN_OTHER,
+    ONEWIRE_TXN_TYPE_COUNT
+}OneWireTxnType;
+
+typedef enum {
+    ONEWIRE_OP_RESET,               // data unused
+    ONEWIRE_OP_WRITE_BYTE,          // data is written byte
+    ONEWIRE_OP_READ_BYTE,           // data unused, read value is not part of workload
+    ONEWIRE_OP_SET_SPEED,           // data is speed mode
+    ONEWIRE_OP_TXN_SUBMIT,          // data is OneWireTxnType
+    ONEWIRE_OP_TXN_COMPLETE,        // data is success
+    ONEWIRE_OP_WRITE_BIT,           // data is written bit
+    ONEWIRE_OP_READ_BIT,            // data unused
+    ONEWIRE_OP_TXN_START            // data unused
+}OneWireRecordedOp;
+
+#if ONEWIRE_OP_RECORD
+typedef struct {
+    TickType_t tick;                // tick of API call
+    uint8_t op;                     // OneWireRecordedOp
+    uint8_t data;
+} OneWireOpRecord;
+
+// ring of last capacity operations, records buffer is owned by application
+typedef struct {
+    OneWireOpRecord* records;
+    uint16_t capacity;
+    uint16_t head;                  // index where next record is stored
+    uint16_t count;                 // valid records
+    uint32_t overwritten;           // oldest records lost because ring was full
+} OneWireOpRecorder;
+#endif
+
+#if ONEWIRE_LATENCY_STATS
+typedef struct {
+    uint32_t queue_delay[ONEWIRE_LATENCY_BUCKETS];  // submit to start on bus, bucket 0 also counts 0 ticks
+    uint32_t service_time[ONEWIRE_LATENCY_BUCKETS]; // start on bus to completion
+    uint32_t count;                 // completed transactions
+    uint32_t failed;                // transactions completed with error
+} OneWireLatencyHistogram;
+
+// timing of one transaction, owned by caller or scheduler so queued transactions do not overwrite each other
+typedef struct {
+    TickType_t submit_tick;
+    TickType_t start_tick;
+    uint8_t type;                   // OneWireTxnType
+    uint8_t phase;                  // 0 none, 1 submitted, 2 running on bus
+} OneWireTxnStats;
+#endif
+
+typedef void (*OneWireTraceHook)(OneWireDriver* onewire, const OneWireTraceEvent* event, void* context);
+
+// called from DMA half/full transfer interrupt with decoded bytes of streaming read
+typedef void (*OneWireStreamCallback)(OneWireDriver* onewire, const uint8_t* data, uint8_t length, void* context);
+
+struct OneWireDriver {
+    uint32_t Pin;                   // GPIO pin used for OneWire communication (TX pin in dual pin mode)
     GPIO_TypeDef* Port;             // GPIO port used for OneWire communication 
+    uint32_t RxPin;                 // GPIO pin used to sense bus, same as Pin in single pin mode
+    GPIO_TypeDef* RxPort;           // GPIO port used to sense bus, same as Port in single pin mode
+    OneWireInterface bus_interface; // how bus is driven and sensed
+    const OneWireBusOps* bus_ops;   // backend used with ONEWIRE_INTERFACE_CUSTOM
+    void* bus_context;              // passed to bus_ops
     OneWireState state;             // Current state
-    uint8_t tx_byte;                // Byte to transmit
+    uint8_t tx_byte;                // Byte to transmit, shifted right after each send bit
     uint8_t rx_byte;                // Byte received
     uint8_t bit_index;              // Bit position (0–7)
+    GPIO_PinState sampled_bus_bit;  // bus level sampled in current read slot, reset to GPIO_PIN_SET after each bit
     TickType_t timestamp;           // For non-blocking delays
+    TickType_t edge_timestamp;      // slave, tick of last falling edge, low pulse width is measured from it
+    const OneWireTiming* timing;    // standard or overdrive timing
+    OneWireSlaveMemory* slave_memory;           // NULL for raw byte slave
+    OneWireSlavePhase slave_phase;              // protocol position of slave
+    OneWireSlavePhase slave_phase_after_tx;     // phase entered after transmit is finished
+    const uint8_t* slave_tx_data;               // data send in ONEWIRE_SLAVE_PHASE_TRANSMIT
+    uint16_t slave_tx_length;
+    uint16_t slave_offset;                      // position in received or transmitted data
+    uint16_t slave_address;                     // Read Memory target address
+    uint8_t slave_tx_crc_bytes;                 // CRC16 bytes left to send after data
+    uint8_t slave_search_slot;                  // search, 0 ROM bit, 1 complement, 2 master direction
+    uint16_t crc16;                             // running CRC16 of slave transaction
     uint8_t flag_reg;               // error flags defined in OneWireFlags
-} OneWireDriver;
+    uint8_t crc8;                   // running CRC8 of received bytes, 0 after valid CRC byte is received
+    GPIO_PinState driven_level;     // last level driven by pull_low()/pull_high()
+    OneWireJitterStats jitter;      // scheduling induced slot timing error
+    OneWireErrorCounters errors;
+#if ONEWIRE_BUS_STATS
+    OneWireBusStats bus_stats;
+    TickType_t stats_window_start;  // tick when current window started
+    TickType_t busy_start;          // tick when bus became occupied or window started
+    uint32_t window_busy_ticks;     // bus occupied ticks in current window
+    uint32_t window_cycles;         // driver cycles in current window
+    uint32_t utilization_sum;       // rolling averages scaled by 2^ONEWIRE_STATS_EWMA_SHIFT
+    uint64_t cpu_cycles_sum;
+#endif
+#if ONEWIRE_LATENCY_STATS
+    OneWireLatencyHistogram latency[ONEWIRE_TXN_TYPE_COUNT];
+    OneWireTxnStats* txn_active;    // transaction that owns bus, its next operation ends queueing delay
+#endif
+#if ONEWIRE_OP_RECORD
+    OneWireOpRecorder* op_recorder; // NULL when recording is off
+#endif
+#if ONEWIRE_HOTPLUG
+    TickType_t idle_edge_timestamp; // falling edge seen on idle bus
+    volatile uint8_t idle_edge_armed;   // falling edge was seen while master was idle
+    volatile uint8_t hotplug_dirty; // presence pulse seen, device list has to be searched
+    uint32_t hotplug_pulses;        // spontaneous presence pulses seen
+#endif
+#if ONEWIRE_TRACE
+    OneWireTraceHook trace_hook;    // called for every traced event, NULL when tracing is off
+    void* trace_context;            // passed to trace_hook
+#endif
+#if ONEWIRE_BLACKBOX_SIZE > 0
+    OneWireTraceEvent blackbox[ONEWIRE_BLACKBOX_SIZE];  // ring of last trace events
+    uint16_t blackbox_head;         // index where next event is stored
+    uint16_t blackbox_count;        // valid events in ring
+    volatile uint8_t blackbox_frozen;   // ring is kept until onewire_blackbox_rearm()
+#endif
+#if ONEWIRE_SPI_BACKEND
+    SPI_HandleTypeDef* hspi;        // SPI used for slot generation
+    OneWireSpiOperation spi_operation;              // operation that is currently shifted out
+    uint8_t spi_tx[ONEWIRE_SPI_BUFFER_SIZE];        // encoded slot frames
+    uint8_t spi_rx[ONEWIRE_SPI_BUFFER_SIZE];        // bus samples received on MISO
+    OneWireStreamCallback stream_callback;          // receives decoded bytes of streaming read
+    void* stream_context;                           // passed to stream_callback
+    uint8_t stream_tx[ONEWIRE_SPI_STREAM_FRAMES];   // read slot frames, shifted out circularly
+    uint8_t stream_rx[ONEWIRE_SPI_STREAM_FRAMES];   // two halves of bus samples
+    uint8_t stream_data[ONEWIRE_SPI_STREAM_BYTES];  // decoded bytes of last completed half
+#endif
+};
 
 
 void onewire_init(OneWireDriver* onewire, GPIO_TypeDef* port, uint32_t pin, OneWireOperatingMode mode);
+void onewire_init_dual_pin(OneWireDriver* onewire, GPIO_TypeDef* tx_port, uint32_t tx_pin, GPIO_TypeDef* rx_port, uint32_t rx_pin, OneWireOperatingMode mode);
+void onewire_init_custom(OneWireDriver* onewire, const OneWireBusOps* ops, void* context, OneWireOperatingMode mode);
+#if ONEWIRE_SPI_BACKEND
+void onewire_init_spi(OneWireDriver* onewire, SPI_HandleTypeDef* hspi);
+void onewire_spi_stream_start(OneWireDriver* onewire, OneWireStreamCallback callback, void* context);
+void onewire_spi_stream_stop(OneWireDriver* onewire);
+void onewire_spi_stream_half_complete(OneWireDriver* onewire);
+void onewire_spi_stream_complete(OneWireDriver* onewire);
+#endif
 void onewire_process(OneWireDriver *onewire);
+void onewire_set_speed(OneWireDriver* onewire, uint8_t speed_mode);
+uint8_t onewire_is_overdrive(OneWireDriver* onewire);
+void onewire_slave_falling_edge_irq(OneWireDriver* onewire);
+void onewire_slave_rising_edge_irq(OneWireDriver* onewire);
+TickType_t onewire_get_next_event_delay(OneWireDriver* onewire);
+void onewire_get_jitter_stats(OneWireDriver* onewire, OneWireJitterStats* stats);
+void onewire_reset_jitter_stats(OneWireDriver* onewire);
+void onewire_get_error_counters(OneWireDriver* onewire, OneWireErrorCounters* counters);
+void onewire_reset_error_counters(OneWireDriver* onewire);
+#if ONEWIRE_BUS_STATS
+void onewire_get_bus_stats(OneWireDriver* onewire, OneWireBusStats* stats);
+void onewire_reset_bus_stats(OneWireDriver* onewire);
+#endif
+#if ONEWIRE_LATENCY_STATS
+void onewire_txn_submit(OneWireDriver* onewire, OneWireTxnStats* txn, OneWireTxnType type);
+void onewire_txn_start(OneWireDriver* onewire, OneWireTxnStats* txn);
+void onewire_txn_complete(OneWireDriver* onewire, OneWireTxnStats* txn, uint8_t success);
+void onewire_get_latency_histogram(OneWireDriver* onewire, OneWireTxnType type, OneWireLatencyHistogram* histogram);
+void onewire_reset_latency_stats(OneWireDriver* onewire);
+TickType_t onewire_latency_percentile(const uint32_t* buckets, uint8_t percent);
+#endif
+#if ONEWIRE_OP_RECORD
+void onewire_set_op_recorder(OneWireDriver* onewire, OneWireOpRecorder* recorder, OneWireOpRecord* records, uint16_t capacity);
+#endif
+#if ONEWIRE_HOTPLUG
+void onewire_idle_falling_edge_irq(OneWireDriver* onewire);
+void onewire_idle_rising_edge_irq(OneWireDriver* onewire);
+uint8_t onewire_hotplug_take(OneWireDriver* onewire);
+#endif
+#if ONEWIRE_TRACE
+void onewire_set_trace_hook(OneWireDriver* onewire, OneWireTraceHook hook, void* context);
+#endif
+#if ONEWIRE_BLACKBOX_SIZE > 0
+void onewire_blackbox_trigger(OneWireDriver* onewire);
+uint8_t onewire_blackbox_is_frozen(OneWireDriver* onewire);
+uint16_t onewire_blackbox_export(OneWireDriver* onewire, uint8_t* buffer, uint16_t size);
+void onewire_blackbox_rearm(OneWireDriver* onewire);
+#endif
+void onewire_reset(OneWireDriver* onewire);
+uint8_t onewire_is_slave_present(OneWireDriver* onewire);
 void onewire_write_byte(OneWireDriver* onewire, uint8_t data);
+void onewire_read_byte(OneWireDriver* onewire);
+void onewire_write_bit(OneWireDriver* onewire, uint8_t bit);
+void onewire_read_bit(OneWireDriver* onewire);
+uint8_t onewire_get_bit(OneWireDriver* onewire);
+GPIO_PinState onewire_get_bus_level(OneWireDriver* onewire);
 uint8_t onewire_is_data_available(OneWireDriver* onewire);
 uint8_t onewire_get_byte(OneWireDriver* onewire);
+void onewire_crc8_reset(OneWireDriver* onewire);
+uint8_t onewire_get_crc8(OneWireDriver* onewire);
+uint8_t onewire_crc8_update(uint8_t crc, uint8_t data);
+uint16_t onewire_crc16_update(uint16_t crc, uint8_t data);
+void onewire_slave_set_memory(OneWireDriver* onewire, OneWireSlaveMemory* memory);
+uint8_t* onewire_slave_get_scratchpad_buffer(OneWireDriver* onewire);
+void onewire_slave_publish_scratchpad(OneWireDriver* onewire);
+void onewire_slave_set_alarm(OneWireDriver* onewire, uint8_t active);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,353 @@
+/**
+ ******************************************************************************
+ * @file    oneWireAdc.c
+ * @brief   DS2438 battery monitor and DS2450 quad ADC sweeps on OneWire scheduler
+ *
+ * @details
+ *          Sweep queues broadcast convert commands, waits longest conversion
+ *          time of device types on bus after last command completed and then
+ *          queues reads of all devices at once. DS2438 needs Recall Memory
+ *          before Read Scratchpad, its read is trusted only when recall of
+ *          same sweep succeeded. DS2450 page read ends with CRC16 over
+ *          command, address and data.
+ *
+ *          DS2450 Convert is answered with CRC16 by every device, overlapped
+ *          answers of several devices are read but not checked.
+ *
+ *          Convert V is broadcast even next to DS18B20, for which it is Read
+ *          Power Supply answered only in read slots that never follow.
+ *
+ * @license MIT License
+ ******************************************************************************
+ */
+
+#include "oneWireAdc.h"
+#include "oneWireCoupler.h"
+#include <string.h>
+#ifndef ONEWIRE_PORT_LINUX
+#include "task.h"
+#endif
+
+#define MS_TO_TICKS(ms)         ((TickType_t)((uint64_t)(ms) * ONEWIRE_TICK_RATE_HZ / 1000))
+#define US_TO_TICKS(us)         ((TickType_t)((uint64_t)(us) * ONEWIRE_TICK_RATE_HZ / 1000000))
+
+
+/* Private function prototypes -----------------------------------------------*/
+static void submit(OneWireAdcSweep* sweep, OneWireTxn* txn, const uint8_t* tx, uint8_t tx_length, uint8_t* rx, uint8_t rx_length, OneWireTxnCallback callback, void* context);
+static uint8_t shares_convert_t(OneWireAdcSweep* sweep);
+static void start_convert(OneWireAdcSweep* sweep);
+static void convert_done(OneWireTxn* txn, OneWireTxnStatus status, void* context);
+static void start_reads(OneWireAdcSweep* sweep);
+static void read_done(OneWireTxn* txn, OneWireTxnStatus status, void* context);
+static uint8_t parse_ds2438(OneWireAdcDevice* device);
+static uint8_t parse_ds2450(OneWireAdcDevice* device);
+static uint8_t address(uint8_t* tx, const uint8_t* rom);
+
+
+static void submit(OneWireAdcSweep* sweep, OneWireTxn* txn, const uint8_t* tx, uint8_t tx_length, uint8_t* rx, uint8_t rx_length, OneWireTxnCallback callback, void* context) {
+	txn->tx = tx;
+	txn->tx_length = tx_length;
+	txn->rx = rx;
+	txn->rx_length = rx_length;
+	txn->reset = 1;
+	txn->branch = sweep->branch;
+	txn->callback = callback;
+	txn->context = context;
+	sweep->pending++;
+	onewire_scheduler_submit(sweep->scheduler, sweep->client, txn);
+}
+
+// other device on swept branch may start conversion on broadcast Convert T, prefetch entries
+// on trunk are reached from every branch
+static uint8_t shares_convert_t(OneWireAdcSweep* sweep) {
+	if (sweep->addressed) {
+		return 1;
+	}
+	for (OneWirePrefetch* prefetch = sweep->scheduler->prefetch; prefetch != NULL; prefetch = prefetch->next) {
+		OneWireBranch* branch = prefetch->branch;
+
+		if (prefetch->convert_command == DS2438_CONVERT_T && (branch == NULL || branch->coupler == NULL || branch == sweep->branch)) {
+			return 1;
+		}
+	}
+	if (sweep->branch != NULL) {
+		const OneWireDeviceTable* table = &sweep->branch->table;
+
+		for (uint8_t i = 0; i < table->count; i++) {
+			uint8_t family = table->devices[i].rom[0];
+
+			if (table->devices[i].present && family != DS2438_FAMILY_CODE && family != DS2450_FAMILY_CODE && family != DS2409_FAMILY_CODE) {
+				return 1;
+			}
+		}
+	}
+	return 0;
+}
+
+static void start_convert(OneWireAdcSweep* sweep) {
+	TickType_t ds2450_ticks = 0;
+	uint8_t inputs = 0;
+
+	sweep->state = ONEWIRE_ADC_SWEEP_CONVERT;
+	sweep->pending = 0;
+	sweep->failed = 0;
+	sweep->conversion_ticks = 0;
+	if (sweep->has_ds2438) {
+		// temperature sensor and A/D converter of DS2438 have own busy flags, both conversions overlap
+		if (shares_convert_t(sweep)) {
+			// read transaction of device is free until conversions end
+			for (OneWireAdcDevice* device = sweep->devices; device != NULL; device = device->next) {
+				if (device->rom[0] == DS2438_FAMILY_CODE) {
+					uint8_t length = address(device->tx[0], device->rom);
+
+					device->tx[0][length++] = DS2438_CONVERT_T;
+					submit(sweep, &device->txn[0], device->tx[0], length, NULL, 0, convert_done, sweep);
+				}
+			}
+		}
+		else {
+			sweep->convert_tx[0][0] = SKIP_ROM;
+			sweep->convert_tx[0][1] = DS2438_CONVERT_T;
+			submit(sweep, &sweep->convert[0], sweep->convert_tx[0], 2, NULL, 0, convert_done, sweep);
+		}
+		sweep->convert_tx[1][0] = SKIP_ROM;
+		sweep->convert_tx[1][1] = DS2438_CONVERT_V;
+		submit(sweep, &sweep->convert[1], sweep->convert_tx[1], 2, NULL, 0, convert_done, sweep);
+		sweep->conversion_ticks = MS_TO_TICKS(DS2438_CONVERSION_MS);
+	}
+	if (sweep->has_ds2450) {
+		sweep->convert_tx[2][0] = SKIP_ROM;
+		sweep->convert_tx[2][1] = DS2450_CONVERT;
+		sweep->convert_tx[2][2] = sweep->ds2450_mask;
+		sweep->convert_tx[2][3] = 0x00; // read-out control, results are not preset
+		// conversion starts after CRC16 was read
+		submit(sweep, &sweep->convert[2], sweep->convert_tx[2], 4, sweep->convert_rx, sizeof(sweep->convert_rx), convert_done, sweep);
+		for (uint8_t i = 0; i < 4; i++) {
+			inputs += (sweep->ds2450_mask >> i) & 1;
+		}
+		ds2450_ticks = US_TO_TICKS((uint32_t)inputs * 16 * DS2450_CONVERSION_BIT_US + DS2450_CONVERSION_OFFSET_US);
+		if (ds2450_ticks > sweep->conversion_ticks) {
+			sweep->conversion_ticks = ds2450_ticks;
+		}
+	}
+}
+
+static void convert_done(OneWireTxn* txn, OneWireTxnStatus status, void* context) {
+	OneWireAdcSweep* sweep = context;
+
+	(void)txn;
+	if (status != ONEWIRE_TXN_STATUS_OK) {
+		sweep->failed = 1;
+	}
+	if (--sweep->pending > 0) {
+		return;
+	}
+	if (sweep->failed) {
+		onewire_scheduler_power_release(sweep->scheduler, sweep->reserved);
+		sweep->reserved = 0;
+		sweep->state = ONEWIRE_ADC_SWEEP_IDLE; // retried on next period or request
+		return;
+	}
+	sweep->convert_tick = ONEWIRE_GET_TICK();
+	sweep->state = ONEWIRE_ADC_SWEEP_WAIT;
+}
+
+static void start_reads(OneWireAdcSweep* sweep) {
+	uint8_t length;
+
+	sweep->state = ONEWIRE_ADC_SWEEP_READ;
+	sweep->pending = 0;
+	for (OneWireAdcDevice* device = sweep->devices; device != NULL; device = device->next) {
+		if (device->rom[0] == DS2438_FAMILY_CODE) {
+			device->recalled = 0;
+			length = address(device->tx[0], device->rom);
+			device->tx[0][length++] = DS2438_RECALL_MEMORY;
+			device->tx[0][length++] = 0; // page 0 holds temperature, voltage and current
+			submit(sweep, &device->txn[0], device->tx[0], length, NULL, 0, read_done, device);
+			length = address(device->tx[1], device->rom);
+			device->tx[1][length++] = DS2438_READ_SCRATCHPAD;
+			device->tx[1][length++] = 0;
+			submit(sweep, &device->txn[1], device->tx[1], length, device->rx, 9, read_done, device);
+		}
+		else {
+			length = address(device->tx[0], device->rom);
+			device->tx[0][length++] = DS2450_READ_MEMORY;
+			device->tx[0][length++] = 0x00; // TA1, TA2 of conversion results A..D
+			device->tx[0][length++] = 0x00;
+			submit(sweep, &device->txn[0], device->tx[0], length, device->rx, 10, read_done, device);
+		}
+	}
+}
+
+static void read_done(OneWireTxn* txn, OneWireTxnStatus status, void* context) {
+	OneWireAdcDevice* device = context;
+	OneWireAdcSweep* sweep = device->owner;
+	uint8_t valid = 0;
+
+	if (txn == &device->txn[0] && device->rom[0] == DS2438_FAMILY_CODE) {
+		device->recalled = (status == ONEWIRE_TXN_STATUS_OK);
+	}
+	else {
+		if (status == ONEWIRE_TXN_STATUS_OK) {
+			// scratchpad without recall still holds page of previous sweep
+			valid = (device->rom[0] == DS2438_FAMILY_CODE) ? (device->recalled && parse_ds2438(device)) : parse_ds2450(device);
+#if ONEWIRE_BLACKBOX_SIZE > 0
+			if (!valid) {
+				onewire_blackbox_trigger(sweep->scheduler->onewire); // failed transactions were kept by scheduler
+			}
+#endif
+		}
+		if (valid) {
+			device->sweep = sweep->sweeps + 1;
+		}
+		else {
+			device->errors++;
+		}
+	}
+	if (--sweep->pending > 0) {
+		return;
+	}
+	sweep->sweeps++;
+	sweep->state = ONEWIRE_ADC_SWEEP_IDLE;
+	if (sweep->callback != NULL) {
+		sweep->callback(sweep, sweep->context);
+	}
+}
+
+static uint8_t parse_ds2438(OneWireAdcDevice* device) {
+	const uint8_t* page = device->rx;
+	uint8_t crc = 0;
+
+	for (uint8_t i = 0; i < 9; i++) {
+		crc = onewire_crc8_update(crc, page[i]);
+	}
+	if (crc != 0) {
+		return 0;
+	}
+	device->temperature = (int16_t)((page[2] << 8) | page[1]);
+	device->voltage = (uint16_t)((page[4] << 8) | page[3]);
+	device->current = (int16_t)((page[6] << 8) | page[5]);
+	return 1;
+}
+
+static uint8_t parse_ds2450(OneWireAdcDevice* device) {
+	const uint8_t* data = device->rx;
+	uint16_t crc = 0;
+
+	for (uint8_t i = 9; i < 12; i++) {
+		crc = onewire_crc16_update(crc, device->tx[0][i]); // command and address
+	}
+	for (uint8_t i = 0; i < 8; i++) {
+		crc = onewire_crc16_update(crc, data[i]);
+	}
+	crc = ~crc; // sent inverted
+	if (crc != (uint16_t)((data[9] << 8) | data[8])) {
+		return 0;
+	}
+	for (uint8_t i = 0; i < 4; i++) {
+		device->channel[i] = (uint16_t)((data[2 * i + 1] << 8) | data[2 * i]);
+	}
+	return 1;
+}
+
+static uint8_t address(uint8_t* tx, const uint8_t* rom) {
+	tx[0] = MATCH_ROM;
+	memcpy(&tx[1], rom, 8);
+	return 9;
+}
+
+// first sweep runs on first process call when period is not 0
+void onewire_adc_sweep_init(OneWireAdcSweep* sweep, OneWireScheduler* scheduler, OneWireClient* client, uint32_t period_ms) {
+	memset(sweep, 0, sizeof(*sweep));
+	sweep->scheduler = scheduler;
+	sweep->client = client;
+	sweep->ds2450_mask = 0x0F;
+	sweep->period = MS_TO_TICKS(period_ms);
+	sweep->requested = (period_ms != 0);
+	sweep->state = ONEWIRE_ADC_SWEEP_IDLE;
+}
+
+// returns -1 when family code of rom is not DS2438 or DS2450, device is read in order of adding
+int onewire_adc_sweep_add(OneWireAdcSweep* sweep, OneWireAdcDevice* device, const uint8_t* rom) {
+	OneWireAdcDevice** link = &sweep->devices;
+
+	if (rom[0] != DS2438_FAMILY_CODE && rom[0] != DS2450_FAMILY_CODE) {
+		return -1;
+	}
+	memset(device, 0, sizeof(*device));
+	memcpy(device->rom, rom, sizeof(device->rom));
+	device->owner = sweep;
+	while (*link != NULL) {
+		link = &(*link)->next;
+	}
+	*link = device;
+	if (rom[0] == DS2438_FAMILY_CODE) {
+		sweep->has_ds2438 = 1;
+	}
+	else {
+		sweep->has_ds2450 = 1;
+	}
+	return 0;
+}
+
+// broadcast reaches trunk and connected branch, devices of sweep must be on that branch
+void onewire_adc_sweep_set_branch(OneWireAdcSweep* sweep, OneWireBranch* branch) {
+	sweep->branch = branch;
+}
+
+// sum of conversion currents of all devices of sweep, they convert at same time
+void onewire_adc_sweep_set_current(OneWireAdcSweep* sweep, uint32_t current) {
+	sweep->current = current;
+}
+
+// Convert T with Match ROM for bus with temperature sensors read outside of scheduler prefetch
+void onewire_adc_sweep_set_addressed(OneWireAdcSweep* sweep, uint8_t addressed) {
+	sweep->addressed = addressed;
+}
+
+// inputs not in mask keep their last result, conversion time is shorter
+void onewire_adc_sweep_set_ds2450_mask(OneWireAdcSweep* sweep, uint8_t mask) {
+	sweep->ds2450_mask = mask & 0x0F;
+}
+
+void onewire_adc_sweep_set_callback(OneWireAdcSweep* sweep, OneWireAdcSweepCallback callback, void* context) {
+	sweep->context = context;
+	sweep->callback = callback;
+}
+
+// request during running sweep starts next sweep after it
+void onewire_adc_sweep_request(OneWireAdcSweep* sweep) {
+	sweep->requested = 1;
+}
+
+// call after onewire_scheduler_process() in same loop
+void onewire_adc_sweep_process(OneWireAdcSweep* sweep) {
+	TickType_t now = ONEWIRE_GET_TICK();
+
+	switch (sweep->state) {
+	case ONEWIRE_ADC_SWEEP_IDLE:
+		if (sweep->devices == NULL) {
+			break;
+		}
+		if (!sweep->requested && (sweep->period == 0 || (TickType_t)(now - sweep->start_tick) < sweep->period)) {
+			break;
+		}
+		if (!onewire_scheduler_power_acquire(sweep->scheduler, sweep->current)) {
+			break; // waits for running conversions to end
+		}
+		sweep->reserved = sweep->current;
+		sweep->requested = 0;
+		sweep->start_tick = now;
+		start_convert(sweep);
+		break;
+	case ONEWIRE_ADC_SWEEP_WAIT:
+		if ((TickType_t)(now - sweep->convert_tick) >= sweep->conversion_ticks) {
+			onewire_scheduler_power_release(sweep->scheduler, sweep->reserved);
+			sweep->reserved = 0;
+			start_reads(sweep);
+		}
+		break;
+	default:
+		break;
+	}
+}
@@ -0,0 +1,126 @@
+/**
+ ******************************************************************************
+ * @file    oneWireAdc.h
+ * @brief   DS2438 battery monitor and DS2450 quad ADC sweeps on OneWire scheduler
+ *
+ * @details
+ *          Sweep converts all ADC devices of bus at once and reads them back
+ *          through scheduler. Conversions are broadcast with Skip ROM, Convert
+ *          T and Convert V for DS2438 (temperature and A/D converter run in
+ *          parallel) and Convert for DS2450, so whole bus waits for one
+ *          conversion time. Then every device is addressed once per page that
+ *          holds all its channels, DS2438 page 0 gives temperature, voltage
+ *          and current, DS2450 page 0 gives inputs A..D.
+ *
+ *          Sweep runs every period or on request, current of conversions is
+ *          reserved in power budgets of scheduler for conversion time.
+ *
+ * @note    Broadcast Convert T would start DS18B20 conversions too, drawing
+ *          current not reserved by sweep and overwriting their scratchpads.
+ *          When prefetch entries with Convert T or other device families are
+ *          on swept branch, or addressed conversion is set, Convert T is sent
+ *          to every DS2438 with Match ROM. Devices behind DS2409 coupler are
+ *          swept by sweep of their branch. DS2450 channels keep their
+ *          configuration (resolution and input range of memory page 1).
+ *
+ * @license MIT License
+ ******************************************************************************
+ */
+
+#ifndef __oneWireAdc_H
+#define __oneWireAdc_H
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+#include "oneWire.h"
+#include <stdint.h>
+#include "oneWireScheduler.h"
+
+#define DS2438_FAMILY_CODE          0x26
+#define DS2438_CONVERT_T            0x44
+#define DS2438_CONVERT_V            0xB4
+#define DS2438_RECALL_MEMORY        0xB8    // page follows, page is copied to scratchpad
+#define DS2438_READ_SCRATCHPAD      0xBE    // page follows, 8 bytes and CRC8 are read
+#define DS2438_CONVERSION_MS        10      // temperature and A/D converter, max
+
+#define DS2450_FAMILY_CODE          0x20
+#define DS2450_CONVERT              0x3C    // input select mask and read-out control follow, CRC16 is read
+#define DS2450_READ_MEMORY          0xAA    // address follows, data to end of page and CRC16 are read
+#define DS2450_CONVERSION_BIT_US    80      // per bit of every selected input, 16 bit resolution assumed
+#define DS2450_CONVERSION_OFFSET_US 160
+
+typedef struct OneWireAdcDevice OneWireAdcDevice;
+typedef struct OneWireAdcSweep OneWireAdcSweep;
+
+// device is owned by application, type is given by family code of ROM
+struct OneWireAdcDevice {
+	uint8_t rom[8];
+	// values of last valid read
+	int16_t temperature;            // DS2438, 1/256 degC
+	uint16_t voltage;               // DS2438, 10 mV
+	int16_t current;                // DS2438, current register, scale depends on sense resistor
+	uint16_t channel[4];            // DS2450 inputs A..D, left aligned to 16 bits
+	uint32_t sweep;                 // number of sweep that read values, 0 when not read yet
+	uint32_t errors;                // reads with CRC mismatch or failed transaction
+	// internal
+	OneWireAdcSweep* owner;
+	uint8_t recalled;               // DS2438 page was copied to scratchpad in this sweep
+	OneWireTxn txn[2];              // DS2438 Recall Memory and Read Scratchpad, DS2450 Read Memory
+	uint8_t tx[2][12];
+	uint8_t rx[10];
+	OneWireAdcDevice* next;
+};
+
+typedef enum {
+	ONEWIRE_ADC_SWEEP_IDLE,
+	ONEWIRE_ADC_SWEEP_CONVERT,          // broadcast convert commands queued or on bus
+	ONEWIRE_ADC_SWEEP_WAIT,             // devices are converting
+	ONEWIRE_ADC_SWEEP_READ              // reads queued or on bus
+}OneWireAdcSweepState;
+
+// called after all devices of sweep were read
+typedef void (*OneWireAdcSweepCallback)(OneWireAdcSweep* sweep, void* context);
+
+struct OneWireAdcSweep {
+	OneWireScheduler* scheduler;
+	OneWireClient* client;          // sweep transactions are charged to this client
+	OneWireBranch* branch;          // coupler branch swept, NULL for bus without couplers
+	OneWireAdcDevice* devices;
+	uint8_t ds2450_mask;            // DS2450 inputs converted, bit 0 is input A
+	TickType_t period;              // 0 sweeps only on request
+	uint32_t current;               // uA drawn by all devices during conversion, 0 is not limited by budget
+	uint8_t addressed;              // Convert T is always sent with Match ROM, bus has sensors not known to scheduler
+	OneWireAdcSweepCallback callback;   // can be NULL
+	void* context;                  // passed to callback
+	uint32_t sweeps;                // completed sweeps
+	// internal
+	uint8_t state;                  // OneWireAdcSweepState
+	uint8_t requested;
+	uint16_t pending;               // transactions of current step not completed
+	uint8_t failed;                 // convert command of current sweep failed
+	uint8_t has_ds2438;
+	uint8_t has_ds2450;
+	uint32_t reserved;              // uA of budgets held for running conversion
+	TickType_t start_tick;          // start of last sweep
+	TickType_t convert_tick;        // end of last convert command
+	TickType_t conversion_ticks;
+	OneWireTxn convert[3];
+	uint8_t convert_tx[3][4];
+	uint8_t convert_rx[2];          // CRC16 of DS2450 Convert, not checked as all devices answer
+};
+
+void onewire_adc_sweep_init(OneWireAdcSweep* sweep, OneWireScheduler* scheduler, OneWireClient* client, uint32_t period_ms);
+int onewire_adc_sweep_add(OneWireAdcSweep* sweep, OneWireAdcDevice* device, const uint8_t* rom);
+void onewire_adc_sweep_set_branch(OneWireAdcSweep* sweep, OneWireBranch* branch);
+void onewire_adc_sweep_set_current(OneWireAdcSweep* sweep, uint32_t current);
+void onewire_adc_sweep_set_ds2450_mask(OneWireAdcSweep* sweep, uint8_t mask);
+void onewire_adc_sweep_set_addressed(OneWireAdcSweep* sweep, uint8_t addressed);
+void onewire_adc_sweep_set_callback(OneWireAdcSweep* sweep, OneWireAdcSweepCallback callback, void* context);
+void onewire_adc_sweep_request(OneWireAdcSweep* sweep);
+void onewire_adc_sweep_process(OneWireAdcSweep* sweep);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
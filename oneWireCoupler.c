@@ -0,0 +1,135 @@
+/**
+ ******************************************************************************
+ * @file    oneWireCoupler.c
+ * @brief   DS2409 MicroLAN coupler branches for OneWire scheduler
+ *
+ * @details
+ *          Switching itself is done by scheduler when transaction on other
+ *          branch starts. Branch search submits empty transaction on branch,
+ *          when it completes branch is connected and search runs with
+ *          scheduler held.
+ *
+ * @license MIT License
+ ******************************************************************************
+ */
+
+#include "oneWireCoupler.h"
+#include <string.h>
+#ifndef ONEWIRE_PORT_LINUX
+#include "task.h"
+#endif
+
+
+/* Private function prototypes -----------------------------------------------*/
+static void branch_init(OneWireBranch* branch, OneWireCoupler* coupler, uint8_t command, OneWireDevice* devices, uint8_t capacity);
+static void select_done(OneWireTxn* txn, OneWireTxnStatus status, void* context);
+static void start_walk(OneWireBranchSearch* branch_search);
+
+
+static void branch_init(OneWireBranch* branch, OneWireCoupler* coupler, uint8_t command, OneWireDevice* devices, uint8_t capacity) {
+	branch->coupler = coupler;
+	branch->command = command;
+	branch->activations = 0;
+	onewire_device_table_init(&branch->table, devices, capacity);
+}
+
+static void select_done(OneWireTxn* txn, OneWireTxnStatus status, void* context) {
+	OneWireBranchSearch* branch_search = context;
+
+	(void)txn;
+	if (status != ONEWIRE_TXN_STATUS_OK) {
+		branch_search->state = ONEWIRE_BRANCH_SEARCH_IDLE;
+		branch_search->status = ONEWIRE_SEARCH_ERROR;
+		return;
+	}
+	// called from scheduler with bus idle, hold keeps next transaction from starting
+	branch_search->state = ONEWIRE_BRANCH_SEARCH_HOLD;
+	start_walk(branch_search);
+}
+
+// search starts once bus is held, branch connected by select is checked again as other holder may have switched it
+static void start_walk(OneWireBranchSearch* branch_search) {
+	OneWireScheduler* scheduler = branch_search->scheduler;
+	OneWireBranch* branch = branch_search->branch;
+	OneWireBranch* trunk = branch_search->trunk;
+
+	if (!onewire_scheduler_hold(scheduler, branch_search) || scheduler->active != NULL) {
+		return;
+	}
+	if (branch != scheduler->active_branch && (branch->coupler != NULL || scheduler->active_branch != NULL)) {
+		onewire_scheduler_release(scheduler, branch_search);
+		branch_search->state = ONEWIRE_BRANCH_SEARCH_SELECT;
+		onewire_scheduler_submit(scheduler, branch_search->client, &branch_search->select);
+		return;
+	}
+	onewire_search_start(&branch_search->search, scheduler->onewire, &branch->table, SEARCH_ROM);
+	if (trunk != NULL && trunk != branch) {
+		onewire_search_exclude(&branch_search->search, &trunk->table);
+	}
+	branch_search->state = ONEWIRE_BRANCH_SEARCH_WALK;
+}
+
+// trunk table is filled by searching trunk branch
+void onewire_branch_init_trunk(OneWireBranch* trunk, OneWireDevice* devices, uint8_t capacity) {
+	branch_init(trunk, NULL, DS2409_ALL_LINES_OFF, devices, capacity);
+}
+
+// rom of coupler, main branch uses Smart-On Main
+void onewire_coupler_init(OneWireCoupler* coupler, const uint8_t* rom, OneWireDevice* main_devices, uint8_t main_capacity, OneWireDevice* aux_devices, uint8_t aux_capacity) {
+	memcpy(coupler->rom, rom, sizeof(coupler->rom));
+	branch_init(&coupler->main, coupler, DS2409_SMART_ON_MAIN, main_devices, main_capacity);
+	branch_init(&coupler->aux, coupler, DS2409_SMART_ON_AUX, aux_devices, aux_capacity);
+}
+
+// Direct-On Main skips reset stimulus and presence byte, usable when main branch devices do not need reset
+void onewire_coupler_set_direct_main(OneWireCoupler* coupler, uint8_t direct) {
+	coupler->main.command = direct ? DS2409_DIRECT_ON_MAIN : DS2409_SMART_ON_MAIN;
+}
+
+// returns branch whose table lists device as present, NULL when device is not behind any coupler
+OneWireBranch* onewire_coupler_find_device(OneWireCoupler* couplers, uint8_t count, const uint8_t* rom) {
+	for (uint8_t i = 0; i < count; i++) {
+		OneWireBranch* branches[2] = {&couplers[i].main, &couplers[i].aux};
+
+		for (uint8_t j = 0; j < 2; j++) {
+			int index = onewire_device_table_find(&branches[j]->table, rom);
+
+			if (index >= 0 && branches[j]->table.devices[index].present) {
+				return branches[j];
+			}
+		}
+	}
+	return NULL;
+}
+
+// searches branch into its table, trunk devices are excluded from coupler branch tables,
+// trunk can be NULL when trunk has no other devices than couplers or is branch itself
+void onewire_branch_search_start(OneWireBranchSearch* branch_search, OneWireScheduler* scheduler, OneWireClient* client, OneWireBranch* branch, OneWireBranch* trunk) {
+	branch_search->scheduler = scheduler;
+	branch_search->client = client;
+	branch_search->branch = branch;
+	branch_search->trunk = trunk;
+	branch_search->state = ONEWIRE_BRANCH_SEARCH_SELECT;
+	branch_search->status = ONEWIRE_SEARCH_RUNNING;
+	memset(&branch_search->select, 0, sizeof(branch_search->select));
+	branch_search->select.branch = branch;
+	branch_search->select.callback = select_done;
+	branch_search->select.context = branch_search;
+	onewire_scheduler_submit(scheduler, client, &branch_search->select);
+}
+
+// call after onewire_scheduler_process() in same loop until status is not ONEWIRE_SEARCH_RUNNING
+OneWireSearchStatus onewire_branch_search_process(OneWireBranchSearch* branch_search) {
+	if (branch_search->state == ONEWIRE_BRANCH_SEARCH_HOLD) {
+		start_walk(branch_search);
+	}
+	if (branch_search->state != ONEWIRE_BRANCH_SEARCH_WALK) {
+		return branch_search->status;
+	}
+	branch_search->status = onewire_search_process(&branch_search->search);
+	if (branch_search->status != ONEWIRE_SEARCH_RUNNING) {
+		branch_search->state = ONEWIRE_BRANCH_SEARCH_IDLE;
+		onewire_scheduler_release(branch_search->scheduler, branch_search);
+	}
+	return branch_search->status;
+}
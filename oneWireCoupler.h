@@ -0,0 +1,91 @@
+/**
+ ******************************************************************************
+ * @file    oneWireCoupler.h
+ * @brief   DS2409 MicroLAN coupler branches for OneWire scheduler
+ *
+ * @details
+ *          Coupler on trunk splits bus into main and auxiliary branch, at most
+ *          one branch of all couplers is connected at time. Transaction names
+ *          branch of its device and scheduler connects that branch before
+ *          transaction starts. Connected branch is cached, so switching
+ *          commands are sent only when consecutive transactions are on
+ *          different branches.
+ *
+ *          Trunk is described by branch without coupler, transaction on it
+ *          disconnects all branches first (Skip ROM or search of trunk only).
+ *          Transaction without branch runs on whatever is connected (Match
+ *          ROM of trunk device).
+ *
+ *          Branch search connects branch and walks it with Search ROM, trunk
+ *          devices are excluded so every branch table lists only devices
+ *          behind its coupler output.
+ *
+ * @note    Couplers are expected directly on trunk, cascaded couplers are not
+ *          handled.
+ *
+ * @license MIT License
+ ******************************************************************************
+ */
+
+#ifndef __oneWireCoupler_H
+#define __oneWireCoupler_H
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+#include "oneWire.h"
+#include <stdint.h>
+#include "oneWireScheduler.h"
+#include "oneWireSearch.h"
+
+#define DS2409_FAMILY_CODE          0x1F
+#define DS2409_SMART_ON_MAIN        0xCC    // reset stimulus, presence byte and confirmation follow
+#define DS2409_SMART_ON_AUX         0x33
+#define DS2409_DIRECT_ON_MAIN       0xA5    // confirmation follows, no reset on branch
+#define DS2409_ALL_LINES_OFF        0x66    // confirmation follows
+#define DS2409_RESET_STIMULUS       0xFF
+
+typedef struct OneWireCoupler OneWireCoupler;
+
+struct OneWireBranch {
+	OneWireCoupler* coupler;        // NULL for trunk
+	uint8_t command;                // command that connects branch
+	OneWireDeviceTable table;       // devices behind branch
+	uint32_t activations;           // times branch was connected
+};
+
+struct OneWireCoupler {
+	uint8_t rom[8];
+	OneWireBranch main;
+	OneWireBranch aux;
+};
+
+typedef enum {
+	ONEWIRE_BRANCH_SEARCH_IDLE,
+	ONEWIRE_BRANCH_SEARCH_SELECT,       // scheduler connects branch
+	ONEWIRE_BRANCH_SEARCH_HOLD,         // branch is connected, bus is held by other search
+	ONEWIRE_BRANCH_SEARCH_WALK          // Search ROM on branch, scheduler is held
+}OneWireBranchSearchState;
+
+typedef struct {
+	OneWireScheduler* scheduler;
+	OneWireClient* client;
+	OneWireBranch* branch;
+	OneWireBranch* trunk;           // its devices are not added to branch table
+	OneWireSearch search;
+	OneWireTxn select;              // empty transaction on branch, scheduler connects branch for it
+	uint8_t state;                  // OneWireBranchSearchState
+	uint8_t status;                 // OneWireSearchStatus of last search
+} OneWireBranchSearch;
+
+void onewire_branch_init_trunk(OneWireBranch* trunk, OneWireDevice* devices, uint8_t capacity);
+void onewire_coupler_init(OneWireCoupler* coupler, const uint8_t* rom, OneWireDevice* main_devices, uint8_t main_capacity, OneWireDevice* aux_devices, uint8_t aux_capacity);
+void onewire_coupler_set_direct_main(OneWireCoupler* coupler, uint8_t direct);
+OneWireBranch* onewire_coupler_find_device(OneWireCoupler* couplers, uint8_t count, const uint8_t* rom);
+void onewire_branch_search_start(OneWireBranchSearch* branch_search, OneWireScheduler* scheduler, OneWireClient* client, OneWireBranch* branch, OneWireBranch* trunk);
+OneWireSearchStatus onewire_branch_search_process(OneWireBranchSearch* branch_search);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,156 @@
+/**
+ ******************************************************************************
+ * @file    oneWireLinuxGpio.c
+ * @brief   Linux GPIO character device backend for OneWire driver
+ *
+ * @details
+ *          Implements OneWireBusOps on top of GPIO v2 line requests, so
+ *          protocol, search and scheduling code of OneWire driver can be used
+ *          on Linux gateways instead of kernel w1 sysfs interface.
+ *
+ * @license MIT License
+ ******************************************************************************
+ */
+
+#ifndef _POSIX_C_SOURCE
+ #define _POSIX_C_SOURCE 200809L        // O_CLOEXEC and poll() with -std=c11
+#endif
+
+#include "oneWireLinuxGpio.h"
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/gpio.h>
+
+#define ONEWIRE_LINUX_GPIO_CONSUMER "onewire"
+
+
+/* Private function prototypes -----------------------------------------------*/
+static int request_line(int chip_fd, unsigned int line, uint64_t flags, int initial_value);
+static void set_line_value(int fd, int value);
+static GPIO_PinState get_line_value(int fd);
+static void gpio_drive_low(void* context);
+static void gpio_release(void* context);
+static GPIO_PinState gpio_read(void* context);
+
+
+const OneWireBusOps onewire_linux_gpio_ops = {
+	.drive_low = gpio_drive_low,
+	.release = gpio_release,
+	.read = gpio_read
+};
+
+
+static int request_line(int chip_fd, unsigned int line, uint64_t flags, int initial_value) {
+	struct gpio_v2_line_request request;
+
+	memset(&request, 0, sizeof(request));
+	request.offsets[0] = line;
+	request.num_lines = 1;
+	strncpy(request.consumer, ONEWIRE_LINUX_GPIO_CONSUMER, sizeof(request.consumer) - 1);
+	request.config.flags = flags;
+	if (flags & GPIO_V2_LINE_FLAG_OUTPUT) {
+		request.config.num_attrs = 1;
+		request.config.attrs[0].attr.id = GPIO_V2_LINE_ATTR_ID_OUTPUT_VALUES;
+		request.config.attrs[0].attr.values = initial_value ? 1 : 0;
+		request.config.attrs[0].mask = 1;
+	}
+	if (ioctl(chip_fd, GPIO_V2_GET_LINE_IOCTL, &request) < 0) {
+		return -1;
+	}
+	return request.fd;
+}
+
+static void set_line_value(int fd, int value) {
+	struct gpio_v2_line_values values;
+
+	values.bits = value ? 1 : 0;
+	values.mask = 1;
+	ioctl(fd, GPIO_V2_LINE_SET_VALUES_IOCTL, &values);
+}
+
+static GPIO_PinState get_line_value(int fd) {
+	struct gpio_v2_line_values values;
+
+	values.bits = 0;
+	values.mask = 1;
+	if (ioctl(fd, GPIO_V2_LINE_GET_VALUES_IOCTL, &values) < 0) {
+		return GPIO_PIN_SET; // treat failed read as released bus
+	}
+	return (values.bits & 1) ? GPIO_PIN_SET : GPIO_PIN_RESET;
+}
+
+static void gpio_drive_low(void* context) {
+	set_line_value(((OneWireLinuxGpio*)context)->line_fd, 0);
+}
+
+static void gpio_release(void* context) {
+	set_line_value(((OneWireLinuxGpio*)context)->line_fd, 1); // open-drain, 1 leaves line to pull-up
+}
+
+static GPIO_PinState gpio_read(void* context) {
+	OneWireLinuxGpio* gpio = (OneWireLinuxGpio*)context;
+
+	if (gpio->sense_fd >= 0) {
+		return get_line_value(gpio->sense_fd);
+	}
+	return get_line_value(gpio->line_fd); // open-drain output reads back real line level
+}
+
+// returns 0 on success, -1 if chip can not be opened or line is not available
+int onewire_linux_gpio_open(OneWireLinuxGpio* gpio, const char* chip_path, unsigned int line, int sense_line) {
+	int chip_fd = open(chip_path, O_RDWR | O_CLOEXEC);
+
+	gpio->line_fd = -1;
+	gpio->sense_fd = -1;
+	if (chip_fd < 0) {
+		return -1;
+	}
+	gpio->line_fd = request_line(chip_fd, line, GPIO_V2_LINE_FLAG_OUTPUT | GPIO_V2_LINE_FLAG_OPEN_DRAIN, 1);
+	if (gpio->line_fd >= 0 && sense_line != ONEWIRE_LINUX_GPIO_NO_SENSE_LINE) {
+		gpio->sense_fd = request_line(chip_fd, (unsigned int)sense_line,
+				GPIO_V2_LINE_FLAG_INPUT | GPIO_V2_LINE_FLAG_EDGE_RISING | GPIO_V2_LINE_FLAG_EDGE_FALLING, 0);
+	}
+	close(chip_fd); // line requests stay valid without chip descriptor
+	if (gpio->line_fd < 0 || (sense_line != ONEWIRE_LINUX_GPIO_NO_SENSE_LINE && gpio->sense_fd < 0)) {
+		onewire_linux_gpio_close(gpio);
+		return -1;
+	}
+	return 0;
+}
+
+void onewire_linux_gpio_close(OneWireLinuxGpio* gpio) {
+	if (gpio->sense_fd >= 0) {
+		close(gpio->sense_fd);
+		gpio->sense_fd = -1;
+	}
+	if (gpio->line_fd >= 0) {
+		close(gpio->line_fd);
+		gpio->line_fd = -1;
+	}
+}
+
+// waits for edge on sense line, returns 1 on edge, 0 on timeout and -1 on error or without sense line
+int onewire_linux_gpio_wait_edge(OneWireLinuxGpio* gpio, int timeout_ms, GPIO_PinState* level, uint64_t* timestamp_ns) {
+	struct pollfd pfd;
+	struct gpio_v2_line_event event;
+	int ret;
+
+	if (gpio->sense_fd < 0) {
+		return -1;
+	}
+	pfd.fd = gpio->sense_fd;
+	pfd.events = POLLIN;
+	ret = poll(&pfd, 1, timeout_ms);
+	if (ret <= 0) {
+		return ret;
+	}
+	if (read(gpio->sense_fd, &event, sizeof(event)) != (ssize_t)sizeof(event)) {
+		return -1;
+	}
+	*level = (event.id == GPIO_V2_LINE_EVENT_RISING_EDGE) ? GPIO_PIN_SET : GPIO_PIN_RESET;
+	*timestamp_ns = event.timestamp_ns;
+	return 1;
+}
@@ -0,0 +1,47 @@
+/**
+ ******************************************************************************
+ * @file    oneWireLinuxGpio.h
+ * @brief   Linux GPIO character device backend for OneWire driver
+ *
+ * @details
+ *          Bus line is requested from /dev/gpiochipN as open-drain output
+ *          (GPIO v2 uAPI). Optional separate sense line is requested as input
+ *          with both edge events, so bus edges can be waited on with
+ *          timestamps from kernel.
+ *
+ *          For tests, gpio-sim (configfs) or gpio-mockup chip can be used in
+ *          place of real hardware, driver does not depend on chip type.
+ *
+ * @note    Build with ONEWIRE_PORT_LINUX defined and bind backend with
+ *          onewire_init_custom(&onewire, &onewire_linux_gpio_ops, &gpio, mode).
+ *
+ * @license MIT License
+ ******************************************************************************
+ */
+
+#ifndef __oneWireLinuxGpio_H
+#define __oneWireLinuxGpio_H
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+#include "oneWire.h"
+#include <stdint.h>
+
+#define ONEWIRE_LINUX_GPIO_NO_SENSE_LINE  (-1)
+
+typedef struct {
+	int line_fd;                    // line request of bus line, open-drain output
+	int sense_fd;                   // line request of sense line with edge events, -1 when bus line is read back
+} OneWireLinuxGpio;
+
+extern const OneWireBusOps onewire_linux_gpio_ops;
+
+int onewire_linux_gpio_open(OneWireLinuxGpio* gpio, const char* chip_path, unsigned int line, int sense_line);
+void onewire_linux_gpio_close(OneWireLinuxGpio* gpio);
+int onewire_linux_gpio_wait_edge(OneWireLinuxGpio* gpio, int timeout_ms, GPIO_PinState* level, uint64_t* timestamp_ns);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
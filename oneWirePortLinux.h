@@ -0,0 +1,108 @@
+/**
+ ******************************************************************************
+ * @file    oneWirePortLinux.h
+ * @brief   Linux userspace port of OneWire driver
+ *
+ * @details
+ *          Replaces FreeRTOS and STM32 HAL definitions used by oneWire.c when
+ *          ONEWIRE_PORT_LINUX is defined. One tick is one microsecond of
+ *          CLOCK_MONOTONIC, so delays from oneWire.h are used as they are.
+ *
+ * @note    STM32 GPIO calls are empty, on Linux bus has to be accessed through
+ *          onewire_init_custom() with backend such as oneWireLinuxGpio.c.
+ *          Feature-test macro is defined here, so oneWire.h has to be included
+ *          before system headers or _POSIX_C_SOURCE has to be set by build.
+ *
+ * @license MIT License
+ ******************************************************************************
+ */
+
+#ifndef __oneWirePortLinux_H
+#define __oneWirePortLinux_H
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+// clock_gettime() is POSIX, it is not declared with -std=c11 unless POSIX interfaces are selected
+#if !defined(_POSIX_C_SOURCE) && !defined(_GNU_SOURCE)
+ #define _POSIX_C_SOURCE          200809L
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+
+typedef uint32_t TickType_t;
+
+#define pdMS_TO_TICKS(x)          ((TickType_t)(x))   // driver delays are already in microseconds
+#define portMAX_DELAY             ((TickType_t)0xFFFFFFFFUL)
+
+static inline TickType_t onewire_linux_get_tick(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (TickType_t)((uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000ULL);
+}
+
+#ifndef ONEWIRE_GET_TICK
+ #define ONEWIRE_GET_TICK()       onewire_linux_get_tick()
+#endif
+
+#ifndef ONEWIRE_TICK_RATE_HZ
+ #define ONEWIRE_TICK_RATE_HZ     1000000UL     // has to match ONEWIRE_GET_TICK() when it is replaced
+#endif
+
+// CPU time of calling thread in nanoseconds stands in for core cycle counter
+static inline uint32_t onewire_linux_get_cycles(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return (uint32_t)((uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec);
+}
+
+#ifndef ONEWIRE_GET_CYCLES
+ #define ONEWIRE_GET_CYCLES()     onewire_linux_get_cycles()
+#endif
+
+// STM32 HAL GPIO definitions used by single and dual pin interface
+typedef enum {
+	GPIO_PIN_RESET = 0,
+	GPIO_PIN_SET
+} GPIO_PinState;
+
+typedef struct GPIO_TypeDef GPIO_TypeDef;
+
+typedef struct {
+	uint32_t Pin;
+	uint32_t Mode;
+	uint32_t Pull;
+	uint32_t Speed;
+} GPIO_InitTypeDef;
+
+#define MODE_INPUT                0
+#define GPIO_MODE_OUTPUT_PP       1
+#define GPIO_MODE_OUTPUT_OD       2
+#define GPIO_NOPULL               0
+#define GPIO_SPEED_FREQ_LOW       0
+
+static inline void HAL_GPIO_Init(GPIO_TypeDef* port, GPIO_InitTypeDef* init) {
+	(void)port;
+	(void)init;
+}
+
+static inline void HAL_GPIO_WritePin(GPIO_TypeDef* port, uint32_t pin, GPIO_PinState state) {
+	(void)port;
+	(void)pin;
+	(void)state;
+}
+
+static inline GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef* port, uint32_t pin) {
+	(void)port;
+	(void)pin;
+	return GPIO_PIN_SET;
+}
+
+#ifdef __cplusplus
+}
+#endif
+#endif
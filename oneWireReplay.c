@@ -0,0 +1,155 @@
+/**
+ ******************************************************************************
+ * @file    oneWireReplay.c
+ * @brief   Export and replay of recorded OneWire master operations
+ *
+ * @details
+ *          onewire_replay_process() is called in same loop as
+ *          onewire_process(). Next operation is issued when driver is idle
+ *          and its recorded offset from first operation has elapsed, when
+ *          driver is still busy operation waits and its lateness is counted.
+ *
+ * @license MIT License
+ ******************************************************************************
+ */
+
+#include "oneWireReplay.h"
+#ifndef ONEWIRE_PORT_LINUX
+#include "task.h"
+#endif
+
+#if ONEWIRE_OP_RECORD
+
+/* Private function prototypes -----------------------------------------------*/
+static uint32_t get_u32(const uint8_t* in);
+static void issue_op(OneWireReplay* replay, uint8_t op, uint8_t data);
+
+
+static uint32_t get_u32(const uint8_t* in) {
+	return (uint32_t)in[0] | ((uint32_t)in[1] << 8) | ((uint32_t)in[2] << 16) | ((uint32_t)in[3] << 24);
+}
+
+static void issue_op(OneWireReplay* replay, uint8_t op, uint8_t data) {
+	OneWireDriver* onewire = replay->onewire;
+
+	switch (op) {
+	case ONEWIRE_OP_RESET:
+		onewire_reset(onewire);
+		break;
+	case ONEWIRE_OP_WRITE_BYTE:
+		onewire_write_byte(onewire, data);
+		break;
+	case ONEWIRE_OP_READ_BYTE:
+		onewire_read_byte(onewire);
+		break;
+	case ONEWIRE_OP_SET_SPEED:
+		onewire_set_speed(onewire, data);
+		break;
+	case ONEWIRE_OP_WRITE_BIT:
+		onewire_write_bit(onewire, data);
+		break;
+	case ONEWIRE_OP_READ_BIT:
+		onewire_read_bit(onewire);
+		break;
+#if ONEWIRE_LATENCY_STATS
+	case ONEWIRE_OP_TXN_SUBMIT:
+		onewire_txn_submit(onewire, &replay->txn, (OneWireTxnType)data);
+		break;
+	case ONEWIRE_OP_TXN_START:
+		onewire_txn_start(onewire, &replay->txn);
+		break;
+	case ONEWIRE_OP_TXN_COMPLETE:
+		onewire_txn_complete(onewire, &replay->txn, data);
+		break;
+#endif
+	default:
+		break; // markers without latency statistics only keep spacing
+	}
+}
+
+// writes recorded operations as blob described in oneWireReplay.h, returns its length or 0 when buffer is too small
+uint16_t onewire_op_recorder_export(const OneWireOpRecorder* recorder, uint8_t* buffer, uint16_t size) {
+	uint16_t count = (recorder->capacity > 0) ? recorder->count : 0;
+	uint16_t index = (count > 0) ? (recorder->head + recorder->capacity - count) % recorder->capacity : 0;
+	uint32_t length = ONEWIRE_REPLAY_BLOB_SIZE((uint32_t)count);
+	TickType_t previous = (count > 0) ? recorder->records[index].tick : 0;
+	uint8_t* out = buffer;
+
+	if (size < length) {
+		return 0;
+	}
+	*out++ = 'O';
+	*out++ = 'W';
+	*out++ = 'R';
+	*out++ = ONEWIRE_REPLAY_VERSION;
+	*out++ = count & 0xFF;
+	*out++ = count >> 8;
+	*out++ = 0;
+	*out++ = 0;
+	for (uint8_t i = 0; i < 4; i++) {
+		*out++ = ((uint32_t)previous >> (8 * i)) & 0xFF;
+	}
+	for (uint16_t i = 0; i < count; i++) {
+		const OneWireOpRecord* record = &recorder->records[index];
+		uint32_t delta = record->tick - previous;
+
+		for (uint8_t j = 0; j < 4; j++) {
+			*out++ = (delta >> (8 * j)) & 0xFF;
+		}
+		*out++ = record->op;
+		*out++ = record->data;
+		previous = record->tick;
+		index = (index + 1) % recorder->capacity;
+	}
+	return (uint16_t)length;
+}
+
+// blob has to stay valid until replay is done
+OneWireReplayStatus onewire_replay_start(OneWireReplay* replay, OneWireDriver* onewire, const uint8_t* blob, uint16_t length) {
+	uint16_t count;
+
+	if (length < ONEWIRE_REPLAY_HEADER_SIZE || blob[0] != 'O' || blob[1] != 'W' || blob[2] != 'R' || blob[3] != ONEWIRE_REPLAY_VERSION) {
+		return ONEWIRE_REPLAY_INVALID;
+	}
+	count = blob[4] | (blob[5] << 8);
+	if (length < ONEWIRE_REPLAY_BLOB_SIZE((uint32_t)count)) {
+		return ONEWIRE_REPLAY_INVALID;
+	}
+	replay->onewire = onewire;
+	replay->next = &blob[ONEWIRE_REPLAY_HEADER_SIZE];
+	replay->remaining = count;
+	replay->start_tick = ONEWIRE_GET_TICK();
+	replay->offset = 0;
+	replay->issued = 0;
+	replay->total_lateness = 0;
+	replay->max_lateness = 0;
+	return (count > 0) ? ONEWIRE_REPLAY_RUNNING : ONEWIRE_REPLAY_DONE;
+}
+
+OneWireReplayStatus onewire_replay_process(OneWireReplay* replay) {
+	TickType_t now = ONEWIRE_GET_TICK();
+	TickType_t elapsed = now - replay->start_tick;
+	TickType_t offset;
+	TickType_t lateness;
+
+	if (replay->remaining == 0) {
+		return ONEWIRE_REPLAY_DONE;
+	}
+	offset = replay->offset + get_u32(replay->next);
+	if (elapsed < offset || replay->onewire->state != ONEWIRE_STATE_IDLE) {
+		return ONEWIRE_REPLAY_RUNNING; // not due yet or previous operation still on bus
+	}
+	lateness = elapsed - offset;
+	replay->total_lateness += lateness;
+	if (lateness > replay->max_lateness) {
+		replay->max_lateness = lateness;
+	}
+	issue_op(replay, replay->next[4], replay->next[5]);
+	replay->offset = offset;
+	replay->next += ONEWIRE_REPLAY_OP_SIZE;
+	replay->remaining--;
+	replay->issued++;
+	return (replay->remaining > 0) ? ONEWIRE_REPLAY_RUNNING : ONEWIRE_REPLAY_DONE;
+}
+
+#endif
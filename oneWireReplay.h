@@ -0,0 +1,71 @@
+/**
+ ******************************************************************************
+ * @file    oneWireReplay.h
+ * @brief   Export and replay of recorded OneWire master operations
+ *
+ * @details
+ *          Operations captured by recorder of driver (ONEWIRE_OP_RECORD) are
+ *          exported as compact blob, blob is replayed against driver on host
+ *          simulator or bench unit with original spacing of operations, so
+ *          throughput problems of field unit are reproduced deterministically.
+ *
+ *          Blob, all fields little endian:
+ *            0  'O' 'W' 'R' version
+ *            4  uint16 operation count, uint16 reserved
+ *            8  uint32 tick of first operation
+ *            12 operations oldest first, uint32 ticks since previous
+ *               operation, uint8 OneWireRecordedOp, uint8 data
+ *
+ * @note    Recording and replaying unit should use same tick rate, ticks are
+ *          stored as they were read from ONEWIRE_GET_TICK().
+ *
+ * @license MIT License
+ ******************************************************************************
+ */
+
+#ifndef __oneWireReplay_H
+#define __oneWireReplay_H
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+#include "oneWire.h"
+#include <stdint.h>
+
+#if ONEWIRE_OP_RECORD
+
+#define ONEWIRE_REPLAY_VERSION          1
+#define ONEWIRE_REPLAY_HEADER_SIZE      12
+#define ONEWIRE_REPLAY_OP_SIZE          6
+#define ONEWIRE_REPLAY_BLOB_SIZE(ops)   (ONEWIRE_REPLAY_HEADER_SIZE + ONEWIRE_REPLAY_OP_SIZE * (ops))
+
+typedef enum {
+	ONEWIRE_REPLAY_RUNNING,
+	ONEWIRE_REPLAY_DONE,
+	ONEWIRE_REPLAY_INVALID          // blob header or length is wrong
+}OneWireReplayStatus;
+
+typedef struct {
+	OneWireDriver* onewire;
+	const uint8_t* next;            // next operation in blob
+	uint16_t remaining;             // operations not issued yet
+	TickType_t start_tick;          // replay tick of first operation
+	TickType_t offset;              // recorded ticks from first operation to next one
+	uint32_t issued;                // operations issued to driver
+	uint32_t total_lateness;        // sum of ticks operations were issued after their recorded offset
+	TickType_t max_lateness;        // worst lateness, grows when bus can not keep up with recorded load
+#if ONEWIRE_LATENCY_STATS
+	OneWireTxnStats txn;            // stream does not tell transactions apart, last submitted one is timed
+#endif
+} OneWireReplay;
+
+uint16_t onewire_op_recorder_export(const OneWireOpRecorder* recorder, uint8_t* buffer, uint16_t size);
+OneWireReplayStatus onewire_replay_start(OneWireReplay* replay, OneWireDriver* onewire, const uint8_t* blob, uint16_t length);
+OneWireReplayStatus onewire_replay_process(OneWireReplay* replay);
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+#endif
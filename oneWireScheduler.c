@@ -0,0 +1,792 @@
+/**
+ ******************************************************************************
+ * @file    oneWireScheduler.c
+ * @brief   Transaction scheduler with bus time shares for OneWire driver
+ *
+ * @details
+ *          Transaction runs as reset, tx bytes and rx bytes, each step is
+ *          started when driver returns to idle. Cost of transaction is
+ *          computed from slot timing of driver, so budgets are expressed in
+ *          bus time independent of tick rate.
+ *
+ *          Prefetch entry starts conversion so that conversion and read end
+ *          shortly before next request expected from learned period, guard of
+ *          1/8 period absorbs jitter of consumer.
+ *
+ *          Current of conversion is reserved in budgets before convert
+ *          command is queued and released when conversion time elapsed or
+ *          command failed. Conversion whose current alone exceeds budget runs
+ *          when nothing else draws from that budget, so it is never stuck.
+ *
+ *          Branch switch runs as internal transaction charged to client whose
+ *          transaction needs it. Branch of other coupler is connected in two
+ *          switches, All Lines Off of connected coupler and then Smart-On.
+ *          Failed switch fails waiting transaction, cached branch is kept.
+ *
+ * @license MIT License
+ ******************************************************************************
+ */
+
+#include "oneWireScheduler.h"
+#include "oneWireCoupler.h"
+#include <string.h>
+#ifndef ONEWIRE_PORT_LINUX
+#include "task.h"
+#endif
+
+typedef enum {
+	SCHEDULER_STEP_RESET,
+	SCHEDULER_STEP_WRITE,
+	SCHEDULER_STEP_READ
+}SchedulerStep;
+
+#define COPY_SCRATCHPAD         0x48    // DS18B20 scratchpad to EEPROM
+
+#define MS_TO_TICKS(ms)         ((TickType_t)((uint64_t)(ms) * ONEWIRE_TICK_RATE_HZ / 1000))
+#define US_TO_TICKS(us)         ((TickType_t)((uint64_t)(us) * ONEWIRE_TICK_RATE_HZ / 1000000))
+
+#ifndef ONEWIRE_PORT_LINUX
+ #define POWER_LOCK()           taskENTER_CRITICAL()
+ #define POWER_UNLOCK()         taskEXIT_CRITICAL()
+#else
+ #define POWER_LOCK()           // schedulers sharing budget run in one thread
+ #define POWER_UNLOCK()
+#endif
+
+
+/* Private function prototypes -----------------------------------------------*/
+static void refill_tokens(OneWireClient* client, TickType_t now);
+static uint8_t can_pay(OneWireScheduler* scheduler, OneWireClient* client, TickType_t now);
+static void charge_txn(OneWireScheduler* scheduler, OneWireClient* client, const OneWireTxn* txn);
+static uint8_t is_branch_connected(OneWireScheduler* scheduler, const OneWireBranch* branch);
+static OneWireClient* select_client(OneWireScheduler* scheduler);
+static void start_txn(OneWireScheduler* scheduler, OneWireClient* client);
+static void start_switch(OneWireScheduler* scheduler, OneWireClient* client);
+static void switch_done(OneWireTxn* txn, OneWireTxnStatus status, void* context);
+static uint16_t group_branch(OneWireScheduler* scheduler, OneWireTxn** txns, uint16_t start, uint16_t count, const OneWireTxn* first);
+static void issue_next_op(OneWireScheduler* scheduler);
+static void finish_txn(OneWireScheduler* scheduler, OneWireTxnStatus status);
+#if ONEWIRE_LATENCY_STATS
+static OneWireTxnType classify_txn(const OneWireTxn* txn);
+#endif
+static void prefetch_submit(OneWireScheduler* scheduler, OneWirePrefetch* prefetch, uint8_t command, uint8_t rx_length);
+static void prefetch_txn_done(OneWireTxn* txn, OneWireTxnStatus status, void* context);
+static void prefetch_process(OneWireScheduler* scheduler, OneWirePrefetch* prefetch);
+static uint8_t prefetch_is_due(OneWireScheduler* scheduler, OneWirePrefetch* prefetch, TickType_t now, int32_t* lateness);
+static void prefetch_admit(OneWireScheduler* scheduler);
+static uint8_t power_fits(uint32_t budget, uint32_t used, uint32_t current);
+static uint8_t prefetch_take_value(OneWirePrefetch* prefetch, uint8_t* data);
+
+
+static void refill_tokens(OneWireClient* client, TickType_t now) {
+	uint64_t refill = (uint64_t)(TickType_t)(now - client->last_refill) * client->budget / ONEWIRE_TICK_RATE_HZ;
+
+	if (refill == 0) {
+		return; // keep last_refill so short intervals are not lost
+	}
+	client->last_refill = now;
+	if ((int64_t)client->tokens + (int64_t)refill > client->burst) {
+		client->tokens = client->burst;
+	}
+	else {
+		client->tokens += (int32_t)refill;
+	}
+}
+
+static uint8_t can_pay(OneWireScheduler* scheduler, OneWireClient* client, TickType_t now) {
+	if (client->budget == 0) {
+		return 1;
+	}
+	refill_tokens(client, now);
+	return client->tokens >= (int32_t)onewire_scheduler_txn_cost(scheduler->onewire, client->head);
+}
+
+static void charge_txn(OneWireScheduler* scheduler, OneWireClient* client, const OneWireTxn* txn) {
+	if (client->budget != 0) {
+		client->tokens -= (int32_t)onewire_scheduler_txn_cost(scheduler->onewire, txn);
+		if (client->tokens < -client->burst) {
+			client->tokens = -client->burst; // debt of borrower is limited to one burst
+		}
+	}
+}
+
+// trunk branch is connected when all coupler branches are off
+static uint8_t is_branch_connected(OneWireScheduler* scheduler, const OneWireBranch* branch) {
+	return branch == NULL || branch == scheduler->active_branch || (branch->coupler == NULL && scheduler->active_branch == NULL);
+}
+
+// client whose next transaction is on connected branch is preferred for batch of transactions, then
+// round robin over clients that can pay for their next transaction, otherwise bus is lent to waiting
+// client with least lent time relative to its budget, NULL when nothing waits
+static OneWireClient* select_client(OneWireScheduler* scheduler) {
+	TickType_t now = ONEWIRE_GET_TICK();
+	OneWireClient* borrower = NULL;
+
+	if (scheduler->branch_batch < ONEWIRE_SCHEDULER_BRANCH_BATCH) {
+		for (uint8_t i = 1; i <= scheduler->client_count; i++) {
+			uint8_t index = (scheduler->last_client + i) % scheduler->client_count;
+			OneWireClient* client = scheduler->clients[index];
+
+			if (client->head != NULL && client->head->branch != NULL && is_branch_connected(scheduler, client->head->branch) && can_pay(scheduler, client, now)) {
+				scheduler->last_client = index;
+				return client;
+			}
+		}
+	}
+	for (uint8_t i = 1; i <= scheduler->client_count; i++) {
+		uint8_t index = (scheduler->last_client + i) % scheduler->client_count;
+		OneWireClient* client = scheduler->clients[index];
+
+		if (client->head == NULL) {
+			continue;
+		}
+		if (can_pay(scheduler, client, now)) {
+			scheduler->last_client = index;
+			return client;
+		}
+		if (borrower == NULL || (int32_t)(client->lent_time - borrower->lent_time) < 0) {
+			borrower = client;
+		}
+	}
+	if (borrower != NULL) {
+		// lent time is split in proportion to budgets, as tokens are
+		scheduler->lent_clock = borrower->lent_time;
+		borrower->lent_time += (uint32_t)((uint64_t)onewire_scheduler_txn_cost(scheduler->onewire, borrower->head) * ONEWIRE_TICK_RATE_HZ / borrower->budget);
+		borrower->borrowed++;
+	}
+	return borrower;
+}
+
+static void start_txn(OneWireScheduler* scheduler, OneWireClient* client) {
+	OneWireTxn* txn = client->head;
+
+	if (!is_branch_connected(scheduler, txn->branch)) {
+		start_switch(scheduler, client); // transaction stays queued until its branch is connected
+		return;
+	}
+	if (txn->branch != NULL && scheduler->branch_batch < 0xFF) {
+		scheduler->branch_batch++;
+	}
+	client->head = txn->next;
+	if (client->head == NULL) {
+		client->tail = NULL;
+	}
+	charge_txn(scheduler, client, txn);
+	scheduler->active_client = client;
+	scheduler->active = txn;
+	scheduler->index = 0;
+#if ONEWIRE_LATENCY_STATS
+	onewire_txn_start(scheduler->onewire, &txn->stats);
+#endif
+	if (txn->reset) {
+		scheduler->step = SCHEDULER_STEP_RESET;
+		onewire_reset(scheduler->onewire);
+	}
+	else {
+		scheduler->step = SCHEDULER_STEP_WRITE;
+		issue_next_op(scheduler);
+	}
+}
+
+static void start_switch(OneWireScheduler* scheduler, OneWireClient* client) {
+	OneWireBranch* target = client->head->branch;
+	OneWireBranch* active = scheduler->active_branch;
+	OneWireTxn* txn = &scheduler->switch_txn;
+	const uint8_t* rom;
+	uint8_t command;
+	uint8_t length = 0;
+
+	if (active != NULL && (target->coupler == NULL || target->coupler != active->coupler)) {
+		rom = active->coupler->rom; // other coupler or trunk, connected branch is turned off first
+		command = DS2409_ALL_LINES_OFF;
+		scheduler->switch_target = NULL;
+	}
+	else {
+		rom = target->coupler->rom; // other output of same coupler is turned off by coupler itself
+		command = target->command;
+		scheduler->switch_target = target;
+	}
+	scheduler->switch_tx[length++] = MATCH_ROM;
+	memcpy(&scheduler->switch_tx[length], rom, 8);
+	length += 8;
+	scheduler->switch_tx[length++] = command;
+	txn->rx_length = 1; // confirmation byte
+	if (command == DS2409_SMART_ON_MAIN || command == DS2409_SMART_ON_AUX) {
+		scheduler->switch_tx[length++] = DS2409_RESET_STIMULUS;
+		txn->rx_length = 2; // presence on branch and confirmation byte
+	}
+	txn->tx = scheduler->switch_tx;
+	txn->tx_length = length;
+	txn->rx = scheduler->switch_rx;
+	txn->reset = 1;
+	txn->branch = NULL;
+	txn->callback = switch_done;
+	txn->context = scheduler;
+	charge_txn(scheduler, client, txn);
+	scheduler->switch_client = client;
+	scheduler->branch_batch = 0;
+	scheduler->active_client = NULL;
+	scheduler->active = txn;
+	scheduler->index = 0;
+	scheduler->step = SCHEDULER_STEP_RESET;
+#if ONEWIRE_LATENCY_STATS
+	onewire_txn_submit(scheduler->onewire, &txn->stats, ONEWIRE_TXN_OTHER);
+	onewire_txn_start(scheduler->onewire, &txn->stats);
+#endif
+	onewire_reset(scheduler->onewire);
+}
+
+static void switch_done(OneWireTxn* txn, OneWireTxnStatus status, void* context) {
+	OneWireScheduler* scheduler = context;
+	OneWireClient* client = scheduler->switch_client;
+	OneWireTxn* waiting = client->head;
+
+	scheduler->branch_switches++;
+	if (status == ONEWIRE_TXN_STATUS_OK && txn->rx[txn->rx_length - 1] == txn->tx[9]) {
+		scheduler->active_branch = scheduler->switch_target;
+		if (scheduler->switch_target != NULL) {
+			scheduler->switch_target->activations++;
+		}
+		return; // waiting transaction is selected again
+	}
+	client->head = waiting->next;
+	if (client->head == NULL) {
+		client->tail = NULL;
+	}
+	if (waiting->callback != NULL) {
+		waiting->callback(waiting, (status == ONEWIRE_TXN_STATUS_OK) ? ONEWIRE_TXN_STATUS_ERROR : status, waiting->context);
+	}
+}
+
+static void issue_next_op(OneWireScheduler* scheduler) {
+	OneWireTxn* txn = scheduler->active;
+
+	if (scheduler->step == SCHEDULER_STEP_WRITE) {
+		if (scheduler->index < txn->tx_length) {
+			onewire_write_byte(scheduler->onewire, txn->tx[scheduler->index++]);
+			return;
+		}
+		scheduler->step = SCHEDULER_STEP_READ;
+		scheduler->index = 0;
+	}
+	if (scheduler->index < txn->rx_length) {
+		scheduler->index++;
+		onewire_read_byte(scheduler->onewire);
+		return;
+	}
+	finish_txn(scheduler, ONEWIRE_TXN_STATUS_OK);
+}
+
+static void finish_txn(OneWireScheduler* scheduler, OneWireTxnStatus status) {
+	OneWireTxn* txn = scheduler->active;
+
+	if (scheduler->active_client != NULL) {
+		scheduler->active_client->served++; // branch switch is not counted
+	}
+#if ONEWIRE_LATENCY_STATS
+	onewire_txn_complete(scheduler->onewire, &txn->stats, status == ONEWIRE_TXN_STATUS_OK);
+#endif
+#if ONEWIRE_BLACKBOX_SIZE > 0
+	if (status != ONEWIRE_TXN_STATUS_OK) {
+		onewire_blackbox_trigger(scheduler->onewire);
+	}
+#endif
+	scheduler->active = NULL;
+	scheduler->active_client = NULL;
+	if (txn->callback != NULL) {
+		txn->callback(txn, status, txn->context); // callback may submit next transaction
+	}
+}
+
+#if ONEWIRE_LATENCY_STATS
+// histogram of transaction is chosen by its ROM and function command
+static OneWireTxnType classify_txn(const OneWireTxn* txn) {
+	uint8_t command;
+
+	if (!txn->reset || txn->tx_length == 0) {
+		return ONEWIRE_TXN_OTHER; // continuation of earlier transaction
+	}
+	switch (txn->tx[0]) {
+	case READ_ROM:
+		return ONEWIRE_TXN_READ_ROM;
+	case SEARCH_ROM:
+	case ALARM_SEARCH:
+		return ONEWIRE_TXN_SEARCH;
+	case SKIP_ROM:
+		command = (txn->tx_length > 1) ? txn->tx[1] : 0;
+		break;
+	case MATCH_ROM:
+		command = (txn->tx_length > 9) ? txn->tx[9] : 0;
+		break;
+	default:
+		return ONEWIRE_TXN_OTHER;
+	}
+	if (command == READ_SCRATCHPAD) {
+		return ONEWIRE_TXN_READ_SCRATCHPAD;
+	}
+	if (command == COPY_SCRATCHPAD) {
+		return ONEWIRE_TXN_WRITE_EEPROM;
+	}
+	return ONEWIRE_TXN_OTHER;
+}
+#endif
+
+void onewire_scheduler_init(OneWireScheduler* scheduler, OneWireDriver* onewire) {
+	scheduler->onewire = onewire;
+	scheduler->client_count = 0;
+	scheduler->last_client = 0;
+	scheduler->active_client = NULL;
+	scheduler->active = NULL;
+	scheduler->step = SCHEDULER_STEP_RESET;
+	scheduler->index = 0;
+	scheduler->prefetch = NULL;
+	scheduler->power = NULL;
+	scheduler->bus_budget = 0;
+	scheduler->bus_used = 0;
+	scheduler->bus_peak = 0;
+	scheduler->power_deferred = 0;
+	scheduler->hold_owner = NULL;
+	scheduler->lent_clock = 0;
+	scheduler->active_branch = NULL; // coupler outputs are off after power up
+	scheduler->switch_target = NULL;
+	scheduler->switch_client = NULL;
+	scheduler->branch_batch = 0;
+	scheduler->branch_switches = 0;
+}
+
+// returns 0 on success, -1 when all client slots are used
+int onewire_scheduler_add_client(OneWireScheduler* scheduler, OneWireClient* client, uint32_t budget, uint32_t burst) {
+	if (scheduler->client_count >= ONEWIRE_SCHEDULER_MAX_CLIENTS) {
+		return -1;
+	}
+	client->head = NULL;
+	client->tail = NULL;
+	client->served = 0;
+	client->borrowed = 0;
+	client->lent_time = scheduler->lent_clock;
+	onewire_scheduler_set_budget(client, budget, burst);
+	scheduler->clients[scheduler->client_count++] = client;
+	return 0;
+}
+
+// budget in us of slot time per second (0 unlimited), burst in us, client starts with full bucket
+void onewire_scheduler_set_budget(OneWireClient* client, uint32_t budget, uint32_t burst) {
+	client->budget = budget;
+	client->burst = (burst > INT32_MAX) ? INT32_MAX : (int32_t)burst;
+	client->tokens = client->burst;
+	client->last_refill = ONEWIRE_GET_TICK();
+}
+
+void onewire_scheduler_submit(OneWireScheduler* scheduler, OneWireClient* client, OneWireTxn* txn) {
+#if ONEWIRE_LATENCY_STATS
+	onewire_txn_submit(scheduler->onewire, &txn->stats, classify_txn(txn));
+#endif
+	txn->next = NULL;
+	if (client->tail != NULL) {
+		client->tail->next = txn;
+	}
+	else {
+		client->head = txn;
+		if ((int32_t)(client->lent_time - scheduler->lent_clock) < 0) {
+			client->lent_time = scheduler->lent_clock; // idle client does not save lent time
+		}
+	}
+	client->tail = txn;
+}
+
+// groups transactions after start that share branch of first, keeps their order, returns end of group
+static uint16_t group_branch(OneWireScheduler* scheduler, OneWireTxn** txns, uint16_t start, uint16_t count, const OneWireTxn* first) {
+	uint16_t end = start;
+
+	for (uint16_t i = start; i < count; i++) {
+		OneWireTxn* txn = txns[i];
+		uint8_t same = (first == NULL) ? is_branch_connected(scheduler, txn->branch) : (txn->branch == first->branch);
+
+		if (same) {
+			for (uint16_t j = i; j > end; j--) {
+				txns[j] = txns[j - 1];
+			}
+			txns[end++] = txn;
+		}
+	}
+	return end;
+}
+
+// independent transactions are reordered in txns so that those on connected branch come first and
+// rest is grouped by branch in order of first appearance, then they are queued
+void onewire_scheduler_submit_batch(OneWireScheduler* scheduler, OneWireClient* client, OneWireTxn** txns, uint16_t count) {
+	uint16_t start = group_branch(scheduler, txns, 0, count, NULL);
+
+	while (start < count) {
+		start = group_branch(scheduler, txns, start, count, txns[start]);
+	}
+	for (uint16_t i = 0; i < count; i++) {
+		onewire_scheduler_submit(scheduler, client, txns[i]);
+	}
+}
+
+void onewire_scheduler_process(OneWireScheduler* scheduler) {
+	OneWireDriver* onewire = scheduler->onewire;
+	OneWireClient* client;
+
+	onewire_process(onewire);
+	for (OneWirePrefetch* prefetch = scheduler->prefetch; prefetch != NULL; prefetch = prefetch->next) {
+		prefetch_process(scheduler, prefetch);
+	}
+	prefetch_admit(scheduler);
+	if (scheduler->active != NULL) {
+		if (onewire->state == ONEWIRE_STATE_ERROR) {
+			finish_txn(scheduler, ONEWIRE_TXN_STATUS_ERROR);
+		}
+		else if (onewire->state != ONEWIRE_STATE_IDLE) {
+			return; // step still on bus
+		}
+		else if (scheduler->step == SCHEDULER_STEP_RESET) {
+			if (!onewire_is_slave_present(onewire)) {
+				finish_txn(scheduler, ONEWIRE_TXN_STATUS_NO_PRESENCE);
+			}
+			else {
+				scheduler->step = SCHEDULER_STEP_WRITE;
+				issue_next_op(scheduler);
+			}
+		}
+		else {
+			if (scheduler->step == SCHEDULER_STEP_READ && scheduler->index > 0) {
+				scheduler->active->rx[scheduler->index - 1] = onewire_get_byte(onewire);
+			}
+			issue_next_op(scheduler);
+		}
+	}
+	if (scheduler->active == NULL && scheduler->hold_owner == NULL) {
+		client = select_client(scheduler);
+		if (client != NULL) {
+			start_txn(scheduler, client);
+		}
+	}
+}
+
+uint8_t onewire_scheduler_is_idle(OneWireScheduler* scheduler) {
+	if (scheduler->active != NULL) {
+		return 0;
+	}
+	for (uint8_t i = 0; i < scheduler->client_count; i++) {
+		if (scheduler->clients[i]->head != NULL) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+// while held running transaction finishes and queued ones wait, used by searches outside of scheduler.
+// Returns 1 when owner holds bus, 0 while other owner holds it, holding again is allowed.
+uint8_t onewire_scheduler_hold(OneWireScheduler* scheduler, const void* owner) {
+	if (scheduler->hold_owner != NULL && scheduler->hold_owner != owner) {
+		return 0;
+	}
+	scheduler->hold_owner = owner;
+	return 1;
+}
+
+// release by other than owner is ignored
+void onewire_scheduler_release(OneWireScheduler* scheduler, const void* owner) {
+	if (scheduler->hold_owner == owner) {
+		scheduler->hold_owner = NULL;
+	}
+}
+
+// slot time of transaction in us at current bus speed
+uint32_t onewire_scheduler_txn_cost(OneWireDriver* onewire, const OneWireTxn* txn) {
+	const OneWireTiming* timing = onewire->timing;
+	uint32_t slot = timing->write_1_low_delay + timing->write_1_release_bus_delay;
+	uint32_t cost = 8 * slot * ((uint32_t)txn->tx_length + txn->rx_length);
+
+	if (txn->reset) {
+		cost += timing->reset_drive_bus_low_delay + timing->reset_release_bus_delay + timing->reset_sample_bus_delay;
+	}
+	return cost;
+}
+
+static void prefetch_submit(OneWireScheduler* scheduler, OneWirePrefetch* prefetch, uint8_t command, uint8_t rx_length) {
+	uint8_t length = 0;
+
+	if (prefetch->match_rom) {
+		prefetch->tx[length++] = MATCH_ROM;
+		memcpy(&prefetch->tx[length], prefetch->rom, sizeof(prefetch->rom));
+		length += sizeof(prefetch->rom);
+	}
+	else {
+		prefetch->tx[length++] = SKIP_ROM;
+	}
+	prefetch->tx[length++] = command;
+	prefetch->txn.tx = prefetch->tx;
+	prefetch->txn.tx_length = length;
+	prefetch->txn.rx = prefetch->rx;
+	prefetch->txn.rx_length = rx_length;
+	prefetch->txn.reset = 1;
+	prefetch->txn.branch = prefetch->branch;
+	prefetch->txn.callback = prefetch_txn_done;
+	prefetch->txn.context = prefetch;
+	onewire_scheduler_submit(scheduler, prefetch->client, &prefetch->txn);
+}
+
+static void prefetch_txn_done(OneWireTxn* txn, OneWireTxnStatus status, void* context) {
+	OneWirePrefetch* prefetch = context;
+	uint8_t crc = 0;
+
+	(void)txn;
+	if (status != ONEWIRE_TXN_STATUS_OK) {
+		prefetch->state = ONEWIRE_PREFETCH_IDLE; // retried on next due time or request
+		return;
+	}
+	if (prefetch->state == ONEWIRE_PREFETCH_CONVERT) {
+		prefetch->convert_tick = ONEWIRE_GET_TICK();
+		prefetch->state = ONEWIRE_PREFETCH_WAIT;
+		return;
+	}
+	if (prefetch->check_crc8) {
+		for (uint8_t i = 0; i < prefetch->data_length; i++) {
+			crc = onewire_crc8_update(crc, prefetch->rx[i]);
+		}
+	}
+	if (crc == 0) {
+		memcpy(prefetch->value, prefetch->rx, prefetch->data_length);
+		prefetch->value_tick = ONEWIRE_GET_TICK();
+		prefetch->fresh = 1;
+	}
+#if ONEWIRE_BLACKBOX_SIZE > 0
+	else {
+		onewire_blackbox_trigger(prefetch->onewire);
+	}
+#endif
+	prefetch->state = ONEWIRE_PREFETCH_IDLE;
+}
+
+static void prefetch_process(OneWireScheduler* scheduler, OneWirePrefetch* prefetch) {
+	TickType_t now = ONEWIRE_GET_TICK();
+
+	switch (prefetch->state) {
+	case ONEWIRE_PREFETCH_IDLE:
+		if (prefetch->reserved != 0) {
+			onewire_scheduler_power_release(scheduler, prefetch->reserved); // convert command failed
+			prefetch->reserved = 0;
+		}
+		break;
+	case ONEWIRE_PREFETCH_WAIT:
+		if ((TickType_t)(now - prefetch->convert_tick) >= prefetch->conversion_ticks) {
+			onewire_scheduler_power_release(scheduler, prefetch->reserved);
+			prefetch->reserved = 0;
+			prefetch->state = ONEWIRE_PREFETCH_READ;
+			prefetch_submit(scheduler, prefetch, prefetch->read_command, prefetch->data_length);
+		}
+		break;
+	default:
+		break; // transaction queued or on bus
+	}
+}
+
+// conversion should start now, lateness is ticks past deadline of value (negative before it)
+static uint8_t prefetch_is_due(OneWireScheduler* scheduler, OneWirePrefetch* prefetch, TickType_t now, int32_t* lateness) {
+	OneWireTxn read;
+	TickType_t lead;
+
+	if (prefetch->state != ONEWIRE_PREFETCH_IDLE) {
+		return 0;
+	}
+	if (prefetch->demand) {
+		*lateness = (int32_t)(now - prefetch->last_request);
+		return 1;
+	}
+	if (prefetch->samples < ONEWIRE_PREFETCH_MIN_SAMPLES || prefetch->fresh) {
+		return 0; // period not learned yet or prefetched value still waits for consumer
+	}
+	read.tx_length = prefetch->match_rom ? 10 : 2;
+	read.rx_length = prefetch->data_length;
+	read.reset = 1;
+	lead = prefetch->conversion_ticks + US_TO_TICKS(onewire_scheduler_txn_cost(scheduler->onewire, &read)) + prefetch->period / 8;
+	if (prefetch->current != 0 && (scheduler->bus_budget != 0 || (scheduler->power != NULL && scheduler->power->budget != 0))) {
+		lead += prefetch->conversion_ticks; // may run one wave early when later wave is full
+	}
+	if (lead < prefetch->period && (TickType_t)(now - prefetch->last_request) < prefetch->period - lead) {
+		return 0;
+	}
+	*lateness = (int32_t)(now - (prefetch->last_request + prefetch->period));
+	return 1;
+}
+
+// starts due conversions earliest deadline first while their current fits budgets, first one
+// that does not fit stops admission so later deadlines can not starve it
+static void prefetch_admit(OneWireScheduler* scheduler) {
+	TickType_t now = ONEWIRE_GET_TICK();
+
+	while (1) {
+		OneWirePrefetch* next = NULL;
+		int32_t next_lateness = 0;
+		int32_t lateness;
+
+		for (OneWirePrefetch* prefetch = scheduler->prefetch; prefetch != NULL; prefetch = prefetch->next) {
+			if (prefetch_is_due(scheduler, prefetch, now, &lateness) && (next == NULL || lateness > next_lateness)) {
+				next = prefetch;
+				next_lateness = lateness;
+			}
+		}
+		if (next == NULL) {
+			return;
+		}
+		if (!onewire_scheduler_power_acquire(scheduler, next->current)) {
+			if (!next->power_wait) {
+				next->power_wait = 1;
+				scheduler->power_deferred++;
+			}
+			return;
+		}
+		next->reserved = next->current;
+		next->power_wait = 0;
+		next->demand = 0;
+		next->state = ONEWIRE_PREFETCH_CONVERT;
+		prefetch_submit(scheduler, next, next->convert_command, 0);
+	}
+}
+
+// budget 0 is unlimited, current over budget is allowed alone
+static uint8_t power_fits(uint32_t budget, uint32_t used, uint32_t current) {
+	return budget == 0 || used == 0 || used + current <= budget;
+}
+
+// value prefetched for earlier period is too old to be served
+static uint8_t prefetch_take_value(OneWirePrefetch* prefetch, uint8_t* data) {
+	if (!prefetch->fresh) {
+		return 0;
+	}
+	if (prefetch->period != 0 && (TickType_t)(ONEWIRE_GET_TICK() - prefetch->value_tick) > prefetch->period) {
+		prefetch->fresh = 0;
+		return 0;
+	}
+	memcpy(data, prefetch->value, prefetch->data_length);
+	prefetch->fresh = 0;
+	return 1;
+}
+
+// rom NULL uses Skip ROM, data_length up to ONEWIRE_PREFETCH_MAX_DATA
+void onewire_prefetch_init(OneWirePrefetch* prefetch, OneWireClient* client, const uint8_t* rom, uint8_t convert_command, uint32_t conversion_ms, uint8_t read_command, uint8_t data_length) {
+	memset(prefetch, 0, sizeof(*prefetch));
+	prefetch->client = client;
+	if (rom != NULL) {
+		memcpy(prefetch->rom, rom, sizeof(prefetch->rom));
+		prefetch->match_rom = 1;
+	}
+	prefetch->convert_command = convert_command;
+	prefetch->read_command = read_command;
+	prefetch->data_length = (data_length > ONEWIRE_PREFETCH_MAX_DATA) ? ONEWIRE_PREFETCH_MAX_DATA : data_length;
+	prefetch->conversion_ticks = MS_TO_TICKS(conversion_ms);
+	prefetch->state = ONEWIRE_PREFETCH_IDLE;
+}
+
+void onewire_scheduler_add_prefetch(OneWireScheduler* scheduler, OneWirePrefetch* prefetch) {
+	prefetch->onewire = scheduler->onewire;
+	prefetch->next = scheduler->prefetch;
+	scheduler->prefetch = prefetch;
+}
+
+// consumer asks for value, returns 1 and copies data when prefetched value is ready, otherwise
+// conversion is started and value is later taken with onewire_prefetch_get()
+uint8_t onewire_prefetch_request(OneWireScheduler* scheduler, OneWirePrefetch* prefetch, uint8_t* data) {
+	TickType_t now = ONEWIRE_GET_TICK();
+	TickType_t interval = now - prefetch->last_request;
+
+	(void)scheduler; // conversion is admitted by onewire_scheduler_process()
+	if (prefetch->samples > 0) {
+		if (prefetch->period == 0) {
+			prefetch->period = interval;
+		}
+		else if (interval > 4 * prefetch->period) {
+			prefetch->period = 0; // consumer paused, learn period again
+			prefetch->samples = 1;
+			prefetch->fresh = 0; // value prefetched for request that did not come is too old
+		}
+		else if (interval >= prefetch->period) {
+			prefetch->period += (interval - prefetch->period) >> ONEWIRE_PREFETCH_EWMA_SHIFT;
+		}
+		else {
+			prefetch->period -= (prefetch->period - interval) >> ONEWIRE_PREFETCH_EWMA_SHIFT;
+		}
+	}
+	if (prefetch->samples < 0xFF) {
+		prefetch->samples++;
+	}
+	prefetch->last_request = now;
+	if (prefetch_take_value(prefetch, data)) {
+		prefetch->hits++;
+		return 1;
+	}
+	prefetch->misses++;
+	if (prefetch->state == ONEWIRE_PREFETCH_IDLE) {
+		prefetch->demand = 1; // started by scheduler when budgets allow
+	}
+	return 0;
+}
+
+// takes value after missed request, does not count as request
+uint8_t onewire_prefetch_get(OneWirePrefetch* prefetch, uint8_t* data) {
+	return prefetch_take_value(prefetch, data);
+}
+
+// current in uA drawn by device during conversion, 1500 for DS18B20
+void onewire_prefetch_set_current(OneWirePrefetch* prefetch, uint32_t current) {
+	prefetch->current = current;
+}
+
+// branch of device behind DS2409 coupler
+void onewire_prefetch_set_branch(OneWirePrefetch* prefetch, OneWireBranch* branch) {
+	prefetch->branch = branch;
+}
+
+// budget in uA, 0 unlimited
+void onewire_power_budget_init(OneWirePowerBudget* power, uint32_t budget) {
+	power->budget = budget;
+	power->used = 0;
+	power->peak = 0;
+}
+
+// power is global budget shared with other buses or NULL, bus_budget in uA (0 unlimited)
+void onewire_scheduler_set_power(OneWireScheduler* scheduler, OneWirePowerBudget* power, uint32_t bus_budget) {
+	scheduler->power = power;
+	scheduler->bus_budget = bus_budget;
+}
+
+// reserves current in bus and global budget, returns 0 when it does not fit.
+// Device drivers starting conversions outside of prefetch entries use it too.
+uint8_t onewire_scheduler_power_acquire(OneWireScheduler* scheduler, uint32_t current) {
+	OneWirePowerBudget* power = scheduler->power;
+	uint8_t granted = 0;
+
+	if (current == 0) {
+		return 1;
+	}
+	POWER_LOCK();
+	if (power_fits(scheduler->bus_budget, scheduler->bus_used, current) && (power == NULL || power_fits(power->budget, power->used, current))) {
+		scheduler->bus_used += current;
+		if (scheduler->bus_used > scheduler->bus_peak) {
+			scheduler->bus_peak = scheduler->bus_used;
+		}
+		if (power != NULL) {
+			power->used += current;
+			if (power->used > power->peak) {
+				power->peak = power->used;
+			}
+		}
+		granted = 1;
+	}
+	POWER_UNLOCK();
+	return granted;
+}
+
+void onewire_scheduler_power_release(OneWireScheduler* scheduler, uint32_t current) {
+	OneWirePowerBudget* power = scheduler->power;
+
+	POWER_LOCK();
+	scheduler->bus_used -= (current > scheduler->bus_used) ? scheduler->bus_used : current;
+	if (power != NULL) {
+		power->used -= (current > power->used) ? power->used : current;
+	}
+	POWER_UNLOCK();
+}
@@ -0,0 +1,204 @@
+/**
+ ******************************************************************************
+ * @file    oneWireScheduler.h
+ * @brief   Transaction scheduler with bus time shares for OneWire driver
+ *
+ * @details
+ *          Client tasks submit transactions (optional reset, bytes written,
+ *          bytes read) through client handles, scheduler runs them one after
+ *          another on its bus. Every client has token bucket filled with
+ *          budget of slot time per second, transaction is charged with its
+ *          slot time when it starts. Client with enough tokens is served
+ *          round robin, when no waiting client has enough tokens idle bus
+ *          time is lent to waiting clients in proportion to their budgets.
+ *
+ *          Prefetch entries learn period in which consumer asks for value of
+ *          sensor and start conversion and read ahead of expected request,
+ *          so value is already cached when it is requested.
+ *
+ *          Conversions of prefetch entries can be limited by current budget
+ *          of bus and by global budget shared by schedulers of all buses.
+ *          Due conversions are started earliest deadline first while their
+ *          current fits both budgets, the rest waits until running
+ *          conversions end, so conversions run in staggered waves.
+ *
+ *          Transaction on DS2409 coupler branch is preceded by switching
+ *          command when other branch is connected. Client whose next
+ *          transaction is on connected branch is preferred for up to
+ *          ONEWIRE_SCHEDULER_BRANCH_BATCH transactions, batch submit groups
+ *          transactions by branch, so couplers are toggled rarely.
+ *
+ * @note    onewire_scheduler_process() replaces onewire_process() in bus task,
+ *          transactions are submitted from same task or under critical section.
+ *          On Linux port schedulers sharing global budget are processed from
+ *          one thread.
+ *
+ * @license MIT License
+ ******************************************************************************
+ */
+
+#ifndef __oneWireScheduler_H
+#define __oneWireScheduler_H
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+#include "oneWire.h"
+#include <stdint.h>
+
+#ifndef ONEWIRE_SCHEDULER_MAX_CLIENTS
+ #define ONEWIRE_SCHEDULER_MAX_CLIENTS  4
+#endif
+
+// transactions on connected coupler branch are preferred until this many ran in row
+#ifndef ONEWIRE_SCHEDULER_BRANCH_BATCH
+ #define ONEWIRE_SCHEDULER_BRANCH_BATCH 8
+#endif
+
+#define ONEWIRE_PREFETCH_MAX_DATA       9   // DS18B20 scratchpad with CRC
+#define ONEWIRE_PREFETCH_MIN_SAMPLES    3   // requests needed before prefetch starts
+#define ONEWIRE_PREFETCH_EWMA_SHIFT     2   // new interval has weight 1/4 in learned period
+
+typedef enum {
+	ONEWIRE_TXN_STATUS_OK,
+	ONEWIRE_TXN_STATUS_NO_PRESENCE,     // reset was not answered by any device
+	ONEWIRE_TXN_STATUS_ERROR            // driver entered error state
+}OneWireTxnStatus;
+
+typedef struct OneWireTxn OneWireTxn;
+typedef struct OneWireBranch OneWireBranch;    // DS2409 coupler branch, see oneWireCoupler.h
+
+typedef void (*OneWireTxnCallback)(OneWireTxn* txn, OneWireTxnStatus status, void* context);
+
+// transaction is owned by client and must stay valid until callback is called
+struct OneWireTxn {
+	const uint8_t* tx;              // bytes written after reset (ROM and function command, ...)
+	uint8_t tx_length;
+	uint8_t* rx;                    // bytes read after tx
+	uint8_t rx_length;
+	uint8_t reset;                  // start transaction with reset pulse
+	OneWireTxnCallback callback;    // can be NULL
+	void* context;                  // passed to callback
+	OneWireTxn* next;               // queue link, used by scheduler
+	OneWireBranch* branch;          // branch of addressed device, NULL runs on connected branch
+#if ONEWIRE_LATENCY_STATS
+	OneWireTxnStats stats;          // set by scheduler, type is taken from ROM and function command
+#endif
+};
+
+typedef struct {
+	uint32_t budget;                // us of slot time per second, 0 means unlimited
+	int32_t burst;                  // most tokens client can save, us
+	int32_t tokens;                 // us of slot time client can use now, negative after borrowing
+	TickType_t last_refill;
+	OneWireTxn* head;               // waiting transactions
+	OneWireTxn* tail;
+	uint32_t served;                // completed transactions
+	uint32_t borrowed;              // transactions started on lent bus time
+	uint32_t lent_time;             // lent bus time divided by budget, waiting client with lowest borrows
+} OneWireClient;
+
+// current budget shared by schedulers of several buses
+typedef struct {
+	uint32_t budget;                // uA, 0 means unlimited
+	volatile uint32_t used;         // uA drawn by running conversions
+	uint32_t peak;                  // highest used seen
+} OneWirePowerBudget;
+
+typedef enum {
+	ONEWIRE_PREFETCH_IDLE,
+	ONEWIRE_PREFETCH_CONVERT,           // convert command queued or on bus
+	ONEWIRE_PREFETCH_WAIT,              // device is converting
+	ONEWIRE_PREFETCH_READ               // read command queued or on bus
+}OneWirePrefetchState;
+
+typedef struct OneWirePrefetch OneWirePrefetch;
+
+// one sensor value consumed periodically, entry is owned by application
+struct OneWirePrefetch {
+	OneWireClient* client;          // prefetch transactions are charged to this client
+	uint8_t rom[8];                 // device ROM, used with Match ROM
+	uint8_t match_rom;              // 0 uses Skip ROM on single device bus
+	uint8_t convert_command;        // 0x44 for DS18B20
+	uint8_t read_command;           // 0xBE for DS18B20
+	uint8_t data_length;            // bytes read after read_command
+	uint8_t check_crc8;             // last byte of data is Dallas CRC8
+	OneWireBranch* branch;          // coupler branch of device, can be NULL
+	TickType_t conversion_ticks;
+	uint32_t current;               // uA drawn during conversion, 0 is not limited by budget
+	// learned request pattern
+	TickType_t last_request;
+	TickType_t period;              // EWMA of interval between requests
+	uint8_t samples;                // requests seen, saturated
+	// cached value
+	uint8_t value[ONEWIRE_PREFETCH_MAX_DATA];
+	TickType_t value_tick;          // tick when value was read
+	uint8_t fresh;                  // value was not handed to consumer yet
+	uint32_t hits;                  // requests served from cache
+	uint32_t misses;                // requests that had to wait for conversion
+	// internal
+	OneWireDriver* onewire;         // bus of scheduler entry was added to
+	uint8_t state;                  // OneWirePrefetchState
+	uint8_t demand;                 // missed request waits for conversion
+	uint8_t power_wait;             // due conversion was held back by budget
+	uint32_t reserved;              // uA of budgets held for running conversion
+	TickType_t convert_tick;        // start of conversion
+	OneWireTxn txn;
+	uint8_t tx[10];
+	uint8_t rx[ONEWIRE_PREFETCH_MAX_DATA];
+	OneWirePrefetch* next;
+};
+
+typedef struct {
+	OneWireDriver* onewire;
+	OneWireClient* clients[ONEWIRE_SCHEDULER_MAX_CLIENTS];
+	uint8_t client_count;
+	uint8_t last_client;            // round robin position
+	OneWireClient* active_client;
+	OneWireTxn* active;             // transaction on bus, NULL when idle
+	uint8_t step;                   // phase of active transaction
+	uint8_t index;                  // byte index in tx or rx
+	OneWirePrefetch* prefetch;      // list of prefetch entries
+	OneWirePowerBudget* power;      // global budget, can be NULL
+	uint32_t bus_budget;            // uA, 0 means unlimited
+	uint32_t bus_used;              // uA drawn by running conversions on this bus
+	uint32_t bus_peak;              // highest bus_used seen
+	uint32_t power_deferred;        // conversions that waited for budget
+	uint32_t lent_clock;            // lent_time of last borrower, client starting to wait begins there
+	const void* hold_owner;         // no transaction is started while set, bus is used outside of scheduler
+	// coupler branches
+	OneWireBranch* active_branch;   // connected branch, NULL when all branches are off
+	OneWireBranch* switch_target;   // branch connected by running switch, NULL for all lines off
+	OneWireClient* switch_client;   // client whose transaction waits for switch
+	OneWireTxn switch_txn;
+	uint8_t switch_tx[12];
+	uint8_t switch_rx[2];
+	uint8_t branch_batch;           // transactions in row on connected branch
+	uint32_t branch_switches;       // coupler commands sent
+} OneWireScheduler;
+
+void onewire_scheduler_init(OneWireScheduler* scheduler, OneWireDriver* onewire);
+int onewire_scheduler_add_client(OneWireScheduler* scheduler, OneWireClient* client, uint32_t budget, uint32_t burst);
+void onewire_scheduler_set_budget(OneWireClient* client, uint32_t budget, uint32_t burst);
+void onewire_scheduler_submit(OneWireScheduler* scheduler, OneWireClient* client, OneWireTxn* txn);
+void onewire_scheduler_submit_batch(OneWireScheduler* scheduler, OneWireClient* client, OneWireTxn** txns, uint16_t count);
+void onewire_scheduler_process(OneWireScheduler* scheduler);
+uint8_t onewire_scheduler_is_idle(OneWireScheduler* scheduler);
+uint8_t onewire_scheduler_hold(OneWireScheduler* scheduler, const void* owner);
+void onewire_scheduler_release(OneWireScheduler* scheduler, const void* owner);
+uint32_t onewire_scheduler_txn_cost(OneWireDriver* onewire, const OneWireTxn* txn);
+void onewire_prefetch_init(OneWirePrefetch* prefetch, OneWireClient* client, const uint8_t* rom, uint8_t convert_command, uint32_t conversion_ms, uint8_t read_command, uint8_t data_length);
+void onewire_scheduler_add_prefetch(OneWireScheduler* scheduler, OneWirePrefetch* prefetch);
+uint8_t onewire_prefetch_request(OneWireScheduler* scheduler, OneWirePrefetch* prefetch, uint8_t* data);
+uint8_t onewire_prefetch_get(OneWirePrefetch* prefetch, uint8_t* data);
+void onewire_prefetch_set_current(OneWirePrefetch* prefetch, uint32_t current);
+void onewire_prefetch_set_branch(OneWirePrefetch* prefetch, OneWireBranch* branch);
+void onewire_power_budget_init(OneWirePowerBudget* power, uint32_t budget);
+void onewire_scheduler_set_power(OneWireScheduler* scheduler, OneWirePowerBudget* power, uint32_t bus_budget);
+uint8_t onewire_scheduler_power_acquire(OneWireScheduler* scheduler, uint32_t current);
+void onewire_scheduler_power_release(OneWireScheduler* scheduler, uint32_t current);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,366 @@
+/**
+ ******************************************************************************
+ * @file    oneWireSearch.c
+ * @brief   Non blocking ROM search, device table and hot-plug discovery
+ *
+ * @details
+ *          Each pass resets bus, sends search command and for every ROM bit
+ *          reads bit and its complement and writes chosen direction. Where
+ *          devices disagree pass takes 1 branch at last discrepancy of
+ *          previous pass and 0 branch at deeper ones, search ends when pass
+ *          has no 0 branch left.
+ *
+ * @license MIT License
+ ******************************************************************************
+ */
+
+#include "oneWireSearch.h"
+#include <string.h>
+#ifndef ONEWIRE_PORT_LINUX
+#include "task.h"
+#endif
+
+typedef enum {
+	SEARCH_STEP_RESET,              // reset pulse on bus
+	SEARCH_STEP_COMMAND,            // search command on bus
+	SEARCH_STEP_ID_BIT,             // ROM bit read
+	SEARCH_STEP_COMPLEMENT_BIT,     // complement of ROM bit read
+	SEARCH_STEP_DIRECTION           // chosen direction written
+}SearchStep;
+
+
+/* Private function prototypes -----------------------------------------------*/
+static void start_pass(OneWireSearch* search);
+static void finish_search(OneWireSearch* search, OneWireSearchStatus status);
+static void choose_direction(OneWireSearch* search, uint8_t complement_bit);
+static void finish_pass(OneWireSearch* search);
+static void table_add(OneWireDeviceTable* table, const uint8_t* rom);
+#if ONEWIRE_HOTPLUG
+static void hotplug_failed(OneWireHotplug* hotplug);
+static void hotplug_select_done(OneWireTxn* txn, OneWireTxnStatus status, void* context);
+#endif
+
+
+static void start_pass(OneWireSearch* search) {
+	search->step = SEARCH_STEP_RESET;
+	onewire_reset(search->onewire);
+}
+
+static void finish_search(OneWireSearch* search, OneWireSearchStatus status) {
+	OneWireDeviceTable* table = search->table;
+
+	// absence is known only after Search ROM walked whole tree
+	if (table != NULL && search->command == SEARCH_ROM && status == ONEWIRE_SEARCH_DONE) {
+		for (uint8_t i = 0; i < table->count; i++) {
+			if (table->devices[i].present && !table->devices[i].seen) {
+				table->devices[i].present = 0;
+				table->lost++;
+			}
+		}
+	}
+#if ONEWIRE_LATENCY_STATS
+	onewire_txn_complete(search->onewire, &search->txn, status == ONEWIRE_SEARCH_DONE);
+#endif
+	search->running = 0;
+	search->status = status;
+}
+
+static void choose_direction(OneWireSearch* search, uint8_t complement_bit) {
+	uint8_t byte = (search->bit_number - 1) / 8;
+	uint8_t mask = 1 << ((search->bit_number - 1) % 8);
+	uint8_t direction;
+
+	if (search->id_bit != complement_bit) {
+		direction = search->id_bit; // all remaining devices have same bit
+	}
+	else if (search->bit_number < search->last_discrepancy) {
+		direction = (search->rom[byte] & mask) != 0; // follow path of previous pass
+	}
+	else {
+		direction = (search->bit_number == search->last_discrepancy);
+	}
+	if (search->id_bit == complement_bit && direction == 0) {
+		search->last_zero = search->bit_number;
+	}
+	if (direction) {
+		search->rom[byte] |= mask;
+	}
+	else {
+		search->rom[byte] &= ~mask;
+	}
+	search->step = SEARCH_STEP_DIRECTION;
+	onewire_write_bit(search->onewire, direction);
+}
+
+static void finish_pass(OneWireSearch* search) {
+	uint8_t crc = 0;
+
+	for (uint8_t i = 0; i < sizeof(search->rom); i++) {
+		crc = onewire_crc8_update(crc, search->rom[i]);
+	}
+	if (crc != 0) {
+#if ONEWIRE_BLACKBOX_SIZE > 0
+		onewire_blackbox_trigger(search->onewire);
+#endif
+		finish_search(search, ONEWIRE_SEARCH_ERROR); // corrupted pass, its branches can not be trusted
+		return;
+	}
+	search->found++;
+	if (search->table != NULL && (search->exclude == NULL || onewire_device_table_find(search->exclude, search->rom) < 0)) {
+		table_add(search->table, search->rom);
+	}
+	search->last_discrepancy = search->last_zero;
+	if (search->last_discrepancy == 0) {
+		finish_search(search, ONEWIRE_SEARCH_DONE);
+		return;
+	}
+	start_pass(search);
+}
+
+static void table_add(OneWireDeviceTable* table, const uint8_t* rom) {
+	int index = onewire_device_table_find(table, rom);
+
+	if (index >= 0) {
+		table->devices[index].present = 1;
+		table->devices[index].seen = 1;
+		return;
+	}
+	if (table->count >= table->capacity) {
+		table->overflow++;
+		return;
+	}
+	memcpy(table->devices[table->count].rom, rom, 8);
+	table->devices[table->count].present = 1;
+	table->devices[table->count].is_new = 1;
+	table->devices[table->count].seen = 1;
+	table->count++;
+	table->added++;
+}
+
+void onewire_device_table_init(OneWireDeviceTable* table, OneWireDevice* devices, uint8_t capacity) {
+	table->devices = devices;
+	table->capacity = capacity;
+	table->count = 0;
+	table->added = 0;
+	table->lost = 0;
+	table->overflow = 0;
+}
+
+// returns index of device or -1
+int onewire_device_table_find(const OneWireDeviceTable* table, const uint8_t* rom) {
+	for (uint8_t i = 0; i < table->count; i++) {
+		if (memcmp(table->devices[i].rom, rom, 8) == 0) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+// table can be NULL, found ROMs are then only counted
+void onewire_search_start(OneWireSearch* search, OneWireDriver* onewire, OneWireDeviceTable* table, uint8_t command) {
+	memset(search->rom, 0, sizeof(search->rom));
+	search->onewire = onewire;
+	search->table = table;
+	search->exclude = NULL;
+	search->command = command;
+	search->last_discrepancy = 0;
+	search->last_zero = 0;
+	search->found = 0;
+	search->running = 1;
+	search->status = ONEWIRE_SEARCH_RUNNING;
+	if (table != NULL) {
+		table->added = 0;
+		table->lost = 0;
+		table->overflow = 0;
+		for (uint8_t i = 0; i < table->count; i++) {
+			table->devices[i].is_new = 0;
+			table->devices[i].seen = 0;
+		}
+	}
+#if ONEWIRE_LATENCY_STATS
+	onewire_txn_submit(onewire, &search->txn, ONEWIRE_TXN_SEARCH);
+	onewire_txn_start(onewire, &search->txn);
+#endif
+	start_pass(search);
+}
+
+// call right after onewire_search_start(), used to keep trunk devices out of coupler branch table
+void onewire_search_exclude(OneWireSearch* search, const OneWireDeviceTable* exclude) {
+	search->exclude = exclude;
+}
+
+// call after onewire_process() in same loop until status is not ONEWIRE_SEARCH_RUNNING
+OneWireSearchStatus onewire_search_process(OneWireSearch* search) {
+	OneWireDriver* onewire = search->onewire;
+	uint8_t complement_bit;
+
+	if (!search->running) {
+		return search->status;
+	}
+	if (onewire->state == ONEWIRE_STATE_ERROR) {
+		finish_search(search, ONEWIRE_SEARCH_ERROR);
+		return search->status;
+	}
+	if (onewire->state != ONEWIRE_STATE_IDLE) {
+		return ONEWIRE_SEARCH_RUNNING; // operation still on bus
+	}
+	switch (search->step) {
+	case SEARCH_STEP_RESET:
+		if (!onewire_is_slave_present(onewire)) {
+			finish_search(search, (search->found == 0) ? ONEWIRE_SEARCH_NO_DEVICES : ONEWIRE_SEARCH_ERROR);
+			break;
+		}
+		search->last_zero = 0;
+		search->bit_number = 1;
+		search->step = SEARCH_STEP_COMMAND;
+		onewire_write_byte(onewire, search->command);
+		break;
+	case SEARCH_STEP_COMMAND:
+		search->step = SEARCH_STEP_ID_BIT;
+		onewire_read_bit(onewire);
+		break;
+	case SEARCH_STEP_ID_BIT:
+		search->id_bit = onewire_get_bit(onewire);
+		search->step = SEARCH_STEP_COMPLEMENT_BIT;
+		onewire_read_bit(onewire);
+		break;
+	case SEARCH_STEP_COMPLEMENT_BIT:
+		complement_bit = onewire_get_bit(onewire);
+		if (search->id_bit && complement_bit) {
+			// no device answered, device was removed or Alarm Search has no alarming device
+			finish_search(search, (search->found == 0 && search->bit_number == 1) ? ONEWIRE_SEARCH_NO_DEVICES : ONEWIRE_SEARCH_ERROR);
+			break;
+		}
+		choose_direction(search, complement_bit);
+		break;
+	case SEARCH_STEP_DIRECTION:
+		if (search->bit_number < 64) {
+			search->bit_number++;
+			search->step = SEARCH_STEP_ID_BIT;
+			onewire_read_bit(onewire);
+		}
+		else {
+			finish_pass(search);
+		}
+		break;
+	default:
+		break;
+	}
+	return search->running ? ONEWIRE_SEARCH_RUNNING : search->status;
+}
+
+#if ONEWIRE_HOTPLUG
+static void hotplug_failed(OneWireHotplug* hotplug) {
+	hotplug->failures++;
+	if (hotplug->retries < ONEWIRE_HOTPLUG_RETRIES) {
+		hotplug->retries++;
+		hotplug->pending = 1; // devices found so far are kept, tree is walked again
+	}
+	else {
+		hotplug->pending = 0;
+	}
+}
+
+// trunk is connected, bus is held right away so no transaction reconnects branch before search
+static void hotplug_select_done(OneWireTxn* txn, OneWireTxnStatus status, void* context) {
+	OneWireHotplug* hotplug = context;
+
+	(void)txn;
+	hotplug->selecting = 0;
+	if (status != ONEWIRE_TXN_STATUS_OK) {
+		hotplug_failed(hotplug);
+		return;
+	}
+	onewire_scheduler_hold(hotplug->scheduler, hotplug);
+}
+
+void onewire_hotplug_init(OneWireHotplug* hotplug, OneWireDriver* onewire, OneWireScheduler* scheduler, OneWireDeviceTable* table) {
+	hotplug->onewire = onewire;
+	hotplug->scheduler = scheduler;
+	hotplug->table = table;
+	hotplug->client = NULL;
+	hotplug->trunk = NULL;
+	hotplug->selecting = 0;
+	hotplug->search.running = 0;
+	hotplug->search.status = ONEWIRE_SEARCH_DONE;
+	hotplug->pending = 0;
+	hotplug->retries = 0;
+	hotplug->searches = 0;
+	hotplug->failures = 0;
+	hotplug->callback = NULL;
+	hotplug->context = NULL;
+}
+
+void onewire_hotplug_set_callback(OneWireHotplug* hotplug, OneWireHotplugCallback callback, void* context) {
+	hotplug->context = context;
+	hotplug->callback = callback;
+}
+
+// with DS2409 couplers search runs on trunk, All Lines Off is sent through scheduler for client first
+void onewire_hotplug_set_trunk(OneWireHotplug* hotplug, OneWireClient* client, OneWireBranch* trunk) {
+	hotplug->client = client;
+	hotplug->trunk = trunk;
+}
+
+// searches bus without presence pulse, used for initial table or after power cycle of whole bus
+void onewire_hotplug_request(OneWireHotplug* hotplug) {
+	hotplug->pending = 1;
+	hotplug->retries = 0;
+}
+
+// call after onewire_process() or onewire_scheduler_process() in same loop
+void onewire_hotplug_process(OneWireHotplug* hotplug) {
+	OneWireScheduler* scheduler = hotplug->scheduler;
+
+	if (hotplug->search.running) {
+		OneWireSearchStatus status = onewire_search_process(&hotplug->search);
+
+		if (status == ONEWIRE_SEARCH_RUNNING) {
+			return;
+		}
+		if (scheduler != NULL) {
+			onewire_scheduler_release(scheduler, hotplug);
+		}
+		hotplug->searches++;
+		if (status == ONEWIRE_SEARCH_ERROR) {
+			hotplug_failed(hotplug);
+		}
+		else {
+			hotplug->retries = 0;
+		}
+		if (hotplug->table->added > 0 && hotplug->callback != NULL) {
+			hotplug->callback(hotplug, hotplug->context);
+		}
+	}
+	if (onewire_hotplug_take(hotplug->onewire)) {
+		hotplug->pending = 1; // pulse during search is searched again, device may have missed running pass
+		hotplug->retries = 0;
+	}
+	if (!hotplug->pending || hotplug->selecting) {
+		return;
+	}
+	if (scheduler != NULL) {
+		if (hotplug->trunk != NULL && scheduler->active_branch != NULL && scheduler->hold_owner != hotplug) {
+			// transaction on trunk branch makes scheduler turn connected coupler branch off
+			memset(&hotplug->select, 0, sizeof(hotplug->select));
+			hotplug->select.branch = hotplug->trunk;
+			hotplug->select.callback = hotplug_select_done;
+			hotplug->select.context = hotplug;
+			hotplug->selecting = 1;
+			onewire_scheduler_submit(scheduler, hotplug->client, &hotplug->select);
+			return;
+		}
+		if (!onewire_scheduler_hold(scheduler, hotplug)) {
+			return; // other search uses bus
+		}
+		if (scheduler->active != NULL) {
+			return; // running transaction finishes first
+		}
+	}
+	if (hotplug->onewire->state != ONEWIRE_STATE_IDLE && hotplug->onewire->state != ONEWIRE_STATE_ERROR) {
+		return; // reset of new search leaves error state of failed one
+	}
+	hotplug->pending = 0;
+	onewire_search_start(&hotplug->search, hotplug->onewire, hotplug->table, SEARCH_ROM);
+}
+#endif
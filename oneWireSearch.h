@@ -0,0 +1,125 @@
+/**
+ ******************************************************************************
+ * @file    oneWireSearch.h
+ * @brief   Non blocking ROM search, device table and hot-plug discovery
+ *
+ * @details
+ *          Search walks ROM tree with Search ROM or Alarm Search, one reset,
+ *          byte or bit operation per onewire_search_process() call, so it
+ *          runs in same loop as onewire_process(). Found ROMs update device
+ *          table in place, new ROMs are appended and devices that did not
+ *          answer full Search ROM are marked absent, table is never rebuilt.
+ *
+ *          Hot-plug helper (ONEWIRE_HOTPLUG) waits for presence pulse seen
+ *          by idle line monitor of driver and searches bus, newly powered
+ *          device is in table within milliseconds without periodic searches.
+ *          Search disturbed by collision of slot with plugged device is
+ *          repeated up to ONEWIRE_HOTPLUG_RETRIES times.
+ *
+ * @note    Search owns bus while it runs. When scheduler shares bus, hot-plug
+ *          helper holds it and searches after running transaction finished,
+ *          it waits while branch search holds bus. With DS2409 couplers
+ *          connected branch is turned off first and trunk is searched.
+ *
+ * @license MIT License
+ ******************************************************************************
+ */
+
+#ifndef __oneWireSearch_H
+#define __oneWireSearch_H
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+#include "oneWire.h"
+#include <stdint.h>
+#include "oneWireScheduler.h"
+
+// hot-plug search that ended with ONEWIRE_SEARCH_ERROR is repeated up to this many times
+#ifndef ONEWIRE_HOTPLUG_RETRIES
+ #define ONEWIRE_HOTPLUG_RETRIES   3
+#endif
+
+typedef enum {
+	ONEWIRE_SEARCH_RUNNING,
+	ONEWIRE_SEARCH_DONE,
+	ONEWIRE_SEARCH_NO_DEVICES,          // reset was not answered
+	ONEWIRE_SEARCH_ERROR                // driver error or no device answered bit of ROM
+}OneWireSearchStatus;
+
+typedef struct {
+	uint8_t rom[8];
+	uint8_t present;                // answered last full search
+	uint8_t is_new;                 // added by last search
+	uint8_t seen;                   // answered running or last search
+} OneWireDevice;
+
+// devices buffer is owned by application
+typedef struct {
+	OneWireDevice* devices;
+	uint8_t capacity;
+	uint8_t count;
+	uint8_t added;                  // devices added by last search
+	uint8_t lost;                   // present devices that did not answer last search
+	uint8_t overflow;               // found devices that did not fit
+} OneWireDeviceTable;
+
+typedef struct {
+	OneWireDriver* onewire;
+	OneWireDeviceTable* table;      // can be NULL
+	const OneWireDeviceTable* exclude;  // ROMs listed here are not added to table, can be NULL
+	uint8_t command;                // SEARCH_ROM or ALARM_SEARCH
+	uint8_t rom[8];                 // ROM of current pass
+	uint8_t last_discrepancy;       // bit number (1..64) where last pass took 0 branch, 0 when none left
+	uint8_t last_zero;
+	uint8_t bit_number;             // 1..64
+	uint8_t id_bit;
+	uint8_t step;
+	uint8_t running;
+	uint8_t status;                 // OneWireSearchStatus
+	uint8_t found;                  // ROMs with valid CRC in this search
+#if ONEWIRE_LATENCY_STATS
+	OneWireTxnStats txn;
+#endif
+} OneWireSearch;
+
+void onewire_device_table_init(OneWireDeviceTable* table, OneWireDevice* devices, uint8_t capacity);
+int onewire_device_table_find(const OneWireDeviceTable* table, const uint8_t* rom);
+void onewire_search_start(OneWireSearch* search, OneWireDriver* onewire, OneWireDeviceTable* table, uint8_t command);
+void onewire_search_exclude(OneWireSearch* search, const OneWireDeviceTable* exclude);
+OneWireSearchStatus onewire_search_process(OneWireSearch* search);
+
+#if ONEWIRE_HOTPLUG
+typedef struct OneWireHotplug OneWireHotplug;
+
+// called after search that added devices
+typedef void (*OneWireHotplugCallback)(OneWireHotplug* hotplug, void* context);
+
+struct OneWireHotplug {
+	OneWireDriver* onewire;
+	OneWireScheduler* scheduler;    // held during search, can be NULL
+	OneWireClient* client;          // All Lines Off before search is charged to this client
+	OneWireBranch* trunk;           // NULL on bus without DS2409 couplers
+	OneWireDeviceTable* table;
+	OneWireSearch search;
+	OneWireTxn select;              // empty transaction on trunk, scheduler turns coupler branches off for it
+	uint8_t selecting;
+	uint8_t pending;                // presence pulse seen, search waits for bus
+	uint8_t retries;                // failed searches repeated since last pulse or request
+	uint32_t searches;
+	uint32_t failures;              // searches that ended with ONEWIRE_SEARCH_ERROR
+	OneWireHotplugCallback callback;    // can be NULL
+	void* context;                  // passed to callback
+};
+
+void onewire_hotplug_init(OneWireHotplug* hotplug, OneWireDriver* onewire, OneWireScheduler* scheduler, OneWireDeviceTable* table);
+void onewire_hotplug_set_callback(OneWireHotplug* hotplug, OneWireHotplugCallback callback, void* context);
+void onewire_hotplug_set_trunk(OneWireHotplug* hotplug, OneWireClient* client, OneWireBranch* trunk);
+void onewire_hotplug_request(OneWireHotplug* hotplug);
+void onewire_hotplug_process(OneWireHotplug* hotplug);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,157 @@
+/**
+ ******************************************************************************
+ * @file    oneWireTelemetry.c
+ * @brief   Binary telemetry records of OneWire driver statistics
+ *
+ * @details
+ *          Serialises jitter, error, bus utilization and latency statistics
+ *          of each bus into record described in oneWireTelemetry.h.
+ *          onewire_telemetry_process() is called from low priority telemetry
+ *          task, never from task that runs onewire_process(), so slot timing
+ *          is not disturbed by serialisation.
+ *
+ * @license MIT License
+ ******************************************************************************
+ */
+
+#include "oneWireTelemetry.h"
+#ifndef ONEWIRE_PORT_LINUX
+#include "task.h"
+#endif
+
+
+/* Private function prototypes -----------------------------------------------*/
+static uint8_t* put_u16(uint8_t* out, uint16_t value);
+static uint8_t* put_u32(uint8_t* out, uint32_t value);
+static void emit_record(OneWireTelemetry* telemetry, uint16_t length);
+
+
+static uint8_t* put_u16(uint8_t* out, uint16_t value) {
+	*out++ = value & 0xFF;
+	*out++ = value >> 8;
+	return out;
+}
+
+static uint8_t* put_u32(uint8_t* out, uint32_t value) {
+	out = put_u16(out, value & 0xFFFF);
+	return put_u16(out, value >> 16);
+}
+
+static void emit_record(OneWireTelemetry* telemetry, uint16_t length) {
+#ifndef ONEWIRE_PORT_LINUX
+	if (telemetry->stream != NULL) {
+		// whole record or nothing, reader never sees partial record
+		if (xStreamBufferSpacesAvailable(telemetry->stream) >= length) {
+			xStreamBufferSend(telemetry->stream, telemetry->record, length, 0);
+		}
+		else {
+			telemetry->dropped++;
+		}
+	}
+#endif
+	if (telemetry->sink != NULL) {
+		telemetry->sink(telemetry->record, length, telemetry->context);
+	}
+}
+
+void onewire_telemetry_init(OneWireTelemetry* telemetry, OneWireDriver* const* buses, uint8_t bus_count, uint32_t period_ms) {
+	telemetry->buses = buses;
+	telemetry->bus_count = bus_count;
+	telemetry->period = (TickType_t)((uint64_t)period_ms * ONEWIRE_TICK_RATE_HZ / 1000);
+	telemetry->last_tick = ONEWIRE_GET_TICK();
+#ifndef ONEWIRE_PORT_LINUX
+	telemetry->stream = NULL;
+#endif
+	telemetry->sink = NULL;
+	telemetry->context = NULL;
+	telemetry->sequence = 0;
+	telemetry->dropped = 0;
+}
+
+#ifndef ONEWIRE_PORT_LINUX
+void onewire_telemetry_set_stream(OneWireTelemetry* telemetry, StreamBufferHandle_t stream) {
+	telemetry->stream = stream;
+}
+#endif
+
+void onewire_telemetry_set_sink(OneWireTelemetry* telemetry, OneWireTelemetrySink sink, void* context) {
+	telemetry->context = context;
+	telemetry->sink = sink;
+}
+
+// emits one record per bus every period
+void onewire_telemetry_process(OneWireTelemetry* telemetry) {
+	TickType_t now = ONEWIRE_GET_TICK();
+
+	if ((TickType_t)(now - telemetry->last_tick) < telemetry->period) {
+		return;
+	}
+	telemetry->last_tick = now;
+	for (uint8_t i = 0; i < telemetry->bus_count; i++) {
+		uint16_t length = onewire_telemetry_serialize(telemetry->buses[i], i, telemetry->sequence, telemetry->record, sizeof(telemetry->record));
+
+		telemetry->sequence++;
+		emit_record(telemetry, length);
+	}
+}
+
+// writes record of one bus, returns its length or 0 when buffer is too small.
+// Statistics are read without locking, single record may mix values of two neighbouring windows.
+uint16_t onewire_telemetry_serialize(OneWireDriver* onewire, uint8_t bus_index, uint32_t sequence, uint8_t* buffer, uint16_t size) {
+	uint8_t* out = buffer;
+	uint8_t sections = 0;
+
+	if (size < ONEWIRE_TELEMETRY_RECORD_SIZE) {
+		return 0;
+	}
+#if ONEWIRE_BUS_STATS
+	sections |= ONEWIRE_TELEMETRY_SECTION_BUS_STATS;
+#endif
+#if ONEWIRE_LATENCY_STATS
+	sections |= ONEWIRE_TELEMETRY_SECTION_LATENCY;
+#endif
+	*out++ = 'O';
+	*out++ = 'W';
+	*out++ = 'T';
+	*out++ = ONEWIRE_TELEMETRY_VERSION;
+	out = put_u16(out, ONEWIRE_TELEMETRY_RECORD_SIZE);
+	*out++ = bus_index;
+	*out++ = sections;
+#if ONEWIRE_LATENCY_STATS
+	*out++ = ONEWIRE_LATENCY_BUCKETS;
+#else
+	*out++ = 0;
+#endif
+	*out++ = 0;
+	*out++ = 0;
+	*out++ = 0;
+	out = put_u32(out, sequence);
+	out = put_u32(out, (uint32_t)ONEWIRE_GET_TICK());
+	out = put_u32(out, onewire->jitter.deadline_count);
+	out = put_u32(out, onewire->jitter.total_lateness);
+	out = put_u32(out, (uint32_t)onewire->jitter.max_lateness);
+	out = put_u32(out, onewire->errors.errors);
+	out = put_u32(out, onewire->errors.missing_presence);
+#if ONEWIRE_BUS_STATS
+	out = put_u16(out, onewire->bus_stats.utilization);
+	out = put_u16(out, onewire->bus_stats.last_utilization);
+	out = put_u32(out, onewire->bus_stats.cpu_cycles);
+	out = put_u32(out, onewire->bus_stats.last_cpu_cycles);
+	out = put_u32(out, onewire->bus_stats.window_count);
+#endif
+#if ONEWIRE_LATENCY_STATS
+	for (uint8_t type = 0; type < ONEWIRE_TXN_TYPE_COUNT; type++) {
+		const OneWireLatencyHistogram* histogram = &onewire->latency[type];
+
+		out = put_u32(out, histogram->count);
+		out = put_u32(out, histogram->failed);
+		for (uint8_t i = 0; i < ONEWIRE_LATENCY_BUCKETS; i++) {
+			out = put_u32(out, histogram->queue_delay[i]);
+		}
+		for (uint8_t i = 0; i < ONEWIRE_LATENCY_BUCKETS; i++) {
+			out = put_u32(out, histogram->service_time[i]);
+		}
+	}
+#endif
+	return (uint16_t)(out - buffer);
+}
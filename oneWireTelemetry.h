@@ -0,0 +1,90 @@
+/**
+ ******************************************************************************
+ * @file    oneWireTelemetry.h
+ * @brief   Binary telemetry records of OneWire driver statistics
+ *
+ * @details
+ *          Statistics of registered buses are periodically serialised into
+ *          fixed layout records and written to FreeRTOS stream buffer and/or
+ *          handed to callback, telemetry task forwards them without any
+ *          string formatting on MCU.
+ *
+ *          Record, all fields little endian:
+ *            0  'O' 'W' 'T' version
+ *            4  uint16 record length, uint8 bus index, uint8 sections
+ *               (bit 0 bus stats, bit 1 latency histograms)
+ *            8  uint8 latency bucket count, 3 bytes reserved
+ *            12 uint32 sequence number, uint32 tick of record
+ *            20 jitter stats: uint32 deadline count, total lateness, max lateness
+ *            32 error counters: uint32 errors, missing presence
+ *            40 bus stats section: uint16 utilization, last utilization,
+ *               uint32 cpu cycles, last cpu cycles, window count
+ *            .. latency section, for each OneWireTxnType: uint32 count,
+ *               failed, uint32 queue delay and service time buckets
+ *
+ * @note    Sections are present according to ONEWIRE_BUS_STATS and
+ *          ONEWIRE_LATENCY_STATS, layout is fixed for given build.
+ *
+ * @license MIT License
+ ******************************************************************************
+ */
+
+#ifndef __oneWireTelemetry_H
+#define __oneWireTelemetry_H
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+#include "oneWire.h"
+#include <stdint.h>
+#ifndef ONEWIRE_PORT_LINUX
+#include "stream_buffer.h"
+#endif
+
+#define ONEWIRE_TELEMETRY_VERSION            2    // 2 widened latency buckets to uint32
+
+#define ONEWIRE_TELEMETRY_SECTION_BUS_STATS  0x01
+#define ONEWIRE_TELEMETRY_SECTION_LATENCY    0x02
+
+#define ONEWIRE_TELEMETRY_BASE_SIZE          40
+#if ONEWIRE_BUS_STATS
+ #define ONEWIRE_TELEMETRY_BUS_STATS_SIZE    16
+#else
+ #define ONEWIRE_TELEMETRY_BUS_STATS_SIZE    0
+#endif
+#if ONEWIRE_LATENCY_STATS
+ #define ONEWIRE_TELEMETRY_LATENCY_SIZE      (ONEWIRE_TXN_TYPE_COUNT * (8 + 8 * ONEWIRE_LATENCY_BUCKETS))
+#else
+ #define ONEWIRE_TELEMETRY_LATENCY_SIZE      0
+#endif
+#define ONEWIRE_TELEMETRY_RECORD_SIZE        (ONEWIRE_TELEMETRY_BASE_SIZE + ONEWIRE_TELEMETRY_BUS_STATS_SIZE + ONEWIRE_TELEMETRY_LATENCY_SIZE)
+
+typedef void (*OneWireTelemetrySink)(const uint8_t* record, uint16_t length, void* context);
+
+typedef struct {
+	OneWireDriver* const* buses;    // bus index in record is position in this array
+	uint8_t bus_count;
+	TickType_t period;              // ticks between two rounds of records
+	TickType_t last_tick;           // tick of last round
+#ifndef ONEWIRE_PORT_LINUX
+	StreamBufferHandle_t stream;    // records are written here when not NULL
+#endif
+	OneWireTelemetrySink sink;      // called with each record when not NULL
+	void* context;                  // passed to sink
+	uint32_t sequence;              // sequence number of next record
+	uint32_t dropped;               // records that did not fit into stream buffer
+	uint8_t record[ONEWIRE_TELEMETRY_RECORD_SIZE];
+} OneWireTelemetry;
+
+void onewire_telemetry_init(OneWireTelemetry* telemetry, OneWireDriver* const* buses, uint8_t bus_count, uint32_t period_ms);
+#ifndef ONEWIRE_PORT_LINUX
+void onewire_telemetry_set_stream(OneWireTelemetry* telemetry, StreamBufferHandle_t stream);
+#endif
+void onewire_telemetry_set_sink(OneWireTelemetry* telemetry, OneWireTelemetrySink sink, void* context);
+void onewire_telemetry_process(OneWireTelemetry* telemetry);
+uint16_t onewire_telemetry_serialize(OneWireDriver* onewire, uint8_t bus_index, uint32_t sequence, uint8_t* buffer, uint16_t size);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
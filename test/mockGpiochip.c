@@ -0,0 +1,215 @@
+/**
+ ******************************************************************************
+ * @file    mockGpiochip.c
+ * @brief   Mock GPIO character device for tests of Linux GPIO backend
+ *
+ * @license MIT License
+ ******************************************************************************
+ */
+
+#include "mockGpiochip.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/gpio.h>
+
+MockGpiochip mock_gpiochip;
+
+int __real_open(const char* path, int flags, ...);
+int __real_ioctl(int fd, unsigned long request, ...);
+int __real_close(int fd);
+int __wrap_open(const char* path, int flags, ...);
+int __wrap_ioctl(int fd, unsigned long request, ...);
+int __wrap_close(int fd);
+
+/* Private function prototypes -----------------------------------------------*/
+static MockGpioLine* find_line(int fd);
+static int request_line(struct gpio_v2_line_request* request);
+static void line_edge(SimModel* model, GPIO_PinState level);
+
+
+void mock_gpiochip_init(void) {
+	memset(&mock_gpiochip, 0, sizeof(mock_gpiochip));
+	mock_gpiochip.chip_fd = -1;
+	for (uint8_t i = 0; i < MOCK_GPIOCHIP_LINES; i++) {
+		mock_gpiochip.lines[i].fd = -1;
+		mock_gpiochip.lines[i].event_fd = -1;
+		mock_gpiochip.lines[i].model.edge = line_edge;
+	}
+}
+
+// output line drives its node, input line with edge flags is notified about edges of segment
+void mock_gpiochip_attach(uint8_t line, SimBus* bus, uint8_t segment) {
+	mock_gpiochip.lines[line].attached = 1;
+	sim_bus_add_model(bus, &mock_gpiochip.lines[line].model, segment);
+}
+
+// descriptors of chip and lines not closed yet
+uint8_t mock_gpiochip_open_fds(void) {
+	uint8_t count = (mock_gpiochip.chip_fd >= 0) ? 1 : 0;
+
+	for (uint8_t i = 0; i < MOCK_GPIOCHIP_LINES; i++) {
+		count += (mock_gpiochip.lines[i].fd >= 0) ? 1 : 0;
+	}
+	return count;
+}
+
+
+int __wrap_open(const char* path, int flags, ...) {
+	mode_t mode = 0;
+
+	if (flags & O_CREAT) {
+		va_list args;
+
+		va_start(args, flags);
+		mode = (mode_t)va_arg(args, int);
+		va_end(args);
+	}
+	if (strncmp(path, MOCK_GPIOCHIP_PREFIX, strlen(MOCK_GPIOCHIP_PREFIX)) != 0) {
+		return __real_open(path, flags, mode);
+	}
+	if (strcmp(path, MOCK_GPIOCHIP_PATH) != 0 || mock_gpiochip.chip_fd >= 0) {
+		errno = ENOENT;
+		return -1;
+	}
+	mock_gpiochip.chip_fd = __real_open("/dev/null", O_RDWR | O_CLOEXEC); // real descriptor keeps numbers unique
+	mock_gpiochip.opens++;
+	return mock_gpiochip.chip_fd;
+}
+
+int __wrap_ioctl(int fd, unsigned long request, ...) {
+	va_list args;
+	void* argument;
+	MockGpioLine* line;
+
+	va_start(args, request);
+	argument = va_arg(args, void*);
+	va_end(args);
+	if (fd >= 0 && fd == mock_gpiochip.chip_fd) {
+		if (request != GPIO_V2_GET_LINE_IOCTL) {
+			errno = ENOTTY;
+			return -1;
+		}
+		return request_line((struct gpio_v2_line_request*)argument);
+	}
+	line = find_line(fd);
+	if (line == NULL) {
+		return __real_ioctl(fd, request, argument);
+	}
+	if (request == GPIO_V2_LINE_SET_VALUES_IOCTL) {
+		struct gpio_v2_line_values* values = (struct gpio_v2_line_values*)argument;
+
+		if (!(line->flags & GPIO_V2_LINE_FLAG_OUTPUT)) {
+			errno = EPERM;
+			return -1;
+		}
+		if (values->mask & 1) {
+			line->value = values->bits & 1;
+			line->set_count++;
+			if (line->attached) {
+				sim_model_drive(&line->model, !line->value); // open-drain, 1 releases line
+			}
+		}
+		return 0;
+	}
+	if (request == GPIO_V2_LINE_GET_VALUES_IOCTL) {
+		struct gpio_v2_line_values* values = (struct gpio_v2_line_values*)argument;
+		uint8_t level = line->value;
+
+		if (line->attached) {
+			level = (uint8_t)sim_bus_level(line->model.bus, line->model.bus->nodes[line->model.node].segment);
+		}
+		values->bits = level & values->mask & 1;
+		return 0;
+	}
+	errno = ENOTTY;
+	return -1;
+}
+
+int __wrap_close(int fd) {
+	MockGpioLine* line = find_line(fd);
+
+	if (line != NULL) {
+		__real_close(line->event_fd);
+		line->fd = -1;
+		line->event_fd = -1;
+		line->requested = 0;
+	}
+	else if (fd >= 0 && fd == mock_gpiochip.chip_fd) {
+		mock_gpiochip.chip_fd = -1;
+	}
+	return __real_close(fd);
+}
+
+
+static MockGpioLine* find_line(int fd) {
+	if (fd < 0) {
+		return NULL;
+	}
+	for (uint8_t i = 0; i < MOCK_GPIOCHIP_LINES; i++) {
+		if (mock_gpiochip.lines[i].fd == fd) {
+			return &mock_gpiochip.lines[i];
+		}
+	}
+	return NULL;
+}
+
+static int request_line(struct gpio_v2_line_request* request) {
+	MockGpioLine* line;
+	int pipe_fds[2];
+
+	if (request->num_lines != 1 || request->offsets[0] >= MOCK_GPIOCHIP_LINES) {
+		errno = EINVAL;
+		return -1;
+	}
+	line = &mock_gpiochip.lines[request->offsets[0]];
+	if (line->requested || line->busy) {
+		errno = EBUSY;
+		return -1;
+	}
+	if (pipe(pipe_fds) < 0) {
+		return -1;
+	}
+	line->requested = 1;
+	line->fd = pipe_fds[0];
+	line->event_fd = pipe_fds[1];
+	line->flags = request->config.flags;
+	line->initial_value = 0;
+	line->sequence = 0;
+	memcpy(line->consumer, request->consumer, sizeof(line->consumer));
+	line->consumer[sizeof(line->consumer) - 1] = '\0';
+	for (uint32_t i = 0; i < request->config.num_attrs; i++) {
+		if (request->config.attrs[i].attr.id == GPIO_V2_LINE_ATTR_ID_OUTPUT_VALUES && (request->config.attrs[i].mask & 1)) {
+			line->initial_value = request->config.attrs[i].attr.values & 1;
+		}
+	}
+	line->value = line->initial_value;
+	if ((line->flags & GPIO_V2_LINE_FLAG_OUTPUT) && line->attached) {
+		sim_model_drive(&line->model, !line->value);
+	}
+	request->fd = line->fd;
+	return 0;
+}
+
+// edge of segment is queued on requested input line with matching edge flag
+static void line_edge(SimModel* model, GPIO_PinState level) {
+	MockGpioLine* line = (MockGpioLine*)model;
+	struct gpio_v2_line_event event;
+	uint64_t flag = (level == GPIO_PIN_SET) ? GPIO_V2_LINE_FLAG_EDGE_RISING : GPIO_V2_LINE_FLAG_EDGE_FALLING;
+
+	if (!line->requested || !(line->flags & flag)) {
+		return;
+	}
+	memset(&event, 0, sizeof(event));
+	event.timestamp_ns = (uint64_t)sim_now * 1000;
+	event.id = (level == GPIO_PIN_SET) ? GPIO_V2_LINE_EVENT_RISING_EDGE : GPIO_V2_LINE_EVENT_FALLING_EDGE;
+	event.offset = (uint32_t)(line - mock_gpiochip.lines);
+	event.seqno = ++line->sequence;
+	event.line_seqno = line->sequence;
+	if (write(line->event_fd, &event, sizeof(event)) == (ssize_t)sizeof(event)) {
+		line->event_count++;
+	}
+}
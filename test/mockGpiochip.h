@@ -0,0 +1,66 @@
+/**
+ ******************************************************************************
+ * @file    mockGpiochip.h
+ * @brief   Mock GPIO character device for tests of Linux GPIO backend
+ *
+ * @details
+ *          Test is linked with -Wl,--wrap=open,--wrap=ioctl,--wrap=close.
+ *          Paths starting with MOCK_GPIOCHIP_PREFIX open mock chip, GPIO v2
+ *          line requests on it are recorded and return read end of pipe as
+ *          line descriptor, so poll() and read() of backend work unchanged.
+ *          Other descriptors are passed to libc.
+ *
+ *          Lines are attached to segments of simulated bus as model nodes.
+ *          Value set on output line drives its node, value read is level of
+ *          segment, edges of segment are written to pipe of input line with
+ *          edge flags as struct gpio_v2_line_event stamped with sim_now.
+ *
+ * @license MIT License
+ ******************************************************************************
+ */
+
+#ifndef __mockGpiochip_H
+#define __mockGpiochip_H
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+#include "oneWireSim.h"
+#include <stdint.h>
+
+#define MOCK_GPIOCHIP_PREFIX     "/mock/"
+#define MOCK_GPIOCHIP_PATH       "/mock/gpiochip0"
+#define MOCK_GPIOCHIP_LINES      8
+
+typedef struct {
+	SimModel model;                 // receives edges of segment for input line
+	uint8_t requested;
+	uint8_t busy;                   // request of line fails, line is used by other consumer
+	int fd;                         // returned to backend, read end of pipe
+	int event_fd;                   // write end of pipe
+	uint64_t flags;                 // GPIO_V2_LINE_FLAG_* of request
+	uint8_t initial_value;          // output value attribute of request
+	char consumer[32];
+	uint8_t value;                  // last value set on output line
+	uint32_t set_count;
+	uint32_t event_count;
+	uint32_t sequence;
+	uint8_t attached;
+} MockGpioLine;
+
+typedef struct {
+	MockGpioLine lines[MOCK_GPIOCHIP_LINES];
+	int chip_fd;                    // open chip descriptor, -1 when closed
+	uint32_t opens;
+} MockGpiochip;
+
+extern MockGpiochip mock_gpiochip;
+
+void mock_gpiochip_init(void);
+void mock_gpiochip_attach(uint8_t line, SimBus* bus, uint8_t segment);
+uint8_t mock_gpiochip_open_fds(void);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,446 @@
+/**
+ ******************************************************************************
+ * @file    oneWireSim.c
+ * @brief   Discrete-event host simulator of OneWire buses
+ *
+ * @license MIT License
+ ******************************************************************************
+ */
+
+#include "oneWireSim.h"
+#include <string.h>
+
+_Thread_local TickType_t sim_now;
+int sim_failures;
+
+/* Private function prototypes -----------------------------------------------*/
+static uint8_t net_of(SimBus* bus, uint8_t segment);
+static void update_levels(SimBus* bus);
+static void notify(SimNode* node);
+static void run_bus(SimBus* bus);
+static void advance(SimBus* const* buses, uint8_t count, TickType_t limit);
+static uint8_t master_idle(void* context);
+static void node_drive_low(void* context);
+static void node_release(void* context);
+static GPIO_PinState node_read(void* context);
+
+const OneWireBusOps sim_bus_ops = {
+	node_drive_low,
+	node_release,
+	node_read
+};
+
+
+void sim_bus_init(SimBus* bus) {
+	memset(bus, 0, sizeof(*bus));
+	bus->fast_forward = 1;
+	bus->max_jump = 1000;
+	bus->now = sim_now;
+}
+
+SimNode* sim_bus_add_driver(SimBus* bus, OneWireDriver* driver, OneWireOperatingMode mode, uint8_t segment) {
+	SimNode* node;
+
+	if (bus->node_count >= SIM_MAX_NODES) {
+		return NULL;
+	}
+	node = &bus->nodes[bus->node_count];
+	node->bus = bus;
+	node->index = bus->node_count++;
+	node->segment = segment;
+	node->level = sim_bus_level(bus, segment);
+	node->processed = 1;
+	node->driver = driver;
+	node->irq = (mode == OPERATING_MODE_SLAVE) ? SIM_IRQ_SLAVE : 0; // slave waits for edges in interrupts
+	onewire_init_custom(driver, &sim_bus_ops, node, mode);
+	return node;
+}
+
+SimNode* sim_bus_add_model(SimBus* bus, SimModel* model, uint8_t segment) {
+	SimNode* node;
+
+	if (bus->node_count >= SIM_MAX_NODES) {
+		return NULL;
+	}
+	node = &bus->nodes[bus->node_count];
+	node->bus = bus;
+	node->index = bus->node_count++;
+	node->segment = segment;
+	node->level = sim_bus_level(bus, segment);
+	node->model = model;
+	model->bus = bus;
+	model->node = node->index;
+	model->armed = 0;
+	model->current = 0;
+	return node;
+}
+
+void sim_bus_add_task(SimBus* bus, void (*process)(void*), TickType_t (*next_delay)(void*), void* context) {
+	if (bus->task_count < SIM_MAX_TASKS) {
+		bus->tasks[bus->task_count].process = process;
+		bus->tasks[bus->task_count].next_delay = next_delay;
+		bus->tasks[bus->task_count].context = context;
+		bus->task_count++;
+	}
+}
+
+void sim_bus_set_connected(SimBus* bus, uint32_t connected) {
+	bus->connected = connected;
+	update_levels(bus);
+}
+
+void sim_bus_drive(SimBus* bus, uint8_t node, uint8_t low) {
+	bus->nodes[node].low = low;
+	update_levels(bus);
+}
+
+GPIO_PinState sim_bus_level(SimBus* bus, uint8_t segment) {
+	uint8_t net = net_of(bus, segment);
+
+	for (uint8_t i = 0; i < bus->node_count; i++) {
+		if (bus->nodes[i].low && net_of(bus, bus->nodes[i].segment) == net) {
+			return GPIO_PIN_RESET;
+		}
+	}
+	return GPIO_PIN_SET;
+}
+
+// power NULL detaches bus from shared supply
+void sim_bus_set_power(SimBus* bus, SimPower* power) {
+	bus->power = power;
+}
+
+
+void sim_model_arm(SimModel* model, TickType_t delay) {
+	model->event_tick = sim_now + delay;
+	model->armed = 1;
+}
+
+void sim_model_cancel(SimModel* model) {
+	model->armed = 0;
+}
+
+void sim_model_drive(SimModel* model, uint8_t low) {
+	sim_bus_drive(model->bus, model->node, low);
+}
+
+// current in uA drawn by model from now on
+void sim_model_set_current(SimModel* model, uint32_t current) {
+	SimBus* bus = model->bus;
+
+	bus->current = bus->current - model->current + current;
+	if (bus->current > bus->peak) {
+		bus->peak = bus->current;
+	}
+	if (bus->power != NULL) {
+		bus->power->current = bus->power->current - model->current + current;
+		if (bus->power->current > bus->power->peak) {
+			bus->power->peak = bus->power->current;
+		}
+	}
+	model->current = current;
+}
+
+
+void sim_bus_fire_events(SimBus* bus) {
+	for (uint8_t i = 0; i < bus->node_count; i++) {
+		SimModel* model = bus->nodes[i].model;
+
+		if (model != NULL && model->armed && (int32_t)(sim_now - model->event_tick) >= 0) {
+			model->armed = 0;
+			model->event(model);
+		}
+	}
+}
+
+// ticks until something on bus has to run, 1 after edge so every driver sees it in next step
+TickType_t sim_bus_next_delay(SimBus* bus) {
+	TickType_t delay = bus->max_jump;
+	TickType_t next;
+
+	if (!bus->fast_forward || bus->changed) {
+		return 1;
+	}
+	for (uint8_t i = 0; i < bus->node_count; i++) {
+		SimNode* node = &bus->nodes[i];
+
+		if (node->driver != NULL) {
+			next = onewire_get_next_event_delay(node->driver);
+			if (next < delay) {
+				delay = next;
+			}
+		}
+		if (node->model != NULL && node->model->armed) {
+			int32_t left = (int32_t)(node->model->event_tick - sim_now);
+
+			next = (left > 0) ? (TickType_t)left : 0;
+			if (next < delay) {
+				delay = next;
+			}
+		}
+	}
+	for (uint8_t i = 0; i < bus->task_count; i++) {
+		next = (bus->tasks[i].next_delay != NULL) ? bus->tasks[i].next_delay(bus->tasks[i].context) : bus->max_jump;
+		if (next < delay) {
+			delay = next;
+		}
+	}
+	return delay;
+}
+
+void sim_step(SimBus* const* buses, uint8_t count) {
+	for (uint8_t i = 0; i < count; i++) {
+		run_bus(buses[i]);
+	}
+	advance(buses, count, portMAX_DELAY);
+}
+
+void sim_bus_step(SimBus* bus) {
+	sim_step(&bus, 1);
+}
+
+// bus runs at current tick first, clock stops at tick where end is reached
+void sim_bus_run_for(SimBus* bus, TickType_t ticks) {
+	TickType_t end = sim_now + ticks;
+
+	for (;;) {
+		int32_t left;
+
+		run_bus(bus);
+		left = (int32_t)(end - sim_now);
+		if (left <= 0) {
+			return;
+		}
+		advance(&bus, 1, (TickType_t)left);
+	}
+}
+
+// returns 1 when done() returned nonzero before timeout, clock stops at tick where it did
+uint8_t sim_bus_run_until(SimBus* bus, uint8_t (*done)(void*), void* context, TickType_t timeout) {
+	TickType_t start = sim_now;
+
+	for (;;) {
+		TickType_t elapsed;
+
+		run_bus(bus);
+		if (done(context)) {
+			return 1;
+		}
+		elapsed = sim_now - start;
+		if (elapsed >= timeout) {
+			return 0;
+		}
+		advance(&bus, 1, timeout - elapsed);
+	}
+}
+
+void sim_bus_enter(SimBus* bus) {
+	sim_now = bus->now;
+}
+
+void sim_bus_leave(SimBus* bus) {
+	bus->now = sim_now;
+}
+
+
+uint8_t sim_master_reset(SimBus* bus, OneWireDriver* master) {
+	onewire_reset(master);
+	sim_bus_run_until(bus, master_idle, master, SIM_OP_TIMEOUT);
+	return onewire_is_slave_present(master);
+}
+
+void sim_master_write_byte(SimBus* bus, OneWireDriver* master, uint8_t data) {
+	onewire_write_byte(master, data);
+	sim_bus_run_until(bus, master_idle, master, SIM_OP_TIMEOUT);
+}
+
+uint8_t sim_master_read_byte(SimBus* bus, OneWireDriver* master) {
+	onewire_read_byte(master);
+	sim_bus_run_until(bus, master_idle, master, SIM_OP_TIMEOUT);
+	return onewire_get_byte(master);
+}
+
+void sim_master_write_bit(SimBus* bus, OneWireDriver* master, uint8_t bit) {
+	onewire_write_bit(master, bit);
+	sim_bus_run_until(bus, master_idle, master, SIM_OP_TIMEOUT);
+}
+
+uint8_t sim_master_read_bit(SimBus* bus, OneWireDriver* master) {
+	onewire_read_bit(master);
+	sim_bus_run_until(bus, master_idle, master, SIM_OP_TIMEOUT);
+	return onewire_get_bit(master);
+}
+
+void sim_master_write(SimBus* bus, OneWireDriver* master, const uint8_t* data, uint8_t length) {
+	for (uint8_t i = 0; i < length; i++) {
+		sim_master_write_byte(bus, master, data[i]);
+	}
+}
+
+void sim_master_read(SimBus* bus, OneWireDriver* master, uint8_t* data, uint8_t length) {
+	for (uint8_t i = 0; i < length; i++) {
+		data[i] = sim_master_read_byte(bus, master);
+	}
+}
+
+// fills CRC8 byte of ROM from family code and serial number
+void sim_rom_crc(uint8_t* rom) {
+	uint8_t crc = 0;
+
+	for (uint8_t i = 0; i < 7; i++) {
+		crc = onewire_crc8_update(crc, rom[i]);
+	}
+	rom[7] = crc;
+}
+
+
+#if ONEWIRE_TRACE
+static const char* const trace_names[] = { "STATE", "DRIVE", "SAMPLE" };
+
+static void transcript_hook(OneWireDriver* onewire, const OneWireTraceEvent* event, void* context) {
+	SimTranscript* transcript = (SimTranscript*)context;
+
+	(void)onewire;
+	if (event->type == ONEWIRE_TRACE_STATE && !transcript->states) {
+		return;
+	}
+	if (event->type == ONEWIRE_TRACE_STATE) {
+		fprintf(transcript->out, "%8u STATE %u\n", (unsigned)(event->timestamp - transcript->start), event->state);
+	}
+	else {
+		fprintf(transcript->out, "%8u %s %u\n", (unsigned)(event->timestamp - transcript->start), trace_names[event->type], event->level);
+	}
+}
+
+void sim_transcript_start(SimTranscript* transcript, OneWireDriver* onewire, FILE* out, uint8_t states) {
+	transcript->out = out;
+	transcript->start = sim_now;
+	transcript->states = states;
+	onewire_set_trace_hook(onewire, transcript_hook, transcript);
+}
+
+void sim_transcript_stop(SimTranscript* transcript, OneWireDriver* onewire) {
+	(void)transcript;
+	onewire_set_trace_hook(onewire, NULL, NULL);
+}
+#endif
+
+
+// segment joined with trunk shares its net
+static uint8_t net_of(SimBus* bus, uint8_t segment) {
+	if (segment == 0 || (bus->connected & (1UL << segment))) {
+		return 0;
+	}
+	return segment;
+}
+
+// edges are delivered after all drives of call are applied, drive from handler restarts pass
+static void update_levels(SimBus* bus) {
+	uint8_t low[SIM_MAX_SEGMENTS];
+
+	if (bus->updating) {
+		bus->dirty = 1;
+		return;
+	}
+	bus->updating = 1;
+	do {
+		bus->dirty = 0;
+		memset(low, 0, sizeof(low));
+		for (uint8_t i = 0; i < bus->node_count; i++) {
+			if (bus->nodes[i].low) {
+				low[net_of(bus, bus->nodes[i].segment)] = 1;
+			}
+		}
+		for (uint8_t i = 0; i < bus->node_count && !bus->dirty; i++) {
+			SimNode* node = &bus->nodes[i];
+			uint8_t level = low[net_of(bus, node->segment)] ? GPIO_PIN_RESET : GPIO_PIN_SET;
+
+			if (level != node->level) {
+				node->level = level;
+				bus->changed = 1;
+				bus->edges++;
+				notify(node);
+			}
+		}
+	} while (bus->dirty);
+	bus->updating = 0;
+}
+
+static void notify(SimNode* node) {
+	if (node->model != NULL && node->model->edge != NULL) {
+		node->model->edge(node->model, (GPIO_PinState)node->level);
+	}
+	if (node->driver == NULL) {
+		return;
+	}
+	if (node->irq & SIM_IRQ_SLAVE) {
+		if (node->level == GPIO_PIN_RESET) {
+			onewire_slave_falling_edge_irq(node->driver);
+		}
+		else {
+			onewire_slave_rising_edge_irq(node->driver);
+		}
+	}
+#if ONEWIRE_HOTPLUG
+	if (node->irq & SIM_IRQ_IDLE) {
+		if (node->level == GPIO_PIN_RESET) {
+			onewire_idle_falling_edge_irq(node->driver);
+		}
+		else {
+			onewire_idle_rising_edge_irq(node->driver);
+		}
+	}
+#endif
+}
+
+static void run_bus(SimBus* bus) {
+	bus->changed = 0;
+	sim_bus_fire_events(bus);
+	for (uint8_t i = 0; i < bus->node_count; i++) {
+		if (bus->nodes[i].driver != NULL && bus->nodes[i].processed) {
+			onewire_process(bus->nodes[i].driver);
+		}
+	}
+	for (uint8_t i = 0; i < bus->task_count; i++) {
+		bus->tasks[i].process(bus->tasks[i].context);
+	}
+	bus->rounds++;
+}
+
+// buses share clock, it jumps to nearest event of all of them but not past limit
+static void advance(SimBus* const* buses, uint8_t count, TickType_t limit) {
+	TickType_t delay = limit;
+
+	for (uint8_t i = 0; i < count; i++) {
+		TickType_t next = sim_bus_next_delay(buses[i]);
+
+		if (next < delay) {
+			delay = next;
+		}
+	}
+	sim_now += (delay > 0) ? delay : 1;
+}
+
+static uint8_t master_idle(void* context) {
+	OneWireDriver* master = (OneWireDriver*)context;
+
+	return master->state == ONEWIRE_STATE_IDLE || master->state == ONEWIRE_STATE_ERROR;
+}
+
+static void node_drive_low(void* context) {
+	SimNode* node = (SimNode*)context;
+
+	sim_bus_drive(node->bus, node->index, 1);
+}
+
+static void node_release(void* context) {
+	SimNode* node = (SimNode*)context;
+
+	sim_bus_drive(node->bus, node->index, 0);
+}
+
+static GPIO_PinState node_read(void* context) {
+	SimNode* node = (SimNode*)context;
+
+	return sim_bus_level(node->bus, node->segment);
+}
@@ -0,0 +1,172 @@
+/**
+ ******************************************************************************
+ * @file    oneWireSim.h
+ * @brief   Discrete-event host simulator of OneWire buses
+ *
+ * @details
+ *          Bus is wired-AND of nodes, every node is master or slave driver
+ *          bound with onewire_init_custom() and sim_bus_ops, or device model
+ *          reacting to edges of its segment. Simulation clock is sim_now,
+ *          driver reads it through ONEWIRE_GET_TICK() (test/simClock.h).
+ *
+ *          Each step runs due model events, drivers and tasks once, then
+ *          clock jumps to nearest next event of all of them, asked from
+ *          onewire_get_next_event_delay() of drivers. Steps after bus edge
+ *          or polled state advance by one tick, so fast-forward produces
+ *          same transcript as stepping every tick (fast_forward = 0).
+ *
+ *          DS2409 branches are segments of bus, segment is joined with trunk
+ *          (segment 0) while its bit is set in connected mask.
+ *
+ *          Models report supply current they draw (sim_model_set_current()),
+ *          bus sums it and keeps peak, buses sharing supply also add it to
+ *          common SimPower.
+ *
+ * @note    Bus and models keep no global state, buses can be stepped from
+ *          different threads, sim_now is thread local and each thread loads
+ *          time of bus it steps (sim_bus_enter() / sim_bus_leave()).
+ *
+ * @license MIT License
+ ******************************************************************************
+ */
+
+#ifndef __oneWireSim_H
+#define __oneWireSim_H
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+#include "oneWire.h"
+#include <stdint.h>
+#include <stdio.h>
+
+#define SIM_MAX_NODES            16
+#define SIM_MAX_SEGMENTS         8      // trunk and coupler branches
+#define SIM_MAX_TASKS            8
+#define SIM_OP_TIMEOUT           2000   // us, longest reset or slot of master helpers
+
+// test assertion, failed checks are counted and give nonzero exit status of test
+#define SIM_CHECK(condition) do { \
+		if (!(condition)) { \
+			sim_failures++; \
+			fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+		} \
+	} while (0)
+
+// edge interrupts delivered to driver of node
+#define SIM_IRQ_SLAVE            0x01   // onewire_slave_*_edge_irq()
+#define SIM_IRQ_IDLE             0x02   // onewire_idle_*_edge_irq(), ONEWIRE_HOTPLUG
+
+typedef struct SimBus SimBus;
+typedef struct SimModel SimModel;
+
+// device model, edge is called when level of its segment changes, event when armed tick is reached
+struct SimModel {
+	void (*edge)(SimModel* model, GPIO_PinState level);
+	void (*event)(SimModel* model);
+	SimBus* bus;
+	uint8_t node;
+	uint8_t armed;
+	TickType_t event_tick;
+	uint32_t current;               // uA drawn from supply
+};
+
+// supply shared by several buses
+typedef struct {
+	uint32_t current;               // uA drawn by models of all buses
+	uint32_t peak;
+} SimPower;
+
+typedef struct {
+	SimBus* bus;                    // context of sim_bus_ops
+	uint8_t index;
+	uint8_t segment;
+	uint8_t low;                    // node pulls bus low
+	uint8_t level;                  // last level seen by node, GPIO_PinState
+	uint8_t irq;                    // SIM_IRQ_* delivered to driver
+	uint8_t processed;              // driver is processed by kernel, 0 when task processes it
+	OneWireDriver* driver;
+	SimModel* model;
+} SimNode;
+
+// code stepped with bus, such as scheduler or search, next_delay can be NULL for polled task
+typedef struct {
+	void (*process)(void* context);
+	TickType_t (*next_delay)(void* context);
+	void* context;
+} SimTask;
+
+struct SimBus {
+	SimNode nodes[SIM_MAX_NODES];
+	uint8_t node_count;
+	uint32_t connected;             // segments joined with trunk, bit per segment
+	SimTask tasks[SIM_MAX_TASKS];
+	uint8_t task_count;
+	uint8_t fast_forward;           // 0 steps every tick
+	TickType_t max_jump;            // longest step, bounds latency of polled tasks
+	TickType_t now;                 // time of bus between sim_bus_leave() and sim_bus_enter()
+	uint64_t rounds;                // steps taken
+	uint32_t edges;                 // level changes of any segment
+	uint32_t current;               // uA drawn by models of bus
+	uint32_t peak;                  // highest current seen
+	SimPower* power;                // shared supply, can be NULL
+	// internal
+	uint8_t changed;
+	uint8_t updating;
+	uint8_t dirty;
+};
+
+extern _Thread_local TickType_t sim_now;
+extern int sim_failures;
+extern const OneWireBusOps sim_bus_ops;
+
+void sim_bus_init(SimBus* bus);
+SimNode* sim_bus_add_driver(SimBus* bus, OneWireDriver* driver, OneWireOperatingMode mode, uint8_t segment);
+SimNode* sim_bus_add_model(SimBus* bus, SimModel* model, uint8_t segment);
+void sim_bus_add_task(SimBus* bus, void (*process)(void*), TickType_t (*next_delay)(void*), void* context);
+void sim_bus_set_connected(SimBus* bus, uint32_t connected);
+void sim_bus_drive(SimBus* bus, uint8_t node, uint8_t low);
+GPIO_PinState sim_bus_level(SimBus* bus, uint8_t segment);
+void sim_bus_set_power(SimBus* bus, SimPower* power);
+
+void sim_model_arm(SimModel* model, TickType_t delay);
+void sim_model_cancel(SimModel* model);
+void sim_model_drive(SimModel* model, uint8_t low);
+void sim_model_set_current(SimModel* model, uint32_t current);
+
+void sim_bus_fire_events(SimBus* bus);
+TickType_t sim_bus_next_delay(SimBus* bus);
+void sim_step(SimBus* const* buses, uint8_t count);
+void sim_bus_step(SimBus* bus);
+void sim_bus_run_for(SimBus* bus, TickType_t ticks);
+uint8_t sim_bus_run_until(SimBus* bus, uint8_t (*done)(void*), void* context, TickType_t timeout);
+void sim_bus_enter(SimBus* bus);
+void sim_bus_leave(SimBus* bus);
+
+// blocking master operations, bus is stepped until driver is idle again
+uint8_t sim_master_reset(SimBus* bus, OneWireDriver* master);
+void sim_master_write_byte(SimBus* bus, OneWireDriver* master, uint8_t data);
+uint8_t sim_master_read_byte(SimBus* bus, OneWireDriver* master);
+void sim_master_write_bit(SimBus* bus, OneWireDriver* master, uint8_t bit);
+uint8_t sim_master_read_bit(SimBus* bus, OneWireDriver* master);
+void sim_master_write(SimBus* bus, OneWireDriver* master, const uint8_t* data, uint8_t length);
+void sim_master_read(SimBus* bus, OneWireDriver* master, uint8_t* data, uint8_t length);
+
+void sim_rom_crc(uint8_t* rom);
+
+#if ONEWIRE_TRACE
+// trace events of master written one per line, ticks relative to start
+typedef struct {
+	FILE* out;
+	TickType_t start;
+	uint8_t states;                 // write state changes too
+} SimTranscript;
+
+void sim_transcript_start(SimTranscript* transcript, OneWireDriver* onewire, FILE* out, uint8_t states);
+void sim_transcript_stop(SimTranscript* transcript, OneWireDriver* onewire);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,1030 @@
+/**
+ ******************************************************************************
+ * @file    oneWireSimModels.c
+ * @brief   Device models for OneWire host simulator
+ *
+ * @license MIT License
+ ******************************************************************************
+ */
+
+#include "oneWireSimModels.h"
+#include <string.h>
+
+#define DS18B20_CONVERT_T        0x44
+#define DS18B20_COPY_SCRATCHPAD  0x48
+#define DS18B20_RECALL_EEPROM    0xB8
+#define DS18B20_READ_POWER       0xB4
+#define DS2409_SMART_ON_MAIN     0xCC
+#define DS2409_SMART_ON_AUX      0x33
+#define DS2409_DIRECT_ON_MAIN    0xA5
+#define DS2409_ALL_LINES_OFF     0x66
+#define DS2438_CONVERT_T         0x44
+#define DS2438_CONVERT_V         0xB4
+#define DS2438_RECALL_MEMORY     0xB8
+#define DS2438_READ_SCRATCHPAD   0xBE
+#define DS2450_CONVERT           0x3C
+#define DS2450_READ_MEMORY       0xAA
+
+typedef enum {
+	DS_IDLE,                        // waits for reset
+	DS_ROM,
+	DS_MATCH,
+	DS_SEARCH,
+	DS_FUNCTION,
+	DS_RECEIVE,                     // Write Scratchpad bytes
+	DS_TRANSMIT,
+	DS_BUSY,                        // read slots answer 0 while converting or copying
+	DS_POWER
+}SimDs18b20State;
+
+typedef enum {
+	SLOT_NONE,
+	SLOT_RELEASE,
+	SLOT_PRESENCE,
+	SLOT_PRESENCE_END
+}SimDs18b20SlotAction;
+
+typedef enum {
+	CP_IDLE,                        // waits for reset
+	CP_ROM,
+	CP_MATCH,
+	CP_SEARCH,
+	CP_FUNCTION,
+	CP_STIMULUS,                    // reset stimulus byte of Smart-On
+	CP_TRANSMIT                     // Read ROM, presence and confirmation bytes
+}SimDs2409State;
+
+typedef enum {
+	AD_IDLE,                        // waits for reset
+	AD_ROM,
+	AD_MATCH,
+	AD_FUNCTION,
+	AD_ARGUMENT,                    // page or address of function command
+	AD_TRANSMIT
+}SimAdcState;
+
+/* Private function prototypes -----------------------------------------------*/
+static void ds18b20_edge(SimModel* model, GPIO_PinState level);
+static void ds18b20_event(SimModel* model);
+static void ds18b20_rearm(SimDs18b20* device);
+static void ds18b20_hold(SimDs18b20* device, TickType_t ticks);
+static void ds18b20_schedule(SimDs18b20* device, uint8_t action, TickType_t delay);
+static uint8_t ds18b20_output_bit(SimDs18b20* device);
+static void ds18b20_input_bit(SimDs18b20* device, uint8_t bit);
+static void ds18b20_rom_command(SimDs18b20* device, uint8_t command);
+static void ds18b20_function_command(SimDs18b20* device, uint8_t command);
+static void ds18b20_transmit(SimDs18b20* device, const uint8_t* data, uint8_t length, uint8_t next_state);
+static void ds18b20_start_busy(SimDs18b20* device, uint8_t command, TickType_t ticks);
+static void ds18b20_end_busy(SimDs18b20* device);
+static void ds18b20_update_crc(SimDs18b20* device);
+static uint8_t is_transmitting(const SimDs18b20* device);
+static uint8_t is_due(TickType_t tick);
+static void ds18b20_read_done(OneWireTxn* txn, OneWireTxnStatus status, void* context);
+static uint8_t scratchpad_crc_ok(const uint8_t* scratchpad);
+static void ds2409_edge(SimModel* model, GPIO_PinState level);
+static void ds2409_event(SimModel* model);
+static void ds2409_hold(SimDs2409* coupler, TickType_t ticks);
+static void ds2409_schedule(SimDs2409* coupler, uint8_t action, TickType_t delay);
+static uint8_t ds2409_output_bit(SimDs2409* coupler);
+static void ds2409_input_bit(SimDs2409* coupler, uint8_t bit);
+static void ds2409_rom_command(SimDs2409* coupler, uint8_t command);
+static void ds2409_function_command(SimDs2409* coupler, uint8_t command);
+static void ds2409_transmit(SimDs2409* coupler, const uint8_t* data, uint8_t length);
+static void ds2409_slot_end(SimDs2409* coupler);
+static uint8_t ds2409_branch_presence(const SimDs2409* coupler, uint8_t segment);
+static void adc_init(SimAdc* device, const uint8_t* rom);
+static void adc_edge(SimModel* model, GPIO_PinState level);
+static void adc_event(SimModel* model);
+static void adc_rearm(SimAdc* device);
+static void adc_hold(SimAdc* device, TickType_t ticks);
+static void adc_schedule(SimAdc* device, uint8_t action, TickType_t delay);
+static uint8_t adc_output_bit(SimAdc* device);
+static void adc_input_bit(SimAdc* device, uint8_t bit);
+static void adc_function_command(SimAdc* device, uint8_t command);
+static void adc_arguments_done(SimAdc* device);
+static void adc_transmit(SimAdc* device, const uint8_t* data, uint8_t length);
+static void adc_start_busy(SimAdc* device, uint8_t index, TickType_t ticks);
+static void adc_end_busy(SimAdc* device, uint8_t index);
+static uint16_t adc_crc16(SimAdc* device, const uint8_t* data, uint8_t length);
+
+
+void sim_ds18b20_init(SimDs18b20* device, const uint8_t* rom) {
+	static const uint8_t power_on[8] = { 0x50, 0x05, 0x4B, 0x46, 0x7F, 0xFF, 0x0C, 0x10 };
+
+	memset(device, 0, sizeof(*device));
+	memcpy(device->rom, rom, 7);
+	sim_rom_crc(device->rom);
+	memcpy(device->scratchpad, power_on, sizeof(power_on));
+	memcpy(device->eeprom, &power_on[2], sizeof(device->eeprom));
+	ds18b20_update_crc(device);
+	device->temperature = 0x0550;
+	device->present = 1;
+	device->convert_current = SIM_DS18B20_CONVERT_CURRENT;
+	device->model.edge = ds18b20_edge;
+	device->model.event = ds18b20_event;
+}
+
+// plugged device sends presence pulse after power up, unplugged one releases bus
+void sim_ds18b20_plug(SimDs18b20* device, uint8_t present) {
+	device->present = present;
+	device->state = DS_IDLE;
+	device->reading = 0;
+	if (present) {
+		ds18b20_schedule(device, SLOT_PRESENCE, SIM_DS18B20_PRESENCE_WAIT);
+	}
+	else {
+		device->slot_action = SLOT_NONE;
+		device->busy = 0; // powered off, conversion is lost
+		sim_model_set_current(&device->model, 0);
+		if (device->holding) {
+			device->holding = 0;
+			sim_model_drive(&device->model, 0);
+		}
+		ds18b20_rearm(device);
+	}
+}
+
+// temperature of scratchpad in whole degrees is above TH or below TL
+uint8_t sim_ds18b20_alarm(const SimDs18b20* device) {
+	int8_t whole = (int8_t)((int16_t)(device->scratchpad[0] | (device->scratchpad[1] << 8)) >> 4);
+
+	return whole > (int8_t)device->scratchpad[2] || whole < (int8_t)device->scratchpad[3];
+}
+
+
+// transaction is submitted by caller, branch can be set after init
+void sim_ds18b20_read_init(SimDs18b20Read* read, const uint8_t* rom, void (*callback)(SimDs18b20Read* read, void* context), void* context) {
+	memset(read, 0, sizeof(*read));
+	read->tx[0] = MATCH_ROM;
+	memcpy(&read->tx[1], rom, 8);
+	read->tx[9] = READ_SCRATCHPAD;
+	read->txn.tx = read->tx;
+	read->txn.tx_length = sizeof(read->tx);
+	read->txn.rx = read->rx;
+	read->txn.rx_length = sizeof(read->rx);
+	read->txn.reset = 1;
+	read->txn.callback = ds18b20_read_done;
+	read->txn.context = read;
+	read->callback = callback;
+	read->context = context;
+}
+
+// scratchpad has valid CRC and holds temperature of device, stale or foreign value is rejected
+uint8_t sim_ds18b20_check_value(const SimDs18b20* device, const uint8_t* scratchpad) {
+	return scratchpad_crc_ok(scratchpad) && scratchpad[0] == (uint8_t)device->temperature
+		&& scratchpad[1] == (uint8_t)((uint16_t)device->temperature >> 8);
+}
+
+static void ds18b20_read_done(OneWireTxn* txn, OneWireTxnStatus status, void* context) {
+	SimDs18b20Read* read = (SimDs18b20Read*)context;
+
+	(void)txn;
+	read->status = status;
+	read->ok = (status == ONEWIRE_TXN_STATUS_OK && scratchpad_crc_ok(read->rx));
+	read->done = 1;
+	if (read->callback != NULL) {
+		read->callback(read, read->context);
+	}
+}
+
+static uint8_t scratchpad_crc_ok(const uint8_t* scratchpad) {
+	uint8_t crc = 0;
+
+	for (uint8_t i = 0; i < 9; i++) {
+		crc = onewire_crc8_update(crc, scratchpad[i]);
+	}
+	return crc == 0;
+}
+
+static void ds18b20_edge(SimModel* model, GPIO_PinState level) {
+	SimDs18b20* device = (SimDs18b20*)model;
+	TickType_t width;
+
+	if (!device->present || device->holding) {
+		return; // edges of own pulses
+	}
+	if (level == GPIO_PIN_RESET) {
+		device->low_tick = sim_now;
+		device->low_seen = 1;
+		device->reading = is_transmitting(device);
+		if (device->reading && !ds18b20_output_bit(device)) {
+			ds18b20_hold(device, SIM_DS18B20_READ_0_HOLD);
+		}
+		return;
+	}
+	if (!device->low_seen) {
+		return; // low period was started by model, other devices held it longer
+	}
+	device->low_seen = 0;
+	width = sim_now - device->low_tick;
+	if (width >= SIM_DS18B20_RESET_MIN) {
+		device->resets++;
+		device->state = DS_ROM;
+		device->bit_count = 0;
+		device->byte = 0;
+		device->reading = 0;
+		ds18b20_schedule(device, SLOT_PRESENCE, SIM_DS18B20_PRESENCE_WAIT);
+		return;
+	}
+	if (device->reading) {
+		device->reading = 0; // master released read slot
+		return;
+	}
+	ds18b20_input_bit(device, width < SIM_DS18B20_WRITE_1_MAX);
+}
+
+static void ds18b20_event(SimModel* model) {
+	SimDs18b20* device = (SimDs18b20*)model;
+
+	if (device->slot_action != SLOT_NONE && is_due(device->slot_tick)) {
+		uint8_t action = device->slot_action;
+
+		device->slot_action = SLOT_NONE;
+		switch (action) {
+		case SLOT_PRESENCE:
+			device->low_seen = 0; // other device can start low period first, its release is not slot
+			ds18b20_hold(device, SIM_DS18B20_PRESENCE_LOW);
+			break;
+		case SLOT_RELEASE:
+			sim_model_drive(model, 0);
+			device->holding = 0; // after drive, rising edge is not slot of master
+			break;
+		default:
+			break;
+		}
+	}
+	if (device->busy && is_due(device->busy_tick)) {
+		ds18b20_end_busy(device);
+	}
+	ds18b20_rearm(device);
+}
+
+// one armed event per model, nearest of slot timer and end of conversion
+static void ds18b20_rearm(SimDs18b20* device) {
+	uint8_t armed = 0;
+	TickType_t tick = 0;
+
+	if (device->slot_action != SLOT_NONE) {
+		tick = device->slot_tick;
+		armed = 1;
+	}
+	if (device->busy && (!armed || (int32_t)(device->busy_tick - tick) < 0)) {
+		tick = device->busy_tick;
+		armed = 1;
+	}
+	if (armed) {
+		int32_t delay = (int32_t)(tick - sim_now);
+
+		sim_model_arm(&device->model, delay > 0 ? (TickType_t)delay : 0);
+	}
+	else {
+		sim_model_cancel(&device->model);
+	}
+}
+
+static void ds18b20_hold(SimDs18b20* device, TickType_t ticks) {
+	device->holding = 1;
+	sim_model_drive(&device->model, 1);
+	ds18b20_schedule(device, SLOT_RELEASE, ticks);
+}
+
+static void ds18b20_schedule(SimDs18b20* device, uint8_t action, TickType_t delay) {
+	device->slot_action = action;
+	device->slot_tick = sim_now + delay;
+	ds18b20_rearm(device);
+}
+
+static uint8_t ds18b20_output_bit(SimDs18b20* device) {
+	uint8_t bit = 1;
+
+	switch (device->state) {
+	case DS_TRANSMIT:
+		bit = (device->tx[device->tx_bit / 8] >> (device->tx_bit % 8)) & 0x01;
+		if (++device->tx_bit >= device->tx_length * 8) {
+			device->state = device->next_state;
+			device->bit_count = 0;
+			device->byte = 0;
+		}
+		break;
+	case DS_SEARCH:
+		bit = (device->rom[device->bit_count / 8] >> (device->bit_count % 8)) & 0x01;
+		if (device->search_slot++ == 1) {
+			bit ^= 0x01; // complement
+		}
+		break;
+	case DS_BUSY:
+		bit = device->busy ? 0 : 1;
+		break;
+	case DS_POWER:
+		bit = device->parasitic ? 0 : 1;
+		break;
+	default:
+		break;
+	}
+	return bit;
+}
+
+static void ds18b20_input_bit(SimDs18b20* device, uint8_t bit) {
+	switch (device->state) {
+	case DS_MATCH:
+		if (bit != ((device->rom[device->bit_count / 8] >> (device->bit_count % 8)) & 0x01)) {
+			device->state = DS_IDLE;
+		}
+		else if (++device->bit_count == 64) {
+			device->state = DS_FUNCTION;
+			device->bit_count = 0;
+		}
+		return;
+	case DS_SEARCH:
+		if (bit != ((device->rom[device->bit_count / 8] >> (device->bit_count % 8)) & 0x01)) {
+			device->state = DS_IDLE; // master took other branch
+		}
+		else if (++device->bit_count == 64) {
+			device->state = DS_FUNCTION;
+			device->bit_count = 0;
+		}
+		device->search_slot = 0;
+		return;
+	case DS_ROM:
+	case DS_FUNCTION:
+	case DS_RECEIVE:
+		break;
+	default:
+		return;
+	}
+	device->byte |= (uint8_t)(bit << device->bit_count);
+	if (++device->bit_count < 8) {
+		return;
+	}
+	device->bit_count = 0;
+	if (device->state == DS_ROM) {
+		ds18b20_rom_command(device, device->byte);
+	}
+	else if (device->state == DS_FUNCTION) {
+		ds18b20_function_command(device, device->byte);
+	}
+	else {
+		device->scratchpad[2 + device->rx_count] = device->byte;
+		if (++device->rx_count == 3) {
+			ds18b20_update_crc(device);
+			device->state = DS_IDLE;
+		}
+	}
+	device->byte = 0;
+}
+
+static void ds18b20_rom_command(SimDs18b20* device, uint8_t command) {
+	switch (command) {
+	case READ_ROM:
+		ds18b20_transmit(device, device->rom, 8, DS_FUNCTION);
+		break;
+	case MATCH_ROM:
+		device->state = DS_MATCH;
+		break;
+	case SKIP_ROM:
+		device->state = DS_FUNCTION;
+		break;
+	case ALARM_SEARCH:
+		if (!sim_ds18b20_alarm(device)) {
+			device->state = DS_IDLE;
+			break;
+		}
+		// fall through
+	case SEARCH_ROM:
+		device->state = DS_SEARCH;
+		device->search_slot = 0;
+		break;
+	default:
+		device->state = DS_IDLE;
+		break;
+	}
+}
+
+static void ds18b20_function_command(SimDs18b20* device, uint8_t command) {
+	switch (command) {
+	case DS18B20_CONVERT_T:
+		// configuration bits 5 and 6 select 9 to 12 bit resolution
+		ds18b20_start_busy(device, command, SIM_DS18B20_CONVERSION_US >> (3 - ((device->scratchpad[4] >> 5) & 0x03)));
+		break;
+	case READ_SCRATCHPAD:
+		ds18b20_transmit(device, device->scratchpad, 9, DS_IDLE);
+		break;
+	case WRITE_SCRATCHPAD:
+		device->state = DS_RECEIVE;
+		device->rx_count = 0;
+		break;
+	case DS18B20_COPY_SCRATCHPAD:
+		memcpy(device->eeprom, &device->scratchpad[2], sizeof(device->eeprom));
+		ds18b20_start_busy(device, command, SIM_DS18B20_COPY_US);
+		break;
+	case DS18B20_RECALL_EEPROM:
+		memcpy(&device->scratchpad[2], device->eeprom, sizeof(device->eeprom));
+		ds18b20_update_crc(device);
+		device->state = DS_BUSY; // recall is done before next read slot
+		break;
+	case DS18B20_READ_POWER:
+		device->state = DS_POWER;
+		break;
+	default:
+		device->state = DS_IDLE;
+		break;
+	}
+}
+
+static void ds18b20_transmit(SimDs18b20* device, const uint8_t* data, uint8_t length, uint8_t next_state) {
+	memcpy(device->tx, data, length);
+	device->tx_length = length;
+	device->tx_bit = 0;
+	device->next_state = next_state;
+	device->state = DS_TRANSMIT;
+}
+
+static void ds18b20_start_busy(SimDs18b20* device, uint8_t command, TickType_t ticks) {
+	device->state = DS_BUSY;
+	device->busy = 1;
+	device->busy_command = command;
+	device->busy_tick = sim_now + ticks;
+	if (command == DS18B20_CONVERT_T) {
+		device->conversions++;
+		sim_model_set_current(&device->model, device->convert_current);
+	}
+	else {
+		device->copies++;
+	}
+	ds18b20_rearm(device);
+}
+
+static void ds18b20_end_busy(SimDs18b20* device) {
+	device->busy = 0;
+	if (device->busy_command == DS18B20_CONVERT_T) {
+		sim_model_set_current(&device->model, 0);
+		device->scratchpad[0] = (uint8_t)device->temperature;
+		device->scratchpad[1] = (uint8_t)((uint16_t)device->temperature >> 8);
+		ds18b20_update_crc(device);
+	}
+}
+
+static void ds18b20_update_crc(SimDs18b20* device) {
+	uint8_t crc = 0;
+
+	for (uint8_t i = 0; i < 8; i++) {
+		crc = onewire_crc8_update(crc, device->scratchpad[i]);
+	}
+	device->scratchpad[8] = crc;
+}
+
+static uint8_t is_transmitting(const SimDs18b20* device) {
+	switch (device->state) {
+	case DS_TRANSMIT:
+	case DS_BUSY:
+	case DS_POWER:
+		return 1;
+	case DS_SEARCH:
+		return device->search_slot < 2;
+	default:
+		return 0;
+	}
+}
+
+static uint8_t is_due(TickType_t tick) {
+	return (int32_t)(sim_now - tick) >= 0;
+}
+
+// outputs are off after power up, segments are joined only by switching commands
+void sim_ds2409_init(SimDs2409* coupler, const uint8_t* rom, uint8_t main_segment, uint8_t aux_segment) {
+	memset(coupler, 0, sizeof(*coupler));
+	memcpy(coupler->rom, rom, 7);
+	sim_rom_crc(coupler->rom);
+	coupler->main_segment = main_segment;
+	coupler->aux_segment = aux_segment;
+	coupler->model.edge = ds2409_edge;
+	coupler->model.event = ds2409_event;
+}
+
+
+// slot timing is same as of DS18B20 model
+static void ds2409_edge(SimModel* model, GPIO_PinState level) {
+	SimDs2409* coupler = (SimDs2409*)model;
+	TickType_t width;
+
+	if (coupler->holding) {
+		return;
+	}
+	if (level == GPIO_PIN_RESET) {
+		coupler->low_tick = sim_now;
+		coupler->low_seen = 1;
+		coupler->reading = (coupler->state == CP_TRANSMIT || (coupler->state == CP_SEARCH && coupler->search_slot < 2));
+		if (coupler->reading && !ds2409_output_bit(coupler)) {
+			ds2409_hold(coupler, SIM_DS18B20_READ_0_HOLD);
+		}
+		return;
+	}
+	if (!coupler->low_seen) {
+		return;
+	}
+	coupler->low_seen = 0;
+	width = sim_now - coupler->low_tick;
+	if (width >= SIM_DS18B20_RESET_MIN) {
+		coupler->resets++;
+		coupler->state = CP_ROM;
+		coupler->bit_count = 0;
+		coupler->byte = 0;
+		coupler->reading = 0;
+		coupler->switching = 0;
+		ds2409_schedule(coupler, SLOT_PRESENCE, SIM_DS18B20_PRESENCE_WAIT);
+		return;
+	}
+	if (coupler->reading) {
+		coupler->reading = 0;
+		ds2409_slot_end(coupler);
+		return;
+	}
+	ds2409_input_bit(coupler, width < SIM_DS18B20_WRITE_1_MAX);
+}
+
+static void ds2409_event(SimModel* model) {
+	SimDs2409* coupler = (SimDs2409*)model;
+	uint8_t action = coupler->slot_action;
+
+	coupler->slot_action = SLOT_NONE;
+	switch (action) {
+	case SLOT_PRESENCE:
+		coupler->low_seen = 0;
+		ds2409_hold(coupler, SIM_DS18B20_PRESENCE_LOW);
+		break;
+	case SLOT_RELEASE:
+		sim_model_drive(model, 0);
+		coupler->holding = 0;
+		if (coupler->reading && sim_bus_level(model->bus, model->bus->nodes[model->node].segment) == GPIO_PIN_SET) {
+			coupler->reading = 0; // read 0 slot ends with release of coupler, otherwise with rising edge of other holder
+			ds2409_slot_end(coupler);
+		}
+		break;
+	default:
+		break;
+	}
+	if (coupler->slot_action == SLOT_NONE) {
+		sim_model_cancel(model);
+	}
+}
+
+static void ds2409_hold(SimDs2409* coupler, TickType_t ticks) {
+	coupler->holding = 1;
+	sim_model_drive(&coupler->model, 1);
+	ds2409_schedule(coupler, SLOT_RELEASE, ticks);
+}
+
+static void ds2409_schedule(SimDs2409* coupler, uint8_t action, TickType_t delay) {
+	coupler->slot_action = action;
+	coupler->slot_tick = sim_now + delay;
+	sim_model_arm(&coupler->model, delay);
+}
+
+static uint8_t ds2409_output_bit(SimDs2409* coupler) {
+	uint8_t bit = 1;
+
+	if (coupler->state == CP_TRANSMIT) {
+		bit = (coupler->tx[coupler->tx_bit / 8] >> (coupler->tx_bit % 8)) & 0x01;
+		if (++coupler->tx_bit >= coupler->tx_length * 8) {
+			coupler->state = CP_IDLE;
+		}
+	}
+	else if (coupler->state == CP_SEARCH) {
+		bit = (coupler->rom[coupler->bit_count / 8] >> (coupler->bit_count % 8)) & 0x01;
+		if (coupler->search_slot++ == 1) {
+			bit ^= 0x01; // complement
+		}
+	}
+	return bit;
+}
+
+static void ds2409_input_bit(SimDs2409* coupler, uint8_t bit) {
+	switch (coupler->state) {
+	case CP_MATCH:
+	case CP_SEARCH:
+		if (bit != ((coupler->rom[coupler->bit_count / 8] >> (coupler->bit_count % 8)) & 0x01)) {
+			coupler->state = CP_IDLE;
+		}
+		else if (++coupler->bit_count == 64) {
+			coupler->state = CP_FUNCTION;
+			coupler->bit_count = 0;
+		}
+		coupler->search_slot = 0;
+		return;
+	case CP_ROM:
+	case CP_FUNCTION:
+	case CP_STIMULUS:
+		break;
+	default:
+		return;
+	}
+	coupler->byte |= (uint8_t)(bit << coupler->bit_count);
+	if (++coupler->bit_count < 8) {
+		return;
+	}
+	coupler->bit_count = 0;
+	if (coupler->state == CP_ROM) {
+		ds2409_rom_command(coupler, coupler->byte);
+	}
+	else if (coupler->state == CP_FUNCTION) {
+		ds2409_function_command(coupler, coupler->byte);
+	}
+	else {
+		// branch reset follows stimulus, presence byte reports whether anything answered it
+		uint8_t data[2] = { ds2409_branch_presence(coupler, coupler->target), coupler->command };
+
+		ds2409_transmit(coupler, data, 2);
+		coupler->switching = 1;
+	}
+	coupler->byte = 0;
+}
+
+static void ds2409_rom_command(SimDs2409* coupler, uint8_t command) {
+	switch (command) {
+	case READ_ROM:
+		ds2409_transmit(coupler, coupler->rom, 8);
+		break;
+	case MATCH_ROM:
+		coupler->state = CP_MATCH;
+		break;
+	case SKIP_ROM:
+		coupler->state = CP_FUNCTION;
+		break;
+	case SEARCH_ROM:
+		coupler->state = CP_SEARCH;
+		coupler->search_slot = 0;
+		break;
+	default:
+		coupler->state = CP_IDLE;
+		break;
+	}
+}
+
+// target is segment joined after confirmation, segment 0 turns both outputs off
+static void ds2409_function_command(SimDs2409* coupler, uint8_t command) {
+	coupler->command = command;
+	switch (command) {
+	case DS2409_SMART_ON_MAIN:
+	case DS2409_SMART_ON_AUX:
+		coupler->target = (command == DS2409_SMART_ON_MAIN) ? coupler->main_segment : coupler->aux_segment;
+		coupler->state = CP_STIMULUS;
+		break;
+	case DS2409_DIRECT_ON_MAIN:
+	case DS2409_ALL_LINES_OFF:
+		coupler->target = (command == DS2409_DIRECT_ON_MAIN) ? coupler->main_segment : 0;
+		ds2409_transmit(coupler, &command, 1);
+		coupler->switching = 1;
+		break;
+	default:
+		coupler->state = CP_IDLE;
+		break;
+	}
+}
+
+static void ds2409_transmit(SimDs2409* coupler, const uint8_t* data, uint8_t length) {
+	memcpy(coupler->tx, data, length);
+	coupler->tx_length = length;
+	coupler->tx_bit = 0;
+	coupler->state = CP_TRANSMIT;
+}
+
+// output changes with bus released, so no branch device sees partial slot
+static void ds2409_slot_end(SimDs2409* coupler) {
+	SimBus* bus = coupler->model.bus;
+	uint32_t outputs = (1UL << coupler->main_segment) | (1UL << coupler->aux_segment);
+
+	if (coupler->state == CP_TRANSMIT || !coupler->switching) {
+		return;
+	}
+	coupler->switching = 0;
+	coupler->output = coupler->target;
+	coupler->switches++;
+	sim_bus_set_connected(bus, (bus->connected & ~outputs) | (coupler->output ? (1UL << coupler->output) : 0));
+}
+
+// 0 when node is attached to segment of branch, real coupler sees its presence pulse
+static uint8_t ds2409_branch_presence(const SimDs2409* coupler, uint8_t segment) {
+	const SimBus* bus = coupler->model.bus;
+
+	for (uint8_t i = 0; i < bus->node_count; i++) {
+		if (bus->nodes[i].segment == segment && segment != 0) {
+			return 0x00;
+		}
+	}
+	return 0xFF;
+}
+
+void sim_ds2438_init(SimAdc* device, const uint8_t* rom) {
+	adc_init(device, rom);
+	device->temperature = 0x1700;
+	device->voltage = 500;
+	device->page[0] = 0x0F; // IAD, CA, EE, AD as after power up
+}
+
+void sim_ds2450_init(SimAdc* device, const uint8_t* rom) {
+	adc_init(device, rom);
+	for (uint8_t i = 0; i < 4; i++) {
+		device->input[i] = 0x8000;
+	}
+}
+
+static void adc_init(SimAdc* device, const uint8_t* rom) {
+	memset(device, 0, sizeof(*device));
+	memcpy(device->rom, rom, 7);
+	sim_rom_crc(device->rom);
+	device->model.edge = adc_edge;
+	device->model.event = adc_event;
+}
+
+// slot timing is same as of DS18B20 model
+static void adc_edge(SimModel* model, GPIO_PinState level) {
+	SimAdc* device = (SimAdc*)model;
+	TickType_t width;
+
+	if (device->holding) {
+		return;
+	}
+	if (level == GPIO_PIN_RESET) {
+		device->low_tick = sim_now;
+		device->low_seen = 1;
+		device->reading = (device->state == AD_TRANSMIT);
+		if (device->reading && !adc_output_bit(device)) {
+			adc_hold(device, SIM_DS18B20_READ_0_HOLD);
+		}
+		return;
+	}
+	if (!device->low_seen) {
+		return;
+	}
+	device->low_seen = 0;
+	width = sim_now - device->low_tick;
+	if (width >= SIM_DS18B20_RESET_MIN) {
+		device->resets++;
+		device->state = AD_ROM;
+		device->command = 0;
+		device->bit_count = 0;
+		device->byte = 0;
+		device->reading = 0;
+		adc_schedule(device, SLOT_PRESENCE, SIM_DS18B20_PRESENCE_WAIT);
+		return;
+	}
+	if (device->reading) {
+		device->reading = 0;
+		return;
+	}
+	adc_input_bit(device, width < SIM_DS18B20_WRITE_1_MAX);
+}
+
+static void adc_event(SimModel* model) {
+	SimAdc* device = (SimAdc*)model;
+
+	if (device->slot_action != SLOT_NONE && is_due(device->slot_tick)) {
+		uint8_t action = device->slot_action;
+
+		device->slot_action = SLOT_NONE;
+		if (action == SLOT_PRESENCE) {
+			device->low_seen = 0;
+			adc_hold(device, SIM_DS18B20_PRESENCE_LOW);
+		}
+		else if (action == SLOT_RELEASE) {
+			sim_model_drive(model, 0);
+			device->holding = 0;
+		}
+	}
+	for (uint8_t i = 0; i < 2; i++) {
+		if ((device->busy & (1 << i)) && is_due(device->busy_tick[i])) {
+			adc_end_busy(device, i);
+		}
+	}
+	adc_rearm(device);
+}
+
+// one armed event per model, nearest of slot timer and ends of conversions
+static void adc_rearm(SimAdc* device) {
+	uint8_t armed = 0;
+	TickType_t tick = 0;
+
+	if (device->slot_action != SLOT_NONE) {
+		tick = device->slot_tick;
+		armed = 1;
+	}
+	for (uint8_t i = 0; i < 2; i++) {
+		if ((device->busy & (1 << i)) && (!armed || (int32_t)(device->busy_tick[i] - tick) < 0)) {
+			tick = device->busy_tick[i];
+			armed = 1;
+		}
+	}
+	if (armed) {
+		int32_t delay = (int32_t)(tick - sim_now);
+
+		sim_model_arm(&device->model, delay > 0 ? (TickType_t)delay : 0);
+	}
+	else {
+		sim_model_cancel(&device->model);
+	}
+}
+
+static void adc_hold(SimAdc* device, TickType_t ticks) {
+	device->holding = 1;
+	sim_model_drive(&device->model, 1);
+	adc_schedule(device, SLOT_RELEASE, ticks);
+}
+
+static void adc_schedule(SimAdc* device, uint8_t action, TickType_t delay) {
+	device->slot_action = action;
+	device->slot_tick = sim_now + delay;
+	adc_rearm(device);
+}
+
+static uint8_t adc_output_bit(SimAdc* device) {
+	uint8_t bit = (device->tx[device->tx_bit / 8] >> (device->tx_bit % 8)) & 0x01;
+
+	if (++device->tx_bit >= device->tx_length * 8) {
+		device->state = AD_IDLE;
+		if (device->command == DS2450_CONVERT) {
+			uint8_t inputs = 0;
+
+			// conversion starts after CRC16 was read
+			for (uint8_t i = 0; i < 4; i++) {
+				inputs += (device->mask >> i) & 0x01;
+			}
+			device->conversions++;
+			adc_start_busy(device, 0, (TickType_t)inputs * 16 * SIM_DS2450_CONVERSION_BIT_US + SIM_DS2450_CONVERSION_OFFSET_US);
+		}
+	}
+	return bit;
+}
+
+static void adc_input_bit(SimAdc* device, uint8_t bit) {
+	switch (device->state) {
+	case AD_MATCH:
+		if (bit != ((device->rom[device->bit_count / 8] >> (device->bit_count % 8)) & 0x01)) {
+			device->state = AD_IDLE;
+		}
+		else if (++device->bit_count == 64) {
+			device->state = AD_FUNCTION;
+			device->bit_count = 0;
+		}
+		return;
+	case AD_ROM:
+	case AD_FUNCTION:
+	case AD_ARGUMENT:
+		break;
+	default:
+		return;
+	}
+	device->byte |= (uint8_t)(bit << device->bit_count);
+	if (++device->bit_count < 8) {
+		return;
+	}
+	device->bit_count = 0;
+	if (device->state == AD_ROM) {
+		device->state = (device->byte == MATCH_ROM) ? AD_MATCH : (device->byte == SKIP_ROM) ? AD_FUNCTION : AD_IDLE;
+	}
+	else if (device->state == AD_FUNCTION) {
+		adc_function_command(device, device->byte);
+	}
+	else {
+		device->args[device->arg_count] = device->byte;
+		if (++device->arg_count == device->arg_length) {
+			adc_arguments_done(device);
+		}
+	}
+	device->byte = 0;
+}
+
+// commands of other device type are ignored until next reset
+static void adc_function_command(SimAdc* device, uint8_t command) {
+	device->command = command;
+	device->arg_count = 0;
+	device->state = AD_IDLE;
+	if (device->rom[0] == SIM_DS2438_FAMILY_CODE) {
+		switch (command) {
+		case DS2438_CONVERT_T:
+			device->conversions++;
+			adc_start_busy(device, 0, SIM_DS2438_CONVERSION_US);
+			break;
+		case DS2438_CONVERT_V:
+			device->voltage_conversions++;
+			adc_start_busy(device, 1, SIM_DS2438_CONVERSION_US);
+			break;
+		case DS2438_RECALL_MEMORY:
+		case DS2438_READ_SCRATCHPAD:
+			device->arg_length = 1;
+			device->state = AD_ARGUMENT;
+			break;
+		default:
+			break;
+		}
+	}
+	else if (command == DS2450_CONVERT || command == DS2450_READ_MEMORY) {
+		device->arg_length = 2;
+		device->state = AD_ARGUMENT;
+	}
+}
+
+// only page 0 of DS2438 is modeled, other pages read as zeros
+static void adc_arguments_done(SimAdc* device) {
+	uint8_t data[34];
+	uint8_t crc = 0;
+	uint16_t crc16;
+	uint16_t address = device->args[0] | (device->args[1] << 8);
+	uint8_t length;
+
+	device->state = AD_IDLE;
+	switch (device->command) {
+	case DS2438_RECALL_MEMORY:
+		device->recalls++;
+		device->read_tick = sim_now;
+		if (device->args[0] == 0) {
+			memcpy(device->scratchpad, device->page, sizeof(device->page));
+		}
+		else {
+			memset(device->scratchpad, 0, sizeof(device->scratchpad));
+		}
+		break;
+	case DS2438_READ_SCRATCHPAD:
+		device->reads++;
+		memcpy(data, device->scratchpad, 8);
+		for (uint8_t i = 0; i < 8; i++) {
+			crc = onewire_crc8_update(crc, data[i]);
+		}
+		data[8] = crc ^ (device->crc_error ? 0x01 : 0x00);
+		device->crc_error = 0;
+		adc_transmit(device, data, 9);
+		break;
+	case DS2450_CONVERT:
+		// read-out control is ignored, results are not preset
+		device->mask = device->args[0] & 0x0F;
+		crc16 = ~adc_crc16(device, NULL, 0);
+		data[0] = (uint8_t)crc16;
+		data[1] = (uint8_t)(crc16 >> 8);
+		adc_transmit(device, data, 2);
+		break;
+	case DS2450_READ_MEMORY:
+		if (address >= sizeof(device->memory)) {
+			break;
+		}
+		device->reads++;
+		device->read_tick = sim_now;
+		length = 8 - (address % 8);
+		memcpy(data, &device->memory[address], length);
+		crc16 = ~adc_crc16(device, data, length) ^ (device->crc_error ? 0x0001 : 0x0000);
+		device->crc_error = 0;
+		data[length] = (uint8_t)crc16;
+		data[length + 1] = (uint8_t)(crc16 >> 8);
+		adc_transmit(device, data, length + 2);
+		break;
+	default:
+		break;
+	}
+}
+
+static void adc_transmit(SimAdc* device, const uint8_t* data, uint8_t length) {
+	memcpy(device->tx, data, length);
+	device->tx_length = length;
+	device->tx_bit = 0;
+	device->state = AD_TRANSMIT;
+}
+
+static void adc_start_busy(SimAdc* device, uint8_t index, TickType_t ticks) {
+	device->busy |= (uint8_t)(1 << index);
+	device->busy_tick[index] = sim_now + ticks;
+	device->convert_tick = sim_now;
+	adc_rearm(device);
+}
+
+// registers are loaded with values set by test when conversion ends
+static void adc_end_busy(SimAdc* device, uint8_t index) {
+	device->busy &= (uint8_t)~(1 << index);
+	if (device->rom[0] == SIM_DS2450_FAMILY_CODE) {
+		for (uint8_t i = 0; i < 4; i++) {
+			if ((device->mask >> i) & 0x01) {
+				device->memory[2 * i] = (uint8_t)device->input[i];
+				device->memory[2 * i + 1] = (uint8_t)(device->input[i] >> 8);
+			}
+		}
+	}
+	else if (index == 0) {
+		device->page[1] = (uint8_t)device->temperature;
+		device->page[2] = (uint8_t)((uint16_t)device->temperature >> 8);
+	}
+	else {
+		device->page[3] = (uint8_t)device->voltage;
+		device->page[4] = (uint8_t)(device->voltage >> 8);
+		device->page[5] = (uint8_t)device->current;
+		device->page[6] = (uint8_t)((uint16_t)device->current >> 8);
+	}
+}
+
+// over command, its two argument bytes and data sent
+static uint16_t adc_crc16(SimAdc* device, const uint8_t* data, uint8_t length) {
+	uint16_t crc = onewire_crc16_update(0, device->command);
+
+	crc = onewire_crc16_update(crc, device->args[0]);
+	crc = onewire_crc16_update(crc, device->args[1]);
+	for (uint8_t i = 0; i < length; i++) {
+		crc = onewire_crc16_update(crc, data[i]);
+	}
+	return crc;
+}
@@ -0,0 +1,194 @@
+/**
+ ******************************************************************************
+ * @file    oneWireSimModels.h
+ * @brief   Device models for OneWire host simulator
+ *
+ * @details
+ *          DS18B20 model decodes slots from edges of its bus segment, it does
+ *          not use slave code of driver, so simulated bus checks master
+ *          against independent implementation of device. Write slot low for
+ *          less than 15 us is 1, low pulse of reset width is answered with
+ *          presence pulse, read slot 0 is held low for 30 us.
+ *
+ *          ROM commands Read ROM, Match ROM, Skip ROM, Search ROM and Alarm
+ *          Search, function commands Convert T, Read and Write Scratchpad,
+ *          Copy Scratchpad, Recall EEPROM and Read Power Supply are served.
+ *          Conversion time follows resolution in configuration register,
+ *          during conversion model draws convert_current from bus supply.
+ *
+ *          DS2409 model serves same ROM commands and Smart-On Main, Smart-On
+ *          Auxiliary, Direct-On Main and All Lines Off. Confirmation byte
+ *          echoes command, after its last slot coupler output joins branch
+ *          segment with trunk by sim_bus_set_connected(). Presence byte of
+ *          Smart-On is 0 when any node is attached to branch segment.
+ *
+ *          DS2438 and DS2450 models serve Match ROM and Skip ROM. DS2438
+ *          converts temperature (Convert T) and voltage with current (Convert
+ *          V) with own busy timers, Recall Memory copies page 0 to scratchpad
+ *          and Read Scratchpad sends it with CRC8. DS2450 Convert answers
+ *          inverted CRC16 of command, conversion of selected inputs starts
+ *          after it was read. Read Memory sends data to end of page and
+ *          inverted CRC16. Registers are loaded only when conversion ends, so
+ *          early read gets values of previous conversion.
+ *
+ * @license MIT License
+ ******************************************************************************
+ */
+
+#ifndef __oneWireSimModels_H
+#define __oneWireSimModels_H
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+#include "oneWireSim.h"
+#include "oneWireScheduler.h"
+#include <stdint.h>
+
+#define SIM_DS18B20_FAMILY_CODE        0x28
+#define SIM_DS18B20_RESET_MIN          450     // us, shorter low pulse is slot
+#define SIM_DS18B20_WRITE_1_MAX        15      // us, longer low pulse is write 0
+#define SIM_DS18B20_PRESENCE_WAIT      30      // us, tPDH
+#define SIM_DS18B20_PRESENCE_LOW       120     // us, tPDL
+#define SIM_DS18B20_READ_0_HOLD        30      // us
+#define SIM_DS18B20_CONVERSION_US      750000  // 12 bit, halved for every bit less
+#define SIM_DS18B20_COPY_US            10000
+#define SIM_DS18B20_CONVERT_CURRENT    1500    // uA, active current IDD
+
+#define SIM_DS2409_FAMILY_CODE         0x1F
+
+#define SIM_DS2438_FAMILY_CODE         0x26
+#define SIM_DS2438_CONVERSION_US       10000   // temperature and A/D converter, max
+#define SIM_DS2450_FAMILY_CODE         0x20
+#define SIM_DS2450_CONVERSION_BIT_US   80      // per bit of every selected input, 16 bit resolution
+#define SIM_DS2450_CONVERSION_OFFSET_US 160
+
+typedef struct {
+	SimModel model;
+	uint8_t rom[8];
+	uint8_t scratchpad[9];
+	uint8_t eeprom[3];              // TH, TL, configuration
+	int16_t temperature;            // 1/16 degC, loaded into scratchpad by next conversion
+	uint8_t parasitic;              // Read Power Supply answers 0
+	uint8_t present;                // 0 unplugged, model ignores bus
+	uint32_t convert_current;       // uA drawn while converting
+	uint32_t resets;
+	uint32_t conversions;
+	uint32_t copies;
+	// internal
+	uint8_t state;
+	uint8_t next_state;             // entered when transmit ends
+	uint8_t bit_count;
+	uint8_t byte;
+	uint8_t search_slot;            // 0 ROM bit, 1 complement, 2 direction of master
+	uint8_t tx[9];
+	uint8_t tx_length;
+	uint16_t tx_bit;
+	uint8_t rx_count;
+	uint8_t reading;                // slot started in transmit state, its rising edge is not write slot
+	uint8_t holding;                // model pulls bus low
+	uint8_t low_seen;               // falling edge of current low period was seen, pulse can be classified
+	uint8_t slot_action;
+	TickType_t slot_tick;
+	uint8_t busy;                   // converting or copying
+	uint8_t busy_command;
+	TickType_t busy_tick;           // end of conversion or copy
+	TickType_t low_tick;            // falling edge of current slot
+} SimDs18b20;
+
+typedef struct SimDs18b20Read SimDs18b20Read;
+
+// Match ROM and Read Scratchpad of DS18B20 as scheduler transaction
+struct SimDs18b20Read {
+	OneWireTxn txn;
+	uint8_t tx[10];
+	uint8_t rx[9];
+	uint8_t done;
+	uint8_t ok;                     // completed with valid CRC
+	OneWireTxnStatus status;
+	void (*callback)(SimDs18b20Read* read, void* context);  // called after result is stored, can be NULL
+	void* context;
+};
+
+// DS2409 coupler on trunk segment, its outputs join main or aux segment with trunk
+typedef struct {
+	SimModel model;
+	uint8_t rom[8];
+	uint8_t main_segment;
+	uint8_t aux_segment;
+	uint8_t output;                 // segment joined with trunk, 0 when all lines are off
+	uint32_t resets;
+	uint32_t switches;              // confirmed switching commands
+	// internal
+	uint8_t state;
+	uint8_t bit_count;
+	uint8_t byte;
+	uint8_t search_slot;            // 0 ROM bit, 1 complement, 2 direction of master
+	uint8_t command;
+	uint8_t target;                 // segment joined by command, 0 all lines off
+	uint8_t tx[8];
+	uint8_t tx_length;
+	uint8_t tx_bit;
+	uint8_t switching;              // output is changed when read slot of last confirmation bit ends
+	uint8_t reading;
+	uint8_t holding;
+	uint8_t low_seen;
+	uint8_t slot_action;
+	TickType_t slot_tick;
+	TickType_t low_tick;
+} SimDs2409;
+
+// DS2438 battery monitor or DS2450 quad ADC, type is given by family code
+typedef struct {
+	SimModel model;
+	uint8_t rom[8];
+	uint8_t page[8];                // DS2438 page 0: status, temperature, voltage, current, threshold
+	uint8_t scratchpad[8];          // DS2438 page copied by Recall Memory
+	uint8_t memory[32];             // DS2450 pages, page 0 holds conversion results
+	int16_t temperature;            // DS2438 1/256 degC, loaded into page 0 by next Convert T
+	uint16_t voltage;               // DS2438 10 mV, loaded by next Convert V
+	int16_t current;                // DS2438 current register, loaded with voltage
+	uint16_t input[4];              // DS2450 inputs A..D left aligned, loaded by next Convert of selected inputs
+	uint8_t crc_error;              // next data read is sent with damaged CRC
+	uint32_t resets;
+	uint32_t conversions;           // Convert T of DS2438, Convert of DS2450
+	uint32_t voltage_conversions;   // Convert V of DS2438
+	uint32_t recalls;
+	uint32_t reads;                 // Read Scratchpad of DS2438, Read Memory of DS2450
+	TickType_t convert_tick;        // start of last conversion
+	TickType_t read_tick;           // last Recall Memory or Read Memory
+	// internal
+	uint8_t state;
+	uint8_t bit_count;
+	uint8_t byte;
+	uint8_t command;
+	uint8_t args[2];
+	uint8_t arg_count;
+	uint8_t arg_length;
+	uint8_t tx[34];
+	uint8_t tx_length;
+	uint16_t tx_bit;
+	uint8_t mask;                   // DS2450 inputs of running conversion
+	uint8_t busy;                   // bit 0 Convert T or DS2450 Convert, bit 1 Convert V
+	TickType_t busy_tick[2];
+	uint8_t reading;
+	uint8_t holding;
+	uint8_t low_seen;
+	uint8_t slot_action;
+	TickType_t slot_tick;
+	TickType_t low_tick;
+} SimAdc;
+
+void sim_ds18b20_init(SimDs18b20* device, const uint8_t* rom);
+void sim_ds18b20_plug(SimDs18b20* device, uint8_t present);
+uint8_t sim_ds18b20_alarm(const SimDs18b20* device);
+void sim_ds18b20_read_init(SimDs18b20Read* read, const uint8_t* rom, void (*callback)(SimDs18b20Read* read, void* context), void* context);
+uint8_t sim_ds18b20_check_value(const SimDs18b20* device, const uint8_t* scratchpad);
+void sim_ds2409_init(SimDs2409* coupler, const uint8_t* rom, uint8_t main_segment, uint8_t aux_segment);
+void sim_ds2438_init(SimAdc* device, const uint8_t* rom);
+void sim_ds2450_init(SimAdc* device, const uint8_t* rom);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
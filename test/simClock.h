@@ -0,0 +1,21 @@
+/**
+ ******************************************************************************
+ * @file    simClock.h
+ * @brief   Simulation clock of host tests
+ *
+ * @details
+ *          Forced into every translation unit of simulated tests with
+ *          -include, together with -DONEWIRE_GET_TICK()=sim_now driver reads
+ *          time of simulated bus. Clock is thread local, so buses stepped by
+ *          different threads keep their own time.
+ *
+ * @license MIT License
+ ******************************************************************************
+ */
+
+#ifndef __simClock_H
+#define __simClock_H
+
+extern _Thread_local unsigned int sim_now;     // TickType_t of Linux port, us
+
+#endif
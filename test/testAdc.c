@@ -0,0 +1,275 @@
+/**
+ ******************************************************************************
+ * @file    testAdc.c
+ * @brief   DS2438 and DS2450 sweeps on simulated bus
+ *
+ * @details
+ *          Two DS2438 and two DS2450 models share bus with DS18B20 model. Every
+ *          sweep has to wait once for longest conversion time, read each
+ *          DS2438 with Recall Memory and Read Scratchpad and each DS2450 with
+ *          one Read Memory, and store values loaded by conversions of same
+ *          sweep. Read with damaged CRC8 or CRC16 is counted as error and
+ *          keeps previous values. DS18B20 must not convert when sweep is
+ *          addressed or when prefetch entry with Convert T exists.
+ *
+ * @license MIT License
+ ******************************************************************************
+ */
+
+#include "oneWireSim.h"
+#include "oneWireSimModels.h"
+#include "oneWireAdc.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DS2438_COUNT        2
+#define DS2450_COUNT        2
+#define MODELS              (DS2438_COUNT + DS2450_COUNT)
+#define SWEEPS              3
+#define SWEEP_TIMEOUT_US    500000
+
+static SimBus bus;
+static OneWireDriver master;
+static OneWireScheduler scheduler;
+static OneWireClient client;
+static SimAdc models[MODELS];       // DS2438 first
+static SimAdc before[MODELS];       // copies taken before sweep
+static SimDs18b20 sensor;
+static OneWireAdcSweep all;
+static OneWireAdcSweep quad;        // DS2450 only
+static OneWireAdcDevice devices[MODELS];
+static OneWireAdcDevice quad_devices[DS2450_COUNT];
+static OneWireAdcSweep* observed;
+static uint8_t last_state;
+static uint32_t waits;              // entries of observed sweep into conversion wait
+static TickType_t wait_start;
+static TickType_t wait_ticks;
+static uint32_t completed;
+
+static void sweep_done(OneWireAdcSweep* sweep, void* context) {
+	(void)sweep;
+	(void)context;
+	completed++;
+}
+
+// sweep runs in same loop as scheduler, state changes are seen in tick they happen
+static void bus_task(void* context) {
+	(void)context;
+	onewire_scheduler_process(&scheduler);
+	onewire_adc_sweep_process(&all);
+	onewire_adc_sweep_process(&quad);
+	if (observed->state != last_state) {
+		if (observed->state == ONEWIRE_ADC_SWEEP_WAIT) {
+			waits++;
+			wait_start = sim_now;
+		}
+		else if (last_state == ONEWIRE_ADC_SWEEP_WAIT) {
+			wait_ticks = sim_now - wait_start;
+		}
+		last_state = observed->state;
+	}
+}
+
+// clock must not jump over end of conversion wait
+static TickType_t bus_next_delay(void* context) {
+	TickType_t elapsed = sim_now - observed->convert_tick;
+
+	(void)context;
+	if (observed->state != ONEWIRE_ADC_SWEEP_WAIT) {
+		return bus.max_jump;
+	}
+	return (elapsed < observed->conversion_ticks) ? observed->conversion_ticks - elapsed : 0;
+}
+
+static uint8_t sweep_completed(void* context) {
+	return completed == *(uint32_t*)context;
+}
+
+// models get new values for conversions of next sweep, returns sweep duration
+static TickType_t run_sweep(OneWireAdcSweep* sweep, uint8_t value) {
+	uint32_t until = completed + 1;
+	TickType_t start;
+
+	for (uint8_t i = 0; i < MODELS; i++) {
+		models[i].temperature = (int16_t)((20 + value) * 256 + 0x80);
+		models[i].voltage = 360 + value;
+		models[i].current = (int16_t)(-16 * value);
+		for (uint8_t c = 0; c < 4; c++) {
+			models[i].input[c] = (uint16_t)(0x1000 * (c + 1) + 0x100 * i + value);
+		}
+	}
+	memcpy(before, models, sizeof(models));
+	observed = sweep;
+	waits = 0;
+	wait_ticks = 0;
+	start = sim_now;
+	onewire_adc_sweep_request(sweep);
+	SIM_CHECK(sim_bus_run_until(&bus, sweep_completed, &until, SWEEP_TIMEOUT_US));
+	return sim_now - start;
+}
+
+// values of device are those loaded by conversion of model, for inputs in mask
+static uint8_t values_match(const OneWireAdcDevice* device, const SimAdc* model, uint8_t mask) {
+	if (model->rom[0] == SIM_DS2438_FAMILY_CODE) {
+		return device->temperature == model->temperature && device->voltage == model->voltage && device->current == model->current;
+	}
+	for (uint8_t c = 0; c < 4; c++) {
+		if (((mask >> c) & 0x01) && device->channel[c] != model->input[c]) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+// each DS2438 is read with two transactions and each DS2450 with one, after one wait
+static void check_sweeps(void) {
+	for (uint8_t s = 1; s <= SWEEPS; s++) {
+		TickType_t duration = run_sweep(&all, s);
+
+		SIM_CHECK(all.sweeps == s && waits == 1 && wait_ticks == all.conversion_ticks);
+		SIM_CHECK(all.conversion_ticks == SIM_DS2438_CONVERSION_US);
+		for (uint8_t i = 0; i < MODELS; i++) {
+			const SimAdc* model = &models[i];
+
+			// broadcast Convert T, Convert V and Convert, then reads of all devices
+			SIM_CHECK(model->resets - before[i].resets == 3 + 2 * DS2438_COUNT + DS2450_COUNT);
+			SIM_CHECK(model->conversions - before[i].conversions == 1);
+			SIM_CHECK(model->reads - before[i].reads == 1);
+			if (i < DS2438_COUNT) {
+				SIM_CHECK(model->voltage_conversions - before[i].voltage_conversions == 1);
+				SIM_CHECK(model->recalls - before[i].recalls == 1);
+				SIM_CHECK(model->read_tick - model->convert_tick >= SIM_DS2438_CONVERSION_US);
+			}
+			SIM_CHECK(devices[i].sweep == s && devices[i].errors == 0 && values_match(&devices[i], model, 0x0F));
+		}
+		printf("sweep %u: %u us, wait %u us, T=%d V=%u I=%d A=0x%04X D=0x%04X\n", s, (unsigned)duration, (unsigned)wait_ticks,
+			devices[0].temperature, devices[0].voltage, devices[0].current, devices[DS2438_COUNT].channel[0], devices[DS2438_COUNT].channel[3]);
+	}
+	SIM_CHECK(sensor.conversions == 0);
+}
+
+// inputs outside mask keep values of previous sweep, wait is conversion time of selected inputs
+static void check_ds2450_mask(void) {
+	OneWireAdcDevice previous[DS2450_COUNT];
+
+	memcpy(previous, devices + DS2438_COUNT, sizeof(previous));
+	run_sweep(&quad, SWEEPS + 1);
+	SIM_CHECK(waits == 1 && wait_ticks == 2 * 16 * SIM_DS2450_CONVERSION_BIT_US + SIM_DS2450_CONVERSION_OFFSET_US);
+	for (uint8_t i = 0; i < MODELS; i++) {
+		SIM_CHECK(models[i].resets - before[i].resets == 1 + DS2450_COUNT);
+		SIM_CHECK(models[i].conversions - before[i].conversions == (i < DS2438_COUNT ? 0u : 1u));
+	}
+	for (uint8_t i = 0; i < DS2450_COUNT; i++) {
+		const SimAdc* model = &models[DS2438_COUNT + i];
+
+		SIM_CHECK(quad_devices[i].sweep == 1 && values_match(&quad_devices[i], model, 0x05));
+		SIM_CHECK(quad_devices[i].channel[1] == previous[i].channel[1] && quad_devices[i].channel[3] == previous[i].channel[3]);
+	}
+}
+
+// damaged CRC8 of DS2438 and CRC16 of DS2450 are errors, other devices are read
+static void check_crc(void) {
+	OneWireAdcDevice previous[MODELS];
+
+	memcpy(previous, devices, sizeof(previous));
+	models[0].crc_error = 1;
+	models[DS2438_COUNT].crc_error = 1;
+	run_sweep(&all, SWEEPS + 2);
+	for (uint8_t i = 0; i < MODELS; i++) {
+		if (i == 0 || i == DS2438_COUNT) {
+			SIM_CHECK(devices[i].errors == 1 && devices[i].sweep == previous[i].sweep);
+			SIM_CHECK(values_match(&devices[i], &before[i], 0x0F) == 0);
+			SIM_CHECK(memcmp(devices[i].channel, previous[i].channel, sizeof(previous[i].channel)) == 0);
+			SIM_CHECK(devices[i].temperature == previous[i].temperature && devices[i].voltage == previous[i].voltage);
+		}
+		else {
+			SIM_CHECK(devices[i].errors == 0 && devices[i].sweep == all.sweeps && values_match(&devices[i], &models[i], 0x0F));
+		}
+	}
+	run_sweep(&all, SWEEPS + 3);
+	SIM_CHECK(devices[0].sweep == all.sweeps && devices[DS2438_COUNT].sweep == all.sweeps);
+	SIM_CHECK(values_match(&devices[0], &models[0], 0x0F) && values_match(&devices[DS2438_COUNT], &models[DS2438_COUNT], 0x0F));
+}
+
+// broadcast Convert T reaches DS18B20, addressed one reaches only DS2438
+static void check_shared_bus(void) {
+	static OneWirePrefetch prefetch;
+	uint32_t conversions;
+
+	sim_ds18b20_plug(&sensor, 1);
+	sim_bus_run_for(&bus, 1000); // presence pulse of powered device
+	run_sweep(&all, SWEEPS + 4);
+	SIM_CHECK(sensor.conversions == 1);
+
+	conversions = sensor.conversions;
+	onewire_adc_sweep_set_addressed(&all, 1);
+	run_sweep(&all, SWEEPS + 5);
+	SIM_CHECK(sensor.conversions == conversions && waits == 1);
+	for (uint8_t i = 0; i < MODELS; i++) {
+		// Match ROM Convert T per DS2438 replaces broadcast one
+		SIM_CHECK(models[i].resets - before[i].resets == 2 + DS2438_COUNT + 2 * DS2438_COUNT + DS2450_COUNT);
+		SIM_CHECK(models[i].conversions - before[i].conversions == 1);
+		SIM_CHECK(devices[i].sweep == all.sweeps && values_match(&devices[i], &models[i], 0x0F));
+	}
+
+	// prefetch entry is not requested, it only marks bus as shared
+	onewire_adc_sweep_set_addressed(&all, 0);
+	onewire_prefetch_init(&prefetch, &client, sensor.rom, 0x44, 750, READ_SCRATCHPAD, 9);
+	onewire_scheduler_add_prefetch(&scheduler, &prefetch);
+	run_sweep(&all, SWEEPS + 6);
+	SIM_CHECK(sensor.conversions == conversions && waits == 1);
+	for (uint8_t i = 0; i < DS2438_COUNT; i++) {
+		SIM_CHECK(models[i].conversions - before[i].conversions == 1);
+		SIM_CHECK(devices[i].sweep == all.sweeps && values_match(&devices[i], &models[i], 0x0F));
+	}
+}
+
+int main(void) {
+	OneWireAdcDevice rejected;
+	SimNode* node;
+
+	sim_now = 1000;
+	sim_bus_init(&bus);
+	node = sim_bus_add_driver(&bus, &master, OPERATING_MODE_MASTER, 0);
+	node->processed = 0; // onewire_process() is called by scheduler
+	onewire_scheduler_init(&scheduler, &master);
+	onewire_scheduler_add_client(&scheduler, &client, 0, 0);
+	onewire_adc_sweep_init(&all, &scheduler, &client, 0);
+	onewire_adc_sweep_set_callback(&all, sweep_done, NULL);
+	onewire_adc_sweep_init(&quad, &scheduler, &client, 0);
+	onewire_adc_sweep_set_callback(&quad, sweep_done, NULL);
+	onewire_adc_sweep_set_ds2450_mask(&quad, 0x05);
+	for (uint8_t i = 0; i < MODELS; i++) {
+		uint8_t rom[7] = { (i < DS2438_COUNT) ? SIM_DS2438_FAMILY_CODE : SIM_DS2450_FAMILY_CODE, 0x41, 0x44, 0x43, i, 0x00, 0x00 };
+
+		if (i < DS2438_COUNT) {
+			sim_ds2438_init(&models[i], rom);
+		}
+		else {
+			sim_ds2450_init(&models[i], rom);
+		}
+		sim_bus_add_model(&bus, &models[i].model, 0);
+		SIM_CHECK(onewire_adc_sweep_add(&all, &devices[i], models[i].rom) == 0);
+	}
+	for (uint8_t i = 0; i < DS2450_COUNT; i++) {
+		SIM_CHECK(onewire_adc_sweep_add(&quad, &quad_devices[i], models[DS2438_COUNT + i].rom) == 0);
+	}
+	{
+		uint8_t rom[7] = { SIM_DS18B20_FAMILY_CODE, 0x41, 0x44, 0x43, 0x18, 0x00, 0x00 };
+
+		sim_ds18b20_init(&sensor, rom);
+		sim_bus_add_model(&bus, &sensor.model, 0);
+		sim_ds18b20_plug(&sensor, 0); // plugged for shared bus check
+		SIM_CHECK(onewire_adc_sweep_add(&all, &rejected, sensor.rom) == -1);
+	}
+	observed = &all;
+	sim_bus_add_task(&bus, bus_task, bus_next_delay, NULL);
+
+	check_sweeps();
+	check_ds2450_mask();
+	check_crc();
+	check_shared_bus();
+	printf("adc: %s\n", sim_failures ? "FAILED" : "ok");
+	return sim_failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
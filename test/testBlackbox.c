@@ -0,0 +1,167 @@
+/**
+ ******************************************************************************
+ * @file    testBlackbox.c
+ * @brief   Black-box recorder frozen by failures on simulated bus
+ *
+ * @details
+ *          Trace hook of master keeps every event, exported blob has to
+ *          decode to last events seen by hook. Recorder is frozen by reset
+ *          without presence, by Search ROM pass with bad CRC8 and by entry
+ *          to error state, frozen blob stays same byte for byte through
+ *          later traffic until recorder is rearmed.
+ *
+ * @license MIT License
+ ******************************************************************************
+ */
+
+#include "oneWireSim.h"
+#include "oneWireSimModels.h"
+#include "oneWireSearch.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define HISTORY             4096    // events kept by trace hook
+
+static SimBus bus;
+static OneWireDriver master;
+static SimDs18b20 device;
+static OneWireTraceEvent history[HISTORY];
+static uint32_t history_count;
+static uint32_t ring_end;           // history events up to last one stored in recorder
+static uint16_t ring_head;
+static uint8_t blob[ONEWIRE_BLACKBOX_EXPORT_SIZE];
+static uint8_t frozen_blob[ONEWIRE_BLACKBOX_EXPORT_SIZE];
+static uint16_t frozen_length;
+static const uint8_t serial[7] = { SIM_DS18B20_FAMILY_CODE, 0x0B, 0x0B, 0x00, 0x80, 0x4E, 0x01 };
+
+// hook is called after event is stored, ring head moves only while recorder is not frozen
+static void record_event(OneWireDriver* onewire, const OneWireTraceEvent* event, void* context) {
+	(void)context;
+	history[history_count++ % HISTORY] = *event;
+	if (onewire->blackbox_head != ring_head) {
+		ring_head = onewire->blackbox_head;
+		ring_end = history_count;
+	}
+}
+
+// decodes exported blob, events have to be last events seen by hook before end
+static uint8_t blob_matches(const uint8_t* data, uint16_t length, uint8_t frozen, uint32_t end) {
+	uint16_t count = data[4] | (data[5] << 8);
+	TickType_t tick = data[8] | (data[9] << 8) | (data[10] << 16) | ((TickType_t)data[11] << 24);
+
+	if (length != ONEWIRE_BLACKBOX_HEADER_SIZE + ONEWIRE_BLACKBOX_EVENT_SIZE * count || count > end) {
+		return 0;
+	}
+	if (memcmp(data, "OWB", 3) != 0 || data[3] != ONEWIRE_BLACKBOX_VERSION || data[6] != frozen) {
+		return 0;
+	}
+	for (uint16_t i = 0; i < count; i++) {
+		const uint8_t* event = &data[ONEWIRE_BLACKBOX_HEADER_SIZE + ONEWIRE_BLACKBOX_EVENT_SIZE * i];
+		const OneWireTraceEvent* expected = &history[(end - count + i) % HISTORY];
+
+		tick += event[0] | (event[1] << 8);
+		if (tick != expected->timestamp || event[2] != expected->state) {
+			return 0;
+		}
+		if ((event[3] >> 1) != expected->type || (event[3] & 0x01) != expected->level) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+// freezes recorder and keeps exported blob for later comparison
+static void save_frozen(void) {
+	SIM_CHECK(onewire_blackbox_is_frozen(&master));
+	frozen_length = onewire_blackbox_export(&master, frozen_blob, sizeof(frozen_blob));
+	SIM_CHECK(blob_matches(frozen_blob, frozen_length, 1, ring_end));
+}
+
+// read of ROM, all slots are traced but frozen recorder does not change
+static void traffic(void) {
+	uint8_t rom[8];
+
+	SIM_CHECK(sim_master_reset(&bus, &master));
+	sim_master_write_byte(&bus, &master, READ_ROM);
+	sim_master_read(&bus, &master, rom, sizeof(rom));
+	SIM_CHECK(memcmp(rom, device.rom, sizeof(rom)) == 0);
+}
+
+static void check_frozen_kept(void) {
+	uint32_t events = history_count;
+
+	traffic();
+	SIM_CHECK(history_count > events + ONEWIRE_BLACKBOX_SIZE);
+	SIM_CHECK(onewire_blackbox_export(&master, blob, sizeof(blob)) == frozen_length);
+	SIM_CHECK(memcmp(blob, frozen_blob, frozen_length) == 0);
+	onewire_blackbox_rearm(&master);
+	ring_head = 0;
+	SIM_CHECK(!onewire_blackbox_is_frozen(&master));
+	SIM_CHECK(onewire_blackbox_export(&master, blob, sizeof(blob)) == ONEWIRE_BLACKBOX_HEADER_SIZE);
+}
+
+static void search_task(void* context) {
+	onewire_search_process((OneWireSearch*)context);
+}
+
+static uint8_t search_done(void* context) {
+	return !((OneWireSearch*)context)->running;
+}
+
+int main(void) {
+	OneWireSearch search;
+	OneWireErrorCounters errors;
+	uint32_t events;
+	uint16_t length;
+
+	sim_now = 1000;
+	sim_bus_init(&bus);
+	sim_bus_add_driver(&bus, &master, OPERATING_MODE_MASTER, 0);
+	sim_ds18b20_init(&device, serial);
+	sim_bus_add_model(&bus, &device.model, 0);
+	onewire_set_trace_hook(&master, record_event, NULL);
+	memset(&search, 0, sizeof(search));
+	sim_bus_add_task(&bus, search_task, NULL, &search);
+
+	// ring keeps last events of healthy traffic and is not frozen by it
+	traffic();
+	traffic();
+	SIM_CHECK(!onewire_blackbox_is_frozen(&master));
+	length = onewire_blackbox_export(&master, blob, sizeof(blob));
+	SIM_CHECK(length == ONEWIRE_BLACKBOX_EXPORT_SIZE && blob_matches(blob, length, 0, history_count));
+	SIM_CHECK(onewire_blackbox_export(&master, blob, length - 1) == 0);
+
+	// reset without presence, last event is sample of released bus
+	sim_ds18b20_plug(&device, 0);
+	SIM_CHECK(!sim_master_reset(&bus, &master));
+	save_frozen();
+	SIM_CHECK(history[(ring_end - 1) % HISTORY].type == ONEWIRE_TRACE_SAMPLE);
+	SIM_CHECK(history[(ring_end - 1) % HISTORY].level == GPIO_PIN_SET);
+	sim_ds18b20_plug(&device, 1);
+	sim_bus_run_for(&bus, 1000); // presence pulse of powered device
+	check_frozen_kept();
+
+	// Search ROM pass with bad CRC8, ring ends with last slot of pass
+	device.rom[7] ^= 0x01;
+	onewire_search_start(&search, &master, NULL, SEARCH_ROM);
+	SIM_CHECK(sim_bus_run_until(&bus, search_done, &search, 100000));
+	SIM_CHECK(search.status == ONEWIRE_SEARCH_ERROR && search.found == 0);
+	save_frozen();
+	device.rom[7] ^= 0x01;
+	check_frozen_kept();
+
+	// undefined state enters error once, error state is traced and kept
+	onewire_get_error_counters(&master, &errors);
+	events = history_count;
+	master.state = ONEWIRE_STATE_SPI_TRANSFER; // not used without SPI backend
+	sim_bus_run_for(&bus, 10000);
+	SIM_CHECK(history_count == events + 1 && ring_end == history_count);
+	SIM_CHECK(history[events % HISTORY].state == ONEWIRE_STATE_ERROR);
+	save_frozen();
+	SIM_CHECK(master.errors.errors == errors.errors + 1);
+	check_frozen_kept();
+
+	printf("black box: %u events traced, %s\n", (unsigned)history_count, sim_failures ? "FAILED" : "ok");
+	return sim_failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,127 @@
+/**
+ ******************************************************************************
+ * @file    testBusStats.c
+ * @brief   Bus utilization and CPU cost averages on simulated bus
+ *
+ * @details
+ *          Master writes byte of write 1 slots every LOAD_PERIOD_US, bus is
+ *          occupied for about half of wall time. Every completed window is
+ *          recorded, rolling averages have to follow EWMA of window values
+ *          seeded by first window, step of load is approached with weight
+ *          1/8 per window and decays same way when load stops.
+ *
+ * @license MIT License
+ ******************************************************************************
+ */
+
+#include "oneWireSim.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define LOAD_PERIOD_US      1000    // write byte takes 8 slots of 70 us
+#define IDLE_WINDOWS        3
+#define LOAD_WINDOWS        24
+#define DECAY_WINDOWS       8
+#define MAX_WINDOWS         (IDLE_WINDOWS + LOAD_WINDOWS + DECAY_WINDOWS + 2)
+
+static SimBus bus;
+static OneWireDriver master;
+static OneWireBusStats windows[MAX_WINDOWS];
+static uint8_t load;
+static TickType_t next_write;
+
+static void load_task(void* context) {
+	(void)context;
+	if (!load || (int32_t)(sim_now - next_write) < 0 || master.state != ONEWIRE_STATE_IDLE) {
+		return;
+	}
+	next_write += LOAD_PERIOD_US;
+	onewire_write_byte(&master, 0xFF);
+}
+
+// stats are copied right after window is folded into averages
+static void window_task(void* context) {
+	OneWireBusStats stats;
+
+	(void)context;
+	onewire_get_bus_stats(&master, &stats);
+	if (stats.window_count > 0 && stats.window_count <= MAX_WINDOWS) {
+		windows[stats.window_count - 1] = stats;
+	}
+}
+
+static uint8_t window_done(void* context) {
+	OneWireBusStats stats;
+
+	onewire_get_bus_stats(&master, &stats);
+	return stats.window_count >= *(uint32_t*)context;
+}
+
+static void run_windows(uint32_t count) {
+	OneWireBusStats stats;
+	uint32_t until;
+
+	onewire_get_bus_stats(&master, &stats);
+	until = stats.window_count + count;
+	SIM_CHECK(sim_bus_run_until(&bus, window_done, &until, (count + 1) * ONEWIRE_STATS_WINDOW_TICKS));
+}
+
+int main(void) {
+	uint32_t utilization_sum = 0;
+	uint64_t cpu_sum = 0;
+	uint16_t low = ONEWIRE_STATS_FULL_SCALE;
+	uint16_t high = 0;
+	uint16_t steady;
+	uint16_t decayed;
+
+	sim_now = 1000;
+	sim_bus_init(&bus);
+	sim_bus_add_driver(&bus, &master, OPERATING_MODE_MASTER, 0);
+	sim_bus_add_task(&bus, load_task, NULL, NULL);
+	sim_bus_add_task(&bus, window_task, NULL, NULL);
+
+	run_windows(IDLE_WINDOWS);
+	load = 1;
+	next_write = sim_now;
+	run_windows(LOAD_WINDOWS);
+	load = 0;
+	run_windows(DECAY_WINDOWS);
+
+	// averages are EWMA of window values, first window seeds them
+	for (uint8_t i = 0; i < IDLE_WINDOWS + LOAD_WINDOWS + DECAY_WINDOWS; i++) {
+		const OneWireBusStats* window = &windows[i];
+
+		if (i == 0) {
+			utilization_sum = (uint32_t)window->last_utilization << ONEWIRE_STATS_EWMA_SHIFT;
+			cpu_sum = (uint64_t)window->last_cpu_cycles << ONEWIRE_STATS_EWMA_SHIFT;
+		}
+		else {
+			utilization_sum += window->last_utilization - (utilization_sum >> ONEWIRE_STATS_EWMA_SHIFT);
+			cpu_sum += window->last_cpu_cycles - (cpu_sum >> ONEWIRE_STATS_EWMA_SHIFT);
+		}
+		SIM_CHECK(window->window_count == (uint32_t)i + 1);
+		SIM_CHECK(window->utilization == (uint16_t)(utilization_sum >> ONEWIRE_STATS_EWMA_SHIFT));
+		SIM_CHECK(window->cpu_cycles == (uint32_t)(cpu_sum >> ONEWIRE_STATS_EWMA_SHIFT));
+		if (i < IDLE_WINDOWS || i > IDLE_WINDOWS + LOAD_WINDOWS) {
+			SIM_CHECK(window->last_utilization == 0);
+		}
+		else if (i > IDLE_WINDOWS && i < IDLE_WINDOWS + LOAD_WINDOWS) {
+			low = (window->last_utilization < low) ? window->last_utilization : low;
+			high = (window->last_utilization > high) ? window->last_utilization : high;
+			SIM_CHECK(window->last_cpu_cycles > 0);
+		}
+	}
+
+	// 8 slots of about 71 us every 1 ms, window holds 100 or 101 bytes as its end is noticed up to 1 ms late
+	printf("bus stats: steady window %u..%u, average after load %u, after decay %u\n", low, high,
+		windows[IDLE_WINDOWS + LOAD_WINDOWS - 1].utilization, windows[IDLE_WINDOWS + LOAD_WINDOWS + DECAY_WINDOWS - 1].utilization);
+	SIM_CHECK(low >= 5500 && high <= 5900 && high - low <= 120);
+	steady = windows[IDLE_WINDOWS + LOAD_WINDOWS - 1].utilization;
+	decayed = windows[IDLE_WINDOWS + LOAD_WINDOWS + DECAY_WINDOWS - 1].utilization;
+	SIM_CHECK(steady >= low - low / 16 && steady <= high); // 1 - (7/8)^23 of step
+	SIM_CHECK(decayed >= steady / 3 && decayed <= steady / 2); // (7/8)^8 of average
+	onewire_reset_bus_stats(&master);
+	SIM_CHECK(master.bus_stats.window_count == 0 && master.bus_stats.utilization == 0);
+	printf("bus stats: %s\n", sim_failures ? "FAILED" : "ok");
+	return sim_failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
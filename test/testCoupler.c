@@ -0,0 +1,293 @@
+/**
+ ******************************************************************************
+ * @file    testCoupler.c
+ * @brief   DS2409 coupler branches of scheduler against coupler models
+ *
+ * @details
+ *          Two DS2409 models split bus into trunk and four branch segments.
+ *          Branch searches have to list every DS18B20 model only in table of
+ *          its branch, reads of devices behind different branches have to
+ *          return their scratchpads, batched reads need fewer switches than
+ *          reads queued in order. Hot-plug search that arrives while branch
+ *          search holds bus waits for it, turns branch off and searches trunk.
+ *
+ * @license MIT License
+ ******************************************************************************
+ */
+
+#include "oneWireSim.h"
+#include "oneWireSimModels.h"
+#include "oneWireCoupler.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define COUPLERS            2
+#define SENSORS             5
+#define ROUNDS              3       // reads of every sensor per workload
+#define READS               (ROUNDS * SENSORS)
+#define TIMEOUT_US          2000000
+#define DISCOVERY_US        100000  // presence pulse to device in table, All Lines Off included
+
+static SimBus bus;
+static OneWireDriver master;
+static OneWireScheduler scheduler;
+static OneWireClient client;
+static SimDs2409 coupler_models[COUPLERS];
+static SimDs18b20 sensors[SENSORS];
+static OneWireCoupler couplers[COUPLERS];
+static OneWireBranch trunk;
+static OneWireDevice trunk_devices[8];
+static OneWireDevice branch_devices[COUPLERS][2][4];
+static OneWireBranchSearch branch_search;
+static OneWireHotplug hotplug;
+static OneWireDevice hotplug_devices[8];
+static OneWireDeviceTable hotplug_table;
+static SimDs18b20Read reads[READS];
+static uint32_t done;
+static uint32_t submitted;
+
+// segment of every sensor, trunk sensors 0 and 4 (4 is plugged later), 1 and 2 on main of first coupler
+static const uint8_t sensor_segment[SENSORS] = { 0, 1, 1, 2, 0 };
+static const uint8_t trunk_sensor = 0;
+static const uint8_t plugged_sensor = 4;
+
+static void read_done(SimDs18b20Read* read, void* context) {
+	(void)read;
+	(void)context;
+	done++;
+}
+
+// hot-plug helper runs in same loop as scheduler, branch search is processed by test
+static void bus_task(void* context) {
+	(void)context;
+	onewire_scheduler_process(&scheduler);
+	onewire_hotplug_process(&hotplug);
+}
+
+static uint8_t reads_done(void* context) {
+	(void)context;
+	return done == submitted;
+}
+
+static uint8_t hotplug_idle(void* context) {
+	OneWireHotplug* helper = (OneWireHotplug*)context;
+
+	return !helper->search.running && !helper->pending && !helper->selecting;
+}
+
+// branch of sensor segment, segments 1..4 are main and aux of couplers in order
+static OneWireBranch* sensor_branch(uint8_t sensor) {
+	uint8_t segment = sensor_segment[sensor];
+
+	if (segment == 0) {
+		return NULL; // Match ROM of trunk device runs on whatever is connected
+	}
+	return ((segment - 1) % 2 == 0) ? &couplers[(segment - 1) / 2].main : &couplers[(segment - 1) / 2].aux;
+}
+
+static uint32_t model_switches(void) {
+	uint32_t switches = 0;
+
+	for (uint8_t c = 0; c < COUPLERS; c++) {
+		switches += coupler_models[c].switches;
+	}
+	return switches;
+}
+
+// joined segments of models have to match branch cached by scheduler
+static void check_connected(void) {
+	OneWireBranch* active = scheduler.active_branch;
+	uint32_t expected = 0;
+
+	for (uint8_t c = 0; c < COUPLERS; c++) {
+		if (active == &couplers[c].main) {
+			expected = 1UL << coupler_models[c].main_segment;
+		}
+		else if (active == &couplers[c].aux) {
+			expected = 1UL << coupler_models[c].aux_segment;
+		}
+	}
+	SIM_CHECK(bus.connected == expected);
+}
+
+static OneWireSearchStatus run_branch_search(OneWireBranch* branch) {
+	TickType_t start = sim_now;
+
+	onewire_branch_search_start(&branch_search, &scheduler, &client, branch, &trunk);
+	while (onewire_branch_search_process(&branch_search) == ONEWIRE_SEARCH_RUNNING && sim_now - start < TIMEOUT_US) {
+		sim_bus_step(&bus);
+	}
+	check_connected();
+	return branch_search.status;
+}
+
+static void search_branches(void) {
+	SIM_CHECK(run_branch_search(&trunk) == ONEWIRE_SEARCH_DONE);
+	SIM_CHECK(trunk.table.count == COUPLERS + 1); // couplers and trunk sensor
+	SIM_CHECK(onewire_device_table_find(&trunk.table, sensors[trunk_sensor].rom) >= 0);
+	for (uint8_t c = 0; c < COUPLERS; c++) {
+		SIM_CHECK(onewire_device_table_find(&trunk.table, coupler_models[c].rom) >= 0);
+		SIM_CHECK(run_branch_search(&couplers[c].main) == ONEWIRE_SEARCH_DONE);
+		SIM_CHECK(run_branch_search(&couplers[c].aux) == ONEWIRE_SEARCH_DONE || couplers[c].aux.table.count == 0);
+	}
+	// every sensor is listed only by its branch, trunk devices are excluded from branch tables
+	for (uint8_t s = 0; s < SENSORS; s++) {
+		if (s != plugged_sensor) {
+			SIM_CHECK(onewire_coupler_find_device(couplers, COUPLERS, sensors[s].rom) == sensor_branch(s));
+		}
+	}
+	SIM_CHECK(couplers[0].main.table.count == 2 && couplers[0].aux.table.count == 1);
+	SIM_CHECK(couplers[1].main.table.count == 0 && couplers[1].aux.table.count == 0);
+	printf("branch search: trunk=%u main=%u/%u aux=%u/%u switches=%u\n", trunk.table.count,
+		couplers[0].main.table.count, couplers[1].main.table.count, couplers[0].aux.table.count,
+		couplers[1].aux.table.count, scheduler.branch_switches);
+}
+
+// reads cycle through sensors on trunk and both branches of first coupler, batched reads are grouped by branch
+static uint32_t run_reads(const char* name, uint8_t batched) {
+	static const uint8_t order[SENSORS - 1] = { 1, 3, 2, 0 };
+	OneWireTxn* txns[READS];
+	uint32_t switches = scheduler.branch_switches;
+	uint32_t models = model_switches();
+	uint16_t count = 0;
+	TickType_t start = sim_now;
+
+	done = 0;
+	for (uint8_t r = 0; r < ROUNDS; r++) {
+		for (uint8_t i = 0; i < SENSORS - 1; i++) {
+			SimDs18b20Read* read = &reads[count];
+			uint8_t s = order[i];
+
+			sim_ds18b20_read_init(read, sensors[s].rom, read_done, NULL);
+			read->txn.branch = sensor_branch(s);
+			txns[count++] = &read->txn;
+		}
+	}
+	if (batched) {
+		onewire_scheduler_submit_batch(&scheduler, &client, txns, count);
+	}
+	else {
+		for (uint16_t i = 0; i < count; i++) {
+			onewire_scheduler_submit(&scheduler, &client, txns[i]);
+		}
+	}
+	submitted = count;
+	SIM_CHECK(sim_bus_run_until(&bus, reads_done, NULL, TIMEOUT_US));
+	for (uint16_t i = 0; i < count; i++) {
+		const OneWireTxn* txn = txns[i];
+		uint8_t s = 0;
+
+		while (memcmp(sensors[s].rom, &txn->tx[1], 8) != 0) {
+			s++;
+		}
+		SIM_CHECK(reads[i].ok);
+		SIM_CHECK(memcmp(txn->rx, sensors[s].scratchpad, 9) == 0); // TH tells sensors apart
+	}
+	switches = scheduler.branch_switches - switches;
+	SIM_CHECK(model_switches() - models == switches); // every confirmed switch was done by coupler
+	check_connected();
+	printf("%s: switches=%u time=%u us\n", name, switches, (unsigned)(sim_now - start));
+	return switches;
+}
+
+// hot-plug request arrives while branch search walks aux branch, helper waits and searches trunk
+static void hotplug_on_trunk(void) {
+	TickType_t start = sim_now;
+	uint32_t switches;
+	uint8_t overlap = 0;
+	int8_t trunk_only = -1;
+
+	onewire_branch_search_start(&branch_search, &scheduler, &client, &couplers[0].aux, &trunk);
+	while (onewire_branch_search_process(&branch_search) == ONEWIRE_SEARCH_RUNNING && sim_now - start < TIMEOUT_US) {
+		if (branch_search.state == ONEWIRE_BRANCH_SEARCH_WALK && !hotplug.pending && hotplug.searches == 0) {
+			onewire_hotplug_request(&hotplug);
+		}
+		sim_bus_step(&bus);
+		overlap |= hotplug.search.running;
+	}
+	SIM_CHECK(branch_search.status == ONEWIRE_SEARCH_DONE && couplers[0].aux.table.count == 1);
+	SIM_CHECK(!overlap && hotplug.pending); // bus held by branch search
+	switches = scheduler.branch_switches;
+	while (!hotplug_idle(&hotplug) && sim_now - start < TIMEOUT_US) {
+		sim_bus_step(&bus);
+		if (hotplug.search.running && trunk_only < 0) {
+			trunk_only = (bus.connected == 0 && scheduler.active_branch == NULL);
+		}
+	}
+	SIM_CHECK(trunk_only == 1);             // All Lines Off was sent before search
+	SIM_CHECK(scheduler.branch_switches - switches == 1);
+	SIM_CHECK(scheduler.hold_owner == NULL);
+	SIM_CHECK(hotplug.search.status == ONEWIRE_SEARCH_DONE && hotplug_table.count == trunk.table.count);
+
+	// sensor powered on trunk while branch is connected is found by trunk search
+	SIM_CHECK(run_reads("reconnect", 1) > 0);
+	SIM_CHECK(scheduler.active_branch != NULL);
+	start = sim_now;
+	sim_ds18b20_plug(&sensors[plugged_sensor], 1);
+	while ((onewire_device_table_find(&hotplug_table, sensors[plugged_sensor].rom) < 0 || !hotplug_idle(&hotplug))
+			&& sim_now - start < TIMEOUT_US) {
+		sim_bus_step(&bus);
+	}
+	printf("hot-plug on trunk: discovered in %u us, table=%u pulses=%u\n",
+		(unsigned)(sim_now - start), hotplug_table.count, master.hotplug_pulses);
+	SIM_CHECK(sim_now - start < DISCOVERY_US);
+	SIM_CHECK(master.hotplug_pulses == 1 && hotplug_table.count == trunk.table.count + 1);
+	SIM_CHECK(hotplug_table.added == 1 && bus.connected == 0);
+	for (uint8_t s = 0; s < SENSORS; s++) {
+		SIM_CHECK((onewire_device_table_find(&hotplug_table, sensors[s].rom) >= 0) == (sensor_segment[s] == 0));
+	}
+}
+
+int main(void) {
+	SimNode* node;
+	uint32_t naive;
+	uint32_t batched;
+
+	sim_now = 1000;
+	sim_bus_init(&bus);
+	node = sim_bus_add_driver(&bus, &master, OPERATING_MODE_MASTER, 0);
+	node->processed = 0; // onewire_process() is called by scheduler
+	node->irq |= SIM_IRQ_IDLE;
+	onewire_branch_init_trunk(&trunk, trunk_devices, sizeof(trunk_devices) / sizeof(trunk_devices[0]));
+	for (uint8_t c = 0; c < COUPLERS; c++) {
+		uint8_t rom[7] = { SIM_DS2409_FAMILY_CODE, 0x09, 0x24, c, 0x00, 0x00, 0x00 };
+
+		sim_ds2409_init(&coupler_models[c], rom, (uint8_t)(1 + 2 * c), (uint8_t)(2 + 2 * c));
+		sim_bus_add_model(&bus, &coupler_models[c].model, 0);
+		onewire_coupler_init(&couplers[c], coupler_models[c].rom, branch_devices[c][0], 4, branch_devices[c][1], 4);
+	}
+	for (uint8_t s = 0; s < SENSORS; s++) {
+		uint8_t rom[7] = { SIM_DS18B20_FAMILY_CODE, 0x24, 0x09, s, (uint8_t)(0x31 * s), 0x00, 0x00 };
+
+		sim_ds18b20_init(&sensors[s], rom);
+		sensors[s].scratchpad[2] = s;
+		sensors[s].scratchpad[8] = 0;
+		for (uint8_t i = 0; i < 8; i++) {
+			sensors[s].scratchpad[8] = onewire_crc8_update(sensors[s].scratchpad[8], sensors[s].scratchpad[i]);
+		}
+		sim_bus_add_model(&bus, &sensors[s].model, sensor_segment[s]);
+	}
+	sim_ds18b20_plug(&sensors[plugged_sensor], 0);
+	onewire_scheduler_init(&scheduler, &master);
+	onewire_scheduler_add_client(&scheduler, &client, 0, 0);
+	onewire_device_table_init(&hotplug_table, hotplug_devices, sizeof(hotplug_devices) / sizeof(hotplug_devices[0]));
+	onewire_hotplug_init(&hotplug, &master, &scheduler, &hotplug_table);
+	onewire_hotplug_set_trunk(&hotplug, &client, &trunk);
+	sim_bus_add_task(&bus, bus_task, NULL, NULL);
+
+	search_branches();
+	// aux of second coupler is connected after searches, its All Lines Off and Smart-On Main come first,
+	// then every change of branch in queue is switch
+	naive = run_reads("naive", 0);
+	SIM_CHECK(naive == 2 + 2 * ROUNDS);
+	// main stays connected after naive reads, only aux group needs switch
+	batched = run_reads("batched", 1);
+	SIM_CHECK(batched == 1);
+	hotplug_on_trunk();
+
+	// Direct-On Main connects branch without reset stimulus and presence byte, trunk is connected after hot-plug search
+	onewire_coupler_set_direct_main(&couplers[0], 1);
+	SIM_CHECK(run_reads("direct main", 0) == 1 + 2 * ROUNDS);
+	return sim_failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,257 @@
+/**
+ ******************************************************************************
+ * @file    testFleet.c
+ * @brief   Fleet of simulated buses stepped by work stealing thread pool
+ *
+ * @details
+ *          Every bus has master and four DS18B20 models and runs its own
+ *          workload of conversions and addressed scratchpad reads, buses get
+ *          different amount of work. Workers take slices of bus work from
+ *          their own deque and steal from deques of other workers when it is
+ *          empty. sim_now is thread local, worker loads time of bus before
+ *          slice and stores it after.
+ *
+ *          Results of every bus (data checksum, errors, simulated time) have
+ *          to match serial run of same fleet, so buses share no state.
+ *          Throughput in transactions per wall second, steals and load
+ *          balance of workers are printed.
+ *
+ * @license MIT License
+ ******************************************************************************
+ */
+
+#include "oneWireSim.h"
+#include "oneWireSimModels.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define FLEET_BUSES             64
+#define FLEET_DEVICES           4
+#define FLEET_BASE_TXNS         96
+#define FLEET_SLICE_TXNS        8      // transactions of bus run by worker before it picks next slice
+#define FLEET_CONVERT_EVERY     16
+#define FLEET_MAX_WORKERS       8
+
+typedef struct {
+	SimBus bus;
+	OneWireDriver master;
+	SimDs18b20 devices[FLEET_DEVICES];
+	uint32_t total;                 // transactions of workload
+	uint32_t done;
+	uint32_t errors;                // reads with bad CRC or temperature
+	uint32_t checksum;
+} FleetBus;
+
+typedef struct {
+	pthread_mutex_t lock;
+	uint16_t items[FLEET_BUSES];    // bus indexes, owner pops from tail, thieves from head
+	uint16_t head;
+	uint16_t count;
+} FleetDeque;
+
+typedef struct {
+	FleetDeque deque;
+	pthread_t thread;
+	uint8_t index;
+	uint32_t slices;
+	uint32_t steals;
+} FleetWorker;
+
+static FleetBus buses[FLEET_BUSES];
+static FleetWorker workers[FLEET_MAX_WORKERS];
+static uint8_t worker_count;
+static uint32_t buses_left;
+static pthread_mutex_t left_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void fleet_init(void) {
+	for (uint16_t b = 0; b < FLEET_BUSES; b++) {
+		FleetBus* fleet = &buses[b];
+
+		memset(fleet, 0, sizeof(*fleet));
+		sim_now = 0;
+		sim_bus_init(&fleet->bus);
+		sim_bus_add_driver(&fleet->bus, &fleet->master, OPERATING_MODE_MASTER, 0);
+		for (uint8_t d = 0; d < FLEET_DEVICES; d++) {
+			uint8_t rom[7] = { SIM_DS18B20_FAMILY_CODE, (uint8_t)b, d, 0x5A, 0x00, 0x00, 0x00 };
+
+			sim_ds18b20_init(&fleet->devices[d], rom);
+			sim_bus_add_model(&fleet->bus, &fleet->devices[d].model, 0);
+		}
+		fleet->total = FLEET_BASE_TXNS * (1 + b % 5); // uneven load, some workers run out early
+		sim_bus_leave(&fleet->bus);
+	}
+}
+
+static void run_transaction(FleetBus* fleet) {
+	uint32_t n = fleet->done;
+	SimDs18b20* device = &fleet->devices[n % FLEET_DEVICES];
+	uint8_t data[9];
+	uint8_t crc = 0;
+
+	if (n % FLEET_CONVERT_EVERY == 0) {
+		for (uint8_t d = 0; d < FLEET_DEVICES; d++) {
+			fleet->devices[d].temperature = (int16_t)(n + d * 16);
+		}
+		sim_master_reset(&fleet->bus, &fleet->master);
+		sim_master_write_byte(&fleet->bus, &fleet->master, SKIP_ROM);
+		sim_master_write_byte(&fleet->bus, &fleet->master, 0x44);
+		sim_bus_run_for(&fleet->bus, SIM_DS18B20_CONVERSION_US);
+	}
+	sim_master_reset(&fleet->bus, &fleet->master);
+	sim_master_write_byte(&fleet->bus, &fleet->master, MATCH_ROM);
+	sim_master_write(&fleet->bus, &fleet->master, device->rom, 8);
+	sim_master_write_byte(&fleet->bus, &fleet->master, READ_SCRATCHPAD);
+	sim_master_read(&fleet->bus, &fleet->master, data, 9);
+	for (uint8_t i = 0; i < 9; i++) {
+		crc = onewire_crc8_update(crc, data[i]);
+		fleet->checksum = fleet->checksum * 31 + data[i];
+	}
+	if (crc != 0 || (int16_t)(data[0] | (data[1] << 8)) != device->temperature) {
+		fleet->errors++;
+	}
+	fleet->done++;
+}
+
+// returns 1 when bus has work left
+static uint8_t run_slice(FleetBus* fleet) {
+	sim_bus_enter(&fleet->bus);
+	for (uint8_t i = 0; i < FLEET_SLICE_TXNS && fleet->done < fleet->total; i++) {
+		run_transaction(fleet);
+	}
+	sim_bus_leave(&fleet->bus);
+	return fleet->done < fleet->total;
+}
+
+static void deque_push(FleetDeque* deque, uint16_t item) {
+	pthread_mutex_lock(&deque->lock);
+	deque->items[(deque->head + deque->count++) % FLEET_BUSES] = item;
+	pthread_mutex_unlock(&deque->lock);
+}
+
+static int deque_pop(FleetDeque* deque, uint8_t steal) {
+	int item = -1;
+
+	pthread_mutex_lock(&deque->lock);
+	if (deque->count > 0) {
+		if (steal) {
+			item = deque->items[deque->head];
+			deque->head = (deque->head + 1) % FLEET_BUSES;
+		}
+		else {
+			item = deque->items[(deque->head + deque->count - 1) % FLEET_BUSES];
+		}
+		deque->count--;
+	}
+	pthread_mutex_unlock(&deque->lock);
+	return item;
+}
+
+static uint32_t left(void) {
+	uint32_t value;
+
+	pthread_mutex_lock(&left_lock);
+	value = buses_left;
+	pthread_mutex_unlock(&left_lock);
+	return value;
+}
+
+static void* worker_main(void* argument) {
+	FleetWorker* worker = (FleetWorker*)argument;
+
+	while (left() > 0) {
+		int item = deque_pop(&worker->deque, 0);
+
+		for (uint8_t i = 1; item < 0 && i < worker_count; i++) {
+			item = deque_pop(&workers[(worker->index + i) % worker_count].deque, 1);
+			if (item >= 0) {
+				worker->steals++;
+			}
+		}
+		if (item < 0) {
+			sched_yield();
+			continue;
+		}
+		worker->slices++;
+		if (run_slice(&buses[item])) {
+			deque_push(&worker->deque, (uint16_t)item);
+		}
+		else {
+			pthread_mutex_lock(&left_lock);
+			buses_left--;
+			pthread_mutex_unlock(&left_lock);
+		}
+	}
+	return NULL;
+}
+
+static double wall_seconds(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(void) {
+	uint32_t checksum[FLEET_BUSES];
+	TickType_t now[FLEET_BUSES];
+	uint32_t transactions = 0;
+	uint64_t simulated = 0;
+	double start;
+	double elapsed;
+	double sum = 0;
+	double squares = 0;
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+	// serial reference
+	fleet_init();
+	for (uint16_t b = 0; b < FLEET_BUSES; b++) {
+		while (run_slice(&buses[b])) {
+		}
+		checksum[b] = buses[b].checksum;
+		now[b] = buses[b].bus.now;
+		SIM_CHECK(buses[b].errors == 0);
+	}
+
+	fleet_init();
+	worker_count = (cpus < 2) ? 2 : (cpus > FLEET_MAX_WORKERS) ? FLEET_MAX_WORKERS : (uint8_t)cpus;
+	buses_left = FLEET_BUSES;
+	for (uint8_t w = 0; w < worker_count; w++) {
+		memset(&workers[w], 0, sizeof(workers[w]));
+		pthread_mutex_init(&workers[w].deque.lock, NULL);
+		workers[w].index = w;
+	}
+	for (uint16_t b = 0; b < FLEET_BUSES; b++) {
+		deque_push(&workers[(b * worker_count) / FLEET_BUSES].deque, b); // heavy and light buses mixed per worker
+	}
+	start = wall_seconds();
+	for (uint8_t w = 0; w < worker_count; w++) {
+		pthread_create(&workers[w].thread, NULL, worker_main, &workers[w]);
+	}
+	for (uint8_t w = 0; w < worker_count; w++) {
+		pthread_join(workers[w].thread, NULL);
+	}
+	elapsed = wall_seconds() - start;
+
+	for (uint16_t b = 0; b < FLEET_BUSES; b++) {
+		SIM_CHECK(buses[b].done == buses[b].total);
+		SIM_CHECK(buses[b].errors == 0);
+		SIM_CHECK(buses[b].checksum == checksum[b]);
+		SIM_CHECK(buses[b].bus.now == now[b]);
+		transactions += buses[b].done;
+		simulated += buses[b].bus.now;
+	}
+	for (uint8_t w = 0; w < worker_count; w++) {
+		sum += workers[w].slices;
+		squares += (double)workers[w].slices * workers[w].slices;
+		printf("worker %u: slices=%u steals=%u\n", w, workers[w].slices, workers[w].steals);
+	}
+	printf("%u buses, %u workers: %u transactions in %.3f s, %.0f transactions/s, %.1f simulated s/s, balance %.3f\n",
+		FLEET_BUSES, worker_count, transactions, elapsed, transactions / elapsed, simulated / 1e6 / elapsed,
+		sum * sum / (worker_count * squares)); // Jain index of slices per worker
+	return sim_failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,170 @@
+/**
+ ******************************************************************************
+ * @file    testGolden.c
+ * @brief   Slot transcripts of reference scenarios for golden comparison
+ *
+ * @details
+ *          Every scenario runs master against DS18B20 models on simulated bus
+ *          and writes bus drives and sample decisions of master with ticks
+ *          relative to scenario start into <directory>/<scenario>.txt.
+ *          Makefile diffs them against test/golden, any change of slot
+ *          timing, order of resets and bits or sampled values shows up in
+ *          diff. "make golden-update" rewrites corpus after intended change.
+ *
+ * @license MIT License
+ ******************************************************************************
+ */
+
+#include "oneWireSim.h"
+#include "oneWireSimModels.h"
+#include "oneWireSearch.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define GOLDEN_DEVICES  3
+
+typedef struct {
+	SimBus bus;
+	OneWireDriver master;
+	SimDs18b20 devices[GOLDEN_DEVICES];
+	SimTranscript transcript;
+	FILE* out;
+} Scenario;
+
+typedef struct {
+	const char* name;
+	uint8_t devices;
+	void (*run)(Scenario* scenario);
+} ScenarioEntry;
+
+static const uint8_t serials[GOLDEN_DEVICES][7] = {
+	{ SIM_DS18B20_FAMILY_CODE, 0x6B, 0x01, 0x00, 0x80, 0x4E, 0x01 },
+	{ SIM_DS18B20_FAMILY_CODE, 0x2A, 0x7F, 0x00, 0x80, 0x4E, 0x01 },
+	{ SIM_DS18B20_FAMILY_CODE, 0x6B, 0x05, 0x12, 0x00, 0x00, 0x00 }
+};
+
+static void search_task(void* context) {
+	onewire_search_process((OneWireSearch*)context);
+}
+
+static uint8_t search_done(void* context) {
+	return !((OneWireSearch*)context)->running;
+}
+
+static void run_write_byte(Scenario* scenario) {
+	sim_master_reset(&scenario->bus, &scenario->master);
+	sim_master_write_byte(&scenario->bus, &scenario->master, SKIP_ROM);
+	sim_master_write_byte(&scenario->bus, &scenario->master, 0xA5);
+}
+
+static void run_read_byte(Scenario* scenario) {
+	uint8_t rom[8];
+
+	sim_master_reset(&scenario->bus, &scenario->master);
+	sim_master_write_byte(&scenario->bus, &scenario->master, READ_ROM);
+	sim_master_read(&scenario->bus, &scenario->master, rom, 8);
+	SIM_CHECK(memcmp(rom, scenario->devices[0].rom, 8) == 0);
+}
+
+static void run_search(Scenario* scenario) {
+	OneWireSearch search;
+	OneWireDevice devices[GOLDEN_DEVICES];
+	OneWireDeviceTable table;
+
+	onewire_device_table_init(&table, devices, GOLDEN_DEVICES);
+	onewire_search_start(&search, &scenario->master, &table, SEARCH_ROM);
+	sim_bus_add_task(&scenario->bus, search_task, NULL, &search);
+	SIM_CHECK(sim_bus_run_until(&scenario->bus, search_done, &search, 100000));
+	SIM_CHECK(search.status == ONEWIRE_SEARCH_DONE);
+	SIM_CHECK(table.count == GOLDEN_DEVICES);
+	for (uint8_t i = 0; i < GOLDEN_DEVICES; i++) {
+		SIM_CHECK(onewire_device_table_find(&table, scenario->devices[i].rom) >= 0);
+	}
+}
+
+// conversion is polled with read slot every 10 ms, then value is read with Match ROM
+static void run_ds18b20_cycle(Scenario* scenario) {
+	uint8_t scratchpad[9];
+	uint8_t polls = 0;
+
+	scenario->devices[0].temperature = (int16_t)0xFF5E; // -10.125 degC
+	sim_master_reset(&scenario->bus, &scenario->master);
+	sim_master_write_byte(&scenario->bus, &scenario->master, SKIP_ROM);
+	sim_master_write_byte(&scenario->bus, &scenario->master, 0x44);
+	do {
+		sim_bus_run_for(&scenario->bus, 10000);
+		polls++;
+	} while (!sim_master_read_bit(&scenario->bus, &scenario->master) && polls < 100);
+	sim_master_reset(&scenario->bus, &scenario->master);
+	sim_master_write_byte(&scenario->bus, &scenario->master, MATCH_ROM);
+	sim_master_write(&scenario->bus, &scenario->master, scenario->devices[0].rom, 8);
+	sim_master_write_byte(&scenario->bus, &scenario->master, READ_SCRATCHPAD);
+	sim_master_read(&scenario->bus, &scenario->master, scratchpad, 9);
+	SIM_CHECK(polls == 75);
+	SIM_CHECK(scratchpad[0] == 0x5E && scratchpad[1] == 0xFF);
+}
+
+// Write Scratchpad, Copy Scratchpad waited out, Recall EEPROM and Read Scratchpad
+static void run_eeprom_write(Scenario* scenario) {
+	const uint8_t write[4] = { WRITE_SCRATCHPAD, 0x32, 0xEC, 0x5F };
+	uint8_t scratchpad[9];
+
+	sim_master_reset(&scenario->bus, &scenario->master);
+	sim_master_write_byte(&scenario->bus, &scenario->master, SKIP_ROM);
+	sim_master_write(&scenario->bus, &scenario->master, write, sizeof(write));
+	sim_master_reset(&scenario->bus, &scenario->master);
+	sim_master_write_byte(&scenario->bus, &scenario->master, SKIP_ROM);
+	sim_master_write_byte(&scenario->bus, &scenario->master, 0x48);
+	sim_bus_run_for(&scenario->bus, SIM_DS18B20_COPY_US);
+	SIM_CHECK(sim_master_read_bit(&scenario->bus, &scenario->master) == 1);
+	scenario->devices[0].scratchpad[2] = 0; // recall has to restore it from EEPROM
+	sim_master_reset(&scenario->bus, &scenario->master);
+	sim_master_write_byte(&scenario->bus, &scenario->master, SKIP_ROM);
+	sim_master_write_byte(&scenario->bus, &scenario->master, 0xB8);
+	sim_master_reset(&scenario->bus, &scenario->master);
+	sim_master_write_byte(&scenario->bus, &scenario->master, SKIP_ROM);
+	sim_master_write_byte(&scenario->bus, &scenario->master, READ_SCRATCHPAD);
+	sim_master_read(&scenario->bus, &scenario->master, scratchpad, 9);
+	SIM_CHECK(memcmp(&scratchpad[2], &write[1], 3) == 0);
+}
+
+static const ScenarioEntry scenarios[] = {
+	{ "write_byte", 1, run_write_byte },
+	{ "read_byte", 1, run_read_byte },
+	{ "search", GOLDEN_DEVICES, run_search },
+	{ "ds18b20_cycle", 1, run_ds18b20_cycle },
+	{ "eeprom_write", 1, run_eeprom_write }
+};
+
+int main(int argc, char** argv) {
+	static Scenario scenario;
+	char path[256];
+
+	if (argc != 2) {
+		fprintf(stderr, "usage: %s <directory>\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	for (uint8_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++) {
+		snprintf(path, sizeof(path), "%s/%s.txt", argv[1], scenarios[i].name);
+		memset(&scenario, 0, sizeof(scenario));
+		scenario.out = fopen(path, "w");
+		if (scenario.out == NULL) {
+			perror(path);
+			return EXIT_FAILURE;
+		}
+		sim_now = 0;
+		sim_bus_init(&scenario.bus);
+		sim_bus_add_driver(&scenario.bus, &scenario.master, OPERATING_MODE_MASTER, 0);
+		for (uint8_t d = 0; d < scenarios[i].devices; d++) {
+			sim_ds18b20_init(&scenario.devices[d], serials[d]);
+			sim_bus_add_model(&scenario.bus, &scenario.devices[d].model, 0);
+		}
+		fprintf(scenario.out, "# %s, tick DRIVE|SAMPLE level\n", scenarios[i].name);
+		sim_transcript_start(&scenario.transcript, &scenario.master, scenario.out, 0);
+		scenarios[i].run(&scenario);
+		sim_transcript_stop(&scenario.transcript, &scenario.master);
+		fclose(scenario.out);
+	}
+	return sim_failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,185 @@
+/**
+ ******************************************************************************
+ * @file    testHotplug.c
+ * @brief   Hot-plug discovery from presence pulses of DS18B20 models
+ *
+ * @details
+ *          Master node gets idle edge interrupts (SIM_IRQ_IDLE), hot-plug
+ *          helper shares bus with control reads through scheduler. Traffic
+ *          of master alone must not start searches, device plugged into idle
+ *          bus has to be in table within milliseconds of its presence pulse.
+ *          Device plugged while search walks ROM tree collides with its slots,
+ *          search is repeated until new device and old ones are found.
+ *
+ * @license MIT License
+ ******************************************************************************
+ */
+
+#include "oneWireSim.h"
+#include "oneWireSimModels.h"
+#include "oneWireSearch.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define DEVICES             4       // first two are present at start
+#define CONTROL_US          20000   // period of control reads, read takes 11 ms
+#define IDLE_US             200000  // control traffic without plugged device
+#define DISCOVERY_US        50000   // presence pulse to device in table
+#define PLUG_BIT            20      // bit of first pass at which device is plugged during search
+
+static SimBus bus;
+static OneWireDriver master;
+static OneWireScheduler scheduler;
+static OneWireClient control;
+static OneWireHotplug hotplug;
+static OneWireDevice devices[8];
+static OneWireDeviceTable table;
+static SimDs18b20 models[DEVICES];
+static SimDs18b20Read control_read;
+static TickType_t next_control;
+static uint32_t control_reads;
+static uint32_t control_skipped;    // previous read still waited for bus
+static uint32_t added;              // devices reported by callback
+
+static void read_done(SimDs18b20Read* read, void* context) {
+	(void)context;
+	SIM_CHECK(read->ok);
+}
+
+static void control_task(void* context) {
+	(void)context;
+	if ((int32_t)(sim_now - next_control) < 0) {
+		return;
+	}
+	next_control += CONTROL_US;
+	if (control_reads > 0 && !control_read.done) {
+		control_skipped++; // search holds bus
+		return;
+	}
+	sim_ds18b20_read_init(&control_read, models[0].rom, read_done, NULL);
+	onewire_scheduler_submit(&scheduler, &control, &control_read.txn);
+	control_reads++;
+}
+
+static TickType_t control_next_delay(void* context) {
+	int32_t left = (int32_t)(next_control - sim_now);
+
+	(void)context;
+	return (left > 0) ? (TickType_t)left : 0;
+}
+
+// hot-plug helper runs in same loop as scheduler
+static void bus_task(void* context) {
+	(void)context;
+	onewire_scheduler_process(&scheduler);
+	onewire_hotplug_process(&hotplug);
+}
+
+static void hotplug_added(OneWireHotplug* helper, void* context) {
+	(void)context;
+	added += helper->table->added;
+}
+
+static uint8_t hotplug_idle(void* context) {
+	OneWireHotplug* helper = (OneWireHotplug*)context;
+
+	return !helper->search.running && !helper->pending && !helper->selecting;
+}
+
+static uint8_t search_at_bit(void* context) {
+	OneWireHotplug* helper = (OneWireHotplug*)context;
+
+	return helper->search.running && helper->search.bit_number == PLUG_BIT;
+}
+
+static uint8_t scheduler_idle(void* context) {
+	return onewire_scheduler_is_idle((OneWireScheduler*)context);
+}
+
+static uint8_t present(uint8_t model) {
+	int index = onewire_device_table_find(&table, models[model].rom);
+
+	return index >= 0 && devices[index].present;
+}
+
+// plugged device is in table and search that found it ended
+static uint8_t discovered(void* context) {
+	SimDs18b20* model = (SimDs18b20*)context;
+
+	return onewire_device_table_find(&table, model->rom) >= 0 && hotplug_idle(&hotplug);
+}
+
+int main(void) {
+	SimNode* node;
+	TickType_t start;
+
+	sim_now = 1000;
+	sim_bus_init(&bus);
+	node = sim_bus_add_driver(&bus, &master, OPERATING_MODE_MASTER, 0);
+	node->processed = 0; // onewire_process() is called by scheduler
+	node->irq |= SIM_IRQ_IDLE;
+	for (uint8_t d = 0; d < DEVICES; d++) {
+		uint8_t rom[7] = { SIM_DS18B20_FAMILY_CODE, 0x48, 0x50, d, (uint8_t)(0x11 * d), 0x00, 0x00 };
+
+		sim_ds18b20_init(&models[d], rom);
+		sim_bus_add_model(&bus, &models[d].model, 0);
+		if (d >= 2) {
+			sim_ds18b20_plug(&models[d], 0);
+		}
+	}
+	onewire_scheduler_init(&scheduler, &master);
+	onewire_scheduler_add_client(&scheduler, &control, 0, 0);
+	onewire_device_table_init(&table, devices, sizeof(devices) / sizeof(devices[0]));
+	onewire_hotplug_init(&hotplug, &master, &scheduler, &table);
+	onewire_hotplug_set_callback(&hotplug, hotplug_added, NULL);
+	sim_bus_add_task(&bus, bus_task, NULL, NULL);
+	next_control = sim_now + 10 * IDLE_US; // control reads start after initial search
+	sim_bus_add_task(&bus, control_task, control_next_delay, NULL);
+
+	// initial table is searched on request
+	onewire_hotplug_request(&hotplug);
+	SIM_CHECK(sim_bus_run_until(&bus, hotplug_idle, &hotplug, DISCOVERY_US));
+	SIM_CHECK(hotplug.searches == 1 && hotplug.search.status == ONEWIRE_SEARCH_DONE);
+	SIM_CHECK(table.count == 2 && added == 2 && present(0) && present(1));
+
+	// slots of master are not presence pulses
+	next_control = sim_now;
+	sim_bus_run_for(&bus, IDLE_US);
+	SIM_CHECK(control_reads >= IDLE_US / CONTROL_US && control_skipped == 0);
+	SIM_CHECK(master.hotplug_pulses == 0 && hotplug.searches == 1);
+
+	// device powered on idle bus is found by search started from its presence pulse
+	SIM_CHECK(sim_bus_run_until(&bus, scheduler_idle, &scheduler, CONTROL_US));
+	start = sim_now;
+	sim_ds18b20_plug(&models[2], 1);
+	SIM_CHECK(sim_bus_run_until(&bus, discovered, &models[2], DISCOVERY_US));
+	printf("plugged on idle bus: discovered in %u us, pulses=%u searches=%u\n",
+		(unsigned)(sim_now - start), master.hotplug_pulses, hotplug.searches);
+	SIM_CHECK(sim_now - start < DISCOVERY_US);
+	SIM_CHECK(master.hotplug_pulses == 1 && hotplug.searches == 2);
+	SIM_CHECK(table.count == 3 && table.added == 1 && added == 3 && present(2));
+
+	// device powered during search collides with slot, search is repeated until it is found
+	onewire_hotplug_request(&hotplug);
+	SIM_CHECK(sim_bus_run_until(&bus, search_at_bit, &hotplug, DISCOVERY_US));
+	sim_ds18b20_plug(&models[3], 1);
+	SIM_CHECK(sim_bus_run_until(&bus, hotplug_idle, &hotplug, 4 * DISCOVERY_US));
+	printf("plugged during search: searches=%u failures=%u retries=%u status=%u skipped reads=%u\n",
+		hotplug.searches, hotplug.failures, hotplug.retries, hotplug.search.status, control_skipped);
+	SIM_CHECK(hotplug.failures >= 1 && hotplug.failures <= ONEWIRE_HOTPLUG_RETRIES); // disturbed search was repeated
+	SIM_CHECK(hotplug.search.status == ONEWIRE_SEARCH_DONE && hotplug.retries == 0);
+	SIM_CHECK(table.count == 4 && added == 4);
+	for (uint8_t d = 0; d < DEVICES; d++) {
+		SIM_CHECK(present(d));
+	}
+
+	// removed device is marked absent by next full search
+	next_control = sim_now + 10 * IDLE_US; // no reads of removed device
+	SIM_CHECK(sim_bus_run_until(&bus, scheduler_idle, &scheduler, CONTROL_US));
+	sim_ds18b20_plug(&models[0], 0);
+	onewire_hotplug_request(&hotplug);
+	SIM_CHECK(sim_bus_run_until(&bus, hotplug_idle, &hotplug, DISCOVERY_US));
+	SIM_CHECK(table.lost == 1 && !present(0) && present(1) && present(2) && present(3));
+	printf("hot-plug: %s\n", sim_failures ? "FAILED" : "ok");
+	return sim_failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,122 @@
+/**
+ ******************************************************************************
+ * @file    testKernel.c
+ * @brief   Discrete-event kernel against stepping every tick
+ *
+ * @details
+ *          Same DS18B20 session (Read ROM, conversion waited out on idle bus,
+ *          Read Scratchpad, Write and Copy Scratchpad) is simulated with
+ *          fast-forward and with one step per tick. Slot transcripts of
+ *          master have to be identical, fast-forward has to take fraction
+ *          of steps.
+ *
+ * @license MIT License
+ ******************************************************************************
+ */
+
+#include "oneWireSim.h"
+#include "oneWireSimModels.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+	char* transcript;
+	size_t length;
+	uint64_t rounds;
+	TickType_t duration;
+	uint8_t rom[8];
+	uint8_t scratchpad[9];
+	uint8_t busy_bit;
+	uint8_t done_bit;
+	uint8_t eeprom[3];
+} SessionResult;
+
+static const uint8_t serial[7] = { SIM_DS18B20_FAMILY_CODE, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66 };
+
+static void run_session(uint8_t fast_forward, SessionResult* result) {
+	SimBus bus;
+	OneWireDriver master;
+	SimDs18b20 device;
+	SimTranscript transcript;
+	FILE* out;
+	TickType_t start;
+	const uint8_t write[5] = { SKIP_ROM, WRITE_SCRATCHPAD, 0x19, 0xF6, 0x3F };
+
+	sim_now = 1000;
+	sim_bus_init(&bus);
+	bus.fast_forward = fast_forward;
+	sim_bus_add_driver(&bus, &master, OPERATING_MODE_MASTER, 0);
+	sim_ds18b20_init(&device, serial);
+	device.temperature = 0x0191; // 25.0625 degC
+	sim_bus_add_model(&bus, &device.model, 0);
+
+	out = open_memstream(&result->transcript, &result->length);
+	sim_transcript_start(&transcript, &master, out, 1);
+	start = sim_now;
+
+	SIM_CHECK(sim_master_reset(&bus, &master));
+	sim_master_write_byte(&bus, &master, READ_ROM);
+	sim_master_read(&bus, &master, result->rom, 8);
+
+	sim_master_reset(&bus, &master);
+	sim_master_write_byte(&bus, &master, SKIP_ROM);
+	sim_master_write_byte(&bus, &master, 0x44);
+	sim_bus_run_for(&bus, 100000);
+	result->busy_bit = sim_master_read_bit(&bus, &master);
+	sim_bus_run_for(&bus, 700000);
+	result->done_bit = sim_master_read_bit(&bus, &master);
+
+	sim_master_reset(&bus, &master);
+	sim_master_write_byte(&bus, &master, SKIP_ROM);
+	sim_master_write_byte(&bus, &master, READ_SCRATCHPAD);
+	sim_master_read(&bus, &master, result->scratchpad, 9);
+
+	sim_master_reset(&bus, &master);
+	sim_master_write(&bus, &master, &write[0], sizeof(write));
+	sim_master_reset(&bus, &master);
+	sim_master_write_byte(&bus, &master, SKIP_ROM);
+	sim_master_write_byte(&bus, &master, 0x48);
+	sim_bus_run_for(&bus, 20000);
+	memcpy(result->eeprom, device.eeprom, sizeof(result->eeprom));
+
+	result->duration = sim_now - start;
+	result->rounds = bus.rounds;
+	sim_transcript_stop(&transcript, &master);
+	fclose(out);
+}
+
+static uint8_t crc8(const uint8_t* data, uint8_t length) {
+	uint8_t crc = 0;
+
+	for (uint8_t i = 0; i < length; i++) {
+		crc = onewire_crc8_update(crc, data[i]);
+	}
+	return crc;
+}
+
+int main(void) {
+	SessionResult fast;
+	SessionResult exact;
+
+	run_session(1, &fast);
+	run_session(0, &exact);
+
+	SIM_CHECK(memcmp(fast.rom, serial, 7) == 0);
+	SIM_CHECK(crc8(fast.rom, 8) == 0);
+	SIM_CHECK(fast.busy_bit == 0);
+	SIM_CHECK(fast.done_bit == 1);
+	SIM_CHECK(crc8(fast.scratchpad, 9) == 0);
+	SIM_CHECK(fast.scratchpad[0] == 0x91 && fast.scratchpad[1] == 0x01);
+	SIM_CHECK(fast.eeprom[0] == 0x19 && fast.eeprom[1] == 0xF6 && fast.eeprom[2] == 0x3F);
+
+	SIM_CHECK(fast.duration == exact.duration);
+	SIM_CHECK(fast.length == exact.length && memcmp(fast.transcript, exact.transcript, fast.length) == 0);
+	SIM_CHECK(fast.rounds * 10 < exact.rounds);
+
+	printf("session %u us, %zu transcript bytes, steps fast-forward=%llu per-tick=%llu\n",
+		(unsigned)fast.duration, fast.length, (unsigned long long)fast.rounds, (unsigned long long)exact.rounds);
+	free(fast.transcript);
+	free(exact.transcript);
+	return sim_failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,142 @@
+/**
+ ******************************************************************************
+ * @file    testLinuxGpio.c
+ * @brief   Linux GPIO backend against mock gpiochip
+ *
+ * @details
+ *          open, ioctl and close are wrapped by mockGpiochip.c, backend is
+ *          built unchanged. Checks line requests made by
+ *          onewire_linux_gpio_open(), cleanup on failed open, edges returned
+ *          by onewire_linux_gpio_wait_edge() and Read ROM of DS18B20 model
+ *          through backend ops.
+ *
+ * @license MIT License
+ ******************************************************************************
+ */
+
+#include "mockGpiochip.h"
+#include "oneWireLinuxGpio.h"
+#include "oneWireSimModels.h"
+#include <linux/gpio.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BUS_LINE        2
+#define SENSE_LINE      3
+
+static const uint8_t serial[7] = { SIM_DS18B20_FAMILY_CODE, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F };
+
+static void test_requests(void) {
+	OneWireLinuxGpio gpio;
+	MockGpioLine* line = &mock_gpiochip.lines[BUS_LINE];
+	MockGpioLine* sense = &mock_gpiochip.lines[SENSE_LINE];
+
+	mock_gpiochip_init();
+	SIM_CHECK(onewire_linux_gpio_open(&gpio, MOCK_GPIOCHIP_PATH, BUS_LINE, SENSE_LINE) == 0);
+	SIM_CHECK(line->requested && sense->requested);
+	SIM_CHECK(line->flags == (GPIO_V2_LINE_FLAG_OUTPUT | GPIO_V2_LINE_FLAG_OPEN_DRAIN));
+	SIM_CHECK(line->initial_value == 1); // bus released while line is taken over
+	SIM_CHECK(sense->flags == (GPIO_V2_LINE_FLAG_INPUT | GPIO_V2_LINE_FLAG_EDGE_RISING | GPIO_V2_LINE_FLAG_EDGE_FALLING));
+	SIM_CHECK(strcmp(line->consumer, "onewire") == 0 && strcmp(sense->consumer, "onewire") == 0);
+	SIM_CHECK(gpio.line_fd == line->fd && gpio.sense_fd == sense->fd);
+	SIM_CHECK(mock_gpiochip.chip_fd < 0); // chip closed after lines were requested
+
+	onewire_linux_gpio_ops.drive_low(&gpio);
+	SIM_CHECK(line->value == 0 && line->set_count == 1);
+	onewire_linux_gpio_ops.release(&gpio);
+	SIM_CHECK(line->value == 1 && line->set_count == 2);
+
+	onewire_linux_gpio_close(&gpio);
+	SIM_CHECK(gpio.line_fd < 0 && gpio.sense_fd < 0);
+	SIM_CHECK(mock_gpiochip_open_fds() == 0);
+
+	// without sense line bus line is read back
+	SIM_CHECK(onewire_linux_gpio_open(&gpio, MOCK_GPIOCHIP_PATH, BUS_LINE, ONEWIRE_LINUX_GPIO_NO_SENSE_LINE) == 0);
+	SIM_CHECK(!sense->requested && gpio.sense_fd < 0);
+	onewire_linux_gpio_close(&gpio);
+	SIM_CHECK(mock_gpiochip_open_fds() == 0);
+}
+
+static void test_open_failures(void) {
+	OneWireLinuxGpio gpio;
+
+	mock_gpiochip_init();
+	SIM_CHECK(onewire_linux_gpio_open(&gpio, "/mock/gpiochip9", BUS_LINE, SENSE_LINE) < 0);
+	SIM_CHECK(gpio.line_fd < 0 && gpio.sense_fd < 0);
+
+	mock_gpiochip.lines[BUS_LINE].busy = 1;
+	SIM_CHECK(onewire_linux_gpio_open(&gpio, MOCK_GPIOCHIP_PATH, BUS_LINE, SENSE_LINE) < 0);
+	SIM_CHECK(gpio.line_fd < 0 && gpio.sense_fd < 0);
+	SIM_CHECK(mock_gpiochip_open_fds() == 0);
+	mock_gpiochip.lines[BUS_LINE].busy = 0;
+
+	// bus line already requested has to be released when sense line fails
+	mock_gpiochip.lines[SENSE_LINE].busy = 1;
+	SIM_CHECK(onewire_linux_gpio_open(&gpio, MOCK_GPIOCHIP_PATH, BUS_LINE, SENSE_LINE) < 0);
+	SIM_CHECK(gpio.line_fd < 0 && gpio.sense_fd < 0);
+	SIM_CHECK(!mock_gpiochip.lines[BUS_LINE].requested);
+	SIM_CHECK(mock_gpiochip_open_fds() == 0);
+	SIM_CHECK(mock_gpiochip.opens == 2);
+}
+
+// expected edge of sense line, timestamp relative to start in us
+static void check_edge(OneWireLinuxGpio* gpio, GPIO_PinState expected, TickType_t start, TickType_t min_us, TickType_t max_us) {
+	GPIO_PinState level;
+	uint64_t timestamp_ns = 0;
+	uint64_t offset_us;
+
+	SIM_CHECK(onewire_linux_gpio_wait_edge(gpio, 0, &level, &timestamp_ns) == 1);
+	offset_us = timestamp_ns / 1000 - start;
+	SIM_CHECK(level == expected);
+	SIM_CHECK(offset_us >= min_us && offset_us <= max_us);
+}
+
+static void test_bus(void) {
+	SimBus bus;
+	OneWireDriver master;
+	OneWireLinuxGpio gpio;
+	SimDs18b20 device;
+	uint8_t rom[8];
+	GPIO_PinState level;
+	uint64_t timestamp_ns;
+	TickType_t start;
+
+	mock_gpiochip_init();
+	sim_now = 1000;
+	sim_bus_init(&bus);
+	sim_bus_add_driver(&bus, &master, OPERATING_MODE_MASTER, 0);
+	mock_gpiochip_attach(BUS_LINE, &bus, 0);
+	mock_gpiochip_attach(SENSE_LINE, &bus, 0);
+	sim_ds18b20_init(&device, serial);
+	sim_bus_add_model(&bus, &device.model, 0);
+
+	SIM_CHECK(onewire_linux_gpio_open(&gpio, MOCK_GPIOCHIP_PATH, BUS_LINE, SENSE_LINE) == 0);
+	onewire_init_custom(&master, &onewire_linux_gpio_ops, &gpio, OPERATING_MODE_MASTER);
+	SIM_CHECK(onewire_linux_gpio_wait_edge(&gpio, 0, &level, &timestamp_ns) == 0); // released bus, no edge
+
+	start = sim_now;
+	SIM_CHECK(sim_master_reset(&bus, &master));
+	check_edge(&gpio, GPIO_PIN_RESET, start, 0, 0);
+	check_edge(&gpio, GPIO_PIN_SET, start, 480, 480);
+	check_edge(&gpio, GPIO_PIN_RESET, start, 480 + 15, 480 + 60);   // presence of model
+	check_edge(&gpio, GPIO_PIN_SET, start, 480 + 75, 480 + 300);
+	SIM_CHECK(onewire_linux_gpio_wait_edge(&gpio, 0, &level, &timestamp_ns) == 0);
+
+	sim_master_write_byte(&bus, &master, READ_ROM);
+	sim_master_read(&bus, &master, rom, 8);
+	SIM_CHECK(memcmp(rom, device.rom, 8) == 0);
+	SIM_CHECK(master.state == ONEWIRE_STATE_IDLE);
+	SIM_CHECK(mock_gpiochip.lines[SENSE_LINE].event_count * bus.node_count == bus.edges); // every node of single segment sees each edge
+
+	onewire_linux_gpio_close(&gpio);
+	SIM_CHECK(mock_gpiochip_open_fds() == 0);
+}
+
+int main(void) {
+	test_requests();
+	test_open_failures();
+	test_bus();
+	printf("linux gpio backend: %s\n", sim_failures ? "FAILED" : "ok");
+	return sim_failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
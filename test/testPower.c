@@ -0,0 +1,192 @@
+/**
+ ******************************************************************************
+ * @file    testPower.c
+ * @brief   Conversion staggering of scheduler against current of device models
+ *
+ * @details
+ *          Three buses with three DS18B20 models each share one supply. Every
+ *          bus runs transaction scheduler with prefetch entry per device,
+ *          consumer asks for all values once per period. Current drawn by
+ *          converting models is measured by simulator, its peak on every bus
+ *          and on shared supply must not exceed budgets given to schedulers,
+ *          while conversions still run in parallel as far as budgets allow.
+ *
+ * @license MIT License
+ ******************************************************************************
+ */
+
+#include "oneWireSim.h"
+#include "oneWireSimModels.h"
+#include "oneWireScheduler.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define POWER_BUSES         3
+#define POWER_DEVICES       3
+#define POWER_PERIOD        3000000 // us between requests of consumer
+#define POWER_REQUESTS      12      // per device
+#define POWER_CURRENT       SIM_DS18B20_CONVERT_CURRENT
+
+typedef struct {
+	SimBus bus;
+	OneWireDriver master;
+	OneWireScheduler scheduler;
+	OneWireClient client;
+	SimDs18b20 devices[POWER_DEVICES];
+	OneWirePrefetch prefetch[POWER_DEVICES];
+	uint8_t waiting[POWER_DEVICES];     // request missed, value is taken when read
+	TickType_t next_request;
+	uint32_t requests;
+	uint32_t values;                    // values with valid CRC handed to consumer
+	uint32_t stale;                     // request came while previous one still waited
+} PowerBus;
+
+typedef struct {
+	uint32_t bus_budget;
+	uint32_t global_budget;
+	uint32_t bus_peak;                  // expected measured peak of every bus
+	uint32_t global_peak;               // expected measured peak of supply
+	uint8_t prefetched;                 // waves fit in lead of prefetch, every request after learning is hit
+} PowerCase;
+
+static PowerBus buses[POWER_BUSES];
+static SimPower supply;
+static OneWirePowerBudget global;
+
+static void take_value(PowerBus* power_bus, uint8_t device, const uint8_t* data) {
+	SIM_CHECK(sim_ds18b20_check_value(&power_bus->devices[device], data));
+	power_bus->values++;
+	power_bus->waiting[device] = 0;
+}
+
+static void scheduler_task(void* context) {
+	onewire_scheduler_process((OneWireScheduler*)context);
+}
+
+static void consumer_task(void* context) {
+	PowerBus* power_bus = (PowerBus*)context;
+	uint8_t data[9];
+
+	for (uint8_t d = 0; d < POWER_DEVICES; d++) {
+		if (power_bus->waiting[d] && onewire_prefetch_get(&power_bus->prefetch[d], data)) {
+			take_value(power_bus, d, data);
+		}
+	}
+	if ((int32_t)(sim_now - power_bus->next_request) < 0 || power_bus->requests >= POWER_REQUESTS * POWER_DEVICES) {
+		return;
+	}
+	for (uint8_t d = 0; d < POWER_DEVICES; d++) {
+		if (power_bus->waiting[d]) {
+			power_bus->stale++;
+		}
+		power_bus->requests++;
+		if (onewire_prefetch_request(&power_bus->scheduler, &power_bus->prefetch[d], data)) {
+			take_value(power_bus, d, data);
+		}
+		else {
+			power_bus->waiting[d] = 1;
+		}
+	}
+	power_bus->next_request += POWER_PERIOD;
+}
+
+static TickType_t consumer_next_delay(void* context) {
+	PowerBus* power_bus = (PowerBus*)context;
+	int32_t left = (int32_t)(power_bus->next_request - sim_now);
+
+	return (left > 0) ? (TickType_t)left : 0;
+}
+
+static void setup(const PowerCase* power_case) {
+	memset(&supply, 0, sizeof(supply));
+	onewire_power_budget_init(&global, power_case->global_budget);
+	for (uint8_t b = 0; b < POWER_BUSES; b++) {
+		PowerBus* power_bus = &buses[b];
+		SimNode* node;
+
+		memset(power_bus, 0, sizeof(*power_bus));
+		sim_bus_init(&power_bus->bus);
+		sim_bus_set_power(&power_bus->bus, &supply);
+		node = sim_bus_add_driver(&power_bus->bus, &power_bus->master, OPERATING_MODE_MASTER, 0);
+		node->processed = 0; // onewire_process() is called by scheduler
+		onewire_scheduler_init(&power_bus->scheduler, &power_bus->master);
+		onewire_scheduler_add_client(&power_bus->scheduler, &power_bus->client, 0, 0);
+		onewire_scheduler_set_power(&power_bus->scheduler, &global, power_case->bus_budget);
+		for (uint8_t d = 0; d < POWER_DEVICES; d++) {
+			uint8_t rom[7] = { SIM_DS18B20_FAMILY_CODE, 0x50, 0x57, b, d, 0x00, 0x00 };
+
+			sim_ds18b20_init(&power_bus->devices[d], rom);
+			power_bus->devices[d].temperature = (int16_t)(0x0150 + b * 16 + d);
+			sim_bus_add_model(&power_bus->bus, &power_bus->devices[d].model, 0);
+			onewire_prefetch_init(&power_bus->prefetch[d], &power_bus->client, power_bus->devices[d].rom,
+					0x44, SIM_DS18B20_CONVERSION_US / 1000, READ_SCRATCHPAD, 9);
+			power_bus->prefetch[d].check_crc8 = 1;
+			onewire_prefetch_set_current(&power_bus->prefetch[d], POWER_CURRENT);
+			onewire_scheduler_add_prefetch(&power_bus->scheduler, &power_bus->prefetch[d]);
+		}
+		power_bus->next_request = sim_now + 1000;
+		sim_bus_add_task(&power_bus->bus, scheduler_task, NULL, &power_bus->scheduler);
+		sim_bus_add_task(&power_bus->bus, consumer_task, consumer_next_delay, power_bus);
+	}
+}
+
+static void run_case(const PowerCase* power_case) {
+	SimBus* stepped[POWER_BUSES];
+	TickType_t end;
+	uint32_t hits = 0;
+	uint32_t misses = 0;
+	uint32_t deferred = 0;
+
+	setup(power_case);
+	for (uint8_t b = 0; b < POWER_BUSES; b++) {
+		stepped[b] = &buses[b].bus;
+	}
+	end = sim_now + POWER_REQUESTS * POWER_PERIOD + 2 * POWER_PERIOD;
+	while ((int32_t)(end - sim_now) > 0) {
+		sim_step(stepped, POWER_BUSES);
+	}
+
+	for (uint8_t b = 0; b < POWER_BUSES; b++) {
+		PowerBus* power_bus = &buses[b];
+
+		// budget is never exceeded, parallel conversions fill it
+		SIM_CHECK(power_bus->bus.peak == power_case->bus_peak);
+		SIM_CHECK(power_bus->scheduler.bus_peak >= power_bus->bus.peak); // reservation covers draw of models
+		SIM_CHECK(power_bus->bus.current == 0);
+		SIM_CHECK(power_bus->requests == POWER_REQUESTS * POWER_DEVICES);
+		SIM_CHECK(power_bus->values == power_bus->requests);
+		SIM_CHECK(power_bus->stale == 0);
+		for (uint8_t d = 0; d < POWER_DEVICES; d++) {
+			SIM_CHECK(power_bus->devices[d].conversions == POWER_REQUESTS + 1); // last one for request that did not come
+			hits += power_bus->prefetch[d].hits;
+			misses += power_bus->prefetch[d].misses;
+		}
+		deferred += power_bus->scheduler.power_deferred;
+	}
+	SIM_CHECK(supply.peak == power_case->global_peak);
+	SIM_CHECK(global.peak >= supply.peak);
+	SIM_CHECK(hits + misses == POWER_REQUESTS * POWER_DEVICES * POWER_BUSES);
+	if (power_case->prefetched) {
+		SIM_CHECK(hits == (POWER_REQUESTS - ONEWIRE_PREFETCH_MIN_SAMPLES) * POWER_DEVICES * POWER_BUSES);
+	}
+	printf("bus budget=%-5u global=%-5u peak bus=%u/%u/%u global=%-5u deferred=%-3u hits=%u misses=%u\n",
+		power_case->bus_budget, power_case->global_budget, buses[0].bus.peak, buses[1].bus.peak, buses[2].bus.peak,
+		supply.peak, deferred, hits, misses);
+}
+
+// three waves do not fit in lead of prefetch, late values are read on demand
+static const PowerCase cases[] = {
+	{ 0, 0, POWER_DEVICES * POWER_CURRENT, POWER_BUSES * POWER_DEVICES * POWER_CURRENT, 1 },   // all at once
+	{ 2 * POWER_CURRENT, 0, 2 * POWER_CURRENT, POWER_BUSES * 2 * POWER_CURRENT, 1 },           // two waves per bus
+	{ 2 * POWER_CURRENT, 4 * POWER_CURRENT, 2 * POWER_CURRENT, 4 * POWER_CURRENT, 0 },         // supply limits all buses
+	{ POWER_CURRENT / 2, 0, POWER_CURRENT, POWER_BUSES * POWER_CURRENT, 0 }                    // device over budget runs alone
+};
+
+int main(void) {
+	sim_now = 1000;
+	for (uint8_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+		run_case(&cases[i]);
+	}
+	return sim_failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,161 @@
+/**
+ ******************************************************************************
+ * @file    testPrefetch.c
+ * @brief   Learned periodic prefetch of DS18B20 values
+ *
+ * @details
+ *          Two consumers read one DS18B20 each at fixed but different rates.
+ *          After period is learned every request has to be served from cache
+ *          without waiting, with value converted shortly before request and
+ *          without spare conversions. Consumer that pauses for several
+ *          periods learns its period again, missed requests wait for
+ *          conversion and read.
+ *
+ * @license MIT License
+ ******************************************************************************
+ */
+
+#include "oneWireSim.h"
+#include "oneWireSimModels.h"
+#include "oneWireScheduler.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define CONSUMERS           2
+#define PHASE_REQUESTS      20      // requests before and after pause
+#define PAUSE_PERIODS       6       // longer than 4 periods, period is learned again
+
+typedef struct {
+	OneWirePrefetch prefetch;
+	SimDs18b20* device;
+	TickType_t period;
+	TickType_t next_request;
+	TickType_t request_tick;
+	uint8_t waiting;
+	uint32_t requests;
+	uint32_t hits;
+	uint32_t misses;
+	uint32_t max_hit_age;           // age of cached value at request
+	uint32_t max_miss_latency;      // request to value of missed request
+	uint32_t min_miss_latency;
+} Consumer;
+
+static SimBus bus;
+static OneWireDriver master;
+static OneWireScheduler scheduler;
+static OneWireClient client;
+static SimDs18b20 devices[CONSUMERS];
+static Consumer consumers[CONSUMERS];
+
+static void consumer_task(void* context) {
+	Consumer* consumer = (Consumer*)context;
+	uint8_t data[9];
+
+	if (consumer->waiting && onewire_prefetch_get(&consumer->prefetch, data)) {
+		uint32_t latency = sim_now - consumer->request_tick;
+
+		SIM_CHECK(sim_ds18b20_check_value(consumer->device, data));
+		consumer->waiting = 0;
+		if (latency > consumer->max_miss_latency) {
+			consumer->max_miss_latency = latency;
+		}
+		if (latency < consumer->min_miss_latency) {
+			consumer->min_miss_latency = latency;
+		}
+	}
+	if ((int32_t)(sim_now - consumer->next_request) < 0 || consumer->requests >= PHASE_REQUESTS) {
+		return;
+	}
+	SIM_CHECK(!consumer->waiting);
+	consumer->requests++;
+	consumer->request_tick = sim_now;
+	consumer->next_request += consumer->period;
+	if (onewire_prefetch_request(&scheduler, &consumer->prefetch, data)) {
+		SIM_CHECK(sim_ds18b20_check_value(consumer->device, data));
+		consumer->hits++;
+		if (sim_now - consumer->prefetch.value_tick > consumer->max_hit_age) {
+			consumer->max_hit_age = sim_now - consumer->prefetch.value_tick;
+		}
+	}
+	else {
+		consumer->misses++;
+		consumer->waiting = 1;
+	}
+	consumer->device->temperature++; // next value differs, stale cache would be seen
+}
+
+static TickType_t consumer_next_delay(void* context) {
+	Consumer* consumer = (Consumer*)context;
+	int32_t left = (int32_t)(consumer->next_request - sim_now);
+
+	return (left > 0) ? (TickType_t)left : 0;
+}
+
+static void scheduler_task(void* context) {
+	onewire_scheduler_process((OneWireScheduler*)context);
+}
+
+// runs phase starting after delay and checks that only requests before period is learned miss
+static void run_phase(const char* name, TickType_t delay, uint32_t misses) {
+	uint32_t conversions[CONSUMERS];
+
+	for (uint8_t c = 0; c < CONSUMERS; c++) {
+		consumers[c].next_request = sim_now + delay;
+		consumers[c].requests = 0;
+		consumers[c].hits = 0;
+		consumers[c].misses = 0;
+		consumers[c].max_hit_age = 0;
+		consumers[c].max_miss_latency = 0;
+		consumers[c].min_miss_latency = UINT32_MAX;
+		conversions[c] = devices[c].conversions;
+	}
+	sim_bus_run_for(&bus, delay + (PHASE_REQUESTS + 2) * consumers[CONSUMERS - 1].period);
+	for (uint8_t c = 0; c < CONSUMERS; c++) {
+		Consumer* consumer = &consumers[c];
+
+		SIM_CHECK(consumer->requests == PHASE_REQUESTS && !consumer->waiting);
+		SIM_CHECK(consumer->misses == misses);
+		SIM_CHECK(consumer->hits == PHASE_REQUESTS - misses);
+		// missed request pays for conversion and read, maybe behind read of other consumer
+		// hit is served at once with recent value
+		SIM_CHECK(consumer->min_miss_latency >= SIM_DS18B20_CONVERSION_US);
+		SIM_CHECK(consumer->max_miss_latency < SIM_DS18B20_CONVERSION_US + 2 * 20000);
+		SIM_CHECK(consumer->max_hit_age < consumer->period / 4);
+		// one conversion per request, last one for request after phase
+		SIM_CHECK(devices[c].conversions - conversions[c] == PHASE_REQUESTS + 1);
+		printf("%s consumer %u: period %u ms, hits=%u misses=%u miss latency %u..%u us, hit age <= %u us\n",
+			name, c, (unsigned)(consumer->period / 1000), consumer->hits, consumer->misses,
+			consumer->min_miss_latency, consumer->max_miss_latency, consumer->max_hit_age);
+	}
+}
+
+int main(void) {
+	SimNode* node;
+
+	sim_now = 1000;
+	sim_bus_init(&bus);
+	node = sim_bus_add_driver(&bus, &master, OPERATING_MODE_MASTER, 0);
+	node->processed = 0; // onewire_process() is called by scheduler
+	onewire_scheduler_init(&scheduler, &master);
+	onewire_scheduler_add_client(&scheduler, &client, 0, 0);
+	sim_bus_add_task(&bus, scheduler_task, NULL, &scheduler);
+	for (uint8_t c = 0; c < CONSUMERS; c++) {
+		uint8_t rom[7] = { SIM_DS18B20_FAMILY_CODE, 0x9F, 0x3A, c, 0x00, 0x00, 0x00 };
+		Consumer* consumer = &consumers[c];
+
+		sim_ds18b20_init(&devices[c], rom);
+		devices[c].temperature = (int16_t)(0x0100 + 0x40 * c);
+		sim_bus_add_model(&bus, &devices[c].model, 0);
+		consumer->device = &devices[c];
+		consumer->period = (c == 0) ? 2000000 : 3000000;
+		onewire_prefetch_init(&consumer->prefetch, &client, devices[c].rom, 0x44, SIM_DS18B20_CONVERSION_US / 1000, READ_SCRATCHPAD, 9);
+		consumer->prefetch.check_crc8 = 1;
+		onewire_scheduler_add_prefetch(&scheduler, &consumer->prefetch);
+		sim_bus_add_task(&bus, consumer_task, consumer_next_delay, consumer);
+	}
+
+	run_phase("learn", 1000, ONEWIRE_PREFETCH_MIN_SAMPLES);
+	// request after pause is first sample of new period, cached value is too old for it
+	run_phase("resume", PAUSE_PERIODS * consumers[CONSUMERS - 1].period, ONEWIRE_PREFETCH_MIN_SAMPLES - 1);
+	return sim_failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,302 @@
+/**
+ ******************************************************************************
+ * @file    testRealtime.c
+ * @brief   Wall clock timing harness of driver engines
+ *
+ * @details
+ *          Driver runs on CLOCK_MONOTONIC in bus thread, DS18B20 models of
+ *          simulated bus run their timers in model thread woken by condition
+ *          variable, both threads are put to SCHED_FIFO when permitted. Same scratchpad reads are done
+ *          with three engines driving onewire_process():
+ *
+ *          polled  - process in busy loop
+ *          timer   - timerfd armed with onewire_get_next_event_delay(), as
+ *                    timer interrupt would do
+ *          hybrid  - timerfd wakes RT_SPIN_US before deadline, rest is spun
+ *
+ *          Each engine runs without and with load threads, lateness of slot
+ *          deadlines (onewire_get_jitter_stats()), failed reads and CPU time
+ *          of bus thread are printed. Results depend on host, harness is run
+ *          by "make -C test realtime" and is not part of check.
+ *
+ * @license MIT License
+ ******************************************************************************
+ */
+
+#define _GNU_SOURCE                 // CPU count and scheduling of threads
+#include "oneWireSim.h"
+#include "oneWireSimModels.h"
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#define RT_DEVICES          2
+#define RT_SPIN_US          50      // hybrid engine spins this long before deadline
+#define RT_PRIORITY         80
+#define RT_MAX_LOAD         16
+
+typedef enum {
+	ENGINE_POLLED,
+	ENGINE_TIMER,
+	ENGINE_HYBRID,
+	ENGINE_COUNT
+}Engine;
+
+static const char* const engine_names[ENGINE_COUNT] = { "polled", "timer", "hybrid" };
+
+static SimBus bus;
+static OneWireDriver master;
+static SimDs18b20 devices[RT_DEVICES];
+static pthread_mutex_t bus_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t model_wake;  // bus edge can arm model timer
+static volatile int stop_models;
+static volatile int stop_load;
+static int timer_fd;
+
+/* Private function prototypes -----------------------------------------------*/
+static void rt_drive_low(void* context);
+static void rt_release(void* context);
+static GPIO_PinState rt_read(void* context);
+
+// simulated bus ops under lock, models read time of calling thread
+static const OneWireBusOps rt_bus_ops = {
+	rt_drive_low,
+	rt_release,
+	rt_read
+};
+
+static void rt_drive_low(void* context) {
+	pthread_mutex_lock(&bus_lock);
+	sim_now = onewire_linux_get_tick();
+	sim_bus_ops.drive_low(context);
+	pthread_cond_signal(&model_wake);
+	pthread_mutex_unlock(&bus_lock);
+}
+
+static void rt_release(void* context) {
+	pthread_mutex_lock(&bus_lock);
+	sim_now = onewire_linux_get_tick();
+	sim_bus_ops.release(context);
+	pthread_cond_signal(&model_wake);
+	pthread_mutex_unlock(&bus_lock);
+}
+
+static GPIO_PinState rt_read(void* context) {
+	GPIO_PinState level;
+
+	pthread_mutex_lock(&bus_lock);
+	level = sim_bus_ops.read(context);
+	pthread_mutex_unlock(&bus_lock);
+	return level;
+}
+
+static int set_fifo(pthread_t thread, int priority) {
+	struct sched_param param;
+
+	memset(&param, 0, sizeof(param));
+	param.sched_priority = priority;
+	return pthread_setschedparam(thread, SCHED_FIFO, &param);
+}
+
+// model timers fire when thread wakes up, late wake up stretches pulses of models as on real bus
+static void* model_main(void* argument) {
+	(void)argument;
+	pthread_mutex_lock(&bus_lock);
+	while (!stop_models) {
+		struct timespec wake;
+		int32_t delay = 10000; // stop is checked at least this often
+
+		sim_now = onewire_linux_get_tick();
+		sim_bus_fire_events(&bus);
+		for (uint8_t i = 0; i < bus.node_count; i++) {
+			SimModel* model = bus.nodes[i].model;
+
+			if (model != NULL && model->armed && (int32_t)(model->event_tick - sim_now) < delay) {
+				delay = (int32_t)(model->event_tick - sim_now);
+			}
+		}
+		if (delay <= 0) {
+			continue;
+		}
+		clock_gettime(CLOCK_MONOTONIC, &wake);
+		wake.tv_nsec += (long)delay * 1000;
+		wake.tv_sec += wake.tv_nsec / 1000000000L;
+		wake.tv_nsec %= 1000000000L;
+		pthread_cond_timedwait(&model_wake, &bus_lock, &wake);
+	}
+	pthread_mutex_unlock(&bus_lock);
+	return NULL;
+}
+
+static void* load_main(void* argument) {
+	volatile uint64_t* sink = (volatile uint64_t*)argument;
+	static uint8_t memory[1 << 20];
+
+	// cache and scheduler pressure
+	while (!stop_load) {
+		for (uint32_t i = 0; i < sizeof(memory); i += 64) {
+			memory[i]++;
+			*sink += memory[(i * 7919) % sizeof(memory)];
+		}
+	}
+	return NULL;
+}
+
+// sleeps until deadline of driver, returns at once when driver polls or is idle
+static void engine_wait(Engine engine) {
+	TickType_t delay = onewire_get_next_event_delay(&master);
+	struct itimerspec timer;
+	uint64_t expirations;
+
+	if (engine == ENGINE_POLLED || delay == 0 || delay == portMAX_DELAY) {
+		return;
+	}
+	if (engine == ENGINE_HYBRID) {
+		if (delay <= RT_SPIN_US) {
+			return;
+		}
+		delay -= RT_SPIN_US;
+	}
+	memset(&timer, 0, sizeof(timer));
+	timer.it_value.tv_sec = delay / 1000000;
+	timer.it_value.tv_nsec = (long)(delay % 1000000) * 1000;
+	timerfd_settime(timer_fd, 0, &timer, NULL);
+	if (read(timer_fd, &expirations, sizeof(expirations)) < 0) {
+		perror("timerfd");
+	}
+}
+
+static void run_op(Engine engine) {
+	for (;;) {
+		onewire_process(&master);
+		if (master.state == ONEWIRE_STATE_IDLE || master.state == ONEWIRE_STATE_ERROR) {
+			return;
+		}
+		engine_wait(engine);
+	}
+}
+
+static void write_byte(Engine engine, uint8_t data) {
+	onewire_write_byte(&master, data);
+	run_op(engine);
+}
+
+// Match ROM and Read Scratchpad, returns 1 when CRC matches
+static uint8_t read_scratchpad(Engine engine, const uint8_t* rom) {
+	uint8_t crc = 0;
+
+	onewire_reset(&master);
+	run_op(engine);
+	write_byte(engine, MATCH_ROM);
+	for (uint8_t i = 0; i < 8; i++) {
+		write_byte(engine, rom[i]);
+	}
+	write_byte(engine, READ_SCRATCHPAD);
+	for (uint8_t i = 0; i < 9; i++) {
+		onewire_read_byte(&master);
+		run_op(engine);
+		crc = onewire_crc8_update(crc, onewire_get_byte(&master));
+	}
+	return onewire_is_slave_present(&master) && crc == 0;
+}
+
+static void run_engine(Engine engine, uint32_t transactions, uint8_t load) {
+	OneWireJitterStats jitter;
+	struct timespec cpu_start;
+	struct timespec cpu_end;
+	TickType_t start = onewire_linux_get_tick();
+	uint32_t failed = 0;
+	double cpu_ms;
+
+	onewire_reset_jitter_stats(&master);
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu_start);
+	for (uint32_t i = 0; i < transactions; i++) {
+		if (!read_scratchpad(engine, devices[i % RT_DEVICES].rom)) {
+			failed++;
+		}
+		usleep(500);
+	}
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu_end);
+	onewire_get_jitter_stats(&master, &jitter);
+	cpu_ms = (cpu_end.tv_sec - cpu_start.tv_sec) * 1e3 + (cpu_end.tv_nsec - cpu_start.tv_nsec) / 1e6;
+	printf("%-7s load=%-2u deadlines=%-7u mean lateness=%6.2f us max=%5u us failed=%u/%u cpu=%.1f ms wall=%.1f ms\n",
+		engine_names[engine], load, jitter.deadline_count,
+		jitter.deadline_count ? (double)jitter.total_lateness / jitter.deadline_count : 0.0,
+		(unsigned)jitter.max_lateness, failed, transactions, cpu_ms, (onewire_linux_get_tick() - start) / 1e3);
+}
+
+int main(int argc, char** argv) {
+	uint32_t transactions = (argc > 1) ? (uint32_t)atoi(argv[1]) : 100;
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	uint8_t load_threads = (argc > 2) ? (uint8_t)atoi(argv[2]) : (uint8_t)(cpus < RT_MAX_LOAD ? cpus : RT_MAX_LOAD);
+	pthread_t model_thread;
+	pthread_t load[RT_MAX_LOAD];
+	uint64_t sinks[RT_MAX_LOAD];
+	SimNode* node;
+	pthread_condattr_t attr;
+	pthread_attr_t load_attr;
+	int error;
+
+	setvbuf(stdout, NULL, _IOLBF, 0);
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&model_wake, &attr);
+	timer_fd = timerfd_create(CLOCK_MONOTONIC, 0);
+	if (timer_fd < 0) {
+		perror("timerfd_create");
+		return EXIT_FAILURE;
+	}
+	sim_now = onewire_linux_get_tick();
+	sim_bus_init(&bus);
+	node = sim_bus_add_driver(&bus, &master, OPERATING_MODE_MASTER, 0);
+	onewire_init_custom(&master, &rt_bus_ops, node, OPERATING_MODE_MASTER);
+	for (uint8_t d = 0; d < RT_DEVICES; d++) {
+		uint8_t rom[7] = { SIM_DS18B20_FAMILY_CODE, 0x52, 0x54, d, 0x00, 0x00, 0x00 };
+
+		sim_ds18b20_init(&devices[d], rom);
+		devices[d].temperature = (int16_t)(0x0190 + d);
+		sim_bus_add_model(&bus, &devices[d].model, 0);
+	}
+
+	error = set_fifo(pthread_self(), RT_PRIORITY);
+	if (error != 0) {
+		printf("SCHED_FIFO not permitted (%s), threads run with default policy\n", strerror(error));
+	}
+	pthread_create(&model_thread, NULL, model_main, NULL);
+	if (error == 0) {
+		set_fifo(model_thread, RT_PRIORITY + 1); // model preempts polling bus thread
+	}
+	// load threads do not inherit SCHED_FIFO of main thread
+	pthread_attr_init(&load_attr);
+	pthread_attr_setinheritsched(&load_attr, PTHREAD_EXPLICIT_SCHED);
+	pthread_attr_setschedpolicy(&load_attr, SCHED_OTHER);
+	printf("%ld CPUs, %u transactions per run, load threads %u\n", cpus, transactions, load_threads);
+
+	for (uint8_t with_load = 0; with_load < 2; with_load++) {
+		stop_load = 0;
+		for (uint8_t i = 0; with_load && i < load_threads; i++) {
+			sinks[i] = 0;
+			pthread_create(&load[i], &load_attr, load_main, &sinks[i]);
+		}
+		for (uint8_t engine = 0; engine < ENGINE_COUNT; engine++) {
+			run_engine((Engine)engine, transactions, with_load ? load_threads : 0);
+		}
+		stop_load = 1;
+		for (uint8_t i = 0; with_load && i < load_threads; i++) {
+			pthread_join(load[i], NULL);
+		}
+	}
+
+	pthread_mutex_lock(&bus_lock);
+	stop_models = 1;
+	pthread_cond_signal(&model_wake);
+	pthread_mutex_unlock(&bus_lock);
+	pthread_join(model_thread, NULL);
+	close(timer_fd);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,208 @@
+/**
+ ******************************************************************************
+ * @file    testReplay.c
+ * @brief   Recorded DS18B20 cycle exported and replayed on fresh bus
+ *
+ * @details
+ *          Master with operation recorder reads ROM, converts temperature
+ *          and reads scratchpad. Exported blob replayed on fresh bus with
+ *          fresh device has to give same slot transcript and same recorded
+ *          operations with same spacing, without lateness. Blob denser than
+ *          bus can serve is replayed late by growing amount, short or
+ *          damaged blobs are refused.
+ *
+ * @license MIT License
+ ******************************************************************************
+ */
+
+#include "oneWireSim.h"
+#include "oneWireSimModels.h"
+#include "oneWireReplay.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define RECORDS             256
+#define DENSE_OPS           10
+#define DENSE_SPACING_US    100     // write byte takes 8 slots of about 70 us
+
+typedef struct {
+	SimBus bus;
+	OneWireDriver master;
+	SimDs18b20 device;
+	OneWireOpRecorder recorder;
+	OneWireOpRecord records[RECORDS];
+	SimTranscript transcript;
+	FILE* out;
+	char* text;
+	size_t length;
+} Session;
+
+static const uint8_t serial[7] = { SIM_DS18B20_FAMILY_CODE, 0x52, 0x45, 0x50, 0x4C, 0x41, 0x59 };
+static Session recorded;
+static Session replayed;
+static OneWireReplay replay;
+static uint8_t blob[ONEWIRE_REPLAY_BLOB_SIZE(RECORDS)];
+static uint8_t replayed_blob[ONEWIRE_REPLAY_BLOB_SIZE(RECORDS)];
+
+// both sessions start at same tick, so their transcripts and exported blobs are comparable
+static void session_start(Session* session) {
+	sim_now = 1000;
+	sim_bus_init(&session->bus);
+	sim_bus_add_driver(&session->bus, &session->master, OPERATING_MODE_MASTER, 0);
+	sim_ds18b20_init(&session->device, serial);
+	sim_bus_add_model(&session->bus, &session->device.model, 0);
+	onewire_set_op_recorder(&session->master, &session->recorder, session->records, RECORDS);
+	session->out = open_memstream(&session->text, &session->length);
+	sim_transcript_start(&session->transcript, &session->master, session->out, 1);
+}
+
+static void session_stop(Session* session) {
+	sim_transcript_stop(&session->transcript, &session->master);
+	fclose(session->out);
+}
+
+static void record_cycle(Session* session) {
+	SimBus* bus = &session->bus;
+	OneWireDriver* master = &session->master;
+	uint8_t data[9];
+
+	SIM_CHECK(sim_master_reset(bus, master));
+	sim_master_write_byte(bus, master, READ_ROM);
+	sim_master_read(bus, master, data, 8);
+	SIM_CHECK(memcmp(data, session->device.rom, 8) == 0);
+
+	sim_master_reset(bus, master);
+	sim_master_write_byte(bus, master, SKIP_ROM);
+	sim_master_write_byte(bus, master, 0x44);
+	sim_bus_run_for(bus, 100000);
+	SIM_CHECK(sim_master_read_bit(bus, master) == 0); // conversion running
+	sim_bus_run_for(bus, 700000);
+	SIM_CHECK(sim_master_read_bit(bus, master) == 1);
+
+	sim_master_reset(bus, master);
+	sim_master_write_byte(bus, master, SKIP_ROM);
+	sim_master_write_byte(bus, master, READ_SCRATCHPAD);
+	sim_master_read(bus, master, data, 9);
+}
+
+// issued operation is started in same tick, as blocking helpers of recorded session did
+static void replay_task(void* context) {
+	OneWireReplay* running = (OneWireReplay*)context;
+	uint32_t issued = running->issued;
+
+	onewire_replay_process(running);
+	if (running->issued != issued) {
+		onewire_process(running->onewire);
+	}
+}
+
+// ticks until next operation is due, clock must not jump over it while bus is idle
+static TickType_t replay_next_delay(void* context) {
+	OneWireReplay* running = (OneWireReplay*)context;
+	TickType_t due;
+	TickType_t elapsed = sim_now - running->start_tick;
+
+	if (running->remaining == 0) {
+		return portMAX_DELAY;
+	}
+	due = running->offset + (running->next[0] | (running->next[1] << 8) | (running->next[2] << 16) | ((TickType_t)running->next[3] << 24));
+	return (due > elapsed) ? due - elapsed : 0;
+}
+
+// all operations issued and last one finished on bus
+static uint8_t replay_done(void* context) {
+	OneWireReplay* running = (OneWireReplay*)context;
+
+	return running->remaining == 0 && running->onewire->state == ONEWIRE_STATE_IDLE;
+}
+
+static void check_round_trip(void) {
+	uint16_t length;
+	TickType_t recorded_end;
+
+	session_start(&recorded);
+	record_cycle(&recorded);
+	recorded_end = sim_now;
+	session_stop(&recorded);
+	length = onewire_op_recorder_export(&recorded.recorder, blob, sizeof(blob));
+	SIM_CHECK(length == ONEWIRE_REPLAY_BLOB_SIZE(recorded.recorder.count) && recorded.recorder.overwritten == 0);
+	SIM_CHECK(onewire_op_recorder_export(&recorded.recorder, blob, length - 1) == 0);
+	SIM_CHECK(memcmp(blob, "OWR", 3) == 0 && blob[3] == ONEWIRE_REPLAY_VERSION);
+	SIM_CHECK((blob[4] | (blob[5] << 8)) == recorded.recorder.count);
+
+	session_start(&replayed);
+	sim_bus_add_task(&replayed.bus, replay_task, replay_next_delay, &replay);
+	SIM_CHECK(onewire_replay_start(&replay, &replayed.master, blob, length) == ONEWIRE_REPLAY_RUNNING);
+	SIM_CHECK(sim_bus_run_until(&replayed.bus, replay_done, &replay, 2000000));
+	session_stop(&replayed);
+	printf("replay: %u operations, %u us recorded, %u us replayed, max lateness %u us\n", (unsigned)replay.issued,
+		(unsigned)(recorded_end - 1000), (unsigned)(sim_now - 1000), (unsigned)replay.max_lateness);
+
+	// replayed master records same operations at same ticks
+	SIM_CHECK(replay.issued == recorded.recorder.count && replay.total_lateness == 0 && sim_now == recorded_end);
+	SIM_CHECK(onewire_op_recorder_export(&replayed.recorder, replayed_blob, sizeof(replayed_blob)) == length);
+	SIM_CHECK(memcmp(blob, replayed_blob, length) == 0);
+	SIM_CHECK(replayed.length == recorded.length && memcmp(recorded.text, replayed.text, recorded.length) == 0);
+	SIM_CHECK(replayed.device.conversions == 1);
+	free(recorded.text);
+	free(replayed.text);
+}
+
+// operations recorded faster than bus serves them, each waits for previous one
+static void check_lateness(void) {
+	uint8_t dense[ONEWIRE_REPLAY_BLOB_SIZE(DENSE_OPS)] = { 'O', 'W', 'R', ONEWIRE_REPLAY_VERSION, DENSE_OPS, 0 };
+	TickType_t lateness = 0;
+
+	for (uint8_t i = 0; i < DENSE_OPS; i++) {
+		uint8_t* op = &dense[ONEWIRE_REPLAY_HEADER_SIZE + ONEWIRE_REPLAY_OP_SIZE * i];
+
+		op[0] = (i > 0) ? DENSE_SPACING_US : 0;
+		op[4] = ONEWIRE_OP_WRITE_BYTE;
+		op[5] = 0xFF;
+	}
+	session_start(&replayed);
+	sim_bus_add_task(&replayed.bus, replay_task, replay_next_delay, &replay);
+	SIM_CHECK(onewire_replay_start(&replay, &replayed.master, dense, sizeof(dense)) == ONEWIRE_REPLAY_RUNNING);
+	SIM_CHECK(sim_bus_run_until(&replayed.bus, replay_done, &replay, 100000));
+	session_stop(&replayed);
+	free(replayed.text);
+
+	// lateness of operation i is i times difference of byte time and recorded spacing
+	for (uint8_t i = 1; i < replayed.recorder.count; i++) {
+		TickType_t issued = replayed.records[i].tick - replayed.records[0].tick;
+
+		SIM_CHECK(issued > (TickType_t)i * DENSE_SPACING_US);
+		lateness += issued - i * DENSE_SPACING_US;
+	}
+	printf("dense replay: total lateness %u us, max %u us\n", (unsigned)replay.total_lateness, (unsigned)replay.max_lateness);
+	SIM_CHECK(replay.issued == DENSE_OPS && replayed.recorder.count == DENSE_OPS);
+	SIM_CHECK(replay.total_lateness == lateness);
+	SIM_CHECK(replay.max_lateness == replayed.records[DENSE_OPS - 1].tick - replayed.records[0].tick - (DENSE_OPS - 1) * DENSE_SPACING_US);
+	SIM_CHECK(replay.max_lateness > (DENSE_OPS - 1) * (8 * 60 - DENSE_SPACING_US));
+}
+
+static void check_invalid(void) {
+	uint8_t damaged[ONEWIRE_REPLAY_BLOB_SIZE(2)] = { 'O', 'W', 'R', ONEWIRE_REPLAY_VERSION, 2, 0 };
+
+	SIM_CHECK(onewire_replay_start(&replay, &replayed.master, damaged, sizeof(damaged)) == ONEWIRE_REPLAY_RUNNING);
+	SIM_CHECK(onewire_replay_start(&replay, &replayed.master, damaged, ONEWIRE_REPLAY_HEADER_SIZE - 1) == ONEWIRE_REPLAY_INVALID);
+	SIM_CHECK(onewire_replay_start(&replay, &replayed.master, damaged, sizeof(damaged) - 1) == ONEWIRE_REPLAY_INVALID);
+	SIM_CHECK(onewire_replay_start(&replay, &replayed.master, damaged, ONEWIRE_REPLAY_HEADER_SIZE) == ONEWIRE_REPLAY_INVALID);
+	damaged[3] = ONEWIRE_REPLAY_VERSION + 1;
+	SIM_CHECK(onewire_replay_start(&replay, &replayed.master, damaged, sizeof(damaged)) == ONEWIRE_REPLAY_INVALID);
+	damaged[3] = ONEWIRE_REPLAY_VERSION;
+	damaged[2] = 'B'; // black box blob
+	SIM_CHECK(onewire_replay_start(&replay, &replayed.master, damaged, sizeof(damaged)) == ONEWIRE_REPLAY_INVALID);
+	damaged[2] = 'R';
+	damaged[4] = 0;
+	SIM_CHECK(onewire_replay_start(&replay, &replayed.master, damaged, ONEWIRE_REPLAY_HEADER_SIZE) == ONEWIRE_REPLAY_DONE);
+}
+
+int main(void) {
+	check_round_trip();
+	check_lateness();
+	check_invalid();
+	printf("replay: %s\n", sim_failures ? "FAILED" : "ok");
+	return sim_failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
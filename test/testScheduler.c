@@ -0,0 +1,215 @@
+/**
+ ******************************************************************************
+ * @file    testScheduler.c
+ * @brief   Bus time shares of scheduler clients and their latency statistics
+ *
+ * @details
+ *          Logging and discovery clients submit hundreds of scratchpad reads
+ *          at once, control client reads one device every 50 ms. Token
+ *          buckets have to split bus time between bulk clients by their
+ *          budgets and keep control reads from waiting behind bulk queues.
+ *          Every scheduler transaction has to appear in latency histograms
+ *          of driver and in telemetry record, failed one with missing
+ *          presence too. Client that was idle while other one borrowed bus
+ *          time keeps its share after search held and released bus.
+ *
+ * @license MIT License
+ ******************************************************************************
+ */
+
+#include "oneWireSim.h"
+#include "oneWireSimModels.h"
+#include "oneWireScheduler.h"
+#include "oneWireTelemetry.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define SCHED_BULK          400     // transactions submitted by each bulk client
+#define SCHED_RUN_US        2000000
+#define SCHED_CONTROL_US    50000   // period of control reads
+#define SCHED_LOG_BUDGET    300000  // us of slot time per second
+#define SCHED_SCAN_BUDGET   100000
+#define SCHED_CTRL_BUDGET   200000
+#define SCHED_BURST         20000
+
+static SimBus bus;
+static OneWireDriver master;
+static OneWireScheduler scheduler;
+static OneWireClient logger;
+static OneWireClient scanner;
+static OneWireClient control;
+static SimDs18b20 devices[2];
+static SimDs18b20Read log_reads[SCHED_BULK];
+static SimDs18b20Read scan_reads[SCHED_BULK];
+static SimDs18b20Read control_read;
+static TickType_t control_submit;
+static TickType_t next_control;
+static uint32_t control_max_latency;
+static uint32_t completed;
+static uint32_t failed;
+
+static void read_done(SimDs18b20Read* read, void* context) {
+	(void)context;
+	completed++;
+	if (read->status != ONEWIRE_TXN_STATUS_OK) {
+		failed++;
+	}
+	if (read == &control_read && sim_now - control_submit > control_max_latency) {
+		control_max_latency = sim_now - control_submit;
+	}
+}
+
+static void scheduler_task(void* context) {
+	onewire_scheduler_process((OneWireScheduler*)context);
+}
+
+static uint8_t scheduler_idle(void* context) {
+	return onewire_scheduler_is_idle((OneWireScheduler*)context);
+}
+
+static void control_task(void* context) {
+	(void)context;
+	if ((int32_t)(sim_now - next_control) < 0) {
+		return;
+	}
+	SIM_CHECK(control_read.done || control.served == 0); // previous read finished within period
+	sim_ds18b20_read_init(&control_read, devices[1].rom, read_done, NULL);
+	control_submit = sim_now;
+	onewire_scheduler_submit(&scheduler, &control, &control_read.txn);
+	next_control += SCHED_CONTROL_US;
+}
+
+static TickType_t control_next_delay(void* context) {
+	int32_t left = (int32_t)(next_control - sim_now);
+
+	(void)context;
+	return (left > 0) ? (TickType_t)left : 0;
+}
+
+static uint32_t get_u32(const uint8_t* data) {
+	return data[0] | ((uint32_t)data[1] << 8) | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+static void check_latency(void) {
+	OneWireLatencyHistogram histogram;
+	uint8_t record[ONEWIRE_TELEMETRY_RECORD_SIZE];
+	const uint8_t* section;
+	uint32_t queued = 0;
+
+	onewire_get_latency_histogram(&master, ONEWIRE_TXN_READ_SCRATCHPAD, &histogram);
+	SIM_CHECK(histogram.count == completed);
+	SIM_CHECK(histogram.failed == failed);
+	for (uint8_t i = 0; i < ONEWIRE_LATENCY_BUCKETS; i++) {
+		queued += histogram.queue_delay[i];
+	}
+	SIM_CHECK(queued == completed);
+
+	// latency section follows header, there is no bus stats section in this build
+	SIM_CHECK(onewire_telemetry_serialize(&master, 0, 0, record, sizeof(record)) == ONEWIRE_TELEMETRY_RECORD_SIZE);
+	SIM_CHECK(record[7] == ONEWIRE_TELEMETRY_SECTION_LATENCY && record[8] == ONEWIRE_LATENCY_BUCKETS);
+	section = &record[40 + ONEWIRE_TXN_READ_SCRATCHPAD * (8 + 8 * ONEWIRE_LATENCY_BUCKETS)];
+	SIM_CHECK(get_u32(section) == completed);
+	SIM_CHECK(get_u32(section + 4) == failed);
+}
+
+// scanner stays idle while logger borrows idle bus time, then search holds and releases bus before
+// scanner queues its reads, scanner must not catch up on lent time it did not wait for
+static void check_hold_release(void) {
+	uint32_t log_served;
+	uint32_t scan_served;
+	double ratio;
+
+	sim_ds18b20_plug(&devices[0], 1);
+	sim_ds18b20_plug(&devices[1], 1);
+	onewire_scheduler_init(&scheduler, &master);
+	onewire_scheduler_add_client(&scheduler, &logger, SCHED_LOG_BUDGET, SCHED_BURST);
+	onewire_scheduler_add_client(&scheduler, &scanner, SCHED_SCAN_BUDGET, SCHED_BURST);
+	for (uint16_t i = 0; i < SCHED_BULK; i++) {
+		sim_ds18b20_read_init(&log_reads[i], devices[0].rom, read_done, NULL);
+		onewire_scheduler_submit(&scheduler, &logger, &log_reads[i].txn);
+	}
+	sim_bus_run_for(&bus, SCHED_RUN_US / 4);
+	SIM_CHECK(onewire_scheduler_hold(&scheduler, &scheduler));
+	sim_bus_run_for(&bus, SCHED_CONTROL_US);
+	onewire_scheduler_release(&scheduler, &scheduler);
+	for (uint16_t i = 0; i < SCHED_BULK; i++) {
+		sim_ds18b20_read_init(&scan_reads[i], devices[1].rom, read_done, NULL);
+		onewire_scheduler_submit(&scheduler, &scanner, &scan_reads[i].txn);
+	}
+	log_served = logger.served;
+	scan_served = scanner.served;
+	sim_bus_run_for(&bus, SCHED_RUN_US / 2);
+	log_served = logger.served - log_served;
+	scan_served = scanner.served - scan_served;
+	ratio = (double)log_served / scan_served;
+	SIM_CHECK(logger.head != NULL && scanner.head != NULL);
+	SIM_CHECK(ratio > 2.5 && ratio < 3.5);
+	printf("after hold: served logger=%u scanner=%u (ratio %.2f)\n", log_served, scan_served, ratio);
+}
+
+int main(void) {
+	SimNode* node;
+	uint32_t log_served;
+	uint32_t scan_served;
+	uint32_t cost;
+	double ratio;
+
+	sim_now = 1000;
+	sim_bus_init(&bus);
+	node = sim_bus_add_driver(&bus, &master, OPERATING_MODE_MASTER, 0);
+	node->processed = 0; // onewire_process() is called by scheduler
+	for (uint8_t d = 0; d < 2; d++) {
+		uint8_t rom[7] = { SIM_DS18B20_FAMILY_CODE, 0x5C, 0x4E, d, 0x00, 0x00, 0x00 };
+
+		sim_ds18b20_init(&devices[d], rom);
+		sim_bus_add_model(&bus, &devices[d].model, 0);
+	}
+	onewire_scheduler_init(&scheduler, &master);
+	onewire_scheduler_add_client(&scheduler, &logger, SCHED_LOG_BUDGET, SCHED_BURST);
+	onewire_scheduler_add_client(&scheduler, &scanner, SCHED_SCAN_BUDGET, SCHED_BURST);
+	onewire_scheduler_add_client(&scheduler, &control, SCHED_CTRL_BUDGET, SCHED_BURST);
+	for (uint16_t i = 0; i < SCHED_BULK; i++) {
+		sim_ds18b20_read_init(&log_reads[i], devices[0].rom, read_done, NULL);
+		onewire_scheduler_submit(&scheduler, &logger, &log_reads[i].txn);
+		sim_ds18b20_read_init(&scan_reads[i], devices[1].rom, read_done, NULL);
+		onewire_scheduler_submit(&scheduler, &scanner, &scan_reads[i].txn);
+	}
+	next_control = sim_now;
+	sim_bus_add_task(&bus, scheduler_task, NULL, &scheduler);
+	sim_bus_add_task(&bus, control_task, control_next_delay, NULL);
+	sim_bus_run_for(&bus, SCHED_RUN_US);
+
+	// bulk clients are still backlogged, their shares follow budgets
+	log_served = logger.served;
+	scan_served = scanner.served;
+	ratio = (double)log_served / scan_served;
+	SIM_CHECK(log_served < SCHED_BULK && scan_served < SCHED_BULK);
+	SIM_CHECK(ratio > 2.5 && ratio < 3.5);
+	// control read waits at most for one bulk transaction
+	cost = onewire_scheduler_txn_cost(&master, &control_read.txn);
+	SIM_CHECK(control.served == SCHED_RUN_US / SCHED_CONTROL_US);
+	SIM_CHECK(control_max_latency <= 2 * cost + 1000);
+	for (uint16_t i = 0; i < SCHED_BULK; i++) {
+		SIM_CHECK(!log_reads[i].done || log_reads[i].ok);
+		SIM_CHECK(!scan_reads[i].done || scan_reads[i].ok);
+	}
+	SIM_CHECK(failed == 0);
+	check_latency();
+	printf("served logger=%u scanner=%u (ratio %.2f, borrowed %u/%u) control=%u max latency=%u us (txn %u us)\n",
+		log_served, scan_served, ratio, logger.borrowed, scanner.borrowed, control.served, control_max_latency, cost);
+
+	// unanswered reset fails transaction, it is counted as failed in histogram
+	sim_bus_run_until(&bus, scheduler_idle, &scheduler, 10 * SCHED_RUN_US);
+	sim_ds18b20_plug(&devices[0], 0);
+	sim_ds18b20_plug(&devices[1], 0);
+	sim_ds18b20_read_init(&control_read, devices[1].rom, read_done, NULL);
+	next_control = sim_now + SCHED_RUN_US; // no periodic reads while unplugged
+	onewire_scheduler_submit(&scheduler, &control, &control_read.txn);
+	SIM_CHECK(sim_bus_run_until(&bus, scheduler_idle, &scheduler, 10000));
+	SIM_CHECK(control_read.done && !control_read.ok);
+	SIM_CHECK(failed == 1);
+	check_latency();
+
+	check_hold_release();
+	return sim_failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,362 @@
+/**
+ ******************************************************************************
+ * @file    testSlave.c
+ * @brief   Master driver against slave driver serving memory map
+ *
+ * @details
+ *          Slave driver gets edge interrupts of its node (SIM_IRQ_SLAVE) and
+ *          serves OneWireSlaveMemory, master is stepped by blocking helpers
+ *          of simulator. Overdrive Skip and Overdrive Match ROM switch slave
+ *          to overdrive, overdrive reset keeps it and standard reset returns
+ *          it to standard speed.
+ *
+ *          Read Scratchpad, Write Scratchpad and Read Memory are checked
+ *          with inverted CRC16 send by slave. Sample published while master
+ *          reads scratchpad is served only by next Read Scratchpad, and
+ *          published buffer is not handed to application again, so master
+ *          always gets whole frame.
+ *
+ *          Reset is recognised by width of low pulse at any bit, in bytes
+ *          slave receives as well as in bytes it transmits.
+ *
+ *          Second slave joins bus for searches. Search ROM finds both, Alarm
+ *          Search only slave with alarm flag set, flag is sampled when
+ *          command byte completes.
+ *
+ * @license MIT License
+ ******************************************************************************
+ */
+
+#include "oneWireSim.h"
+#include "oneWireSearch.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SCRATCHPAD_SIZE     9       // 8 data bytes and CRC8, as DS18B20
+#define WRITE_SIZE          3
+#define MEMORY_SIZE         16
+#define MEMORY_ADDRESS      4       // Read Memory starts inside page
+
+static SimBus bus;
+static OneWireDriver master;
+static OneWireDriver slave;
+static OneWireSlaveMemory memory;
+static uint8_t scratchpad[2][SCRATCHPAD_SIZE];
+static uint8_t write_buffer[WRITE_SIZE];
+static uint8_t pages[MEMORY_SIZE];
+static uint8_t written;             // length reported by write callback
+static OneWireDriver other;         // second slave, joins bus for searches
+static OneWireSlaveMemory other_memory;
+static OneWireSearch search;
+static OneWireDevice devices[4];
+static OneWireDeviceTable table;
+static const uint8_t rom[8] = { 0x7E, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x00 };
+static const uint8_t other_rom[8] = { 0x7E, 0x81, 0x02, 0x03, 0x04, 0x05, 0x06, 0x00 };
+
+// every byte of frame depends on sample so mixed frames are recognised, last byte is CRC8
+static uint8_t sample_byte(uint8_t sample, uint8_t index) {
+	uint8_t crc = 0;
+
+	if (index < SCRATCHPAD_SIZE - 1) {
+		return (uint8_t)(sample + 0x11 * index);
+	}
+	for (uint8_t i = 0; i < SCRATCHPAD_SIZE - 1; i++) {
+		crc = onewire_crc8_update(crc, sample_byte(sample, i));
+	}
+	return crc;
+}
+
+// application writes first count bytes of sample, rest of frame keeps old content
+static void fill_sample(uint8_t* buffer, uint8_t sample, uint8_t count) {
+	for (uint8_t i = 0; i < count; i++) {
+		buffer[i] = sample_byte(sample, i);
+	}
+}
+
+static uint8_t publish_sample(uint8_t sample) {
+	uint8_t* buffer = onewire_slave_get_scratchpad_buffer(&slave);
+
+	if (buffer == NULL) {
+		return 0;
+	}
+	fill_sample(buffer, sample, SCRATCHPAD_SIZE);
+	onewire_slave_publish_scratchpad(&slave);
+	return 1;
+}
+
+// whole frame of sample with valid CRC8
+static uint8_t frame_is_sample(const uint8_t* frame, uint8_t sample) {
+	uint8_t crc = 0;
+
+	for (uint8_t i = 0; i < SCRATCHPAD_SIZE; i++) {
+		crc = onewire_crc8_update(crc, frame[i]);
+	}
+	return crc == 0 && frame[0] == sample && frame[1] == (uint8_t)(sample + 0x11);
+}
+
+// slave sends inverted CRC16 of command, parameters and data, low byte first
+static uint8_t read_crc16(const uint8_t* data, uint8_t length) {
+	uint16_t crc = 0;
+	uint8_t received[2];
+
+	for (uint8_t i = 0; i < length; i++) {
+		crc = onewire_crc16_update(crc, data[i]);
+	}
+	sim_master_read(&bus, &master, received, sizeof(received));
+	return received[0] == (uint8_t)~crc && received[1] == (uint8_t)(~crc >> 8);
+}
+
+// device is selected, returns 1 when CRC16 after frame is valid
+static uint8_t read_scratchpad(uint8_t* frame) {
+	uint8_t data[1 + SCRATCHPAD_SIZE] = { READ_SCRATCHPAD };
+
+	sim_master_write_byte(&bus, &master, READ_SCRATCHPAD);
+	sim_master_read(&bus, &master, frame, SCRATCHPAD_SIZE);
+	memcpy(&data[1], frame, SCRATCHPAD_SIZE);
+	return read_crc16(data, sizeof(data));
+}
+
+static void write_done(OneWireDriver* onewire, uint8_t length, void* context) {
+	(void)onewire;
+	(void)context;
+	written = length;
+}
+
+static void check_overdrive(void) {
+	uint8_t frame[SCRATCHPAD_SIZE];
+
+	SIM_CHECK(publish_sample(0x20));
+
+	// Overdrive Skip is send at standard speed, rest of transaction runs in overdrive
+	SIM_CHECK(sim_master_reset(&bus, &master) && !onewire_is_overdrive(&slave));
+	sim_master_write_byte(&bus, &master, OVERDRIVE_SKIP_ROM);
+	SIM_CHECK(onewire_is_overdrive(&slave));
+	onewire_set_speed(&master, ONEWIRE_OVERDRIVE_SPEED);
+	SIM_CHECK(read_scratchpad(frame));
+	SIM_CHECK(frame_is_sample(frame, 0x20));
+
+	// overdrive reset keeps slave in overdrive
+	SIM_CHECK(sim_master_reset(&bus, &master) && onewire_is_overdrive(&slave));
+	sim_master_write_byte(&bus, &master, SKIP_ROM);
+	SIM_CHECK(read_scratchpad(frame));
+	SIM_CHECK(frame_is_sample(frame, 0x20));
+
+	// standard reset returns slave to standard speed
+	onewire_set_speed(&master, ONEWIRE_STANDARD_SPEED);
+	SIM_CHECK(sim_master_reset(&bus, &master) && !onewire_is_overdrive(&slave));
+	sim_master_write_byte(&bus, &master, SKIP_ROM);
+	SIM_CHECK(read_scratchpad(frame));
+	SIM_CHECK(frame_is_sample(frame, 0x20));
+
+	// Overdrive Match ROM, ROM id already follows in overdrive
+	SIM_CHECK(sim_master_reset(&bus, &master));
+	sim_master_write_byte(&bus, &master, OVERDRIVE_MATCH_ROM);
+	SIM_CHECK(onewire_is_overdrive(&slave));
+	onewire_set_speed(&master, ONEWIRE_OVERDRIVE_SPEED);
+	sim_master_write(&bus, &master, memory.rom, sizeof(memory.rom));
+	SIM_CHECK(read_scratchpad(frame));
+	SIM_CHECK(frame_is_sample(frame, 0x20));
+	onewire_set_speed(&master, ONEWIRE_STANDARD_SPEED);
+	SIM_CHECK(sim_master_reset(&bus, &master) && !onewire_is_overdrive(&slave));
+}
+
+static void check_memory(void) {
+	uint8_t frame[SCRATCHPAD_SIZE];
+	uint8_t write[1 + WRITE_SIZE] = { WRITE_SCRATCHPAD, 0x4B, 0x46, 0x7F };
+	uint8_t read[3 + MEMORY_SIZE - MEMORY_ADDRESS] = { READ_MEMORY, MEMORY_ADDRESS, 0x00 };
+
+	// Read Scratchpad takes published buffer, application then gets other one
+	SIM_CHECK(publish_sample(0x30));
+	SIM_CHECK(onewire_slave_get_scratchpad_buffer(&slave) == NULL);
+	SIM_CHECK(sim_master_reset(&bus, &master));
+	sim_master_write_byte(&bus, &master, SKIP_ROM);
+	SIM_CHECK(read_scratchpad(frame) && frame_is_sample(frame, 0x30));
+	SIM_CHECK(memory.scratchpad[memory.front] != onewire_slave_get_scratchpad_buffer(&slave));
+
+	// Write Scratchpad goes to application buffer, slave confirms it with CRC16
+	written = 0;
+	SIM_CHECK(sim_master_reset(&bus, &master));
+	sim_master_write_byte(&bus, &master, MATCH_ROM);
+	sim_master_write(&bus, &master, memory.rom, sizeof(memory.rom));
+	sim_master_write(&bus, &master, write, sizeof(write));
+	SIM_CHECK(read_crc16(write, sizeof(write)));
+	SIM_CHECK(written == WRITE_SIZE && memcmp(write_buffer, &write[1], WRITE_SIZE) == 0);
+
+	// Read Memory from address inside page to its end, CRC16 covers command and address
+	SIM_CHECK(sim_master_reset(&bus, &master));
+	sim_master_write_byte(&bus, &master, SKIP_ROM);
+	sim_master_write(&bus, &master, read, 3);
+	sim_master_read(&bus, &master, &read[3], MEMORY_SIZE - MEMORY_ADDRESS);
+	SIM_CHECK(memcmp(&read[3], &pages[MEMORY_ADDRESS], MEMORY_SIZE - MEMORY_ADDRESS) == 0);
+	SIM_CHECK(read_crc16(read, sizeof(read)));
+}
+
+// application publishes and rewrites samples while master reads scratchpad
+static void check_torn_frame(void) {
+	uint8_t frame[SCRATCHPAD_SIZE];
+	uint8_t data[1 + SCRATCHPAD_SIZE] = { READ_SCRATCHPAD };
+	uint8_t* buffer;
+
+	// sample published in middle of Read Scratchpad waits for next one
+	SIM_CHECK(sim_master_reset(&bus, &master));
+	sim_master_write_byte(&bus, &master, SKIP_ROM);
+	sim_master_write_byte(&bus, &master, READ_SCRATCHPAD);
+	sim_master_read(&bus, &master, frame, 4);
+	SIM_CHECK(publish_sample(0x40));
+	sim_master_read(&bus, &master, &frame[4], SCRATCHPAD_SIZE - 4);
+	memcpy(&data[1], frame, SCRATCHPAD_SIZE);
+	SIM_CHECK(read_crc16(data, sizeof(data)) && frame_is_sample(frame, 0x30));
+	SIM_CHECK(sim_master_reset(&bus, &master));
+	sim_master_write_byte(&bus, &master, SKIP_ROM);
+	SIM_CHECK(read_scratchpad(frame) && frame_is_sample(frame, 0x40));
+
+	// published buffer is not given back, its rewrite could be swapped to front half done
+	SIM_CHECK(publish_sample(0x50));
+	buffer = onewire_slave_get_scratchpad_buffer(&slave);
+	SIM_CHECK(buffer == NULL);
+	if (buffer != NULL) {
+		fill_sample(buffer, 0x60, SCRATCHPAD_SIZE / 2);
+	}
+	SIM_CHECK(sim_master_reset(&bus, &master));
+	sim_master_write_byte(&bus, &master, SKIP_ROM);
+	sim_master_write_byte(&bus, &master, READ_SCRATCHPAD);
+	sim_master_read(&bus, &master, frame, 4);
+	if (buffer != NULL) {
+		fill_sample(buffer, 0x60, SCRATCHPAD_SIZE); // rest of sample lands in frame master is reading
+	}
+	sim_master_read(&bus, &master, &frame[4], SCRATCHPAD_SIZE - 4);
+	memcpy(&data[1], frame, SCRATCHPAD_SIZE);
+	SIM_CHECK(read_crc16(data, sizeof(data)) && frame_is_sample(frame, 0x50));
+	SIM_CHECK(onewire_slave_get_scratchpad_buffer(&slave) != NULL);
+}
+
+// reset interrupts command, data written by master and data send by slave
+static void check_reset_mid_byte(void) {
+	uint8_t frame[SCRATCHPAD_SIZE];
+
+	SIM_CHECK(sim_master_reset(&bus, &master));
+	for (uint8_t i = 0; i < 3; i++) {
+		sim_master_write_bit(&bus, &master, (SKIP_ROM >> i) & 0x01);
+	}
+	SIM_CHECK(sim_master_reset(&bus, &master));
+	sim_master_write_byte(&bus, &master, SKIP_ROM);
+	SIM_CHECK(read_scratchpad(frame) && frame_is_sample(frame, 0x50));
+
+	// Write Scratchpad cut after first data byte does not reach application
+	written = 0;
+	SIM_CHECK(sim_master_reset(&bus, &master));
+	sim_master_write_byte(&bus, &master, SKIP_ROM);
+	sim_master_write_byte(&bus, &master, WRITE_SCRATCHPAD);
+	sim_master_write_byte(&bus, &master, 0x12);
+	sim_master_write_bit(&bus, &master, 1);
+	SIM_CHECK(sim_master_reset(&bus, &master) && written == 0);
+
+	// slave transmitting 0 bits stops in middle of byte and answers reset with presence
+	sim_master_write_byte(&bus, &master, SKIP_ROM);
+	sim_master_write_byte(&bus, &master, READ_SCRATCHPAD);
+	sim_master_read(&bus, &master, frame, 2);
+	for (uint8_t i = 0; i < 5; i++) {
+		SIM_CHECK(sim_master_read_bit(&bus, &master) == ((sample_byte(0x50, 2) >> i) & 0x01));
+	}
+	SIM_CHECK(sim_master_reset(&bus, &master));
+	sim_master_write_byte(&bus, &master, SKIP_ROM);
+	SIM_CHECK(read_scratchpad(frame) && frame_is_sample(frame, 0x50));
+
+	// same in overdrive, overdrive reset in middle of byte keeps speed
+	SIM_CHECK(sim_master_reset(&bus, &master));
+	sim_master_write_byte(&bus, &master, OVERDRIVE_SKIP_ROM);
+	onewire_set_speed(&master, ONEWIRE_OVERDRIVE_SPEED);
+	sim_master_write_byte(&bus, &master, READ_SCRATCHPAD);
+	sim_master_read(&bus, &master, frame, 1);
+	sim_master_read_bit(&bus, &master);
+	SIM_CHECK(sim_master_reset(&bus, &master) && onewire_is_overdrive(&slave));
+	sim_master_write_byte(&bus, &master, SKIP_ROM);
+	SIM_CHECK(read_scratchpad(frame) && frame_is_sample(frame, 0x50));
+	onewire_set_speed(&master, ONEWIRE_STANDARD_SPEED);
+	SIM_CHECK(sim_master_reset(&bus, &master) && !onewire_is_overdrive(&slave));
+}
+
+static void search_task(void* context) {
+	onewire_search_process((OneWireSearch*)context);
+}
+
+static uint8_t search_done(void* context) {
+	return !((OneWireSearch*)context)->running;
+}
+
+static uint8_t search_at_bit(void* context) {
+	OneWireSearch* current = (OneWireSearch*)context;
+
+	return current->running && current->bit_number == 16;
+}
+
+static OneWireSearchStatus run_search(uint8_t command) {
+	onewire_device_table_init(&table, devices, sizeof(devices) / sizeof(devices[0]));
+	onewire_search_start(&search, &master, &table, command);
+	SIM_CHECK(sim_bus_run_until(&bus, search_done, &search, 100000));
+	return (OneWireSearchStatus)search.status;
+}
+
+static void check_alarm_search(void) {
+	memcpy(other_memory.rom, other_rom, sizeof(other_memory.rom));
+	sim_rom_crc(other_memory.rom);
+	other_memory.scratchpad[0] = scratchpad[0];
+	other_memory.scratchpad[1] = scratchpad[1];
+	other_memory.scratchpad_size = SCRATCHPAD_SIZE;
+	sim_bus_add_driver(&bus, &other, OPERATING_MODE_SLAVE, 0);
+	onewire_slave_set_memory(&other, &other_memory);
+	sim_bus_add_task(&bus, search_task, NULL, &search);
+
+	SIM_CHECK(run_search(SEARCH_ROM) == ONEWIRE_SEARCH_DONE && table.count == 2);
+	SIM_CHECK(onewire_device_table_find(&table, memory.rom) >= 0);
+	SIM_CHECK(onewire_device_table_find(&table, other_memory.rom) >= 0);
+
+	// nothing in alarm, slaves answer presence but not first ROM bit
+	SIM_CHECK(run_search(ALARM_SEARCH) == ONEWIRE_SEARCH_NO_DEVICES && table.count == 0);
+
+	onewire_slave_set_alarm(&other, 1);
+	SIM_CHECK(run_search(ALARM_SEARCH) == ONEWIRE_SEARCH_DONE && table.count == 1);
+	SIM_CHECK(onewire_device_table_find(&table, other_memory.rom) == 0);
+
+	// flag cleared after command byte does not stop running search
+	onewire_slave_set_alarm(&slave, 1);
+	onewire_slave_set_alarm(&other, 0);
+	onewire_device_table_init(&table, devices, sizeof(devices) / sizeof(devices[0]));
+	onewire_search_start(&search, &master, &table, ALARM_SEARCH);
+	SIM_CHECK(sim_bus_run_until(&bus, search_at_bit, &search, 100000));
+	onewire_slave_set_alarm(&slave, 0);
+	SIM_CHECK(sim_bus_run_until(&bus, search_done, &search, 100000));
+	SIM_CHECK(search.status == ONEWIRE_SEARCH_DONE && table.count == 1);
+	SIM_CHECK(onewire_device_table_find(&table, memory.rom) == 0);
+	SIM_CHECK(run_search(ALARM_SEARCH) == ONEWIRE_SEARCH_NO_DEVICES && table.count == 0);
+}
+
+int main(void) {
+	sim_now = 1000;
+	sim_bus_init(&bus);
+	sim_bus_add_driver(&bus, &master, OPERATING_MODE_MASTER, 0);
+	sim_bus_add_driver(&bus, &slave, OPERATING_MODE_SLAVE, 0);
+	memcpy(memory.rom, rom, sizeof(memory.rom));
+	sim_rom_crc(memory.rom);
+	memory.scratchpad[0] = scratchpad[0];
+	memory.scratchpad[1] = scratchpad[1];
+	memory.scratchpad_size = SCRATCHPAD_SIZE;
+	memory.write_buffer = write_buffer;
+	memory.write_buffer_size = WRITE_SIZE;
+	memory.write_callback = write_done;
+	for (uint8_t i = 0; i < MEMORY_SIZE; i++) {
+		pages[i] = (uint8_t)(0xA0 + i);
+	}
+	memory.memory = pages;
+	memory.memory_size = MEMORY_SIZE;
+	onewire_slave_set_memory(&slave, &memory);
+
+	check_overdrive();
+	check_memory();
+	check_torn_frame();
+	check_reset_mid_byte();
+	check_alarm_search();
+	printf("slave: %s\n", sim_failures ? "FAILED" : "ok");
+	return sim_failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}